@@ -427,8 +427,8 @@ BlockDriverState *bdrv_new(void)
 
     qemu_co_queue_init(&bs->flush_queue);
 
-    qemu_co_mutex_init(&bs->bsc_modify_lock);
-    bs->block_status_cache = g_new0(BdrvBlockStatusCache, 1);
+    qemu_mutex_init(&bs->block_status_cache.lock);
+    QTAILQ_INIT(&bs->block_status_cache.lru);
 
     for (i = 0; i < bdrv_drain_all_count; i++) {
         bdrv_drained_begin(bs);
@@ -1489,6 +1489,10 @@ static void GRAPH_WRLOCK bdrv_child_cb_detach(BdrvChild *child)
 
     assert_bdrv_graph_writable();
     QLIST_REMOVE(child, next);
+
+    /* Cached extents may refer to the node that is going away */
+    bdrv_bsc_invalidate(bs);
+
     if (child == bs->backing) {
         assert(child != bs->file);
         bs->backing = NULL;
@@ -5113,6 +5117,7 @@ static void GRAPH_UNLOCKED bdrv_reopen_commit(BDRVReopenState *reopen_state)
     if (drv->bdrv_reopen_commit) {
         drv->bdrv_reopen_commit(reopen_state);
     }
+    bdrv_bsc_invalidate(bs);
 
     GRAPH_RDLOCK_GUARD_MAINLOOP();
 
@@ -5205,8 +5210,7 @@ static void bdrv_close(BlockDriverState *bs)
     bs->explicit_options = NULL;
     qobject_unref(bs->full_open_options);
     bs->full_open_options = NULL;
-    g_free(bs->block_status_cache);
-    bs->block_status_cache = NULL;
+    bdrv_bsc_invalidate(bs);
 
     bdrv_release_named_dirty_bitmaps(bs);
     assert(QLIST_EMPTY(&bs->dirty_bitmaps));
@@ -5590,6 +5594,7 @@ static void bdrv_delete(BlockDriverState *bs)
     bdrv_close(bs);
 
     qemu_mutex_destroy(&bs->reqs_lock);
+    qemu_mutex_destroy(&bs->block_status_cache.lock);
 
     g_free(bs);
 }
@@ -5679,6 +5684,7 @@ fail:
 int coroutine_fn bdrv_co_check(BlockDriverState *bs,
                                BdrvCheckResult *res, BdrvCheckMode fix)
 {
+    int ret;
     IO_CODE();
     assert_bdrv_graph_readable();
     if (bs->drv == NULL) {
@@ -5689,7 +5695,12 @@ int coroutine_fn bdrv_co_check(BlockDriverState *bs,
     }
 
     memset(res, 0, sizeof(*res));
-    return bs->drv->bdrv_co_check(bs, res, fix);
+    ret = bs->drv->bdrv_co_check(bs, res, fix);
+    if (fix) {
+        /* Repairs may have changed the mapping of guest data */
+        bdrv_bsc_invalidate(bs);
+    }
+    return ret;
 }
 
 /*
@@ -6954,6 +6965,8 @@ int coroutine_fn bdrv_co_invalidate_cache(BlockDriverState *bs, Error **errp)
     assert(!(bs->open_flags & BDRV_O_INACTIVE));
     assert_bdrv_graph_readable();
 
+    bdrv_bsc_invalidate(bs);
+
     if (bs->drv->bdrv_co_invalidate_cache) {
         bs->drv->bdrv_co_invalidate_cache(bs, &local_err);
         if (local_err) {
@@ -7057,6 +7070,7 @@ bdrv_inactivate_recurse(BlockDriverState *bs, bool top_level)
     }
 
     bs->open_flags |= BDRV_O_INACTIVE;
+    bdrv_bsc_invalidate(bs);
 
     /*
      * Update permissions, they may differ for inactive nodes.
@@ -7850,6 +7864,8 @@ int bdrv_amend_options(BlockDriverState *bs, QemuOpts *opts,
                        bool force,
                        Error **errp)
 {
+    int ret;
+
     GLOBAL_STATE_CODE();
     if (!bs->drv) {
         error_setg(errp, "Node is ejected");
@@ -7860,8 +7876,10 @@ int bdrv_amend_options(BlockDriverState *bs, QemuOpts *opts,
                    bs->drv->format_name);
         return -ENOTSUP;
     }
-    return bs->drv->bdrv_amend_options(bs, opts, status_cb,
-                                       cb_opaque, force, errp);
+    ret = bs->drv->bdrv_amend_options(bs, opts, status_cb,
+                                      cb_opaque, force, errp);
+    bdrv_bsc_invalidate(bs);
+    return ret;
 }
 
 /*
@@ -8321,6 +8339,7 @@ int bdrv_make_empty(BdrvChild *c, Error **errp)
     }
 
     ret = drv->bdrv_make_empty(c->bs);
+    bdrv_bsc_invalidate(c->bs);
     if (ret < 0) {
         error_setg_errno(errp, -ret, "Failed to empty %s",
                          c->bs->filename);
@@ -8491,41 +8510,73 @@ BlockDriverState *bdrv_backing_chain_next(BlockDriverState *bs)
     return bdrv_skip_filters(bdrv_cow_bs(bdrv_skip_filters(bs)));
 }
 
+/*
+ * Upper bound for the number of extents cached per node.  Once reached, the
+ * least recently filled extent is dropped.
+ */
+#define BDRV_BSC_MAX_EXTENTS 4096
+
+static void bdrv_bsc_drop_locked(BdrvBlockStatusCache *bsc,
+                                 BdrvBlockStatusExtent *extent)
+{
+    interval_tree_remove(&extent->node, &bsc->extents);
+    QTAILQ_REMOVE(&bsc->lru, extent, next);
+    qatomic_set(&bsc->nb_extents, bsc->nb_extents - 1);
+    g_free(extent);
+}
+
+static void bdrv_bsc_drop_range_locked(BdrvBlockStatusCache *bsc,
+                                       int64_t offset, int64_t bytes)
+{
+    IntervalTreeNode *node, *next;
+
+    node = interval_tree_iter_first(&bsc->extents, offset, offset + bytes - 1);
+    while (node) {
+        next = interval_tree_iter_next(node, offset, offset + bytes - 1);
+        bdrv_bsc_drop_locked(bsc,
+                             container_of(node, BdrvBlockStatusExtent, node));
+        node = next;
+    }
+}
+
 /**
- * Check whether [offset, offset + bytes) overlaps with the cached
- * block-status data region.
- *
- * If so, and @pnum is not NULL, set *pnum to `bsc.data_end - offset`,
- * which is what bdrv_bsc_is_data()'s interface needs.
- * Otherwise, *pnum is not touched.
+ * See block_int.h for this function's documentation.
  */
-static bool bdrv_bsc_range_overlaps_locked(BlockDriverState *bs,
-                                           int64_t offset, int64_t bytes,
-                                           int64_t *pnum)
+int bdrv_bsc_lookup(BlockDriverState *bs, int64_t offset, int64_t *pnum,
+                    int64_t *map, BlockDriverState **file)
 {
-    BdrvBlockStatusCache *bsc = qatomic_rcu_read(&bs->block_status_cache);
-    bool overlaps;
+    BdrvBlockStatusCache *bsc = &bs->block_status_cache;
+    BdrvBlockStatusExtent *extent;
+    IntervalTreeNode *node;
+    IO_CODE();
 
-    overlaps =
-        qatomic_read(&bsc->valid) &&
-        ranges_overlap(offset, bytes, bsc->data_start,
-                       bsc->data_end - bsc->data_start);
+    if (!qatomic_read(&bsc->nb_extents)) {
+        return -ENOENT;
+    }
+
+    QEMU_LOCK_GUARD(&bsc->lock);
 
-    if (overlaps && pnum) {
-        *pnum = bsc->data_end - offset;
+    node = interval_tree_iter_first(&bsc->extents, offset, offset);
+    if (!node) {
+        return -ENOENT;
     }
 
-    return overlaps;
+    extent = container_of(node, BdrvBlockStatusExtent, node);
+    *pnum = node->last + 1 - offset;
+    *map = extent->map + (offset - node->start);
+    *file = extent->file;
+    return extent->status;
 }
 
 /**
  * See block_int.h for this function's documentation.
  */
-bool bdrv_bsc_is_data(BlockDriverState *bs, int64_t offset, int64_t *pnum)
+uint64_t bdrv_bsc_generation(BlockDriverState *bs)
 {
+    BdrvBlockStatusCache *bsc = &bs->block_status_cache;
     IO_CODE();
-    RCU_READ_LOCK_GUARD();
-    return bdrv_bsc_range_overlaps_locked(bs, offset, 1, pnum);
+
+    return qatomic_read(&bsc->generation);
 }
 
 /**
@@ -8534,34 +8585,102 @@ bool bdrv_bsc_is_data(BlockDriverState *bs, int64_t offset, int64_t *pnum)
 void bdrv_bsc_invalidate_range(BlockDriverState *bs,
                                int64_t offset, int64_t bytes)
 {
+    BdrvBlockStatusCache *bsc = &bs->block_status_cache;
     IO_CODE();
-    RCU_READ_LOCK_GUARD();
 
-    if (bdrv_bsc_range_overlaps_locked(bs, offset, bytes, NULL)) {
-        qatomic_set(&bs->block_status_cache->valid, false);
+    if (!bytes) {
+        return;
     }
+
+    /*
+     * Nodes that never cache anything get away with a single atomic.
+     * Pairs with the smp_mb() in bdrv_bsc_fill(): either it sees the new
+     * generation, or we see the extent it inserted.
+     */
+    qatomic_inc(&bsc->generation);
+    if (!qatomic_read(&bsc->nb_extents)) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&bsc->lock);
+    bdrv_bsc_drop_range_locked(bsc, offset, bytes);
 }
 
 /**
  * See block_int.h for this function's documentation.
  */
-void bdrv_bsc_fill(BlockDriverState *bs, int64_t offset, int64_t bytes)
+void bdrv_bsc_invalidate(BlockDriverState *bs)
 {
-    BdrvBlockStatusCache *new_bsc = g_new(BdrvBlockStatusCache, 1);
-    BdrvBlockStatusCache *old_bsc;
+    BdrvBlockStatusCache *bsc = &bs->block_status_cache;
+    BdrvBlockStatusExtent *extent, *next;
     IO_CODE();
 
-    *new_bsc = (BdrvBlockStatusCache) {
-        .valid = true,
-        .data_start = offset,
-        .data_end = offset + bytes,
+    QEMU_LOCK_GUARD(&bsc->lock);
+
+    qatomic_inc(&bsc->generation);
+    /* Read it again, e.g. after a reopen */
+    qatomic_set(&bsc->granularity, 0);
+    QTAILQ_FOREACH_SAFE(extent, &bsc->lru, next, next) {
+        bdrv_bsc_drop_locked(bsc, extent);
+    }
+    assert(interval_tree_is_empty(&bsc->extents));
+}
+
+/**
+ * See block_int.h for this function's documentation.
+ */
+void bdrv_bsc_fill(BlockDriverState *bs, uint64_t generation,
+                   int64_t offset, int64_t bytes, int status, int64_t map,
+                   BlockDriverState *file)
+{
+    BdrvBlockStatusCache *bsc = &bs->block_status_cache;
+    BdrvBlockStatusExtent *extent;
+    IO_CODE();
+
+    assert(status >= 0 && bytes > 0);
+
+    /* While inactive, the image may be changed by someone else */
+    if (bs->open_flags & BDRV_O_INACTIVE) {
+        return;
+    }
+
+    extent = g_new(BdrvBlockStatusExtent, 1);
+    *extent = (BdrvBlockStatusExtent) {
+        .node.start = offset,
+        .node.last = offset + bytes - 1,
+        .status = status,
+        .map = map,
+        .file = file,
     };
 
-    QEMU_LOCK_GUARD(&bs->bsc_modify_lock);
+    QEMU_LOCK_GUARD(&bsc->lock);
 
-    old_bsc = qatomic_rcu_read(&bs->block_status_cache);
-    qatomic_rcu_set(&bs->block_status_cache, new_bsc);
-    if (old_bsc) {
-        g_free_rcu(old_bsc, rcu);
+    if (qatomic_read(&bsc->generation) != generation) {
+        /* Invalidated while the driver was queried, the result may be stale */
+        g_free(extent);
+        return;
+    }
+
+    /*
+     * Remove older extents overlapping the new one; the new result is at
+     * least as recent as theirs.
+     */
+    bdrv_bsc_drop_range_locked(bsc, offset, bytes);
+
+    if (bsc->nb_extents >= BDRV_BSC_MAX_EXTENTS) {
+        bdrv_bsc_drop_locked(bsc, QTAILQ_FIRST(&bsc->lru));
+    }
+
+    interval_tree_insert(&extent->node, &bsc->extents);
+    QTAILQ_INSERT_TAIL(&bsc->lru, extent, next);
+    qatomic_set(&bsc->nb_extents, bsc->nb_extents + 1);
+
+    /*
+     * bdrv_bsc_invalidate_range() does not take the lock if the cache was
+     * empty, so check again now that the extent is visible.
+     */
+    smp_mb();
+    if (qatomic_read(&bsc->generation) != generation) {
+        bdrv_bsc_drop_locked(bsc, extent);
     }
 }
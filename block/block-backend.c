@@ -82,6 +82,7 @@ struct BlockBackend {
     QemuMutex queued_requests_lock; /* protects queued_requests */
     CoQueue queued_requests;
     bool disable_request_queuing; /* atomic */
+    bool small_request_stack; /* atomic */
 
     VMChangeStateEntry *vmsh;
     bool force_allow_inactivate;
@@ -1271,6 +1272,18 @@ void blk_set_disable_request_queuing(BlockBackend *blk, bool disable)
     qatomic_set(&blk->disable_request_queuing, disable);
 }
 
+/*
+ * Run AIO requests in coroutines with a small stack, which is only safe
+ * when nothing in the graph below @blk needs a deep call chain.  Requests
+ * still get a normal stack whenever the root node of @blk is not a
+ * protocol node without children.
+ */
+void blk_set_small_request_stack(BlockBackend *blk, bool small)
+{
+    IO_CODE();
+    qatomic_set(&blk->small_request_stack, small);
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 blk_check_byte_request(BlockBackend *blk, int64_t offset, int64_t bytes)
 {
@@ -1580,6 +1593,27 @@ static void blk_aio_complete_bh(void *opaque)
     blk_aio_complete(acb);
 }
 
+/*
+ * Small stacks are only safe when requests go straight to a single protocol
+ * node.  The graph may have changed since the device enabled them, e.g. a
+ * block job inserted a filter, so check it for every request.
+ *
+ * The graph is only changed in drained sections, in which devices do not
+ * submit requests, so it is stable here even without the graph lock.
+ */
+static bool TSA_NO_TSA blk_use_small_request_stack(BlockBackend *blk)
+{
+    BlockDriverState *bs;
+
+    if (!qatomic_read(&blk->small_request_stack)) {
+        return false;
+    }
+
+    bs = blk_bs(blk);
+    return bs && bs->drv && bs->drv->protocol_name &&
+           QLIST_EMPTY(&bs->children);
+}
+
 static BlockAIOCB *blk_aio_prwv(BlockBackend *blk, int64_t offset,
                                 int64_t bytes,
                                 void *iobuf, CoroutineEntry co_entry,
@@ -1601,7 +1635,11 @@ static BlockAIOCB *blk_aio_prwv(BlockBackend *blk, int64_t offset,
     acb->bytes = bytes;
     acb->has_returned = false;
 
-    co = qemu_coroutine_create(co_entry, acb);
+    if (blk_use_small_request_stack(blk)) {
+        co = qemu_coroutine_create_small(co_entry, acb);
+    } else {
+        co = qemu_coroutine_create(co_entry, acb);
+    }
     aio_co_enter(qemu_get_current_aio_context(), co);
 
     acb->has_returned = true;
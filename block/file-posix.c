@@ -2495,9 +2495,17 @@ out:
     return result;
 }
 
-static int coroutine_fn raw_thread_pool_submit(ThreadPoolFunc func, void *arg)
+static int coroutine_fn raw_thread_pool_submit(ThreadPoolFunc func,
+                                               RawPosixAIOData *acb)
 {
-    return thread_pool_submit_co(func, arg);
+    ThreadPoolClass cls = THREAD_POOL_CLASS_SLOW;
+
+    /* Don't let flushes, discards, etc. delay I/O */
+    if (acb->aio_type & (QEMU_AIO_READ | QEMU_AIO_WRITE | QEMU_AIO_IOCTL |
+                         QEMU_AIO_ZONE_REPORT | QEMU_AIO_ZONE_APPEND)) {
+        cls = THREAD_POOL_CLASS_DEFAULT;
+    }
+    return thread_pool_submit_co_class(cls, func, acb);
 }
 
 /*
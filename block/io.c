@@ -38,6 +38,7 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "system/replay.h"
+#include "system/stats.h"
 #include "qemu/units.h"
 
 /* Maximum bounce buffer for copy-on-read and write zeroes, in bytes */
@@ -580,31 +581,94 @@ void bdrv_drain_all(void)
     bdrv_drain_all_end();
 }
 
+/*
+ * Interval tree key for the overlap range of @req.  Zero-length requests are
+ * stored as a single byte; tracked_request_overlaps() has the final word.
+ */
+static void tracked_request_set_key(BdrvTrackedRequest *req,
+                                    IntervalTreeNode *node)
+{
+    node->start = req->overlap_offset;
+    node->last = req->overlap_offset + MAX(req->overlap_bytes, 1) - 1;
+}
+
+static BdrvLatencySize bdrv_latency_size_class(int64_t bytes)
+{
+    if (bytes <= 4 * KiB) {
+        return BDRV_LATENCY_SIZE_4K;
+    } else if (bytes <= 64 * KiB) {
+        return BDRV_LATENCY_SIZE_64K;
+    } else if (bytes <= 1 * MiB) {
+        return BDRV_LATENCY_SIZE_1M;
+    }
+    return BDRV_LATENCY_SIZE_LARGE;
+}
+
+/*
+ * Account a request of @bytes that was started at @start_ns in the latency
+ * histograms of @bs.  This is called from whatever thread completes the
+ * request, so the buckets are only ever touched with atomic adds.
+ */
+static void bdrv_latency_account(BlockDriverState *bs, BdrvLatencyOp op,
+                                 int64_t bytes, int64_t start_ns)
+{
+    int64_t ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_ns;
+    int bucket = stats_log2_bucket(ns, BDRV_LATENCY_BUCKETS);
+    BdrvLatencyHistogram *hist;
+
+    hist = &bs->latency[op][bdrv_latency_size_class(bytes)];
+    stat64_add(&hist->buckets[bucket], 1);
+}
+
 /**
- * Remove an active request from the tracked requests list
+ * Remove an active request from the tracked requests tree
  *
  * This function should be called when a tracked request is completing.
  */
 static void coroutine_fn tracked_request_end(BdrvTrackedRequest *req)
 {
+    BlockDriverState *bs = req->bs;
+
+    switch (req->type) {
+    case BDRV_TRACKED_READ:
+        bdrv_latency_account(bs, BDRV_LATENCY_READ, req->bytes,
+                             req->start_ns);
+        break;
+    case BDRV_TRACKED_WRITE:
+        bdrv_latency_account(bs, req->zero_write ? BDRV_LATENCY_ZERO_WRITE
+                                                 : BDRV_LATENCY_WRITE,
+                             req->bytes, req->start_ns);
+        break;
+    case BDRV_TRACKED_DISCARD:
+        bdrv_latency_account(bs, BDRV_LATENCY_DISCARD, req->bytes,
+                             req->start_ns);
+        break;
+    case BDRV_TRACKED_TRUNCATE:
+        break;
+    }
+
     if (req->serialising) {
-        qatomic_dec(&req->bs->serialising_in_flight);
+        qatomic_dec(&bs->serialising_in_flight);
     }
 
-    qemu_mutex_lock(&req->bs->reqs_lock);
-    QLIST_REMOVE(req, list);
-    qemu_mutex_unlock(&req->bs->reqs_lock);
+    qemu_mutex_lock(&bs->reqs_lock);
+    interval_tree_remove(&req->node, &bs->tracked_requests);
+    if (req->serialising) {
+        interval_tree_remove(&req->serialising_node,
+                             &bs->serialising_requests);
+    }
+    qemu_mutex_unlock(&bs->reqs_lock);
 
     /*
      * At this point qemu_co_queue_wait(&req->wait_queue, ...) won't be called
-     * anymore because the request has been removed from the list, so it's safe
+     * anymore because the request has been removed from the tree, so it's safe
      * to restart the queue outside reqs_lock to minimize the critical section.
      */
     qemu_co_queue_restart_all(&req->wait_queue);
 }
 
 /**
- * Add an active request to the tracked requests list
+ * Add an active request to the tracked requests tree
  */
 static void coroutine_fn tracked_request_begin(BdrvTrackedRequest *req,
                                                BlockDriverState *bs,
@@ -623,12 +687,14 @@ static void coroutine_fn tracked_request_begin(BdrvTrackedRequest *req,
         .serialising    = false,
         .overlap_offset = offset,
         .overlap_bytes  = bytes,
+        .start_ns       = qemu_clock_get_ns(QEMU_CLOCK_REALTIME),
     };
 
     qemu_co_queue_init(&req->wait_queue);
+    tracked_request_set_key(req, &req->node);
 
     qemu_mutex_lock(&bs->reqs_lock);
-    QLIST_INSERT_HEAD(&bs->tracked_requests, req, list);
+    interval_tree_insert(&req->node, &bs->tracked_requests);
     qemu_mutex_unlock(&bs->reqs_lock);
 }
 
@@ -652,10 +718,28 @@ static bool tracked_request_overlaps(BdrvTrackedRequest *req,
 static coroutine_fn BdrvTrackedRequest *
 bdrv_find_conflicting_request(BdrvTrackedRequest *self)
 {
-    BdrvTrackedRequest *req;
+    BlockDriverState *bs = self->bs;
+    IntervalTreeNode *node;
+    uint64_t start = self->node.start;
+    uint64_t last = self->node.last;
+
+    /*
+     * A serialising request conflicts with all overlapping requests, others
+     * only with overlapping serialising requests.
+     */
+    if (self->serialising) {
+        node = interval_tree_iter_first(&bs->tracked_requests, start, last);
+    } else {
+        node = interval_tree_iter_first(&bs->serialising_requests,
+                                        start, last);
+    }
 
-    QLIST_FOREACH(req, &self->bs->tracked_requests, list) {
-        if (req == self || (!req->serialising && !self->serialising)) {
+    for (; node; node = interval_tree_iter_next(node, start, last)) {
+        BdrvTrackedRequest *req = self->serialising ?
+            container_of(node, BdrvTrackedRequest, node) :
+            container_of(node, BdrvTrackedRequest, serialising_node);
+
+        if (req == self) {
             continue;
         }
         if (tracked_request_overlaps(req, self->overlap_offset,
@@ -699,19 +783,30 @@ bdrv_wait_serialising_requests_locked(BdrvTrackedRequest *self)
 static void tracked_request_set_serialising(BdrvTrackedRequest *req,
                                             uint64_t align)
 {
+    BlockDriverState *bs = req->bs;
     int64_t overlap_offset = req->offset & ~(align - 1);
     int64_t overlap_bytes =
         ROUND_UP(req->offset + req->bytes, align) - overlap_offset;
 
     bdrv_check_request(req->offset, req->bytes, &error_abort);
 
-    if (!req->serialising) {
-        qatomic_inc(&req->bs->serialising_in_flight);
+    /* The key of a request can only change while it is out of the trees */
+    interval_tree_remove(&req->node, &bs->tracked_requests);
+    if (req->serialising) {
+        interval_tree_remove(&req->serialising_node,
+                             &bs->serialising_requests);
+    } else {
+        qatomic_inc(&bs->serialising_in_flight);
         req->serialising = true;
     }
 
     req->overlap_offset = MIN(req->overlap_offset, overlap_offset);
     req->overlap_bytes = MAX(req->overlap_bytes, overlap_bytes);
+
+    tracked_request_set_key(req, &req->node);
+    tracked_request_set_key(req, &req->serialising_node);
+    interval_tree_insert(&req->node, &bs->tracked_requests);
+    interval_tree_insert(&req->serialising_node, &bs->serialising_requests);
 }
 
 /**
@@ -720,11 +815,17 @@ static void tracked_request_set_serialising(BdrvTrackedRequest *req,
  */
 BdrvTrackedRequest *coroutine_fn bdrv_co_get_self_request(BlockDriverState *bs)
 {
-    BdrvTrackedRequest *req;
+    IntervalTreeNode *node;
     Coroutine *self = qemu_coroutine_self();
     IO_CODE();
 
-    QLIST_FOREACH(req, &bs->tracked_requests, list) {
+    QEMU_LOCK_GUARD(&bs->reqs_lock);
+
+    for (node = interval_tree_iter_first(&bs->tracked_requests, 0, UINT64_MAX);
+         node;
+         node = interval_tree_iter_next(node, 0, UINT64_MAX))
+    {
+        BdrvTrackedRequest *req = container_of(node, BdrvTrackedRequest, node);
         if (req->co == self) {
             return req;
         }
@@ -1286,6 +1387,7 @@ bdrv_co_do_copy_on_readv(BdrvChild *child, int64_t offset, int64_t bytes,
                                           &local_qiov, 0,
                                           BDRV_REQ_WRITE_UNCHANGED);
             }
+            bdrv_bsc_invalidate_range(bs, align_offset, pnum);
 
             if (ret < 0) {
                 /* It might be okay to ignore write errors for guest
@@ -2018,6 +2120,28 @@ bdrv_co_write_req_prepare(BdrvChild *child, int64_t offset, int64_t bytes,
     }
 }
 
+/*
+ * Writing to part of a cluster (or subcluster) allocates all of it, which
+ * changes the block status of the rest of it too.
+ */
+static int64_t coroutine_fn GRAPH_RDLOCK
+bdrv_bsc_granularity(BlockDriverState *bs)
+{
+    BdrvBlockStatusCache *bsc = &bs->block_status_cache;
+    int64_t granularity = qatomic_read(&bsc->granularity);
+    BlockDriverInfo bdi;
+
+    if (!granularity) {
+        if (bdrv_co_get_info(bs, &bdi) == 0 && bdi.subcluster_size > 0) {
+            granularity = bdi.subcluster_size;
+        } else {
+            granularity = bs->bl.request_alignment;
+        }
+        qatomic_set(&bsc->granularity, granularity);
+    }
+    return granularity;
+}
+
 static inline void coroutine_fn GRAPH_RDLOCK
 bdrv_co_write_req_finish(BdrvChild *child, int64_t offset, int64_t bytes,
                          BdrvTrackedRequest *req, int ret)
@@ -2029,6 +2153,22 @@ bdrv_co_write_req_finish(BdrvChild *child, int64_t offset, int64_t bytes,
 
     qatomic_inc(&bs->write_gen);
 
+    /*
+     * For drivers that have all of their block-status results cached, any
+     * write may change the allocation status.  Invalidate once the request is
+     * done, so that results fetched while it was in flight are not cached
+     * either.  (Protocol nodes only cache data regions, which are invalidated
+     * before zeroing or discarding.)
+     */
+    if (bs->drv && bs->drv->block_status_cacheable) {
+        int64_t granularity = bdrv_bsc_granularity(bs);
+        int64_t start = QEMU_ALIGN_DOWN(offset, granularity);
+
+        bdrv_bsc_invalidate_range(bs, start,
+                                  QEMU_ALIGN_UP(offset + bytes, granularity) -
+                                  start);
+    }
+
     /*
      * Discard cannot extend the image, but in error handling cases, such as
      * when reverting a qcow2 cluster allocation, the discarded range can pass
@@ -2292,6 +2432,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
 
     if (flags & BDRV_REQ_ZERO_WRITE) {
         assert(!padded);
+        req.zero_write = true;
         ret = bdrv_co_do_zero_pwritev(child, offset, bytes, flags, &req);
         goto out;
     }
@@ -2450,66 +2591,70 @@ bdrv_co_do_block_status(BlockDriverState *bs, unsigned int mode,
 
     if (bs->drv->bdrv_co_block_status) {
         /*
-         * Use the block-status cache only for protocol nodes: Format
-         * drivers are generally quick to inquire the status, but protocol
-         * drivers often need to get information from outside of qemu, so
-         * we do not have control over the actual implementation.  There
-         * have been cases where inquiring the status took an unreasonably
-         * long time, and we can do nothing in qemu to fix it.
+         * Protocol drivers often need to get information from outside of
+         * qemu, so we do not have control over the actual implementation.
+         * There have been cases where inquiring the status took an
+         * unreasonably long time, and we can do nothing in qemu to fix it.
          * This is especially problematic for images with large data areas,
          * because finding the few holes in them and giving them special
-         * treatment does not gain much performance.  Therefore, we try to
-         * cache the last-identified data region.
+         * treatment does not gain much performance.  Therefore, we cache
+         * the data regions identified on protocol nodes.
          *
-         * Second, limiting ourselves to protocol nodes allows us to assume
-         * the block status for data regions to be DATA | OFFSET_VALID, and
-         * that the host offset is the same as the guest offset.
+         * Limiting ourselves to data regions on protocol nodes allows us to
+         * assume the block status to be DATA | OFFSET_VALID, and that the
+         * host offset is the same as the guest offset.
          *
          * Note that it is possible that external writers zero parts of
          * the cached regions without the cache being invalidated, and so
          * we may report zeroes as data.  This is not catastrophic,
-         * however, because reporting zeroes as data is fine.
+         * however, because reporting zeroes as data is fine.  Caching
+         * holes or zeroes on protocol nodes would not be safe for that
+         * reason.
+         *
+         * Format drivers whose metadata only changes through requests on
+         * the node itself (.block_status_cacheable) get all of their
+         * results cached, which saves walking their mapping tables again
+         * and again for repeated queries, as done by mirror, backup,
+         * qemu-img map/convert and the NBD server.
          */
-        if (QLIST_EMPTY(&bs->children) &&
-            bdrv_bsc_is_data(bs, aligned_offset, pnum))
-        {
-            ret = BDRV_BLOCK_DATA | BDRV_BLOCK_OFFSET_VALID;
-            local_file = bs;
-            local_map = aligned_offset;
-        } else {
+        bool is_protocol = QLIST_EMPTY(&bs->children);
+        bool cacheable = is_protocol || bs->drv->block_status_cacheable;
+        uint64_t bsc_gen = 0;
+
+        ret = -ENOENT;
+        if (cacheable) {
+            bsc_gen = bdrv_bsc_generation(bs);
+            ret = bdrv_bsc_lookup(bs, aligned_offset, pnum, &local_map,
+                                  &local_file);
+        }
+        if (ret == -ENOENT) {
             ret = bs->drv->bdrv_co_block_status(bs, mode, aligned_offset,
                                                 aligned_bytes, pnum, &local_map,
                                                 &local_file);
 
             /*
-             * Note that checking QLIST_EMPTY(&bs->children) is also done when
-             * the cache is queried above.  Technically, we do not need to check
-             * it here; the worst that can happen is that we fill the cache for
-             * non-protocol nodes, and then it is never used.  However, filling
-             * the cache requires an RCU update, so double check here to avoid
-             * such an update if possible.
-             *
              * Check mode, because we only want to update the cache when we
              * have accurate information about what is zero and what is data.
              */
-            if (mode == BDRV_WANT_PRECISE &&
-                ret == (BDRV_BLOCK_DATA | BDRV_BLOCK_OFFSET_VALID) &&
-                QLIST_EMPTY(&bs->children))
-            {
-                /*
-                 * When a protocol driver reports BLOCK_OFFSET_VALID, the
-                 * returned local_map value must be the same as the offset we
-                 * have passed (aligned_offset), and local_bs must be the node
-                 * itself.
-                 * Assert this, because we follow this rule when reading from
-                 * the cache (see the `local_file = bs` and
-                 * `local_map = aligned_offset` assignments above), and the
-                 * result the cache delivers must be the same as the driver
-                 * would deliver.
-                 */
-                assert(local_file == bs);
-                assert(local_map == aligned_offset);
-                bdrv_bsc_fill(bs, aligned_offset, *pnum);
+            if (cacheable && mode == BDRV_WANT_PRECISE && ret >= 0) {
+                if (!is_protocol) {
+                    bdrv_bsc_fill(bs, bsc_gen, aligned_offset, *pnum, ret,
+                                  local_map, local_file);
+                } else if (ret == (BDRV_BLOCK_DATA | BDRV_BLOCK_OFFSET_VALID)) {
+                    /*
+                     * When a protocol driver reports BLOCK_OFFSET_VALID, the
+                     * returned local_map value must be the same as the offset
+                     * we have passed (aligned_offset), and local_bs must be
+                     * the node itself.
+                     * Assert this, because the cache would not be correct
+                     * otherwise, and the result the cache delivers must be
+                     * the same as the driver would deliver.
+                     */
+                    assert(local_file == bs);
+                    assert(local_map == aligned_offset);
+                    bdrv_bsc_fill(bs, bsc_gen, aligned_offset, *pnum, ret,
+                                  local_map, local_file);
+                }
             }
         }
     } else {
@@ -3018,6 +3163,7 @@ int coroutine_fn bdrv_co_flush(BlockDriverState *bs)
     BdrvChild *primary_child = bdrv_primary_child(bs);
     BdrvChild *child;
     int current_gen;
+    int64_t start_ns;
     int ret = 0;
     IO_CODE();
 
@@ -3029,6 +3175,8 @@ int coroutine_fn bdrv_co_flush(BlockDriverState *bs)
         goto early_exit;
     }
 
+    start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
     qemu_mutex_lock(&bs->reqs_lock);
     current_gen = qatomic_read(&bs->write_gen);
 
@@ -3133,6 +3281,8 @@ out:
     qemu_co_queue_next(&bs->flush_queue);
     qemu_mutex_unlock(&bs->reqs_lock);
 
+    bdrv_latency_account(bs, BDRV_LATENCY_FLUSH, 0, start_ns);
+
 early_exit:
     bdrv_dec_in_flight(bs);
     return ret;
@@ -3717,6 +3867,8 @@ int coroutine_fn bdrv_co_truncate(BdrvChild *child, int64_t offset, bool exact,
     bdrv_co_write_req_finish(child, offset - new_bytes, new_bytes, &req, 0);
 
 out:
+    /* Even a failed truncation may have changed the image */
+    bdrv_bsc_invalidate(bs);
     tracked_request_end(&req);
     bdrv_dec_in_flight(bs);
 
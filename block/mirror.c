@@ -24,11 +24,22 @@
 #include "qemu/ratelimit.h"
 #include "qemu/bitmap.h"
 #include "qemu/memalign.h"
+#include "qemu/stats64.h"
 
 #define MAX_IN_FLIGHT 16
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
 #define DEFAULT_MIRROR_BUF_SIZE (MAX_IN_FLIGHT * MAX_IO_BYTES)
 
+/*
+ * In background-deferred mode, a chunk that has been written this many times
+ * by the guest since the heat counters were last halved is considered hot and
+ * is left dirty until only hot chunks remain.
+ */
+#define MIRROR_HOT_CHUNK_WRITES 4
+
+/* Interval at which copy and dirty rates are sampled for the ETA */
+#define MIRROR_RATE_INTERVAL_MS 1000
+
 /* The mirroring buffer is a list of granularity-sized chunks.
  * Free chunks are organized in a list.
  */
@@ -95,6 +106,38 @@ typedef struct MirrorBlockJob {
     bool prepared;
     bool in_drain;
     bool base_ro;
+
+    /*
+     * Per-chunk guest write counters, only allocated in background-deferred
+     * mode.  Updated with atomics from the write path, halved on every pass
+     * over the dirty bitmap.
+     */
+    uint8_t *chunk_heat;
+    /* Whether hot chunks are skipped during the current bitmap pass */
+    bool defer_hot;
+    /* Whether the current bitmap pass has copied any chunk that was not hot */
+    bool pass_copied_cold;
+    /* Whether the job was started in background-deferred mode */
+    bool deferral_enabled;
+    /* Bytes of hot chunks that were skipped by a bitmap pass */
+    Stat64 bytes_deferred;
+
+    /* Bytes written by the guest to the source since the job started */
+    Stat64 bytes_dirtied;
+    /* Bytes successfully copied to the target since the job started */
+    uint64_t bytes_copied;
+    bool rates_sampled;
+    uint64_t last_rate_ns;
+    uint64_t last_bytes_dirtied;
+    uint64_t last_bytes_copied;
+    uint64_t copy_rate;
+    uint64_t dirty_rate;
+    /*
+     * Predicted time in milliseconds until the dirty bitmap is clean, or -1 if
+     * the job is not expected to converge at the current rates.  Protected by
+     * the job mutex.
+     */
+    int64_t converge_eta_ms;
 } MirrorBlockJob;
 
 typedef struct MirrorBDSOpaque {
@@ -227,6 +270,7 @@ static void coroutine_fn mirror_iteration_done(MirrorOp *op, int ret)
         }
         if (!s->initial_zeroing_ongoing) {
             job_progress_update(&s->common.job, op->bytes);
+            s->bytes_copied += op->bytes;
         }
     }
     qemu_iovec_destroy(&op->qiov);
@@ -517,6 +561,118 @@ static unsigned mirror_perform(MirrorBlockJob *s, int64_t offset,
     return bytes_handled;
 }
 
+static bool mirror_chunk_is_hot(MirrorBlockJob *s, int64_t offset)
+{
+    if (!s->chunk_heat || !s->defer_hot || s->should_complete ||
+        qatomic_read(&s->copy_mode) != MIRROR_COPY_MODE_BACKGROUND_DEFERRED) {
+        return false;
+    }
+    return qatomic_read(&s->chunk_heat[offset / s->granularity]) >=
+           MIRROR_HOT_CHUNK_WRITES;
+}
+
+/*
+ * Called whenever the dirty bitmap iterator wraps around.  Cool down all
+ * chunks, and if the previous pass only found hot chunks, stop deferring them
+ * for the next pass: the cold part of the image has converged and what is left
+ * must be copied eventually.
+ */
+static void mirror_start_dirty_pass(MirrorBlockJob *s)
+{
+    int64_t i, nb_chunks;
+
+    if (!s->chunk_heat) {
+        return;
+    }
+
+    nb_chunks = DIV_ROUND_UP(s->bdev_length, s->granularity);
+    for (i = 0; i < nb_chunks; i++) {
+        uint8_t heat = qatomic_read(&s->chunk_heat[i]);
+        if (heat) {
+            qatomic_set(&s->chunk_heat[i], heat / 2);
+        }
+    }
+
+    s->defer_hot = s->pass_copied_cold;
+    s->pass_copied_cold = false;
+    trace_mirror_dirty_pass(s, s->defer_hot);
+}
+
+/*
+ * Return the offset of the next dirty chunk to copy, skipping hot chunks
+ * if they are being deferred.  Must be called with the dirty bitmap locked.
+ */
+static int64_t mirror_next_dirty_chunk(MirrorBlockJob *s)
+{
+    int64_t offset;
+
+    for (;;) {
+        offset = bdrv_dirty_iter_next(s->dbi);
+        if (offset < 0) {
+            bdrv_set_dirty_iter(s->dbi, 0);
+            offset = bdrv_dirty_iter_next(s->dbi);
+            trace_mirror_restart_iter(s,
+                                      bdrv_get_dirty_count(s->dirty_bitmap));
+            assert(offset >= 0);
+            mirror_start_dirty_pass(s);
+        }
+
+        /*
+         * A pass that skips every dirty chunk clears s->pass_copied_cold, so
+         * this terminates after at most two wrap-arounds.
+         */
+        if (!mirror_chunk_is_hot(s, offset)) {
+            break;
+        }
+        stat64_add(&s->bytes_deferred, s->granularity);
+    }
+
+    if (s->chunk_heat && s->defer_hot) {
+        s->pass_copied_cold = true;
+    }
+    return offset;
+}
+
+static void mirror_update_convergence(MirrorBlockJob *s, int64_t remaining)
+{
+    uint64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    uint64_t dirtied = stat64_get(&s->bytes_dirtied);
+    uint64_t elapsed_ms = (now - s->last_rate_ns) / SCALE_MS;
+    uint64_t copy_rate, dirty_rate;
+    int64_t eta_ms = -1;
+
+    if (elapsed_ms < MIRROR_RATE_INTERVAL_MS) {
+        return;
+    }
+
+    /* Rates are in bytes per second */
+    copy_rate = (s->bytes_copied - s->last_bytes_copied) * 1000 / elapsed_ms;
+    dirty_rate = (dirtied - s->last_bytes_dirtied) * 1000 / elapsed_ms;
+
+    /* Smooth out bursts a little */
+    if (s->rates_sampled) {
+        copy_rate = (s->copy_rate + copy_rate) / 2;
+        dirty_rate = (s->dirty_rate + dirty_rate) / 2;
+    }
+    s->rates_sampled = true;
+    s->copy_rate = copy_rate;
+    s->dirty_rate = dirty_rate;
+    s->last_rate_ns = now;
+    s->last_bytes_copied = s->bytes_copied;
+    s->last_bytes_dirtied = dirtied;
+
+    if (remaining == 0) {
+        eta_ms = 0;
+    } else if (copy_rate > dirty_rate) {
+        eta_ms = remaining * 1000 / (copy_rate - dirty_rate);
+    }
+
+    trace_mirror_convergence(s, copy_rate, dirty_rate, eta_ms);
+    WITH_JOB_LOCK_GUARD() {
+        s->converge_eta_ms = eta_ms;
+    }
+}
+
 static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
 {
     BlockDriverState *source;
@@ -532,13 +688,7 @@ static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
     bdrv_graph_co_rdunlock();
 
     bdrv_dirty_bitmap_lock(s->dirty_bitmap);
-    offset = bdrv_dirty_iter_next(s->dbi);
-    if (offset < 0) {
-        bdrv_set_dirty_iter(s->dbi, 0);
-        offset = bdrv_dirty_iter_next(s->dbi);
-        trace_mirror_restart_iter(s, bdrv_get_dirty_count(s->dirty_bitmap));
-        assert(offset >= 0);
-    }
+    offset = mirror_next_dirty_chunk(s);
     bdrv_dirty_bitmap_unlock(s->dirty_bitmap);
 
     /*
@@ -566,6 +716,10 @@ static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
         if (test_bit(next_chunk, s->in_flight_bitmap)) {
             break;
         }
+        if (mirror_chunk_is_hot(s, next_offset)) {
+            /* Do not pull a deferred chunk into the run */
+            break;
+        }
 
         next_dirty = bdrv_dirty_iter_next(s->dbi);
         if (next_dirty > next_offset || next_dirty < 0) {
@@ -844,6 +998,8 @@ static int mirror_exit_common(Job *job)
     bdrv_unref(target_bs);
 
     bs_opaque->job = NULL;
+    g_free(s->chunk_heat);
+    s->chunk_heat = NULL;
 
     bdrv_drained_end(src);
     bdrv_drained_end(mirror_top_bs);
@@ -1074,6 +1230,10 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
 
     length = DIV_ROUND_UP(s->bdev_length, s->granularity);
     s->in_flight_bitmap = bitmap_new(length);
+    if (qatomic_read(&s->copy_mode) == MIRROR_COPY_MODE_BACKGROUND_DEFERRED) {
+        s->chunk_heat = g_new0(uint8_t, length);
+        s->defer_hot = true;
+    }
 
     /* If we have no backing file yet in the destination, we cannot let
      * the destination do COW.  Instead, we copy sectors around the
@@ -1104,6 +1264,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
     mirror_free_init(s);
 
     s->last_pause_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    s->last_rate_ns = s->last_pause_ns;
     if (s->sync_mode != MIRROR_SYNC_MODE_NONE) {
         ret = mirror_dirty_init(s);
         if (ret < 0 || job_is_cancelled(&s->common.job)) {
@@ -1142,6 +1303,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
         job_progress_set_remaining(&s->common.job,
                                    s->bytes_in_flight + cnt +
                                    s->active_write_bytes_in_flight);
+        mirror_update_convergence(s, s->bytes_in_flight + cnt);
 
         /* Note that even when no rate limit is applied we need to yield
          * periodically with no pending I/O so that bdrv_drain_all() returns.
@@ -1178,7 +1340,8 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
                  */
                 job_transition_to_ready(&s->common.job);
             }
-            if (qatomic_read(&s->copy_mode) != MIRROR_COPY_MODE_BACKGROUND) {
+            if (qatomic_read(&s->copy_mode) ==
+                MIRROR_COPY_MODE_WRITE_BLOCKING) {
                 qatomic_set(&s->actively_synced, true);
             }
 
@@ -1216,7 +1379,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
             /* The two disks are in sync.  Exit and report successful
              * completion.
              */
-            assert(QLIST_EMPTY(&bs->tracked_requests));
+            assert(interval_tree_is_empty(&bs->tracked_requests));
             need_drain = false;
             break;
         }
@@ -1369,7 +1532,13 @@ static void mirror_change(BlockJob *job, BlockJobChangeOptions *opts,
 
     current = qatomic_cmpxchg(&s->copy_mode, MIRROR_COPY_MODE_BACKGROUND,
                               change_opts->copy_mode);
-    if (current != MIRROR_COPY_MODE_BACKGROUND) {
+    if (current == MIRROR_COPY_MODE_BACKGROUND_DEFERRED) {
+        current = qatomic_cmpxchg(&s->copy_mode,
+                                  MIRROR_COPY_MODE_BACKGROUND_DEFERRED,
+                                  change_opts->copy_mode);
+    }
+    if (current != MIRROR_COPY_MODE_BACKGROUND &&
+        current != MIRROR_COPY_MODE_BACKGROUND_DEFERRED) {
         error_setg(errp, "Expected current copy mode '%s', got '%s'",
                    MirrorCopyMode_str(MIRROR_COPY_MODE_BACKGROUND),
                    MirrorCopyMode_str(current));
@@ -1382,6 +1551,10 @@ static void mirror_query(BlockJob *job, BlockJobInfo *info)
 
     info->u.mirror = (BlockJobInfoMirror) {
         .actively_synced = qatomic_read(&s->actively_synced),
+        .has_converge_eta = s->converge_eta_ms >= 0,
+        .converge_eta = s->converge_eta_ms,
+        .has_deferred_bytes = s->deferral_enabled,
+        .deferred_bytes = stat64_get(&s->bytes_deferred),
     };
 }
 
@@ -1636,6 +1809,27 @@ static bool should_copy_to_target(MirrorBDSOpaque *s)
         qatomic_read(&s->job->copy_mode) == MIRROR_COPY_MODE_WRITE_BLOCKING;
 }
 
+static void mirror_account_guest_write(MirrorBlockJob *s, uint64_t offset,
+                                       uint64_t bytes)
+{
+    int64_t start, end;
+
+    stat64_add(&s->bytes_dirtied, bytes);
+    if (!s->chunk_heat || !bytes) {
+        return;
+    }
+
+    start = offset / s->granularity;
+    end = DIV_ROUND_UP(offset + bytes, s->granularity);
+    for (; start < end; start++) {
+        uint8_t heat = qatomic_read(&s->chunk_heat[start]);
+        /* Racing increments may be lost, which is fine for a heuristic */
+        if (heat < UINT8_MAX) {
+            qatomic_set(&s->chunk_heat[start], heat + 1);
+        }
+    }
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 bdrv_mirror_top_do_write(BlockDriverState *bs, MirrorMethod method,
                          bool copy_to_target, uint64_t offset, uint64_t bytes,
@@ -1669,6 +1863,7 @@ bdrv_mirror_top_do_write(BlockDriverState *bs, MirrorMethod method,
     if (!copy_to_target && s->job && s->job->dirty_bitmap) {
         qatomic_set(&s->job->actively_synced, false);
         bdrv_set_dirty_bitmap(s->job->dirty_bitmap, offset, bytes);
+        mirror_account_guest_write(s->job, offset, bytes);
     }
 
     if (ret < 0) {
@@ -1992,6 +2187,8 @@ static BlockJob *mirror_start_job(
     s->backing_mode = backing_mode;
     s->target_is_zero = target_is_zero;
     qatomic_set(&s->copy_mode, copy_mode);
+    s->deferral_enabled = copy_mode == MIRROR_COPY_MODE_BACKGROUND_DEFERRED;
+    s->converge_eta_ms = -1;
     s->base = base;
     s->base_overlay = bdrv_find_overlay(bs, base);
     s->granularity = granularity;
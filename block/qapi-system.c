@@ -38,6 +38,7 @@
 #include "qobject/qdict.h"
 #include "system/block-backend.h"
 #include "system/blockdev.h"
+#include "system/stats.h"
 
 static BlockBackend *qmp_get_blk(const char *blk_name, const char *qdev_id,
                                  Error **errp)
@@ -572,3 +573,113 @@ void qmp_block_latency_histogram_set(
         }
     }
 }
+
+/*
+ * query-stats support for the per-node latency histograms that block/io.c
+ * keeps in BlockDriverState.latency.
+ */
+
+static const char *const bdrv_latency_op_names[BDRV_LATENCY__MAX] = {
+    [BDRV_LATENCY_READ] = "read",
+    [BDRV_LATENCY_WRITE] = "write",
+    [BDRV_LATENCY_ZERO_WRITE] = "zero-write",
+    [BDRV_LATENCY_DISCARD] = "discard",
+    [BDRV_LATENCY_FLUSH] = "flush",
+};
+
+static const char *const bdrv_latency_size_names[BDRV_LATENCY_SIZE__MAX] = {
+    [BDRV_LATENCY_SIZE_4K] = "4k",
+    [BDRV_LATENCY_SIZE_64K] = "64k",
+    [BDRV_LATENCY_SIZE_1M] = "1m",
+    [BDRV_LATENCY_SIZE_LARGE] = "large",
+};
+
+static int bdrv_latency_nb_sizes(BdrvLatencyOp op)
+{
+    return op == BDRV_LATENCY_FLUSH ? 1 : BDRV_LATENCY_SIZE__MAX;
+}
+
+static char *bdrv_latency_stat_name(BdrvLatencyOp op, BdrvLatencySize size)
+{
+    if (op == BDRV_LATENCY_FLUSH) {
+        return g_strdup("flush-latency");
+    }
+    return g_strdup_printf("%s-latency-%s", bdrv_latency_op_names[op],
+                           bdrv_latency_size_names[size]);
+}
+
+static void blockdev_stats_cb(StatsResultList **result, StatsTarget target,
+                              strList *names, strList *targets, Error **errp)
+{
+    BlockDriverState *bs;
+
+    if (target != STATS_TARGET_BLOCK_NODE) {
+        return;
+    }
+
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+
+    for (bs = bdrv_next_all_states(NULL); bs; bs = bdrv_next_all_states(bs)) {
+        StatsList *stats_list = NULL;
+        StatsResult *entry;
+        BdrvLatencyOp op;
+        int size;
+
+        if (!bs->drv || !apply_str_list_filter(bs->node_name, targets)) {
+            continue;
+        }
+
+        for (op = 0; op < BDRV_LATENCY__MAX; op++) {
+            for (size = 0; size < bdrv_latency_nb_sizes(op); size++) {
+                g_autofree char *name = bdrv_latency_stat_name(op, size);
+                BdrvLatencyHistogram *hist = &bs->latency[op][size];
+                uint64_t buckets[BDRV_LATENCY_BUCKETS];
+                int i;
+
+                if (!apply_str_list_filter(name, names)) {
+                    continue;
+                }
+                for (i = 0; i < BDRV_LATENCY_BUCKETS; i++) {
+                    buckets[i] = stat64_get(&hist->buckets[i]);
+                }
+                stats_list = add_stats_histogram(stats_list, name, buckets,
+                                                 BDRV_LATENCY_BUCKETS);
+            }
+        }
+
+        if (!stats_list) {
+            continue;
+        }
+
+        entry = g_new0(StatsResult, 1);
+        entry->provider = STATS_PROVIDER_BLOCK;
+        entry->node_name = g_strdup(bs->node_name);
+        entry->driver = g_strdup(bs->drv->format_name);
+        entry->stats = stats_list;
+        QAPI_LIST_PREPEND(*result, entry);
+    }
+}
+
+static void blockdev_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *stats_list = NULL;
+    BdrvLatencyOp op;
+    int size;
+
+    for (op = 0; op < BDRV_LATENCY__MAX; op++) {
+        for (size = 0; size < bdrv_latency_nb_sizes(op); size++) {
+            g_autofree char *name = bdrv_latency_stat_name(op, size);
+
+            stats_list = add_stats_schema_latency(stats_list, name);
+        }
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_BLOCK, STATS_TARGET_BLOCK_NODE,
+                     stats_list);
+}
+
+void blockdev_stats_init(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_BLOCK, blockdev_stats_cb,
+                        blockdev_schemas_cb);
+}
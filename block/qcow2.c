@@ -6186,6 +6186,7 @@ BlockDriver bdrv_qcow2 = {
 
     .is_format                          = true,
     .supports_backing                   = true,
+    .block_status_cacheable             = true,
     .bdrv_co_change_backing_file        = qcow2_co_change_backing_file,
 
     .bdrv_refresh_limits                = qcow2_refresh_limits,
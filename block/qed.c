@@ -1649,6 +1649,7 @@ static BlockDriver bdrv_qed = {
     .create_opts                    = &qed_create_opts,
     .is_format                      = true,
     .supports_backing               = true,
+    .block_status_cacheable         = true,
 
     .bdrv_probe                     = bdrv_qed_probe,
     .bdrv_open                      = bdrv_qed_open,
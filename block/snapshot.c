@@ -255,6 +255,7 @@ int bdrv_snapshot_goto(BlockDriverState *bs,
 
     if (drv->bdrv_snapshot_goto) {
         ret = drv->bdrv_snapshot_goto(bs, snapshot_id);
+        bdrv_bsc_invalidate(bs);
         if (ret < 0) {
             error_setg_errno(errp, -ret, "Failed to load snapshot");
         }
@@ -451,7 +452,11 @@ int bdrv_snapshot_load_tmp(BlockDriverState *bs,
         return -EINVAL;
     }
     if (drv->bdrv_snapshot_load_tmp) {
-        return drv->bdrv_snapshot_load_tmp(bs, snapshot_id, name, errp);
+        int ret = drv->bdrv_snapshot_load_tmp(bs, snapshot_id, name, errp);
+
+        /* Block status now comes from the snapshot's tables */
+        bdrv_bsc_invalidate(bs);
+        return ret;
     }
     error_setg(errp, "Block format '%s' used by device '%s' "
                "does not support temporarily loading internal snapshots",
@@ -29,12 +29,18 @@
 #include "qemu/main-loop.h"
 #include "qemu/queue.h"
 #include "qemu/thread.h"
+#include "qemu/units.h"
 #include "system/qtest.h"
 #include "qapi/error.h"
 #include "qapi/qapi-visit-block-core.h"
 #include "qom/object.h"
 #include "qom/object_interfaces.h"
 
+/* Upper bounds for a lease when the group does not limit bytes or
+ * operations, respectively (see throttle_compute_lease()) */
+#define THROTTLE_LEASE_MAX_BYTES (64 * MiB)
+#define THROTTLE_LEASE_MAX_OPS   1024
+
 static void throttle_group_obj_init(Object *obj);
 static void throttle_group_obj_complete(UserCreatable *obj, Error **errp);
 static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction);
@@ -77,6 +83,12 @@ struct ThrottleGroup {
     bool any_timer_armed[THROTTLE_MAX];
     QEMUClockType clock_type;
 
+    /* Requests larger than this are more than one operation and never use
+     * a lease; 0 if every request is one operation.  Written with tg->lock
+     * held, read with atomic operations.
+     */
+    int lease_op_size;
+
     /* This field is protected by the global QEMU mutex */
     QTAILQ_ENTRY(ThrottleGroup) list;
 };
@@ -350,10 +362,124 @@ static void coroutine_mixed_fn schedule_next_request(ThrottleGroupMember *tgm,
     }
 }
 
+/* Try to pay for a request with the lease of a ThrottleGroupMember,
+ * without taking the group lock.
+ *
+ * The lease was already accounted in the group's ThrottleState when it
+ * was handed out, so this only has to consume it.  Requests that are queued
+ * behind throttled ones must not overtake them, so they never use the lease.
+ *
+ * @tgm:       the current ThrottleGroupMember
+ * @bytes:     the number of bytes for this I/O
+ * @direction: the ThrottleDirection
+ * @ret:       whether the request was paid for
+ */
+static bool throttle_group_take_lease(ThrottleGroupMember *tgm, int64_t bytes,
+                                      ThrottleDirection direction)
+{
+    ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+    int op_size = qatomic_read(&tg->lease_op_size);
+
+    if (bytes > INT_MAX || (op_size && bytes > op_size)) {
+        return false;
+    }
+    if (qatomic_read(&tgm->pending_reqs[direction])) {
+        return false;
+    }
+
+    if (qatomic_fetch_sub(&tgm->lease_ops[direction], 1) < 1) {
+        qatomic_add(&tgm->lease_ops[direction], 1);
+        return false;
+    }
+    if (qatomic_fetch_sub(&tgm->lease_bytes[direction], bytes) < bytes) {
+        qatomic_add(&tgm->lease_bytes[direction], bytes);
+        qatomic_add(&tgm->lease_ops[direction], 1);
+        return false;
+    }
+    return true;
+}
+
+/* Take back the unused lease of a ThrottleGroupMember.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the ThrottleGroupMember
+ * @direction: the ThrottleDirection
+ * @refund:    whether to give the unused I/O back to the group
+ */
+static void throttle_group_revoke_lease(ThrottleGroupMember *tgm,
+                                        ThrottleDirection direction,
+                                        bool refund)
+{
+    int bytes = qatomic_xchg(&tgm->lease_bytes[direction], 0);
+    int ops = qatomic_xchg(&tgm->lease_ops[direction], 0);
+
+    if (refund) {
+        throttle_return_lease(tgm->throttle_state, direction,
+                              MAX(bytes, 0), MAX(ops, 0));
+    }
+}
+
+/* Hand out a new lease to a ThrottleGroupMember that has just been allowed
+ * to do I/O, replacing what is left of the previous one. Nothing is handed
+ * out while other requests are waiting, so that the round-robin scheduling
+ * stays fair.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the current ThrottleGroupMember
+ * @direction: the ThrottleDirection
+ */
+static void throttle_group_grant_lease(ThrottleGroupMember *tgm,
+                                       ThrottleDirection direction)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    uint64_t bytes = THROTTLE_LEASE_MAX_BYTES;
+    uint64_t ops = THROTTLE_LEASE_MAX_OPS;
+
+    if (tg->any_timer_armed[direction] || tgm->pending_reqs[direction] ||
+        qatomic_read(&tgm->io_limits_disabled)) {
+        return;
+    }
+
+    throttle_group_revoke_lease(tgm, direction, true);
+
+    throttle_compute_lease(ts, direction, &bytes, &ops);
+    if (!bytes || !ops) {
+        return;
+    }
+
+    throttle_account_lease(ts, direction, bytes, ops);
+    qatomic_add(&tgm->lease_bytes[direction], bytes);
+    qatomic_add(&tgm->lease_ops[direction], ops);
+}
+
+/* Revoke all leases after the configuration of a group has changed.
+ *
+ * This assumes that tg->lock is held.
+ */
+static void throttle_group_config_changed(ThrottleGroup *tg)
+{
+    ThrottleGroupMember *tgm;
+    ThrottleDirection dir;
+
+    qatomic_set(&tg->lease_op_size, MIN(tg->ts.cfg.op_size, INT_MAX));
+    QLIST_FOREACH(tgm, &tg->head, round_robin) {
+        for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
+            throttle_group_revoke_lease(tgm, dir, false);
+        }
+    }
+}
+
 /* Check if an I/O request needs to be throttled, wait and set a timer
  * if necessary, and schedule the next request using a round robin
  * algorithm.
  *
+ * Requests that fit in the member's lease skip all of this, so that
+ * members of a group that run in different iothreads do not contend on
+ * the group lock as long as the group is below its limits.
+ *
  * @tgm:       the current ThrottleGroupMember
  * @bytes:     the number of bytes for this I/O
  * @direction: the ThrottleDirection
@@ -369,6 +495,10 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     assert(bytes >= 0);
     assert(direction < THROTTLE_MAX);
 
+    if (throttle_group_take_lease(tgm, bytes, direction)) {
+        return;
+    }
+
     qemu_mutex_lock(&tg->lock);
 
     /* First we check if this I/O has to be throttled. */
@@ -377,14 +507,14 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
 
     /* Wait if there's a timer set or queued requests of this type */
     if (must_wait || tgm->pending_reqs[direction]) {
-        tgm->pending_reqs[direction]++;
+        qatomic_inc(&tgm->pending_reqs[direction]);
         qemu_mutex_unlock(&tg->lock);
         qemu_co_mutex_lock(&tgm->throttled_reqs_lock);
         qemu_co_queue_wait(&tgm->throttled_reqs[direction],
                            &tgm->throttled_reqs_lock);
         qemu_co_mutex_unlock(&tgm->throttled_reqs_lock);
         qemu_mutex_lock(&tg->lock);
-        tgm->pending_reqs[direction]--;
+        qatomic_dec(&tgm->pending_reqs[direction]);
     }
 
     /* The I/O will be executed, so do the accounting */
@@ -393,6 +523,8 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     /* Schedule the next request */
     schedule_next_request(tgm, direction);
 
+    throttle_group_grant_lease(tgm, direction);
+
     qemu_mutex_unlock(&tg->lock);
 }
 
@@ -478,6 +610,7 @@ void throttle_group_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
     qemu_mutex_lock(&tg->lock);
     throttle_config(ts, tg->clock_type, cfg);
+    throttle_group_config_changed(tg);
     qemu_mutex_unlock(&tg->lock);
 
     throttle_group_restart_tgm(tgm);
@@ -551,6 +684,10 @@ void throttle_group_register_tgm(ThrottleGroupMember *tgm,
     tgm->throttle_state = ts;
     tgm->aio_context = ctx;
     qatomic_set(&tgm->restart_pending, 0);
+    for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
+        qatomic_set(&tgm->lease_bytes[dir], 0);
+        qatomic_set(&tgm->lease_ops[dir], 0);
+    }
 
     QEMU_LOCK_GUARD(&tg->lock);
     /* If the ThrottleGroup is new set this ThrottleGroupMember as the token */
@@ -602,6 +739,8 @@ void throttle_group_unregister_tgm(ThrottleGroupMember *tgm)
             assert(tgm->pending_reqs[dir] == 0);
             assert(qemu_co_queue_empty(&tgm->throttled_reqs[dir]));
             assert(!timer_pending(tgm->throttle_timers.timers[dir]));
+            /* Give the unused lease back to the other members */
+            throttle_group_revoke_lease(tgm, dir, true);
             if (tg->tokens[dir] == tgm) {
                 token = throttle_group_next_tgm(tgm);
                 /* Take care of the case where this is the last tgm in the group */
@@ -792,6 +931,7 @@ static void throttle_group_obj_complete(UserCreatable *obj, Error **errp)
         return;
     }
     throttle_config(&tg->ts, tg->clock_type, &cfg);
+    qatomic_set(&tg->lease_op_size, MIN(cfg.op_size, INT_MAX));
     QTAILQ_INSERT_TAIL(&throttle_groups, tg, list);
     tg->is_initialized = true;
 }
@@ -903,6 +1043,7 @@ static void throttle_group_set_limits(Object *obj, Visitor *v,
         goto unlock;
     }
     throttle_config(&tg->ts, tg->clock_type, &cfg);
+    throttle_group_config_changed(tg);
 
 unlock:
     qemu_mutex_unlock(&tg->lock);
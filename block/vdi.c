@@ -1055,6 +1055,7 @@ static BlockDriver bdrv_vdi = {
     .bdrv_co_get_info = vdi_co_get_info,
 
     .is_format = true,
+    .block_status_cacheable = true,
     .create_opts = &vdi_create_opts,
     .bdrv_co_check = vdi_co_check,
 };
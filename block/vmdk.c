@@ -3181,6 +3181,7 @@ static BlockDriver bdrv_vmdk = {
 
     .is_format                    = true,
     .supports_backing             = true,
+    .block_status_cacheable       = true,
     .create_opts                  = &vmdk_create_opts,
 };
 
@@ -213,6 +213,91 @@ fail:
     g_free(req);
 }
 
+/* @req may be the first of several merged requests */
+static void virtio_blk_submit_rw(VirtIOBlockReq *req, bool is_write,
+                                 BlockCompletionFunc *cb)
+{
+    VirtIOBlock *s = req->dev;
+    BdrvRequestFlags flags = 0;
+
+    if (blk_ram_registrar_ok(&s->blk_ram_registrar)) {
+        flags |= BDRV_REQ_REGISTERED_BUF;
+    }
+
+    if (is_write) {
+        blk_aio_pwritev(s->blk, req->sector_num << BDRV_SECTOR_BITS,
+                        &req->qiov, flags, cb, req);
+    } else {
+        blk_aio_preadv(s->blk, req->sector_num << BDRV_SECTOR_BITS,
+                       &req->qiov, flags, cb, req);
+    }
+}
+
+/*
+ * Only the thread of a virtqueue may push to it, so requests that another
+ * thread of the pool submitted complete there.
+ */
+static void virtio_blk_pool_complete_bh(void *opaque)
+{
+    VirtIOBlockReq *req = opaque;
+    BlockBackend *blk = req->dev->blk;
+
+    virtio_blk_rw_complete(req, req->ret);
+    blk_dec_in_flight(blk);
+}
+
+/* Runs in the thread of the pool that submitted the request */
+static void virtio_blk_pool_rw_complete(void *opaque, int ret)
+{
+    VirtIOBlockReq *req = opaque;
+    VirtIOBlock *s = req->dev;
+    AioContext *ctx = s->vq_aio_context[virtio_get_queue_index(req->vq)];
+
+    if (ctx == qemu_get_current_aio_context()) {
+        virtio_blk_rw_complete(req, ret);
+        return;
+    }
+
+    /* Keep drain waiting until the request is completed */
+    blk_inc_in_flight(s->blk);
+    req->ret = ret;
+    aio_bh_schedule_oneshot(ctx, virtio_blk_pool_complete_bh, req);
+}
+
+/* Runs in whichever thread of the pool gets to the request first */
+static void virtio_blk_pool_submit_bh(void *opaque)
+{
+    VirtIOBlockReq *req = opaque;
+    VirtIOBlock *s = req->dev;
+    bool is_write = virtio_ldl_p(VIRTIO_DEVICE(s), &req->out.type) &
+                    VIRTIO_BLK_T_OUT;
+
+    virtio_blk_submit_rw(req, is_write, virtio_blk_pool_rw_complete);
+    blk_dec_in_flight(s->blk);
+}
+
+/* Requests that a virtqueue run submits itself before using its pool */
+#define VIRTIO_BLK_POOL_LOCAL_REQS 16
+
+/*
+ * Let an idle thread of the pool submit the request if this one is
+ * backlogged: it already submitted many requests from the same virtqueue
+ * run, or work that it queued earlier is still waiting.  Not when the
+ * virtqueue is handled outside of its thread because ioeventfd is disabled.
+ */
+static bool virtio_blk_pool_offload(VirtIOBlock *s, MultiReqBuffer *mrb,
+                                    unsigned vq_index)
+{
+    IOThreadPool *pool = s->vq_pool[vq_index];
+
+    if (!pool ||
+        s->vq_aio_context[vq_index] != qemu_get_current_aio_context()) {
+        return false;
+    }
+    return mrb->num_submitted >= VIRTIO_BLK_POOL_LOCAL_REQS ||
+           iothread_pool_backlogged(pool);
+}
+
 static inline void submit_requests(VirtIOBlock *s, MultiReqBuffer *mrb,
                                    int start, int num_reqs, int niov)
 {
@@ -220,7 +305,7 @@ static inline void submit_requests(VirtIOBlock *s, MultiReqBuffer *mrb,
     QEMUIOVector *qiov = &mrb->reqs[start]->qiov;
     int64_t sector_num = mrb->reqs[start]->sector_num;
     bool is_write = mrb->is_write;
-    BdrvRequestFlags flags = 0;
+    unsigned vq_index = virtio_get_queue_index(mrb->reqs[start]->vq);
 
     if (num_reqs > 1) {
         int i;
@@ -251,19 +336,16 @@ static inline void submit_requests(VirtIOBlock *s, MultiReqBuffer *mrb,
                               num_reqs - 1);
     }
 
-    if (blk_ram_registrar_ok(&s->blk_ram_registrar)) {
-        flags |= BDRV_REQ_REGISTERED_BUF;
+    if (virtio_blk_pool_offload(s, mrb, vq_index)) {
+        /* Keep drain waiting until the request is submitted */
+        blk_inc_in_flight(blk);
+        iothread_pool_schedule(s->vq_pool[vq_index],
+                               virtio_blk_pool_submit_bh, mrb->reqs[start]);
+        return;
     }
 
-    if (is_write) {
-        blk_aio_pwritev(blk, sector_num << BDRV_SECTOR_BITS, qiov,
-                        flags, virtio_blk_rw_complete,
-                        mrb->reqs[start]);
-    } else {
-        blk_aio_preadv(blk, sector_num << BDRV_SECTOR_BITS, qiov,
-                       flags, virtio_blk_rw_complete,
-                       mrb->reqs[start]);
-    }
+    mrb->num_submitted++;
+    virtio_blk_submit_rw(mrb->reqs[start], is_write, virtio_blk_rw_complete);
 }
 
 static int multireq_compare(const void *a, const void *b)
@@ -1455,20 +1537,27 @@ static bool virtio_blk_vq_aio_context_init(VirtIOBlock *s, Error **errp)
     }
 
     s->vq_aio_context = g_new(AioContext *, conf->num_queues);
+    s->vq_pool = g_new0(IOThreadPool *, conf->num_queues);
 
     if (conf->iothread_vq_mapping_list) {
         if (!iothread_vq_mapping_apply(conf->iothread_vq_mapping_list,
                                        s->vq_aio_context,
+                                       s->vq_pool,
                                        conf->num_queues,
                                        errp)) {
             g_free(s->vq_aio_context);
             s->vq_aio_context = NULL;
+            g_free(s->vq_pool);
+            s->vq_pool = NULL;
             return false;
         }
     } else if (conf->iothread) {
         AioContext *ctx = iothread_get_aio_context(conf->iothread);
+        IOThreadPool *pool = iothread_get_pool(conf->iothread);
+
         for (unsigned i = 0; i < conf->num_queues; i++) {
             s->vq_aio_context[i] = ctx;
+            s->vq_pool[i] = pool;
         }
 
         /* Released in virtio_blk_vq_aio_context_cleanup() */
@@ -1500,6 +1589,8 @@ static void virtio_blk_vq_aio_context_cleanup(VirtIOBlock *s)
 
     g_free(s->vq_aio_context);
     s->vq_aio_context = NULL;
+    g_free(s->vq_pool);
+    s->vq_pool = NULL;
 }
 
 /* Context: BQL held */
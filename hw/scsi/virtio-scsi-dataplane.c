@@ -66,7 +66,7 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
 
     if (vs->conf.iothread_vq_mapping_list) {
         if (!iothread_vq_mapping_apply(vs->conf.iothread_vq_mapping_list,
-                    &s->vq_aio_context[VIRTIO_SCSI_VQ_NUM_FIXED],
+                    &s->vq_aio_context[VIRTIO_SCSI_VQ_NUM_FIXED], NULL,
                     vs->conf.num_queues, errp)) {
             g_free(s->vq_aio_context);
             s->vq_aio_context = NULL;
@@ -11,6 +11,9 @@
 #include "qemu/main-loop.h"
 #include "qemu/cutils.h"
 #include "qemu/units.h"
+#include "qemu/lockable.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
 #include "qemu/error-report.h"
 #include <linux/vfio.h>
 #include <sys/ioctl.h>
@@ -40,6 +43,36 @@
  */
 #define VFIO_MIG_DEFAULT_DATA_BUFFER_SIZE (1 * MiB)
 
+/*
+ * Maximum amount of device data that the destination reads ahead of what
+ * the device has consumed, per device.
+ */
+#define VFIO_LOAD_PIPELINE_MAX_QUEUED (64 * MiB)
+
+typedef struct VFIOLoadChunk {
+    QSIMPLEQ_ENTRY(VFIOLoadChunk) next;
+    size_t size;
+    uint8_t data[];
+} VFIOLoadChunk;
+
+/*
+ * Device data is written to the device from a separate thread on the
+ * destination, so that the migration stream keeps being read, e.g. RAM
+ * or the data of other devices, while the device consumes it.
+ */
+struct VFIOLoadPipeline {
+    QemuThread thread;
+    QemuMutex lock;
+    /* Signalled when a chunk is queued or written, or on exit request */
+    QemuCond cond;
+    QSIMPLEQ_HEAD(, VFIOLoadChunk) chunks;
+    size_t queued_bytes;
+    bool writing;
+    bool exit;
+    /* First write error, a negative errno */
+    int ret;
+};
+
 static unsigned long bytes_transferred;
 
 static const char *mig_state_to_str(enum vfio_device_mig_state state)
@@ -227,13 +260,153 @@ vfio_migration_set_state_or_reset(VFIODevice *vbasedev,
                                     VFIO_DEVICE_STATE_ERROR, errp);
 }
 
+static void *vfio_load_pipeline_thread(void *opaque)
+{
+    VFIODevice *vbasedev = opaque;
+    VFIOMigration *migration = vbasedev->migration;
+    VFIOLoadPipeline *pipeline = migration->load_pipeline;
+    VFIOLoadChunk *chunk;
+    int ret = 0;
+
+    qemu_mutex_lock(&pipeline->lock);
+    while (true) {
+        while (QSIMPLEQ_EMPTY(&pipeline->chunks) && !pipeline->exit) {
+            qemu_cond_wait(&pipeline->cond, &pipeline->lock);
+        }
+        chunk = QSIMPLEQ_FIRST(&pipeline->chunks);
+        if (!chunk) {
+            break;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&pipeline->chunks, next);
+        pipeline->writing = true;
+        qemu_mutex_unlock(&pipeline->lock);
+
+        /* After an error, only drop what is queued */
+        if (!ret && qemu_write_full(migration->data_fd, chunk->data,
+                                    chunk->size) != chunk->size) {
+            ret = -errno;
+        }
+        trace_vfio_load_pipeline_write(vbasedev->name, chunk->size, ret);
+
+        qemu_mutex_lock(&pipeline->lock);
+        pipeline->queued_bytes -= chunk->size;
+        pipeline->writing = false;
+        if (ret && !pipeline->ret) {
+            pipeline->ret = ret;
+        }
+        qemu_cond_broadcast(&pipeline->cond);
+        g_free(chunk);
+    }
+    qemu_mutex_unlock(&pipeline->lock);
+
+    return NULL;
+}
+
+static void vfio_load_pipeline_start(VFIODevice *vbasedev)
+{
+    VFIOMigration *migration = vbasedev->migration;
+    VFIOLoadPipeline *pipeline = g_new0(VFIOLoadPipeline, 1);
+    g_autofree char *name = g_strdup_printf("vfioload-%s", vbasedev->name);
+
+    qemu_mutex_init(&pipeline->lock);
+    qemu_cond_init(&pipeline->cond);
+    QSIMPLEQ_INIT(&pipeline->chunks);
+    migration->load_pipeline = pipeline;
+
+    qemu_thread_create(&pipeline->thread, name, vfio_load_pipeline_thread,
+                       vbasedev, QEMU_THREAD_JOINABLE);
+}
+
+static void vfio_load_pipeline_stop(VFIODevice *vbasedev)
+{
+    VFIOMigration *migration = vbasedev->migration;
+    VFIOLoadPipeline *pipeline = migration->load_pipeline;
+
+    if (!pipeline) {
+        return;
+    }
+
+    /* Whatever is still queued is dropped by the thread */
+    WITH_QEMU_LOCK_GUARD(&pipeline->lock) {
+        pipeline->exit = true;
+        pipeline->ret = pipeline->ret ?: -ECANCELED;
+        qemu_cond_broadcast(&pipeline->cond);
+    }
+    qemu_thread_join(&pipeline->thread);
+
+    qemu_cond_destroy(&pipeline->cond);
+    qemu_mutex_destroy(&pipeline->lock);
+    g_free(pipeline);
+    migration->load_pipeline = NULL;
+}
+
+/*
+ * Wait until the device consumed all the data queued for it.  Must be
+ * called before anything else accesses the device, as the device state
+ * is a single stream.
+ */
+static int vfio_load_pipeline_drain(VFIODevice *vbasedev)
+{
+    VFIOLoadPipeline *pipeline = vbasedev->migration->load_pipeline;
+
+    if (!pipeline) {
+        return 0;
+    }
+
+    QEMU_LOCK_GUARD(&pipeline->lock);
+    while (!QSIMPLEQ_EMPTY(&pipeline->chunks) || pipeline->writing) {
+        qemu_cond_wait(&pipeline->cond, &pipeline->lock);
+    }
+    return pipeline->ret;
+}
+
+static int vfio_load_pipeline_queue(QEMUFile *f, VFIODevice *vbasedev,
+                                    uint64_t data_size)
+{
+    VFIOLoadPipeline *pipeline = vbasedev->migration->load_pipeline;
+    VFIOLoadChunk *chunk;
+
+    chunk = g_try_malloc(sizeof(*chunk) + data_size);
+    if (!chunk) {
+        return -ENOMEM;
+    }
+    chunk->size = data_size;
+
+    if (qemu_get_buffer(f, chunk->data, data_size) != data_size) {
+        g_free(chunk);
+        return qemu_file_get_error(f) ?: -EIO;
+    }
+
+    QEMU_LOCK_GUARD(&pipeline->lock);
+    /* A single chunk larger than the limit is still let through */
+    while (pipeline->queued_bytes &&
+           pipeline->queued_bytes + data_size > VFIO_LOAD_PIPELINE_MAX_QUEUED &&
+           !pipeline->ret) {
+        qemu_cond_wait(&pipeline->cond, &pipeline->lock);
+    }
+    if (pipeline->ret) {
+        g_free(chunk);
+        return pipeline->ret;
+    }
+
+    QSIMPLEQ_INSERT_TAIL(&pipeline->chunks, chunk, next);
+    pipeline->queued_bytes += data_size;
+    qemu_cond_broadcast(&pipeline->cond);
+
+    return 0;
+}
+
 static int vfio_load_buffer(QEMUFile *f, VFIODevice *vbasedev,
                             uint64_t data_size)
 {
     VFIOMigration *migration = vbasedev->migration;
     int ret;
 
-    ret = qemu_file_get_to_fd(f, migration->data_fd, data_size);
+    if (migration->load_pipeline) {
+        ret = vfio_load_pipeline_queue(f, vbasedev, data_size);
+    } else {
+        ret = qemu_file_get_to_fd(f, migration->data_fd, data_size);
+    }
     trace_vfio_load_state_device_data(vbasedev->name, data_size, ret);
 
     return ret;
@@ -704,6 +877,10 @@ static int vfio_load_setup(QEMUFile *f, void *opaque, Error **errp)
         return ret;
     }
 
+    if (vbasedev->migration_load_pipeline) {
+        vfio_load_pipeline_start(vbasedev);
+    }
+
     return 0;
 }
 
@@ -711,6 +888,7 @@ static int vfio_load_cleanup(void *opaque)
 {
     VFIODevice *vbasedev = opaque;
 
+    vfio_load_pipeline_stop(vbasedev);
     vfio_multifd_cleanup(vbasedev);
 
     vfio_migration_cleanup(vbasedev);
@@ -740,6 +918,13 @@ static int vfio_load_state(QEMUFile *f, void *opaque, int version_id)
                 return -EINVAL;
             }
 
+            ret = vfio_load_pipeline_drain(vbasedev);
+            if (ret) {
+                error_report("%s: Failed to load device data: %s",
+                             vbasedev->name, strerror(-ret));
+                return ret;
+            }
+
             return vfio_load_device_config_state(f, opaque);
         }
         case VFIO_MIG_FLAG_DEV_SETUP_STATE:
@@ -775,6 +960,14 @@ static int vfio_load_state(QEMUFile *f, void *opaque, int version_id)
                 return -EINVAL;
             }
 
+            /* The device must have taken in its initial data */
+            ret = vfio_load_pipeline_drain(vbasedev);
+            if (ret) {
+                error_report("%s: Failed to load device data: %s",
+                             vbasedev->name, strerror(-ret));
+                return ret;
+            }
+
             ret = qemu_loadvm_approve_switchover();
             if (ret) {
                 error_report(
@@ -810,6 +1003,15 @@ static int vfio_switchover_start(void *opaque)
     VFIODevice *vbasedev = opaque;
 
     if (vfio_multifd_transfer_enabled(vbasedev)) {
+        /* The multifd load thread takes over the device data stream */
+        int ret = vfio_load_pipeline_drain(vbasedev);
+
+        if (ret) {
+            error_report("%s: Failed to load device data: %s",
+                         vbasedev->name, strerror(-ret));
+            return ret;
+        }
+
         return vfio_multifd_switchover_start(vbasedev);
     }
 
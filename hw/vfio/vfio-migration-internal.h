@@ -35,6 +35,7 @@
 
 typedef struct VFIODevice VFIODevice;
 typedef struct VFIOMultifd VFIOMultifd;
+typedef struct VFIOLoadPipeline VFIOLoadPipeline;
 
 typedef struct VFIOMigration {
     struct VFIODevice *vbasedev;
@@ -49,6 +50,7 @@ typedef struct VFIOMigration {
     uint64_t precopy_dirty_size;
     bool multifd_transfer;
     VFIOMultifd *multifd;
+    VFIOLoadPipeline *load_pipeline;
     bool initial_data_sent;
 
     bool event_save_iterate_started;
@@ -8,6 +8,7 @@
 
 #include "qemu/osdep.h"
 #include "system/iothread.h"
+#include "system/iothread-pool.h"
 #include "hw/virtio/iothread-vq-mapping.h"
 
 static bool
@@ -75,6 +76,7 @@ iothread_vq_mapping_validate(IOThreadVirtQueueMappingList *list, uint16_t
 bool iothread_vq_mapping_apply(
         IOThreadVirtQueueMappingList *list,
         AioContext **vq_aio_context,
+        IOThreadPool **vq_pool,
         uint16_t num_queues,
         Error **errp)
 {
@@ -93,6 +95,7 @@ bool iothread_vq_mapping_apply(
     for (node = list; node; node = node->next) {
         IOThread *iothread = iothread_by_id(node->value->iothread);
         AioContext *ctx = iothread_get_aio_context(iothread);
+        IOThreadPool *pool = iothread_get_pool(iothread);
 
         /* Released in virtio_blk_vq_aio_context_cleanup() */
         object_ref(OBJECT(iothread));
@@ -104,12 +107,18 @@ bool iothread_vq_mapping_apply(
             for (vq = node->value->vqs; vq; vq = vq->next) {
                 assert(vq->value < num_queues);
                 vq_aio_context[vq->value] = ctx;
+                if (vq_pool) {
+                    vq_pool[vq->value] = pool;
+                }
             }
         } else {
             /* Round-robin vq:IOThread assignment */
             for (unsigned i = cur_iothread; i < num_queues;
                  i += num_iothreads) {
                 vq_aio_context[i] = ctx;
+                if (vq_pool) {
+                    vq_pool[i] = pool;
+                }
             }
         }
 
@@ -196,9 +196,10 @@ struct AioContext {
      * positives are possible, i.e. "notified" could be set even though the
      * EventNotifier is clear.
      *
-     * Note that event_notifier_set *cannot* be optimized the same way.  For
-     * more information on the problem that would result, see "#ifdef BUG2"
-     * in the docs/aio_notify_accept.promela formal model.
+     * "notified" also lets aio_notify() skip event_notifier_set when it is
+     * already set.  This is only safe because the event loop never blocks
+     * with "notified" set: aio_poll(), aio_ctx_prepare() and the Windows
+     * aio_poll() check it after setting notify_me.
      */
     bool notified;
     EventNotifier notifier;
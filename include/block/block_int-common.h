@@ -28,6 +28,7 @@
 #include "block/block-common.h"
 #include "block/block-global-state.h"
 #include "block/snapshot.h"
+#include "qemu/interval-tree.h"
 #include "qemu/iov.h"
 #include "qemu/rcu.h"
 #include "qemu/stats64.h"
@@ -78,12 +79,17 @@ typedef struct BdrvTrackedRequest {
     int64_t offset;
     int64_t bytes;
     enum BdrvTrackedRequestType type;
+    bool zero_write;        /* for latency accounting only */
+    int64_t start_ns;       /* QEMU_CLOCK_REALTIME */
 
     bool serialising;
     int64_t overlap_offset;
     int64_t overlap_bytes;
 
-    QLIST_ENTRY(BdrvTrackedRequest) list;
+    /* Overlap range in bs->tracked_requests */
+    IntervalTreeNode node;
+    /* Overlap range in bs->serialising_requests, if serialising */
+    IntervalTreeNode serialising_node;
     Coroutine *co; /* owner, used for deadlock detection */
     CoQueue wait_queue; /* coroutines blocked on this request */
 
@@ -163,6 +169,16 @@ struct BlockDriver {
      */
     bool supports_backing;
 
+    /*
+     * Set if the result of .bdrv_co_block_status only depends on metadata
+     * that is changed exclusively through write, discard and truncate
+     * requests on the node itself, or through operations that invalidate
+     * the block-status cache explicitly (e.g. snapshot switching or image
+     * repair).  Results of such drivers are cached by the generic block
+     * layer, so repeated queries do not have to go to the driver.
+     */
+    bool block_status_cacheable;
+
     /*
      * Drivers setting this field must be able to work with just a plain
      * filename with '<protocol_name>:' as a prefix, and no other options.
@@ -1072,23 +1088,82 @@ struct BdrvChild {
 };
 
 /*
- * Allows bdrv_co_block_status() to cache one data region for a
- * protocol node.
+ * One extent of the block-status cache, i.e. the result of a
+ * .bdrv_co_block_status() call.
  *
- * @valid: Whether the cache is valid (should be accessed with atomic
- *         functions so this can be reset by RCU readers)
- * @data_start: Offset where we know (or strongly assume) is data
- * @data_end: Offset where the data region ends (which is not necessarily
- *            the start of a zeroed region)
+ * @node: Interval covered by this extent, in bytes
+ * @status: BDRV_BLOCK_* flags returned by the driver
+ * @map: Host offset corresponding to @node.start, if @status has
+ *       BDRV_BLOCK_OFFSET_VALID
+ * @file: Node that @map refers to
  */
-typedef struct BdrvBlockStatusCache {
-    struct rcu_head rcu;
+typedef struct BdrvBlockStatusExtent {
+    IntervalTreeNode node;
+    QTAILQ_ENTRY(BdrvBlockStatusExtent) next;
 
-    bool valid;
-    int64_t data_start;
-    int64_t data_end;
+    int status;
+    int64_t map;
+    BlockDriverState *file;
+} BdrvBlockStatusExtent;
+
+/*
+ * Allows bdrv_co_block_status() to cache driver results.
+ *
+ * For protocol nodes, only data regions are cached (see
+ * bdrv_co_do_block_status()).  For nodes whose driver sets
+ * .block_status_cacheable, all results are cached.
+ *
+ * @lock: Protects all other fields
+ * @extents: Non-overlapping cached extents
+ * @lru: All extents, least recently filled first
+ * @nb_extents: Number of extents in the cache (may be read with atomics
+ *              without holding @lock, as a shortcut for an empty cache)
+ * @generation: Incremented on every invalidation, so that a result obtained
+ *              from the driver while an invalidation was happening is not
+ *              put into the cache (atomic, invalidations of an empty cache
+ *              do not take @lock)
+ * @granularity: Allocation granularity of the node, 0 if not known yet (read
+ *               and written with atomics, see bdrv_co_write_req_finish())
+ */
+typedef struct BdrvBlockStatusCache {
+    QemuMutex lock;
+    IntervalTreeRoot extents;
+    QTAILQ_HEAD(, BdrvBlockStatusExtent) lru;
+    unsigned nb_extents;
+    uint64_t generation;
+    int64_t granularity;
 } BdrvBlockStatusCache;
 
+/*
+ * Per-node request latency histograms, broken down by operation and by
+ * request size.  Bucket i counts requests that completed in [2^i, 2^(i+1))
+ * nanoseconds; the last bucket also counts everything slower.  Buckets are
+ * updated with atomic adds from whatever thread completes the request, so
+ * no lock is needed.
+ */
+typedef enum BdrvLatencyOp {
+    BDRV_LATENCY_READ,
+    BDRV_LATENCY_WRITE,
+    BDRV_LATENCY_ZERO_WRITE,
+    BDRV_LATENCY_DISCARD,
+    BDRV_LATENCY_FLUSH,
+    BDRV_LATENCY__MAX,
+} BdrvLatencyOp;
+
+typedef enum BdrvLatencySize {
+    BDRV_LATENCY_SIZE_4K,       /* up to 4 KiB */
+    BDRV_LATENCY_SIZE_64K,      /* up to 64 KiB */
+    BDRV_LATENCY_SIZE_1M,       /* up to 1 MiB */
+    BDRV_LATENCY_SIZE_LARGE,    /* anything larger */
+    BDRV_LATENCY_SIZE__MAX,
+} BdrvLatencySize;
+
+#define BDRV_LATENCY_BUCKETS 40 /* 2^39 ns is about nine minutes */
+
+typedef struct BdrvLatencyHistogram {
+    Stat64 buckets[BDRV_LATENCY_BUCKETS];
+} BdrvLatencyHistogram;
+
 struct BlockDriverState {
     /*
      * Protected by big QEMU lock or read-only after opening.  No special
@@ -1260,7 +1335,13 @@ struct BlockDriverState {
 
     /* Protected by reqs_lock.  */
     QemuMutex reqs_lock;
-    QLIST_HEAD(, BdrvTrackedRequest) tracked_requests;
+    /*
+     * In-flight requests indexed by their overlap range, and the subset of
+     * them that is serialising, so that conflict checks do not have to scan
+     * all requests.
+     */
+    IntervalTreeRoot tracked_requests;
+    IntervalTreeRoot serialising_requests;
     CoQueue flush_queue;                  /* Serializing flush queue */
     bool active_flush_req;                /* Flush request in flight? */
 
@@ -1270,10 +1351,10 @@ struct BlockDriverState {
     /* BdrvChild links to this node may never be frozen */
     bool never_freeze;
 
-    /* Lock for block-status cache RCU writers */
-    CoMutex bsc_modify_lock;
-    /* Always non-NULL, but must only be dereferenced under an RCU read guard */
-    BdrvBlockStatusCache *block_status_cache;
+    BdrvBlockStatusCache block_status_cache;
+
+    /* See bdrv_latency_account().  Flushes only use the first size class. */
+    BdrvLatencyHistogram latency[BDRV_LATENCY__MAX][BDRV_LATENCY_SIZE__MAX];
 
     /* array of write pointers' location of each zone in the zoned device. */
     BlockZoneWps *wps;
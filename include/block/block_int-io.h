@@ -166,29 +166,43 @@ bdrv_primary_bs(BlockDriverState *bs)
 }
 
 /**
- * Check whether the given offset is in the cached block-status data
- * region.
+ * Look up @offset in the block-status cache of @bs.
  *
- * If it is, and @pnum is not NULL, *pnum is set to
- * `bsc.data_end - offset`, i.e. how many bytes, starting from
- * @offset, are data (according to the cache).
- * Otherwise, *pnum is not touched.
+ * On a hit, return the cached BDRV_BLOCK_* flags, and set *pnum to the
+ * number of bytes starting at @offset that share this status, *map to the
+ * corresponding host offset (if BDRV_BLOCK_OFFSET_VALID is set) and *file
+ * to the node that *map refers to.
+ * On a miss, return -ENOENT and leave the output parameters untouched.
  */
-bool bdrv_bsc_is_data(BlockDriverState *bs, int64_t offset, int64_t *pnum);
+int bdrv_bsc_lookup(BlockDriverState *bs, int64_t offset, int64_t *pnum,
+                    int64_t *map, BlockDriverState **file);
 
 /**
- * If [offset, offset + bytes) overlaps with the currently cached
- * block-status region, invalidate the cache.
+ * Return the current generation of the block-status cache of @bs.  Must be
+ * read before querying the driver, and passed to bdrv_bsc_fill() afterwards.
+ */
+uint64_t bdrv_bsc_generation(BlockDriverState *bs);
+
+/**
+ * Drop all cached extents that overlap with [offset, offset + bytes).
  *
- * (To be used by I/O paths that cause data regions to be zero or
- * holes.)
+ * (To be used by I/O paths that change the allocation status of a range.)
  */
 void bdrv_bsc_invalidate_range(BlockDriverState *bs,
                                int64_t offset, int64_t bytes);
 
 /**
- * Mark the range [offset, offset + bytes) as a data region.
+ * Drop all cached extents of @bs.
+ */
+void bdrv_bsc_invalidate(BlockDriverState *bs);
+
+/**
+ * Cache @status, @map and @file for the range [offset, offset + bytes).
+ * Nothing is cached if the cache has been invalidated since @generation
+ * was obtained from bdrv_bsc_generation().
  */
-void bdrv_bsc_fill(BlockDriverState *bs, int64_t offset, int64_t bytes);
+void bdrv_bsc_fill(BlockDriverState *bs, uint64_t generation,
+                   int64_t offset, int64_t bytes, int status, int64_t map,
+                   BlockDriverState *file);
 
 #endif /* BLOCK_INT_IO_H */
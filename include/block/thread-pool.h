@@ -22,22 +22,52 @@
 
 #define THREAD_POOL_MAX_THREADS_DEFAULT         64
 
+#define THREAD_POOL_LATENCY_BUCKETS             32
+
 typedef int ThreadPoolFunc(void *opaque);
 
 typedef struct ThreadPoolAio ThreadPoolAio;
 
+/*
+ * Requests of each class have their own queue, so that slow requests do
+ * not delay quick ones.  Slow requests never use more than half of the
+ * threads of a pool.
+ */
+typedef enum ThreadPoolClass {
+    /* Reads, writes and other requests that are expected to be quick */
+    THREAD_POOL_CLASS_DEFAULT,
+    /* Flushes, discards, preallocation and the like */
+    THREAD_POOL_CLASS_SLOW,
+    THREAD_POOL_CLASS__MAX,
+} ThreadPoolClass;
+
+typedef struct ThreadPoolStats {
+    uint64_t requests;
+    /* Time spent in the queue; bucket i counts [2^i, 2^(i+1)) ns */
+    uint64_t queue_latency[THREAD_POOL_LATENCY_BUCKETS];
+} ThreadPoolStats;
+
 ThreadPoolAio *thread_pool_new_aio(struct AioContext *ctx);
 void thread_pool_free_aio(ThreadPoolAio *pool);
 
 /*
  * thread_pool_submit_{aio,co} API: submit I/O requests in the thread's
- * current AioContext.
+ * current AioContext.  The _class variants are for requests that are not
+ * in THREAD_POOL_CLASS_DEFAULT.
  */
 BlockAIOCB *thread_pool_submit_aio(ThreadPoolFunc *func, void *arg,
                                    BlockCompletionFunc *cb, void *opaque);
+BlockAIOCB *thread_pool_submit_aio_class(ThreadPoolClass cls,
+                                         ThreadPoolFunc *func, void *arg,
+                                         BlockCompletionFunc *cb, void *opaque);
 int coroutine_fn thread_pool_submit_co(ThreadPoolFunc *func, void *arg);
+int coroutine_fn thread_pool_submit_co_class(ThreadPoolClass cls,
+                                             ThreadPoolFunc *func, void *arg);
 void thread_pool_update_params(ThreadPoolAio *pool, struct AioContext *ctx);
 
+/* Statistics about the requests of class @cls, summed over all pools */
+void thread_pool_get_stats(ThreadPoolClass cls, ThreadPoolStats *stats);
+
 /* ------------------------------------------- */
 /* Generic thread pool types and methods below */
 typedef struct ThreadPool ThreadPool;
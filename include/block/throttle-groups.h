@@ -49,9 +49,18 @@ typedef struct ThrottleGroupMember {
      */
     unsigned int restart_pending;
 
+    /* Budget that the group has already accounted for this member, so
+     * that requests that fit in it do not need to take the group lock.
+     * See throttle_group_co_io_limits_intercept().  Accessed with atomic
+     * operations.
+     */
+    int lease_bytes[THROTTLE_MAX];
+    int lease_ops[THROTTLE_MAX];
+
     /* The following fields are protected by the ThrottleGroup lock.
      * See the ThrottleGroup documentation for details.
-     * throttle_state tells us if I/O limits are configured. */
+     * throttle_state tells us if I/O limits are configured.
+     * pending_reqs is also read with atomic operations outside the lock. */
     ThrottleState *throttle_state;
     ThrottleTimers throttle_timers;
     unsigned       pending_reqs[THROTTLE_MAX];
@@ -67,6 +67,7 @@ typedef struct VFIODevice {
     bool ram_block_discard_allowed;
     OnOffAuto enable_migration;
     OnOffAuto migration_multifd_transfer;
+    bool migration_load_pipeline;
     bool migration_events;
     bool use_region_fds;
     VFIODeviceOps *ops;
@@ -11,16 +11,19 @@
 
 #include "qapi/error.h"
 #include "qapi/qapi-types-virtio.h"
+#include "system/iothread-pool.h"
 
 /**
  * iothread_vq_mapping_apply:
  * @list: The mapping of virtqueues to IOThreads.
  * @vq_aio_context: The array of AioContext pointers to fill in.
+ * @vq_pool: The array of IOThreadPool pointers to fill in, or NULL.
  * @num_queues: The length of @vq_aio_context.
  * @errp: If an error occurs, a pointer to the area to store the error.
  *
  * Fill in the AioContext for each virtqueue in the @vq_aio_context array given
- * the iothread-vq-mapping parameter in @list.
+ * the iothread-vq-mapping parameter in @list.  If @vq_pool is not NULL, also
+ * fill in the pool that the IOThread of each virtqueue belongs to, or NULL.
  *
  * iothread_vq_mapping_cleanup() must be called to free IOThread object
  * references after this function returns success.
@@ -30,6 +33,7 @@
 bool iothread_vq_mapping_apply(
         IOThreadVirtQueueMappingList *list,
         AioContext **vq_aio_context,
+        IOThreadPool **vq_pool,
         uint16_t num_queues,
         Error **errp);
 
@@ -18,6 +18,7 @@
 #include "hw/virtio/virtio.h"
 #include "hw/block/block.h"
 #include "system/iothread.h"
+#include "system/iothread-pool.h"
 #include "system/block-backend.h"
 #include "system/block-ram-registrar.h"
 #include "qom/object.h"
@@ -71,6 +72,12 @@ struct VirtIOBlock {
      */
     AioContext **vq_aio_context;
 
+    /*
+     * The pool that the IOThread of each virtqueue belongs to, or NULL.
+     * Its other threads may submit requests from that virtqueue.
+     */
+    IOThreadPool **vq_pool;
+
     uint64_t host_features;
     size_t config_size;
     BlockRAMRegistrar blk_ram_registrar;
@@ -90,6 +97,7 @@ typedef struct VirtIOBlockReq {
     struct VirtIOBlockReq *next;
     struct VirtIOBlockReq *mr_next;
     BlockAcctCookie acct;
+    int ret;    /* for completion in the thread of vq, see vq_pool */
 } VirtIOBlockReq;
 
 #define VIRTIO_BLK_MAX_MERGE_REQS 32
@@ -97,6 +105,7 @@ typedef struct VirtIOBlockReq {
 typedef struct MultiReqBuffer {
     VirtIOBlockReq *reqs[VIRTIO_BLK_MAX_MERGE_REQS];
     unsigned int num_reqs;
+    unsigned int num_submitted; /* by the thread of vq, see vq_pool */
     bool is_write;
 } MultiReqBuffer;
 
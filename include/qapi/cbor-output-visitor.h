@@ -0,0 +1,35 @@
+/*
+ * CBOR Output Visitor
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#ifndef CBOR_OUTPUT_VISITOR_H
+#define CBOR_OUTPUT_VISITOR_H
+
+#include "qapi/visitor.h"
+
+typedef struct CborOutputVisitor CborOutputVisitor;
+
+/**
+ * Create a CBOR output visitor that appends to @writer
+ *
+ * A CBOR output visitor visit encodes a QAPI object as CBOR, with the
+ * same structure as the QObject that the QObject output visitor would
+ * build for it, but without building that QObject: each member is
+ * written to @writer as it is visited.
+ *
+ * The visit of each top level object appends one CBOR item to
+ * @writer; visit_complete() does nothing and its @opaque argument is
+ * ignored.  @writer must stay valid until the visitor is freed.
+ *
+ * Errors are not expected to happen.
+ *
+ * The caller is responsible for freeing the visitor with
+ * visit_free().
+ */
+Visitor *cbor_output_visitor_new(CborWriter *writer);
+
+#endif
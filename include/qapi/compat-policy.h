@@ -42,4 +42,14 @@ Visitor *qobject_input_visitor_new_qmp(QObject *obj);
  */
 Visitor *qobject_output_visitor_new_qmp(QObject **result);
 
+/*
+ * Create an output visitor for the return value of a QMP command
+ *
+ * This is like qobject_output_visitor_new_qmp(), except when the
+ * command was dispatched by qmp_dispatch_cbor().  The visitor then
+ * encodes the value straight into the CBOR response, and leaves
+ * @result null.
+ */
+Visitor *qmp_output_visitor_new(QObject **result);
+
 #endif
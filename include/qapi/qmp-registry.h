@@ -57,6 +57,10 @@ bool qmp_has_success_response(const QmpCommand *cmd);
 QDict *qmp_error_response(Error *err);
 QDict *coroutine_mixed_fn qmp_dispatch(const QmpCommandList *cmds, QObject *request,
                                        bool allow_oob, Monitor *cur_mon);
+GString *coroutine_mixed_fn qmp_dispatch_cbor(const QmpCommandList *cmds,
+                                              QObject *request,
+                                              bool allow_oob,
+                                              Monitor *cur_mon);
 bool qmp_is_oob(const QDict *dict);
 
 typedef void (*qmp_cmd_callback_fn)(const QmpCommand *cmd, void *opaque);
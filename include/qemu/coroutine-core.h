@@ -76,6 +76,16 @@ typedef void coroutine_fn CoroutineEntry(void *opaque);
  */
 Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque);
 
+/**
+ * Create a new coroutine with a small stack
+ *
+ * Like qemu_coroutine_create(), but the stack is 64 KiB instead of 1 MiB,
+ * and there is no way to grow it.  Only use this for coroutines whose
+ * call chains are known to be short, for example a request that goes
+ * straight to a protocol driver.
+ */
+Coroutine *qemu_coroutine_create_small(CoroutineEntry *entry, void *opaque);
+
 /**
  * Transfer control to a coroutine
  */
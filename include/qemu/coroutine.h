@@ -284,6 +284,24 @@ void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size);
  */
 void qemu_coroutine_dec_pool_size(unsigned int additional_pool_size);
 
+typedef struct CoroutinePoolStats {
+    /* Coroutines reused from a local pool, updated once per batch */
+    uint64_t hits;
+    /* Coroutines allocated because the pools were empty */
+    uint64_t misses;
+    /* Batches that a thread took from a global pool */
+    uint64_t refills;
+    /* Batches freed because the global pools were full */
+    uint64_t discards;
+    /* Coroutines in the global pools */
+    uint64_t size;
+} CoroutinePoolStats;
+
+/**
+ * Get statistics about the coroutine pool
+ */
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats);
+
 /**
  * Sends a (part of) iovec down a socket, yielding when the socket is full, or
  * Receives data into a (part of) iovec from a socket,
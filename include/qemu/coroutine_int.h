@@ -34,6 +34,14 @@ extern __thread void *__safestack_unsafe_stack_ptr;
 #endif
 
 #define COROUTINE_STACK_SIZE (1 << 20)
+#define COROUTINE_SMALL_STACK_SIZE (64 << 10)
+
+/* Stack sizes, each with its own pool */
+typedef enum {
+    COROUTINE_STACK_DEFAULT,    /* COROUTINE_STACK_SIZE */
+    COROUTINE_STACK_SMALL,      /* COROUTINE_SMALL_STACK_SIZE */
+    COROUTINE_STACK__MAX,
+} CoroutineStack;
 
 typedef enum {
     COROUTINE_YIELD = 1,
@@ -45,6 +53,7 @@ struct Coroutine {
     CoroutineEntry *entry;
     void *entry_arg;
     Coroutine *caller;
+    CoroutineStack stack;
 
     /* Only used when the coroutine has terminated.  */
     QSLIST_ENTRY(Coroutine) pool_next;
@@ -69,7 +78,7 @@ struct Coroutine {
     QSLIST_ENTRY(Coroutine) co_scheduled_next;
 };
 
-Coroutine *qemu_coroutine_new(void);
+Coroutine *qemu_coroutine_new(size_t stack_size);
 void qemu_coroutine_delete(Coroutine *co);
 CoroutineAction qemu_coroutine_switch(Coroutine *from, Coroutine *to,
                                       CoroutineAction action);
@@ -143,6 +143,22 @@ struct rcu_head {
 void call_rcu1(struct rcu_head *head, RCUCBFunc *func);
 void drain_call_rcu(void);
 
+#define RCU_LATENCY_BUCKETS 32  /* 2^31 ns is about two seconds */
+
+typedef struct RCUStats {
+    uint64_t grace_periods;     /* completed by synchronize_rcu() */
+    uint64_t callbacks;         /* passed to the call_rcu thread */
+    uint64_t pending;           /* queued and not yet taken */
+
+    /*
+     * Log2 histogram, in nanoseconds, of the time from queuing the oldest
+     * callback of a batch to having run the whole batch.
+     */
+    uint64_t callback_latency[RCU_LATENCY_BUCKETS];
+} RCUStats;
+
+void rcu_get_stats(RCUStats *stats);
+
 /* The operands of the minus operator must have the same type,
  * which must be the one that we specify in the cast.
  */
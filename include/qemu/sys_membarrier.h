@@ -17,11 +17,15 @@
 void smp_mb_global_init(void);
 void smp_mb_global(void);
 #define smp_mb_placeholder()       barrier()
+
+/* Whether smp_mb_global() is cheap enough to call often.  */
+bool smp_mb_global_expedited(void);
 #else
 /* Keep it simple, execute a real memory barrier on both sides.  */
 static inline void smp_mb_global_init(void) {}
 #define smp_mb_global()            smp_mb()
 #define smp_mb_placeholder()       smp_mb()
+static inline bool smp_mb_global_expedited(void) { return true; }
 #endif
 
 #endif
@@ -30,6 +30,14 @@
 
 #define THROTTLE_VALUE_MAX 1000000000000000LL
 
+/*
+ * Leases (see throttle_compute_lease()) take at most 1/THROTTLE_LEASE_SHARE
+ * of the room left in a bucket, and at most THROTTLE_LEASE_NS worth of its
+ * average rate.
+ */
+#define THROTTLE_LEASE_SHARE 8
+#define THROTTLE_LEASE_NS    (10 * SCALE_MS)
+
 typedef enum {
     THROTTLE_BPS_TOTAL,
     THROTTLE_BPS_READ,
@@ -158,6 +166,13 @@ bool throttle_schedule_timer(ThrottleState *ts,
 
 void throttle_account(ThrottleState *ts, ThrottleDirection direction,
                       uint64_t size);
+
+void throttle_compute_lease(ThrottleState *ts, ThrottleDirection direction,
+                            uint64_t *bytes, uint64_t *units);
+void throttle_account_lease(ThrottleState *ts, ThrottleDirection direction,
+                            uint64_t bytes, uint64_t units);
+void throttle_return_lease(ThrottleState *ts, ThrottleDirection direction,
+                           uint64_t bytes, uint64_t units);
 void throttle_limits_to_config(ThrottleLimits *arg, ThrottleConfig *cfg,
                                Error **errp);
 void throttle_config_to_limits(ThrottleConfig *cfg, ThrottleLimits *var);
@@ -86,7 +86,8 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
-    QEMUTimer *next;
+    uint64_t seq;               /* orders timers with the same expire_time */
+    int heap_index;             /* in the timer list, or -1 if not pending */
     int attributes;
     int scale;
 };
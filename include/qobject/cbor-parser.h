@@ -0,0 +1,41 @@
+/*
+ * CBOR Parser
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#ifndef CBOR_PARSER_H
+#define CBOR_PARSER_H
+
+/*
+ * Splits a stream of bytes into CBOR items, like JSONMessageParser does
+ * for JSON text, and calls @emit with each item converted to a QObject.
+ * After a syntax error, @emit is called with an error, and all input
+ * received so far is dropped: there is no way to find the start of the
+ * next item in binary data.
+ */
+typedef struct CborMessageParser {
+    void (*emit)(void *opaque, QObject *obj, Error *err);
+    void *opaque;
+    GByteArray *buf;
+    /* Input before @scanned has been split into items, see cbor_scan() */
+    size_t scanned;
+    /* Bytes of the text string at @scanned that are still to come */
+    uint64_t skip;
+    /* Items still to come in each open array or map, innermost last */
+    GArray *open;
+} CborMessageParser;
+
+void cbor_message_parser_init(CborMessageParser *parser,
+                              void (*emit)(void *opaque, QObject *obj,
+                                           Error *err),
+                              void *opaque);
+
+void cbor_message_parser_feed(CborMessageParser *parser,
+                              const void *buffer, size_t size);
+
+void cbor_message_parser_destroy(CborMessageParser *parser);
+
+#endif
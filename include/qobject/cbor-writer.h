@@ -0,0 +1,39 @@
+/*
+ * CBOR Writer
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#ifndef CBOR_WRITER_H
+#define CBOR_WRITER_H
+
+/*
+ * Encodes data as CBOR (RFC 8949), with the same interface as
+ * JSONWriter.  Objects and arrays are written with indefinite length,
+ * so that they can be streamed without knowing their size in advance.
+ */
+
+CborWriter *cbor_writer_new(void);
+const GString *cbor_writer_get(CborWriter *);
+GString *cbor_writer_get_and_free(CborWriter *);
+void cbor_writer_free(CborWriter *);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CborWriter, cbor_writer_free)
+
+void cbor_writer_start_object(CborWriter *, const char *name);
+void cbor_writer_end_object(CborWriter *);
+void cbor_writer_start_array(CborWriter *, const char *name);
+void cbor_writer_end_array(CborWriter *);
+void cbor_writer_bool(CborWriter *, const char *name, bool val);
+void cbor_writer_null(CborWriter *, const char *name);
+void cbor_writer_int64(CborWriter *, const char *name, int64_t val);
+void cbor_writer_uint64(CborWriter *, const char *name, uint64_t val);
+void cbor_writer_double(CborWriter *, const char *name, double val);
+void cbor_writer_str(CborWriter *, const char *name, const char *str);
+
+/* Append @item, which must be a single item that is already encoded */
+void cbor_writer_raw(CborWriter *, const char *name, const GString *item);
+
+#endif
@@ -27,7 +27,9 @@ typedef struct JSONMessageParser {
     JSONLexer lexer;
     int brace_count;
     int bracket_count;
-    GQueue tokens;
+    /* Tokens of the current message, packed one after the other */
+    GByteArray *tokens;
+    uint64_t token_count;
     uint64_t token_size;
 } JSONMessageParser;
 
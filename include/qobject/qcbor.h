@@ -0,0 +1,38 @@
+/*
+ * QObject CBOR integration
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#ifndef QCBOR_H
+#define QCBOR_H
+
+/* Major types, in the top three bits of the initial byte of an item */
+#define CBOR_MAJOR_UINT         0
+#define CBOR_MAJOR_NEGINT       1
+#define CBOR_MAJOR_BYTES        2
+#define CBOR_MAJOR_TEXT         3
+#define CBOR_MAJOR_ARRAY        4
+#define CBOR_MAJOR_MAP          5
+#define CBOR_MAJOR_TAG          6
+#define CBOR_MAJOR_SIMPLE       7
+
+/* Additional information for strings, arrays and maps of unknown length */
+#define CBOR_INDEFINITE         31
+
+#define CBOR_FALSE              0xf4
+#define CBOR_TRUE               0xf5
+#define CBOR_NULL               0xf6
+#define CBOR_FLOAT64            0xfb
+#define CBOR_BREAK              0xff
+
+QObject *qobject_from_cbor(const void *buf, size_t len, Error **errp);
+
+GString *qobject_to_cbor(const QObject *obj);
+
+void cbor_writer_qobject(CborWriter *writer, const char *name,
+                         const QObject *obj);
+
+#endif /* QCBOR_H */
@@ -0,0 +1,68 @@
+/*
+ * Pool of event loop threads that share work
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef IOTHREAD_POOL_H
+#define IOTHREAD_POOL_H
+
+#include "block/aio.h"
+#include "qemu/coroutine.h"
+#include "qom/object.h"
+#include "system/iothread.h"
+
+#define TYPE_IOTHREAD_POOL "iothread-pool"
+
+typedef struct IOThreadPool IOThreadPool;
+
+DECLARE_INSTANCE_CHECKER(IOThreadPool, IOTHREAD_POOL,
+                         TYPE_IOTHREAD_POOL)
+
+unsigned iothread_pool_get_size(IOThreadPool *pool);
+
+/* Return the pool that @iothread is a thread of, or NULL */
+IOThreadPool *iothread_get_pool(IOThread *iothread);
+
+/*
+ * The threads of the pool are IOThreads, called "<pool id>/thread<N>".
+ * File descriptors, timers and BHs that are attached to the AioContext of
+ * one of them always run in that thread.
+ */
+IOThread *iothread_pool_get_iothread(IOThreadPool *pool, unsigned index);
+
+/*
+ * iothread_pool_schedule:
+ * @pool: the pool
+ * @cb: the function to run
+ * @opaque: the argument of @cb
+ *
+ * Run @cb once in whichever thread of @pool gets to it first, like a
+ * oneshot BH.  Work scheduled from a thread of the pool is queued in that
+ * thread; other threads of the pool steal it when they have nothing else
+ * to do.  @cb runs with the AioContext of that thread as the current one,
+ * in a defer_call_begin()/defer_call_end() section shared with the work
+ * that runs right before and after it.
+ */
+void iothread_pool_schedule(IOThreadPool *pool, QEMUBHFunc *cb, void *opaque);
+
+/*
+ * iothread_pool_co_enter:
+ * @pool: the pool
+ * @co: a coroutine that has not been entered yet
+ *
+ * Start @co in a thread of @pool, see iothread_pool_schedule().  Once it
+ * has started, @co is bound to the AioContext of that thread like any
+ * other coroutine.
+ */
+void iothread_pool_co_enter(IOThreadPool *pool, Coroutine *co);
+
+/*
+ * Return whether the current thread is a thread of @pool that has queued
+ * work which it has not run yet, so that more work is better left to the
+ * other threads of the pool.
+ */
+bool iothread_pool_backlogged(IOThreadPool *pool);
+
+#endif /* IOTHREAD_POOL_H */
@@ -50,6 +50,13 @@ struct RAMBlock {
     size_t page_size;
     /* dirty bitmap used during migration */
     unsigned long *bmap;
+    /*
+     * Bitmap of the host pages that may have dirty pages in @bmap, with
+     * one bit per host page.  A clear bit means that all target pages of
+     * the host page are clean.  Only allocated on the migration source
+     * for RAMBlocks backed by huge pages.
+     */
+    unsigned long *host_bmap;
 
     /*
      * Below fields are only used by mapped-ram migration
@@ -65,6 +72,12 @@ struct RAMBlock {
 
     /* Bitmap of already received pages.  Only used on destination side. */
     unsigned long *receivedmap;
+    /*
+     * Bitmap of pages requested from the source during postcopy, one bit
+     * per target page but only set for the first target page of each host
+     * page.  Only used on destination side.
+     */
+    unsigned long *requestedmap;
 
     /*
      * bitmap to track already cleared dirty bitmap.  When the bit is
@@ -85,6 +98,15 @@ struct RAMBlock {
     unsigned long *clear_bmap;
     uint8_t clear_bmap_shift;
 
+    /*
+     * Model of the dirty page rate of the block, only used on the
+     * migration source (see migration/convergence.c): pages that the
+     * dirty bitmap syncs found dirty in the current period, and the
+     * smoothed dirty rate in bytes per second.
+     */
+    uint64_t dirty_pages_period;
+    double dirty_rate;
+
     /*
      * RAM block length that corresponds to the used_length on the migration
      * source (after RAM block sizes were synchronized). Especially, after
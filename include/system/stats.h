@@ -9,6 +9,7 @@
 #define STATS_H
 
 #include "qapi/qapi-types-stats.h"
+#include "qemu/host-utils.h"
 
 typedef void StatRetrieveFunc(StatsResultList **result, StatsTarget target,
                               strList *names, strList *targets, Error **errp);
@@ -33,6 +34,41 @@ void add_stats_entry(StatsResultList **, StatsProvider, const char *id,
 void add_stats_schema(StatsSchemaList **, StatsProvider, StatsTarget,
                       StatsSchemaValueList *);
 
+/*
+ * Helper routines for providers with a fixed set of stats.  Both prepend
+ * an entry to @list and return the new head of the list.
+ *
+ * stats_fn must add its stats in the same order as schemas_fn adds their
+ * schemas, because "info stats" walks the two lists side by side.
+ */
+StatsList *add_stats_scalar(StatsList *list, const char *name,
+                            uint64_t value);
+StatsSchemaValueList *add_stats_schema_value(StatsSchemaValueList *list,
+                                             const char *name,
+                                             StatsType type);
+
+/*
+ * Prepend a log2 histogram made of the non-empty prefix of @buckets.
+ * Nothing is added if all @nb_buckets buckets are zero.
+ */
+StatsList *add_stats_histogram(StatsList *list, const char *name,
+                               const uint64_t *buckets, int nb_buckets);
+
+/*
+ * Index of the bucket of a log2 histogram with @nb_buckets buckets that
+ * counts @value.  Bucket i counts values in [2^i, 2^(i+1)), except that
+ * the first bucket also counts values below 1 and the last one counts
+ * everything above its range.
+ */
+static inline int stats_log2_bucket(int64_t value, int nb_buckets)
+{
+    return MIN(value > 0 ? 63 - clz64(value) : 0, nb_buckets - 1);
+}
+
+/* Schema of a log2 histogram of latencies in nanoseconds */
+StatsSchemaValueList *add_stats_schema_latency(StatsSchemaValueList *list,
+                                               const char *name);
+
 /*
  * True if a string matches the filter passed to the stats_fn callback,
  * false otherwise.
@@ -42,4 +78,13 @@ void add_stats_schema(StatsSchemaList **, StatsProvider, StatsTarget,
  */
 bool apply_str_list_filter(const char *string, strList *list);
 
+/* Register the "rcu" provider */
+void rcu_stats_init(void);
+
+/* Register the "coroutine" provider */
+void coroutine_stats_init(void);
+
+/* Register the "thread-pool" provider */
+void thread_pool_stats_init(void);
+
 #endif /* STATS_H */
@@ -0,0 +1,417 @@
+/*
+ * Pool of event loop threads that share work
+ *
+ * Each thread of the pool is an IOThread with its own AioContext, so that
+ * file descriptors keep being polled by the thread they were attached to.
+ * In addition, each thread has a run queue of work items: BHs, for example
+ * virtio-blk requests to submit, and coroutines that have not started yet.
+ * They are queued in the thread that schedules them, which keeps them
+ * local while that thread keeps up.
+ * A thread that has nothing to run steals half of the queue of the
+ * busiest thread, so that bursts of work spread over the whole pool.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qom/object.h"
+#include "qom/object_interfaces.h"
+#include "qemu/defer-call.h"
+#include "qemu/module.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "block/aio.h"
+#include "system/iothread.h"
+#include "system/iothread-pool.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "trace/trace-root.h"
+
+#define IOTHREAD_POOL_MAX_SIZE 256
+
+/* Work items that a thread runs before going back to its event loop */
+#define IOTHREAD_POOL_BATCH 64
+
+typedef struct IOThreadPoolWork {
+    QEMUBHFunc *cb;
+    void *opaque;
+    QSIMPLEQ_ENTRY(IOThreadPoolWork) next;
+} IOThreadPoolWork;
+
+typedef QSIMPLEQ_HEAD(, IOThreadPoolWork) IOThreadPoolWorkQueue;
+
+typedef struct IOThreadPoolMember {
+    IOThreadPool *pool;
+    IOThread *iothread;
+    AioContext *ctx;
+    QEMUBH *run_bh;
+
+    QemuMutex lock;
+    IOThreadPoolWorkQueue queue;    /* protected by lock */
+    unsigned queued;                /* length of queue, atomic */
+    bool active;                    /* run_bh is scheduled or running */
+} IOThreadPoolMember;
+
+struct IOThreadPool {
+    Object parent_obj;
+
+    uint32_t size;
+    IOThreadPoolMember *members;
+    unsigned next_member;           /* for work from outside the pool */
+};
+
+static IOThreadPoolMember *iothread_pool_current_member(IOThreadPool *pool)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    unsigned i;
+
+    for (i = 0; i < pool->size; i++) {
+        if (pool->members[i].ctx == ctx) {
+            return &pool->members[i];
+        }
+    }
+    return NULL;
+}
+
+/* Make @member run its queue, or steal, unless it is doing so already */
+static bool iothread_pool_kick(IOThreadPoolMember *member)
+{
+    if (qatomic_read(&member->active) ||
+        qatomic_xchg(&member->active, true)) {
+        return false;
+    }
+    qemu_bh_schedule(member->run_bh);
+    return true;
+}
+
+static IOThreadPoolWork *iothread_pool_pop(IOThreadPoolMember *member)
+{
+    IOThreadPoolWork *work;
+
+    if (!qatomic_read(&member->queued)) {
+        return NULL;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&member->lock) {
+        work = QSIMPLEQ_FIRST(&member->queue);
+        if (work) {
+            QSIMPLEQ_REMOVE_HEAD(&member->queue, next);
+            qatomic_set(&member->queued, member->queued - 1);
+        }
+    }
+    return work;
+}
+
+/*
+ * Move half of the queue of the busiest other thread to @member's queue
+ * and return the first item.
+ */
+static IOThreadPoolWork *iothread_pool_steal(IOThreadPoolMember *member)
+{
+    IOThreadPool *pool = member->pool;
+    IOThreadPoolMember *victim = NULL;
+    IOThreadPoolWorkQueue stolen = QSIMPLEQ_HEAD_INITIALIZER(stolen);
+    IOThreadPoolWork *work;
+    unsigned max_queued = 0;
+    unsigned i, n = 0;
+
+    for (i = 0; i < pool->size; i++) {
+        unsigned queued = qatomic_read(&pool->members[i].queued);
+
+        if (&pool->members[i] != member && queued > max_queued) {
+            victim = &pool->members[i];
+            max_queued = queued;
+        }
+    }
+    if (!victim) {
+        return NULL;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&victim->lock) {
+        unsigned steal = (victim->queued + 1) / 2;
+
+        while (n < steal) {
+            work = QSIMPLEQ_FIRST(&victim->queue);
+            QSIMPLEQ_REMOVE_HEAD(&victim->queue, next);
+            QSIMPLEQ_INSERT_TAIL(&stolen, work, next);
+            n++;
+        }
+        qatomic_set(&victim->queued, victim->queued - n);
+    }
+
+    work = QSIMPLEQ_FIRST(&stolen);
+    if (!work) {
+        return NULL;
+    }
+    trace_iothread_pool_steal(pool, victim - pool->members,
+                              member - pool->members, n);
+
+    QSIMPLEQ_REMOVE_HEAD(&stolen, next);
+    if (n > 1) {
+        WITH_QEMU_LOCK_GUARD(&member->lock) {
+            QSIMPLEQ_CONCAT(&member->queue, &stolen);
+            qatomic_set(&member->queued, member->queued + n - 1);
+        }
+    }
+    return work;
+}
+
+/* Runs in the thread of @opaque */
+static void iothread_pool_run_bh(void *opaque)
+{
+    IOThreadPoolMember *member = opaque;
+    IOThreadPoolWork *work;
+    int i;
+
+    defer_call_begin(); /* work may use defer_call() to coalesce I/O */
+    for (i = 0; i < IOTHREAD_POOL_BATCH; i++) {
+        work = iothread_pool_pop(member);
+        if (!work) {
+            work = iothread_pool_steal(member);
+        }
+        if (!work) {
+            break;
+        }
+        work->cb(work->opaque);
+        g_free(work);
+    }
+    defer_call_end();
+
+    if (i == IOTHREAD_POOL_BATCH) {
+        /* Let file descriptors and timers of this thread run too */
+        qemu_bh_schedule(member->run_bh);
+        return;
+    }
+
+    qatomic_set(&member->active, false);
+
+    /*
+     * Work queued in the meantime did not kick us.  Pairs with
+     * qatomic_xchg() in iothread_pool_kick().
+     */
+    smp_mb();
+    if (qatomic_read(&member->queued)) {
+        iothread_pool_kick(member);
+    }
+}
+
+void iothread_pool_schedule(IOThreadPool *pool, QEMUBHFunc *cb, void *opaque)
+{
+    IOThreadPoolMember *member = iothread_pool_current_member(pool);
+    IOThreadPoolWork *work = g_new(IOThreadPoolWork, 1);
+    unsigned i;
+
+    if (!member) {
+        i = qatomic_fetch_inc(&pool->next_member);
+        member = &pool->members[i % pool->size];
+    }
+
+    *work = (IOThreadPoolWork) {
+        .cb = cb,
+        .opaque = opaque,
+    };
+    WITH_QEMU_LOCK_GUARD(&member->lock) {
+        QSIMPLEQ_INSERT_TAIL(&member->queue, work, next);
+        qatomic_set(&member->queued, member->queued + 1);
+    }
+
+    if (iothread_pool_kick(member)) {
+        return;
+    }
+
+    /* @member is busy, let an idle thread steal the work */
+    for (i = 1; i < pool->size; i++) {
+        IOThreadPoolMember *other =
+            &pool->members[(member - pool->members + i) % pool->size];
+
+        if (iothread_pool_kick(other)) {
+            return;
+        }
+    }
+}
+
+static void iothread_pool_co_enter_bh(void *opaque)
+{
+    Coroutine *co = opaque;
+
+    aio_co_enter(qemu_get_current_aio_context(), co);
+}
+
+void iothread_pool_co_enter(IOThreadPool *pool, Coroutine *co)
+{
+    iothread_pool_schedule(pool, iothread_pool_co_enter_bh, co);
+}
+
+bool iothread_pool_backlogged(IOThreadPool *pool)
+{
+    IOThreadPoolMember *member = iothread_pool_current_member(pool);
+
+    return member && qatomic_read(&member->queued);
+}
+
+unsigned iothread_pool_get_size(IOThreadPool *pool)
+{
+    return pool->size;
+}
+
+IOThread *iothread_pool_get_iothread(IOThreadPool *pool, unsigned index)
+{
+    assert(index < pool->size);
+    return pool->members[index].iothread;
+}
+
+IOThreadPool *iothread_get_pool(IOThread *iothread)
+{
+    Object *parent = OBJECT(iothread)->parent;
+
+    if (!parent) {
+        return NULL;
+    }
+    return (IOThreadPool *)object_dynamic_cast(parent, TYPE_IOTHREAD_POOL);
+}
+
+static void iothread_pool_complete(UserCreatable *uc, Error **errp)
+{
+    IOThreadPool *pool = IOTHREAD_POOL(uc);
+    unsigned i;
+
+    if (!pool->size || pool->size > IOTHREAD_POOL_MAX_SIZE) {
+        error_setg(errp, "size must be in range [1, %d]",
+                   IOTHREAD_POOL_MAX_SIZE);
+        return;
+    }
+
+    pool->members = g_new0(IOThreadPoolMember, pool->size);
+    for (i = 0; i < pool->size; i++) {
+        IOThreadPoolMember *member = &pool->members[i];
+        g_autofree char *name = g_strdup_printf("thread%u", i);
+        Object *obj;
+
+        member->pool = pool;
+        qemu_mutex_init(&member->lock);
+        QSIMPLEQ_INIT(&member->queue);
+
+        obj = object_new_with_props(TYPE_IOTHREAD, OBJECT(pool), name,
+                                    errp, NULL);
+        if (!obj) {
+            return;
+        }
+        member->iothread = IOTHREAD(obj);
+        member->ctx = iothread_get_aio_context(member->iothread);
+        member->run_bh = aio_bh_new(member->ctx, iothread_pool_run_bh,
+                                    member);
+    }
+}
+
+/* Devices keep references to the threads that they use */
+static bool iothread_pool_can_be_deleted(UserCreatable *uc)
+{
+    IOThreadPool *pool = IOTHREAD_POOL(uc);
+    unsigned i;
+
+    for (i = 0; i < pool->size; i++) {
+        if (OBJECT(pool->members[i].iothread)->ref > 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * The threads must be stopped and the BHs deleted before the IOThreads,
+ * which are children of the pool, go away.
+ */
+static void iothread_pool_unparent(Object *obj)
+{
+    IOThreadPool *pool = IOTHREAD_POOL(obj);
+    IOThreadPoolWork *work;
+    unsigned i;
+
+    if (!pool->members) {
+        return;
+    }
+
+    for (i = 0; i < pool->size; i++) {
+        if (pool->members[i].iothread) {
+            iothread_stop(pool->members[i].iothread);
+        }
+    }
+
+    for (i = 0; i < pool->size; i++) {
+        IOThreadPoolMember *member = &pool->members[i];
+
+        if (member->run_bh) {
+            qemu_bh_delete(member->run_bh);
+        }
+        while ((work = QSIMPLEQ_FIRST(&member->queue))) {
+            QSIMPLEQ_REMOVE_HEAD(&member->queue, next);
+            g_free(work);
+        }
+        if (member->pool) {
+            qemu_mutex_destroy(&member->lock);
+        }
+        if (member->iothread) {
+            object_unparent(OBJECT(member->iothread));
+        }
+    }
+
+    g_free(pool->members);
+    pool->members = NULL;
+}
+
+static void iothread_pool_prop_get_size(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp)
+{
+    IOThreadPool *pool = IOTHREAD_POOL(obj);
+
+    visit_type_uint32(v, name, &pool->size, errp);
+}
+
+static void iothread_pool_prop_set_size(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp)
+{
+    IOThreadPool *pool = IOTHREAD_POOL(obj);
+
+    if (pool->members) {
+        error_setg(errp, "cannot change the size of a running pool");
+        return;
+    }
+    visit_type_uint32(v, name, &pool->size, errp);
+}
+
+static void iothread_pool_class_init(ObjectClass *oc, const void *class_data)
+{
+    UserCreatableClass *ucc = USER_CREATABLE_CLASS(oc);
+
+    ucc->complete = iothread_pool_complete;
+    ucc->can_be_deleted = iothread_pool_can_be_deleted;
+    oc->unparent = iothread_pool_unparent;
+
+    object_class_property_add(oc, "size", "uint32",
+                              iothread_pool_prop_get_size,
+                              iothread_pool_prop_set_size,
+                              NULL, NULL);
+    object_class_property_set_description(oc, "size",
+                                          "Number of threads in the pool");
+}
+
+static const TypeInfo iothread_pool_info = {
+    .name = TYPE_IOTHREAD_POOL,
+    .parent = TYPE_OBJECT,
+    .class_init = iothread_pool_class_init,
+    .instance_size = sizeof(IOThreadPool),
+    .interfaces = (const InterfaceInfo[]) {
+        { TYPE_USER_CREATABLE },
+        { }
+    },
+};
+
+static void iothread_pool_register_types(void)
+{
+    type_register_static(&iothread_pool_info);
+}
+
+type_init(iothread_pool_register_types)
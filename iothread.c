@@ -19,6 +19,7 @@
 #include "block/block.h"
 #include "system/event-loop-base.h"
 #include "system/iothread.h"
+#include "system/iothread-pool.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-misc.h"
 #include "qemu/error-report.h"
@@ -331,7 +332,16 @@ type_init(iothread_register_types)
 
 char *iothread_get_id(IOThread *iothread)
 {
-    return g_strdup(object_get_canonical_path_component(OBJECT(iothread)));
+    IOThreadPool *pool = iothread_get_pool(iothread);
+    const char *id = object_get_canonical_path_component(OBJECT(iothread));
+
+    /* The threads of a pool are called "<pool id>/thread<N>" */
+    if (pool) {
+        const char *pool_id = object_get_canonical_path_component(OBJECT(pool));
+
+        return g_strdup_printf("%s/%s", pool_id, id);
+    }
+    return g_strdup(id);
 }
 
 AioContext *iothread_get_aio_context(IOThread *iothread)
@@ -345,6 +355,10 @@ static int query_one_iothread(Object *object, void *opaque)
     IOThreadInfo *info;
     IOThread *iothread;
 
+    if (object_dynamic_cast(object, TYPE_IOTHREAD_POOL)) {
+        return object_child_foreach(object, query_one_iothread, opaque);
+    }
+
     iothread = (IOThread *)object_dynamic_cast(object, TYPE_IOTHREAD);
     if (!iothread) {
         return 0;
@@ -14,6 +14,7 @@
 #include "channel.h"
 #include "tls.h"
 #include "migration.h"
+#include "options.h"
 #include "qemu-file.h"
 #include "trace.h"
 #include "qapi/error.h"
@@ -56,6 +57,16 @@ void migration_channel_process_incoming(QIOChannel *ioc)
 }
 
 
+/*
+ * With multifd, RAM pages go through the multifd channels, which use zero
+ * copy themselves.  Otherwise they go through the main channel, which
+ * socket_outgoing_migration() checked for zero copy support.
+ */
+static bool migration_main_channel_zero_copy(void)
+{
+    return migrate_zero_copy_send() && !migrate_multifd();
+}
+
 /**
  * @migration_channel_connect - Create new outgoing migration channel
  *
@@ -87,6 +98,9 @@ void migration_channel_connect(MigrationState *s,
         } else {
             QEMUFile *f = qemu_file_new_output(ioc);
 
+            if (migration_main_channel_zero_copy()) {
+                qemu_file_set_zero_copy(f);
+            }
             migration_ioc_register_yank(ioc);
 
             qemu_mutex_lock(&s->qemu_file_lock);
@@ -0,0 +1,284 @@
+/*
+ * COLO incremental device state
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/units.h"
+#include "colo-delta.h"
+#include "qemu-file.h"
+#include "trace.h"
+
+/*
+ * With x-colo-incremental-vmstate, the device state of a checkpoint is
+ * sent as one chunk per section, plus a last chunk for the end of the
+ * stream.  Chunks that did not change since the previous checkpoint are
+ * not sent, and large chunks that kept their size only have the blocks
+ * that changed sent.  Both sides keep the device state of the previous
+ * checkpoint around to apply this against.
+ */
+#define COLO_DELTA_BLOCK_SIZE       256
+#define COLO_DELTA_MIN_BLOCKS_SIZE  (4 * KiB)
+
+enum {
+    COLO_DELTA_SAME,
+    COLO_DELTA_FULL,
+    COLO_DELTA_BLOCKS,
+};
+
+void colo_delta_init(ColoVmstateDelta *d)
+{
+    d->ends = g_array_new(false, false, sizeof(uint64_t));
+    d->next_ends = g_array_new(false, false, sizeof(uint64_t));
+}
+
+void colo_delta_cleanup(ColoVmstateDelta *d)
+{
+    g_free(d->data);
+    g_array_free(d->ends, true);
+    g_array_free(d->next_ends, true);
+    *d = (ColoVmstateDelta) { };
+}
+
+/*
+ * Forget the sections of the previous device state and of the checkpoint
+ * being processed, for example because the checkpoint failed half way.
+ * The next checkpoint then sends all of its device state.
+ */
+void colo_delta_reset(ColoVmstateDelta *d)
+{
+    g_array_set_size(d->ends, 0);
+    g_array_set_size(d->next_ends, 0);
+}
+
+static uint64_t colo_delta_chunk_start(GArray *ends, unsigned int i)
+{
+    return i ? g_array_index(ends, uint64_t, i - 1) : 0;
+}
+
+/* Make the checkpoint that was just processed the previous one */
+static void colo_delta_commit(ColoVmstateDelta *d, QIOChannelBuffer *bioc)
+{
+    uint8_t *data = bioc->data;
+    size_t capacity = bioc->capacity;
+    GArray *ends = d->ends;
+
+    bioc->data = d->data;
+    bioc->capacity = d->capacity;
+    d->data = data;
+    d->capacity = capacity;
+
+    d->ends = d->next_ends;
+    d->next_ends = ends;
+    g_array_set_size(d->next_ends, 0);
+}
+
+/*
+ * Find the next run of blocks that differ between @old and @new, starting
+ * at *@pos.  Returns false if there is none.
+ */
+static bool colo_delta_next_run(const uint8_t *old, const uint8_t *new,
+                                uint64_t len, uint64_t *pos, uint64_t *run_len)
+{
+    uint64_t start = *pos, end;
+
+    while (start < len) {
+        uint64_t n = MIN(COLO_DELTA_BLOCK_SIZE, len - start);
+
+        if (memcmp(old + start, new + start, n)) {
+            break;
+        }
+        start += n;
+    }
+    if (start >= len) {
+        return false;
+    }
+
+    for (end = start; end < len; ) {
+        uint64_t n = MIN(COLO_DELTA_BLOCK_SIZE, len - end);
+
+        if (!memcmp(old + end, new + end, n)) {
+            break;
+        }
+        end += n;
+    }
+
+    *pos = start;
+    *run_len = end - start;
+    return true;
+}
+
+/*
+ * Send the device state in @bioc as changes against the device state of
+ * the previous checkpoint.  @d->next_ends holds where its sections end.
+ */
+void colo_delta_put(ColoVmstateDelta *d, QEMUFile *f, QIOChannelBuffer *bioc,
+                    Error **errp)
+{
+    uint64_t start = 0, end = bioc->usage, sent = 0;
+    unsigned int i, nr_same = 0, nr_blocks = 0;
+    int ret;
+
+    /* The last chunk is the end of the stream */
+    g_array_append_val(d->next_ends, end);
+    qemu_put_be32(f, d->next_ends->len);
+
+    for (i = 0; i < d->next_ends->len; i++) {
+        const uint8_t *buf = bioc->data + start;
+        uint64_t len = g_array_index(d->next_ends, uint64_t, i) - start;
+        const uint8_t *prev = NULL;
+        uint64_t prev_len = 0;
+
+        start += len;
+
+        if (i < d->ends->len) {
+            uint64_t prev_start = colo_delta_chunk_start(d->ends, i);
+
+            prev = d->data + prev_start;
+            prev_len = g_array_index(d->ends, uint64_t, i) - prev_start;
+        }
+
+        if (prev && len == prev_len) {
+            uint64_t pos, run_len, nr_runs = 0, run_bytes = 0;
+
+            if (!memcmp(buf, prev, len)) {
+                qemu_put_byte(f, COLO_DELTA_SAME);
+                nr_same++;
+                continue;
+            }
+
+            if (len >= COLO_DELTA_MIN_BLOCKS_SIZE) {
+                for (pos = 0; colo_delta_next_run(prev, buf, len, &pos,
+                                                  &run_len); pos += run_len) {
+                    nr_runs++;
+                    run_bytes += run_len;
+                }
+            }
+
+            if (nr_runs && run_bytes + nr_runs * 16 < len) {
+                qemu_put_byte(f, COLO_DELTA_BLOCKS);
+                qemu_put_be64(f, nr_runs);
+                for (pos = 0; colo_delta_next_run(prev, buf, len, &pos,
+                                                  &run_len); pos += run_len) {
+                    qemu_put_be64(f, pos);
+                    qemu_put_be64(f, run_len);
+                    qemu_put_buffer(f, buf + pos, run_len);
+                }
+                sent += run_bytes;
+                nr_blocks++;
+                continue;
+            }
+        }
+
+        qemu_put_byte(f, COLO_DELTA_FULL);
+        qemu_put_be64(f, len);
+        qemu_put_buffer(f, buf, len);
+        sent += len;
+    }
+
+    ret = qemu_fflush(f);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to send VMstate delta");
+        return;
+    }
+
+    trace_colo_delta_put(bioc->usage, sent, d->next_ends->len, nr_same,
+                         nr_blocks);
+    colo_delta_commit(d, bioc);
+}
+
+/*
+ * Receive a device state of @size bytes sent as changes against the
+ * device state of the previous checkpoint, which is still in @bioc, and
+ * put it into @bioc.
+ */
+void colo_delta_get(ColoVmstateDelta *d, QEMUFile *f, QIOChannelBuffer *bioc,
+                    uint64_t size, Error **errp)
+{
+    uint64_t start = 0;
+    uint32_t i, nr_chunks;
+
+    if (size > d->capacity) {
+        d->capacity = size;
+        d->data = g_realloc(d->data, d->capacity);
+    }
+    g_array_set_size(d->next_ends, 0);
+
+    nr_chunks = qemu_get_be32(f);
+    for (i = 0; i < nr_chunks && !qemu_file_get_error(f); i++) {
+        uint8_t type = qemu_get_byte(f);
+        uint64_t len, prev_start = 0, nr_runs;
+
+        switch (type) {
+        case COLO_DELTA_SAME:
+        case COLO_DELTA_BLOCKS:
+            if (i >= d->ends->len) {
+                error_setg(errp, "COLO: VMstate delta chunk %u has no "
+                           "previous state", i);
+                return;
+            }
+            prev_start = colo_delta_chunk_start(d->ends, i);
+            len = g_array_index(d->ends, uint64_t, i) - prev_start;
+            break;
+        case COLO_DELTA_FULL:
+            len = qemu_get_be64(f);
+            break;
+        default:
+            error_setg(errp, "COLO: Unknown VMstate delta chunk type %d",
+                       type);
+            return;
+        }
+
+        if (len > size - start) {
+            error_setg(errp, "COLO: VMstate delta is larger than expected "
+                       "%" PRIu64, size);
+            return;
+        }
+
+        if (type == COLO_DELTA_FULL) {
+            if (qemu_get_buffer(f, d->data + start, len) != len) {
+                break;
+            }
+        } else {
+            memcpy(d->data + start, bioc->data + prev_start, len);
+        }
+
+        if (type == COLO_DELTA_BLOCKS) {
+            for (nr_runs = qemu_get_be64(f); nr_runs; nr_runs--) {
+                uint64_t pos = qemu_get_be64(f);
+                uint64_t run_len = qemu_get_be64(f);
+
+                if (pos > len || run_len > len - pos) {
+                    error_setg(errp, "COLO: VMstate delta chunk %u has "
+                               "invalid run at %" PRIu64, i, pos);
+                    return;
+                }
+                if (qemu_get_buffer(f, d->data + start + pos, run_len) !=
+                    run_len) {
+                    break;
+                }
+            }
+        }
+
+        start += len;
+        g_array_append_val(d->next_ends, start);
+    }
+
+    if (qemu_file_get_error(f)) {
+        error_setg_errno(errp, -qemu_file_get_error(f),
+                         "Failed to receive VMstate delta");
+        return;
+    }
+    if (start != size) {
+        error_setg(errp, "Got %" PRIu64 " VMState data, less than expected"
+                   " %" PRIu64, start, size);
+        return;
+    }
+
+    colo_delta_commit(d, bioc);
+    bioc->usage = size;
+}
+
@@ -0,0 +1,36 @@
+/*
+ * COLO incremental device state
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_COLO_DELTA_H
+#define QEMU_MIGRATION_COLO_DELTA_H
+
+#include "io/channel-buffer.h"
+
+typedef struct ColoVmstateDelta {
+    /*
+     * Swapped with the data of the channel buffer after each checkpoint.
+     * On the primary side it then holds the device state that was sent,
+     * on the secondary side the previous state is still in the channel
+     * buffer, and this is where the next one is put together.
+     */
+    uint8_t *data;
+    size_t capacity;
+    /* Where each chunk of the previous device state ends */
+    GArray *ends;
+    /* Same, for the device state of the checkpoint being processed */
+    GArray *next_ends;
+} ColoVmstateDelta;
+
+void colo_delta_init(ColoVmstateDelta *d);
+void colo_delta_cleanup(ColoVmstateDelta *d);
+void colo_delta_reset(ColoVmstateDelta *d);
+void colo_delta_put(ColoVmstateDelta *d, QEMUFile *f, QIOChannelBuffer *bioc,
+                    Error **errp);
+void colo_delta_get(ColoVmstateDelta *d, QEMUFile *f, QIOChannelBuffer *bioc,
+                    uint64_t size, Error **errp);
+
+#endif
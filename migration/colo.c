@@ -19,6 +19,7 @@
 #include "savevm.h"
 #include "migration/colo.h"
 #include "io/channel-buffer.h"
+#include "colo-delta.h"
 #include "trace.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
@@ -43,6 +44,9 @@ static COLOMode last_colo_mode;
 
 #define COLO_BUFFER_BASE_SIZE (4 * 1024 * 1024)
 
+/* Device state of the previous checkpoint, with x-colo-incremental-vmstate */
+static ColoVmstateDelta colo_delta;
+
 bool migration_in_colo_state(void)
 {
     MigrationState *s = migrate_get_current();
@@ -380,26 +384,19 @@ static void colo_receive_check_message(QEMUFile *f, COLOMessage expect_msg,
     }
 }
 
-static uint64_t colo_receive_message_value(QEMUFile *f, uint32_t expect_msg,
-                                           Error **errp)
+static void colo_send_vmstate_delta(QEMUFile *f, QIOChannelBuffer *bioc,
+                                    Error **errp)
 {
     Error *local_err = NULL;
-    uint64_t value;
-    int ret;
 
-    colo_receive_check_message(f, expect_msg, &local_err);
+    colo_send_message_value(f, COLO_MESSAGE_VMSTATE_DELTA, bioc->usage,
+                            &local_err);
     if (local_err) {
         error_propagate(errp, local_err);
-        return 0;
+        return;
     }
 
-    value = qemu_get_be64(f);
-    ret = qemu_file_get_error(f);
-    if (ret < 0) {
-        error_setg_errno(errp, -ret, "Failed to get value for COLO message: %s",
-                         COLOMessage_str(expect_msg));
-    }
-    return value;
+    colo_delta_put(&colo_delta, f, bioc, errp);
 }
 
 static int colo_do_checkpoint_transaction(MigrationState *s,
@@ -456,7 +453,8 @@ static int colo_do_checkpoint_transaction(MigrationState *s,
     qemu_savevm_maybe_send_switchover_start(s->to_dst_file);
 
     /* Note: device state is saved into buffer */
-    ret = qemu_save_device_state(fb);
+    ret = qemu_save_device_state(fb, migrate_colo_incremental_vmstate() ?
+                                 colo_delta.next_ends : NULL);
 
     bql_unlock();
     if (ret < 0) {
@@ -475,20 +473,31 @@ static int colo_do_checkpoint_transaction(MigrationState *s,
 
     qemu_fflush(fb);
 
-    /*
-     * We need the size of the VMstate data in Secondary side,
-     * With which we can decide how much data should be read.
-     */
-    colo_send_message_value(s->to_dst_file, COLO_MESSAGE_VMSTATE_SIZE,
-                            bioc->usage, &local_err);
-    if (local_err) {
-        goto out;
-    }
+    if (migrate_colo_incremental_vmstate()) {
+        colo_send_vmstate_delta(s->to_dst_file, bioc, &local_err);
+        if (local_err) {
+            ret = -1;
+            goto out;
+        }
+    } else {
+        /* The secondary side won't know the sections of this one */
+        g_array_set_size(colo_delta.ends, 0);
+
+        /*
+         * We need the size of the VMstate data in Secondary side,
+         * With which we can decide how much data should be read.
+         */
+        colo_send_message_value(s->to_dst_file, COLO_MESSAGE_VMSTATE_SIZE,
+                                bioc->usage, &local_err);
+        if (local_err) {
+            goto out;
+        }
 
-    qemu_put_buffer(s->to_dst_file, bioc->data, bioc->usage);
-    ret = qemu_fflush(s->to_dst_file);
-    if (ret < 0) {
-        goto out;
+        qemu_put_buffer(s->to_dst_file, bioc->data, bioc->usage);
+        ret = qemu_fflush(s->to_dst_file);
+        if (ret < 0) {
+            goto out;
+        }
     }
 
     colo_receive_check_message(s->rp_state.from_dst_file,
@@ -517,6 +526,10 @@ static int colo_do_checkpoint_transaction(MigrationState *s,
     trace_colo_vm_state_change("stop", "run");
 
 out:
+    if (ret < 0 || local_err) {
+        /* Sections saved for this checkpoint must not leak into the next */
+        colo_delta_reset(&colo_delta);
+    }
     if (local_err) {
         error_report_err(local_err);
     }
@@ -563,6 +576,7 @@ static void colo_process_checkpoint(MigrationState *s)
     bioc = qio_channel_buffer_new(COLO_BUFFER_BASE_SIZE);
     fb = qemu_file_new_output(QIO_CHANNEL(bioc));
     object_unref(OBJECT(bioc));
+    colo_delta_init(&colo_delta);
 
     bql_lock();
     replication_start_all(REPLICATION_MODE_PRIMARY, &local_err);
@@ -603,6 +617,7 @@ out:
 
     if (fb) {
         qemu_fclose(fb);
+        colo_delta_cleanup(&colo_delta);
     }
 
     /*
@@ -661,6 +676,7 @@ static void colo_incoming_process_checkpoint(MigrationIncomingState *mis,
 {
     uint64_t total_size;
     uint64_t value;
+    COLOMessage msg;
     Error *local_err = NULL;
     int ret;
 
@@ -694,29 +710,53 @@ static void colo_incoming_process_checkpoint(MigrationIncomingState *mis,
         return;
     }
 
-    value = colo_receive_message_value(mis->from_src_file,
-                             COLO_MESSAGE_VMSTATE_SIZE, &local_err);
+    msg = colo_receive_message(mis->from_src_file, &local_err);
     if (local_err) {
         error_propagate(errp, local_err);
         return;
     }
-
-    /*
-     * Read VM device state data into channel buffer,
-     * It's better to re-use the memory allocated.
-     * Here we need to handle the channel buffer directly.
-     */
-    if (value > bioc->capacity) {
-        bioc->capacity = value;
-        bioc->data = g_realloc(bioc->data, bioc->capacity);
-    }
-    total_size = qemu_get_buffer(mis->from_src_file, bioc->data, value);
-    if (total_size != value) {
-        error_setg(errp, "Got %" PRIu64 " VMState data, less than expected"
-                    " %" PRIu64, total_size, value);
+    if (msg != COLO_MESSAGE_VMSTATE_SIZE &&
+        msg != COLO_MESSAGE_VMSTATE_DELTA) {
+        error_setg(errp, "Unexpected COLO message %d, expected %d or %d",
+                   msg, COLO_MESSAGE_VMSTATE_SIZE, COLO_MESSAGE_VMSTATE_DELTA);
         return;
     }
-    bioc->usage = total_size;
+    value = qemu_get_be64(mis->from_src_file);
+    ret = qemu_file_get_error(mis->from_src_file);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to get value for COLO message: %s",
+                         COLOMessage_str(msg));
+        return;
+    }
+
+    if (msg == COLO_MESSAGE_VMSTATE_DELTA) {
+        colo_delta_get(&colo_delta, mis->from_src_file, bioc, value,
+                       &local_err);
+        if (local_err) {
+            colo_delta_reset(&colo_delta);
+            error_propagate(errp, local_err);
+            return;
+        }
+    } else {
+        /*
+         * Read VM device state data into channel buffer,
+         * It's better to re-use the memory allocated.
+         * Here we need to handle the channel buffer directly.
+         */
+        if (value > bioc->capacity) {
+            bioc->capacity = value;
+            bioc->data = g_realloc(bioc->data, bioc->capacity);
+        }
+        total_size = qemu_get_buffer(mis->from_src_file, bioc->data, value);
+        if (total_size != value) {
+            error_setg(errp, "Got %" PRIu64 " VMState data, less than expected"
+                        " %" PRIu64, total_size, value);
+            return;
+        }
+        bioc->usage = total_size;
+        /* Without its sections, no delta can be applied to this one */
+        g_array_set_size(colo_delta.ends, 0);
+    }
     qio_channel_io_seek(QIO_CHANNEL(bioc), 0, 0, NULL);
 
     colo_send_message(mis->to_src_file, COLO_MESSAGE_VMSTATE_RECEIVED,
@@ -866,6 +906,7 @@ static void *colo_process_incoming_thread(void *opaque)
     bioc = qio_channel_buffer_new(COLO_BUFFER_BASE_SIZE);
     fb = qemu_file_new_input(QIO_CHANNEL(bioc));
     object_unref(OBJECT(bioc));
+    colo_delta_init(&colo_delta);
 
     bql_lock();
     replication_start_all(REPLICATION_MODE_SECONDARY, &local_err);
@@ -920,6 +961,7 @@ out:
 
     if (fb) {
         qemu_fclose(fb);
+        colo_delta_cleanup(&colo_delta);
     }
 
     /* Hope this not to be too long to loop here */
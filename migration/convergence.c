@@ -0,0 +1,222 @@
+/*
+ * Migration convergence model and controller
+ *
+ * The model predicts when precopy will be able to switch over, from the
+ * bandwidth of the migration link and from the rate at which the guest
+ * dirties each RAM block.  Each round of precopy sends what is dirty at
+ * its start, while the guest dirties more; a block can never have more
+ * dirty data than its size, so small blocks that are written all the time
+ * stop adding to the dirty data after a while.
+ *
+ * The controller acts on the prediction: when migration is not predicted
+ * to converge, it starts postcopy or slows down the guest, depending on
+ * the capabilities that are enabled.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/rcu_queue.h"
+#include "qemu/timer.h"
+#include "exec/target_page.h"
+#include "system/ramblock.h"
+#include "convergence.h"
+#include "migration.h"
+#include "options.h"
+#include "ram.h"
+#include "trace.h"
+
+/* Give up predicting after that many rounds */
+#define CONVERGENCE_MAX_ROUNDS 32
+
+static struct {
+    /* Bandwidth of the migration link in bytes per ms, 0 until measured */
+    double bandwidth;
+    /* QEMU_CLOCK_REALTIME time of the predicted switchover, or -1 */
+    int64_t switchover_time;
+    MigrationConvergenceAction action;
+} convergence;
+
+void migration_convergence_reset(void)
+{
+    convergence.bandwidth = 0;
+    convergence.switchover_time = -1;
+    convergence.action = MIGRATION_CONVERGENCE_ACTION_NONE;
+}
+
+/*
+ * Account the bandwidth measured over the last @time_spent ms.
+ */
+void migration_convergence_update_bandwidth(double bandwidth,
+                                            int64_t time_spent)
+{
+    /*
+     * Near the end of a round the source runs out of dirty pages and
+     * the link idles, so the measured bandwidth drops.  Keep the
+     * estimate of what the link can do instead.
+     */
+    if (convergence.bandwidth &&
+        ram_bytes_remaining() < convergence.bandwidth * time_spent) {
+        return;
+    }
+
+    if (!convergence.bandwidth) {
+        convergence.bandwidth = bandwidth;
+    } else {
+        convergence.bandwidth = (convergence.bandwidth * 3 + bandwidth) / 4;
+    }
+}
+
+/* Called with RCU critical section */
+static void migration_convergence_predict(void)
+{
+    uint64_t switchover_bw = migrate_avail_switchover_bandwidth();
+    double bandwidth = convergence.bandwidth;
+    double remaining = ram_bytes_remaining();
+    double threshold, elapsed = 0;
+    RAMBlock *block;
+    int round;
+
+    convergence.switchover_time = -1;
+    if (!bandwidth) {
+        return;
+    }
+
+    /* Same as migration_update_counters() */
+    threshold = (switchover_bw ? switchover_bw / 1000.0 : bandwidth) *
+                migrate_downtime_limit();
+
+    for (round = 0; round < CONVERGENCE_MAX_ROUNDS; round++) {
+        double time, dirty = 0;
+
+        if (remaining <= threshold) {
+            convergence.switchover_time =
+                qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + elapsed;
+            break;
+        }
+
+        /* Time to send what is dirty now, in ms */
+        time = remaining / bandwidth;
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            dirty += MIN(block->dirty_rate * time / 1000,
+                         (double)block->used_length);
+        }
+        if (dirty >= remaining) {
+            /* The guest dirties memory as fast as we send it */
+            break;
+        }
+
+        elapsed += time;
+        remaining = dirty;
+    }
+
+    trace_migration_convergence_predict(bandwidth, ram_bytes_remaining(),
+                                        convergence.switchover_time < 0 ? -1 :
+                                        (int64_t)elapsed);
+}
+
+/*
+ * Account the dirty pages that the bitmap syncs of the last @period ms
+ * found in each RAM block, and update the prediction.
+ */
+void migration_convergence_update_dirty(int64_t period)
+{
+    size_t page_size = qemu_target_page_size();
+    RAMBlock *block;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            double rate = (double)block->dirty_pages_period * page_size *
+                          1000 / period;
+
+            if (!block->dirty_rate) {
+                block->dirty_rate = rate;
+            } else {
+                block->dirty_rate = (block->dirty_rate + rate) / 2;
+            }
+            block->dirty_pages_period = 0;
+        }
+
+        migration_convergence_predict();
+    }
+}
+
+static void migration_convergence_set_action(MigrationConvergenceAction action)
+{
+    if (action != convergence.action) {
+        trace_migration_convergence_action(
+            MigrationConvergenceAction_str(action));
+    }
+    convergence.action = action;
+}
+
+/*
+ * Decide how to make migration converge, after the dirty rates have
+ * been updated.  Postcopy is started here; throttling the guest is left
+ * to the caller.
+ */
+MigrationConvergenceAction migration_convergence_decide(void)
+{
+    MigrationState *s = migrate_get_current();
+    MigrationConvergenceAction action = MIGRATION_CONVERGENCE_ACTION_NONE;
+
+    if (!convergence.bandwidth || convergence.switchover_time >= 0) {
+        /* Nothing measured yet, or converging on its own */
+    } else if (migrate_postcopy_ram()) {
+        /* Bounds downtime without slowing down the guest until then */
+        action = MIGRATION_CONVERGENCE_ACTION_POSTCOPY;
+        qatomic_set(&s->start_postcopy, true);
+    } else if (migrate_dirty_limit()) {
+        /* Only slows down the vCPUs that dirty memory */
+        action = MIGRATION_CONVERGENCE_ACTION_DIRTY_LIMIT;
+    } else if (migrate_auto_converge()) {
+        action = MIGRATION_CONVERGENCE_ACTION_THROTTLE;
+    }
+
+    migration_convergence_set_action(action);
+    return action;
+}
+
+/*
+ * Pending size below which the downtime fits in the downtime limit, at
+ * the bandwidth that the link has shown.  This can be larger than the
+ * threshold that the last iteration measured, when the source ran out
+ * of dirty pages during it.
+ */
+uint64_t migration_convergence_threshold(void)
+{
+    /* The user knows better, see migration_update_counters() */
+    if (migrate_avail_switchover_bandwidth()) {
+        return 0;
+    }
+
+    return convergence.bandwidth * migrate_downtime_limit();
+}
+
+/*
+ * Record that the switchover started earlier than the last iteration's
+ * threshold allowed, thanks to migration_convergence_threshold().
+ */
+void migration_convergence_switchover(void)
+{
+    migration_convergence_set_action(MIGRATION_CONVERGENCE_ACTION_SWITCHOVER);
+}
+
+void migration_convergence_populate(MigrationInfo *info)
+{
+    MigrationState *s = migrate_get_current();
+
+    if (s->state == MIGRATION_STATUS_ACTIVE &&
+        convergence.switchover_time >= 0) {
+        info->has_predicted_switchover_time = true;
+        info->predicted_switchover_time =
+            MAX(convergence.switchover_time -
+                qemu_clock_get_ms(QEMU_CLOCK_REALTIME), 0);
+    }
+
+    if (migrate_convergence_control()) {
+        info->has_convergence_action = true;
+        info->convergence_action = convergence.action;
+    }
+}
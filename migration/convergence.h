@@ -0,0 +1,22 @@
+/*
+ * Migration convergence model and controller
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_CONVERGENCE_H
+#define QEMU_MIGRATION_CONVERGENCE_H
+
+#include "qapi/qapi-types-migration.h"
+
+void migration_convergence_reset(void);
+void migration_convergence_update_bandwidth(double bandwidth,
+                                            int64_t time_spent);
+void migration_convergence_update_dirty(int64_t period);
+MigrationConvergenceAction migration_convergence_decide(void);
+void migration_convergence_switchover(void);
+uint64_t migration_convergence_threshold(void);
+void migration_convergence_populate(MigrationInfo *info);
+
+#endif
@@ -108,6 +108,22 @@ void file_start_outgoing_migration(MigrationState *s,
         return;
     }
 
+    /*
+     * Guest memory that was lazily loaded from a migration file may still
+     * be mapped from it, by this process or another one, which then holds
+     * a shared lock on it.  Writing or truncating the file would change or
+     * take away that memory.
+     */
+    if (qemu_has_ofd_lock()) {
+        int ret = qemu_lock_fd(fioc->fd, 0, 0, true);
+
+        if (ret == -EAGAIN || ret == -EACCES) {
+            error_setg(errp, "migration file %s is in use, guest memory "
+                       "may be mapped from it", filename);
+            return;
+        }
+    }
+
     if (ftruncate(fioc->fd, offset)) {
         error_setg_errno(errp, errno,
                          "failed to truncate migration file to offset %" PRIx64,
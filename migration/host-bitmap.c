@@ -0,0 +1,54 @@
+/*
+ * Dirty bitmap search for RAM backed by huge pages
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "host-bitmap.h"
+
+/**
+ * host_bitmap_find_next_dirty: find the next dirty page in a dirty bitmap
+ *
+ * Returns the index of the first page set in @bmap between @start and
+ * @size, or @size if there is none.
+ *
+ * Only the host pages that are marked in @host_bmap are searched, and the
+ * host pages that turn out to be clean get unmarked.  A host page is only
+ * unmarked if all of it was searched, so that its pages before @start or
+ * after @size are not forgotten.
+ *
+ * @bmap: dirty bitmap, one bit per target page
+ * @host_bmap: one bit per host page, set if it may have dirty pages
+ * @shift: log2 of the number of target pages in a host page
+ * @size: page where the search stops
+ * @start: page where we start the search
+ */
+unsigned long host_bitmap_find_next_dirty(const unsigned long *bmap,
+                                          unsigned long *host_bmap,
+                                          unsigned int shift,
+                                          unsigned long size,
+                                          unsigned long start)
+{
+    unsigned long hp, nr_hps = DIV_ROUND_UP(size, 1UL << shift);
+
+    for (hp = find_next_bit(host_bmap, nr_hps, start >> shift);
+         hp < nr_hps;
+         hp = find_next_bit(host_bmap, nr_hps, hp + 1)) {
+        unsigned long first = hp << shift;
+        unsigned long end = MIN(first + (1UL << shift), size);
+        unsigned long page = find_next_bit(bmap, end, MAX(start, first));
+
+        if (page < end) {
+            return page;
+        }
+
+        if (start <= first && end == first + (1UL << shift)) {
+            clear_bit(hp, host_bmap);
+        }
+    }
+
+    return size;
+}
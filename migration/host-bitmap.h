@@ -0,0 +1,17 @@
+/*
+ * Dirty bitmap search for RAM backed by huge pages
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_HOST_BITMAP_H
+#define QEMU_MIGRATION_HOST_BITMAP_H
+
+unsigned long host_bitmap_find_next_dirty(const unsigned long *bmap,
+                                          unsigned long *host_bmap,
+                                          unsigned int shift,
+                                          unsigned long size,
+                                          unsigned long start);
+
+#endif
@@ -88,6 +88,10 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                 monitor_printf(mon, ", exp_down=%" PRIu64,
                                info->expected_downtime);
             }
+            if (info->has_predicted_switchover_time) {
+                monitor_printf(mon, ", pred_switchover=%" PRId64,
+                               info->predicted_switchover_time);
+            }
             if (info->has_downtime) {
                 monitor_printf(mon, ", down=%" PRIu64,
                                info->downtime);
@@ -199,6 +203,12 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->dirty_limit_ring_full_time);
     }
 
+    if (info->has_convergence_action) {
+        monitor_printf(mon, "Convergence action: %s\n",
+                       MigrationConvergenceAction_str(
+                           info->convergence_action));
+    }
+
     if (info->has_postcopy_blocktime) {
         monitor_printf(mon, "Postcopy Blocktime (ms): %" PRIu32 "\n",
                        info->postcopy_blocktime);
@@ -216,6 +226,35 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         visit_free(v);
     }
 
+    if (info->has_postcopy_latency) {
+        monitor_printf(mon, "Postcopy Latency (us): %" PRIu64 "\n",
+                       info->postcopy_latency);
+    }
+
+    if (info->has_postcopy_vcpu_latency) {
+        Visitor *v;
+        char *str;
+        v = string_output_visitor_new(false, &str);
+        visit_type_uint64List(v, NULL, &info->postcopy_vcpu_latency,
+                              &error_abort);
+        visit_complete(v, &str);
+        monitor_printf(mon, "Postcopy vCPU Latency (us): %s\n", str);
+        g_free(str);
+        visit_free(v);
+    }
+
+    if (info->has_postcopy_latency_p50) {
+        monitor_printf(mon, "Postcopy Latency Percentiles (us): "
+                       "p50 %" PRIu64 " p90 %" PRIu64 " p99 %" PRIu64 "\n",
+                       info->postcopy_latency_p50, info->postcopy_latency_p90,
+                       info->postcopy_latency_p99);
+    }
+
+    if (info->has_postcopy_prefetched_pages) {
+        monitor_printf(mon, "Postcopy Prefetched Pages: %" PRIu64 "\n",
+                       info->postcopy_prefetched_pages);
+    }
+
 out:
     qapi_free_MigrationInfo(info);
 }
@@ -366,6 +405,11 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
                                MIGRATION_PARAMETER_DIRECT_IO),
                            params->direct_io ? "on" : "off");
         }
+
+        assert(params->has_postcopy_prefetch_depth);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_PREFETCH_DEPTH),
+            params->postcopy_prefetch_depth);
     }
 
     qapi_free_MigrationParameters(params);
@@ -647,6 +691,10 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_direct_io = true;
         visit_type_bool(v, param, &p->direct_io, &err);
         break;
+    case MIGRATION_PARAMETER_POSTCOPY_PREFETCH_DEPTH:
+        p->has_postcopy_prefetch_depth = true;
+        visit_type_uint8(v, param, &p->postcopy_prefetch_depth, &err);
+        break;
     default:
         g_assert_not_reached();
     }
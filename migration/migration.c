@@ -36,6 +36,7 @@
 #include "savevm.h"
 #include "qemu-file.h"
 #include "channel.h"
+#include "convergence.h"
 #include "migration/vmstate.h"
 #include "block/block.h"
 #include "qapi/error.h"
@@ -271,6 +272,14 @@ migration_capabilities_and_transport_compatible(MigrationAddress *addr,
                                        errp);
     }
 
+    /* Only socket_outgoing_migration() checks for zero copy support */
+    if (migrate_zero_copy_send() &&
+        addr->transport != MIGRATION_ADDRESS_TYPE_SOCKET) {
+        error_setg(errp,
+                   "Zero copy send requires a socket transport (e.g. tcp)");
+        return false;
+    }
+
     return true;
 }
 
@@ -580,10 +589,14 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis,
 {
     void *aligned = (void *)(uintptr_t)ROUND_DOWN(haddr, qemu_ram_pagesize(rb));
     bool received = false;
+    bool requested = false;
 
     WITH_QEMU_LOCK_GUARD(&mis->page_request_mutex) {
         received = ramblock_recv_bitmap_test_byte_offset(rb, start);
-        if (!received && !g_tree_lookup(mis->page_requested, aligned)) {
+        if (!received) {
+            requested = ramblock_req_bitmap_test_and_set(rb, start);
+        }
+        if (!received && !requested) {
             /*
              * The page has not been received, and it's not yet in the page
              * request list.  Queue it.  Set the value of element to 1, so that
@@ -596,10 +609,12 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis,
     }
 
     /*
-     * If the page is there, skip sending the message.  We don't even need the
-     * lock because as long as the page arrived, it'll be there forever.
+     * If the page is there, or a request for it is already in flight (from
+     * a fault or from prefetching), skip sending the message.  Requests
+     * lost with a broken channel are resent from the page request list on
+     * postcopy recovery.
      */
-    if (received) {
+    if (received || requested) {
         return 0;
     }
 
@@ -1317,6 +1332,8 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->has_dirty_limit_ring_full_time = true;
         info->dirty_limit_ring_full_time = dirtylimit_ring_full_time();
     }
+
+    migration_convergence_populate(info);
 }
 
 static void fill_source_migration_info(MigrationInfo *info)
@@ -1781,6 +1798,7 @@ int migrate_init(MigrationState *s, Error **errp)
     s->pages_per_second = 0.0;
     s->downtime = 0;
     s->expected_downtime = 0;
+    migration_convergence_reset();
     s->setup_time = 0;
     s->start_postcopy = false;
     s->migration_thread_running = false;
@@ -3376,6 +3394,7 @@ static void migration_update_counters(MigrationState *s,
     }
 
     s->threshold_size = expected_bw_per_ms * migrate_downtime_limit();
+    migration_convergence_update_bandwidth(bandwidth, time_spent);
 
     s->mbps = (((double) transferred * 8.0) /
                ((double) time_spent / 1000.0)) / 1000.0 / 1000.0;
@@ -3433,22 +3452,31 @@ typedef enum {
 static MigIterateState migration_iteration_run(MigrationState *s)
 {
     uint64_t must_precopy, can_postcopy, pending_size;
+    uint64_t threshold_size = s->threshold_size;
     Error *local_err = NULL;
     bool in_postcopy = s->state == MIGRATION_STATUS_POSTCOPY_ACTIVE;
     bool can_switchover = migration_can_switchover(s);
 
+    if (migrate_convergence_control() && !in_postcopy) {
+        threshold_size = MAX(threshold_size,
+                             migration_convergence_threshold());
+    }
+
     qemu_savevm_state_pending_estimate(&must_precopy, &can_postcopy);
     pending_size = must_precopy + can_postcopy;
     trace_migrate_pending_estimate(pending_size, must_precopy, can_postcopy);
 
-    if (pending_size < s->threshold_size) {
+    if (pending_size < threshold_size) {
         qemu_savevm_state_pending_exact(&must_precopy, &can_postcopy);
         pending_size = must_precopy + can_postcopy;
         trace_migrate_pending_exact(pending_size, must_precopy, can_postcopy);
     }
 
-    if ((!pending_size || pending_size < s->threshold_size) && can_switchover) {
+    if ((!pending_size || pending_size < threshold_size) && can_switchover) {
         trace_migration_thread_low_pending(pending_size);
+        if (pending_size >= s->threshold_size) {
+            migration_convergence_switchover();
+        }
         migration_completion(s);
         return MIG_ITERATE_BREAK;
     }
@@ -41,8 +41,10 @@
 #define  MIGRATION_THREAD_DST_FAULT         "mig/dst/fault"
 #define  MIGRATION_THREAD_DST_LISTEN        "mig/dst/listen"
 #define  MIGRATION_THREAD_DST_PREEMPT       "mig/dst/preempt"
+#define  MIGRATION_THREAD_DST_PLACE         "mig/dst/place"
 
 struct PostcopyBlocktimeContext;
+typedef struct PostcopyPlacer PostcopyPlacer;
 typedef struct ThreadPool ThreadPool;
 
 #define  MIGRATION_RESUME_ACK_VALUE  (1)
@@ -170,6 +172,12 @@ struct MigrationIncomingState {
      * channel.
      */
     PostcopyTmpPage *postcopy_tmp_pages;
+    /*
+     * Thread placing the pages received on the precopy channel, so that
+     * receiving the next page overlaps with placing the previous one.
+     * NULL if pages are placed by the receiving thread itself.
+     */
+    PostcopyPlacer *postcopy_placer;
     /* This is shared for all postcopy channels */
     void     *postcopy_tmp_zero_page;
     /* PostCopyFD's for external userfaultfds & handlers of shared memory */
@@ -483,6 +491,15 @@ struct MigrationState {
      */
     bool multifd_clean_tls_termination;
 
+    /*
+     * On the destination of a postcopy migration, hand pages of RAM with
+     * small host pages to the placement thread too.  They are read in
+     * place from the QEMUFile buffer, so that costs a copy per page, which
+     * is more than placing them inline costs.  For testing the placement
+     * thread without huge pages.
+     */
+    bool postcopy_place_small_pages;
+
     /*
      * This decides the size of guest memory chunk that will be used
      * to track dirty bitmap clearing.  The size of memory chunk will
@@ -575,6 +592,10 @@ void migration_cancel(void);
 void migration_populate_vfio_info(MigrationInfo *info);
 void migration_reset_vfio_bytes_transferred(void);
 void postcopy_temp_page_reset(PostcopyTmpPage *tmp_page);
+int postcopy_place_tmp_page(MigrationIncomingState *mis, int channel,
+                            PostcopyTmpPage *tmp_page, RAMBlock *rb,
+                            void *from);
+int postcopy_placer_flush(MigrationIncomingState *mis, int channel);
 
 /*
  * Migration thread waiting for return path thread.  Return non-zero if an
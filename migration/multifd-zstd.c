@@ -13,6 +13,7 @@
 #include "qemu/osdep.h"
 #include <zstd.h>
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "system/ramblock.h"
 #include "exec/target_page.h"
 #include "qapi/error.h"
@@ -21,6 +22,40 @@
 #include "options.h"
 #include "multifd.h"
 
+/*
+ * With x-multifd-zstd-adaptive, each packet is sent in one of these modes.
+ * Packets sent as is bypass the zstd stream; a change between the two
+ * zstd levels ends the current zstd frame, as the level of a frame can't
+ * change once it is started.
+ */
+typedef enum {
+    MULTIFD_ZSTD_RAW,
+    MULTIFD_ZSTD_FAST,
+    MULTIFD_ZSTD_FULL,
+    MULTIFD_ZSTD__MAX,
+} MultiFDZstdMode;
+
+static const char *const multifd_zstd_mode_str[MULTIFD_ZSTD__MAX] = {
+    [MULTIFD_ZSTD_RAW] = "raw",
+    [MULTIFD_ZSTD_FAST] = "fast",
+    [MULTIFD_ZSTD_FULL] = "full",
+};
+
+/* Comparable in speed to LZ4 */
+#define MULTIFD_ZSTD_FAST_LEVEL     (-5)
+/* Once in so many packets, measure the zstd mode that is not in use */
+#define MULTIFD_ZSTD_PROBE_INTERVAL 64
+/* Bytes sampled from each page to estimate its entropy */
+#define MULTIFD_ZSTD_SAMPLE_BYTES   64
+#define MULTIFD_ZSTD_SAMPLE_PAGES   8
+
+typedef struct {
+    /* Compression time per input byte */
+    double ns_per_byte;
+    /* Output size per input byte */
+    double ratio;
+} MultiFDZstdModeStats;
+
 struct zstd_data {
     /* stream for compression */
     ZSTD_CStream *zcs;
@@ -33,6 +68,15 @@ struct zstd_data {
     uint8_t *zbuff;
     /* size of compressed buffer */
     uint32_t zbuff_len;
+
+    /* Adaptive mode, sender side only */
+    bool adaptive;
+    /* Mode of the current zstd frame */
+    MultiFDZstdMode frame_mode;
+    uint64_t packets;
+    MultiFDZstdModeStats stats[MULTIFD_ZSTD__MAX];
+    /* Time the channel is busy sending a byte of output */
+    double link_ns_per_byte;
 };
 
 /* Multifd zstd compression */
@@ -68,8 +112,15 @@ static int multifd_zstd_send_setup(MultiFDSendParams *p, Error **errp)
     }
     p->compress_data = z;
 
-    /* Needs 2 IOVs, one for packet header and one for compressed data */
-    p->iov = g_new0(struct iovec, 2);
+    z->adaptive = migrate_multifd_zstd_adaptive();
+    z->frame_mode = MULTIFD_ZSTD_FULL;
+    if (z->adaptive) {
+        /* Packets sent as is need one IOV per page */
+        p->iov = g_new0(struct iovec, 1 + multifd_ram_page_count());
+    } else {
+        /* Needs 2 IOVs, one for packet header and one for compressed data */
+        p->iov = g_new0(struct iovec, 2);
+    }
     return 0;
 }
 
@@ -88,10 +139,128 @@ static void multifd_zstd_send_cleanup(MultiFDSendParams *p, Error **errp)
     p->iov = NULL;
 }
 
+/*
+ * Whether the pages of a packet look incompressible, from the collision
+ * entropy of bytes sampled from some of them: 7.5 bits per byte or more.
+ */
+static bool multifd_zstd_looks_random(MultiFDPages_t *pages)
+{
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t step = MAX(pages->normal_num / MULTIFD_ZSTD_SAMPLE_PAGES, 1);
+    uint32_t hist[256] = { };
+    uint64_t n = 0, collisions = 0;
+    uint32_t i, j;
+
+    for (i = 0; i < pages->normal_num; i += step) {
+        const uint8_t *page = pages->block->host + pages->offset[i];
+
+        for (j = 0; j < page_size; j += page_size / MULTIFD_ZSTD_SAMPLE_BYTES) {
+            collisions += hist[page[j]]++;
+            n++;
+        }
+    }
+
+    /*
+     * The probability that two samples are equal is 2^-entropy, and
+     * collisions counts the equal pairs among n * (n - 1) / 2.
+     */
+    return collisions * 2 * 181 <= n * (n - 1);
+}
+
+static void multifd_zstd_update(double *avg, double sample)
+{
+    *avg = *avg ? (*avg * 7 + sample) / 8 : sample;
+}
+
+/*
+ * The mode that takes the least time to compress and send the packet,
+ * going by how fast the channel compressed and sent previous packets.
+ */
+static MultiFDZstdMode multifd_zstd_choose_mode(struct zstd_data *z,
+                                                MultiFDPages_t *pages)
+{
+    MultiFDZstdMode mode, best = MULTIFD_ZSTD_RAW;
+    double best_cost = z->link_ns_per_byte;
+
+    if (multifd_zstd_looks_random(pages)) {
+        return MULTIFD_ZSTD_RAW;
+    }
+
+    /* Measure each zstd mode first, and then every now and then */
+    if (z->packets % MULTIFD_ZSTD_PROBE_INTERVAL < MULTIFD_ZSTD__MAX - 1) {
+        return MULTIFD_ZSTD_FAST +
+            z->packets % MULTIFD_ZSTD_PROBE_INTERVAL;
+    }
+
+    for (mode = MULTIFD_ZSTD_FAST; mode < MULTIFD_ZSTD__MAX; mode++) {
+        MultiFDZstdModeStats *stats = &z->stats[mode];
+        double cost = stats->ns_per_byte +
+                      stats->ratio * z->link_ns_per_byte;
+
+        if (cost < best_cost) {
+            best = mode;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+/* Start a new zstd frame if @mode compresses at another level */
+static int multifd_zstd_set_mode(MultiFDSendParams *p, struct zstd_data *z,
+                                 MultiFDZstdMode mode, Error **errp)
+{
+    ZSTD_inBuffer in = { };
+    size_t ret;
+
+    if (mode == z->frame_mode) {
+        return 0;
+    }
+
+    /* Sent ahead of the new frame, in the same packet */
+    do {
+        ret = ZSTD_compressStream2(z->zcs, &z->out, &in, ZSTD_e_end);
+    } while (ret > 0 && z->out.size > z->out.pos);
+    if (ZSTD_isError(ret) || ret > 0) {
+        error_setg(errp, "multifd %u: ending zstd frame failed: %s", p->id,
+                   ZSTD_isError(ret) ? ZSTD_getErrorName(ret) :
+                                       "buffer too small");
+        return -1;
+    }
+
+    ret = ZSTD_CCtx_setParameter(z->zcs, ZSTD_c_compressionLevel,
+                                 mode == MULTIFD_ZSTD_FAST ?
+                                 MULTIFD_ZSTD_FAST_LEVEL :
+                                 migrate_multifd_zstd_level());
+    if (ZSTD_isError(ret)) {
+        error_setg(errp, "multifd %u: setting zstd level failed: %s", p->id,
+                   ZSTD_getErrorName(ret));
+        return -1;
+    }
+    z->frame_mode = mode;
+    return 0;
+}
+
+static void multifd_zstd_send_raw(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t i;
+
+    for (i = 0; i < pages->normal_num; i++) {
+        p->iov[p->iovs_num].iov_base = pages->block->host + pages->offset[i];
+        p->iov[p->iovs_num].iov_len = page_size;
+        p->iovs_num++;
+    }
+    p->next_packet_size = pages->normal_num * page_size;
+    p->flags |= MULTIFD_FLAG_UNCOMPRESSED;
+}
+
 static int multifd_zstd_send_prepare(MultiFDSendParams *p, Error **errp)
 {
     MultiFDPages_t *pages = &p->data->u.ram;
     struct zstd_data *z = p->compress_data;
+    MultiFDZstdMode mode = MULTIFD_ZSTD_FULL;
+    int64_t start_ns = 0;
     int ret;
     uint32_t i;
 
@@ -103,6 +272,29 @@ static int multifd_zstd_send_prepare(MultiFDSendParams *p, Error **errp)
     z->out.size = z->zbuff_len;
     z->out.pos = 0;
 
+    if (z->adaptive) {
+        /*
+         * How long writing the previous packet blocked the channel.  The
+         * time the channel waited for pages to send does not count.
+         */
+        if (p->last_write_bytes) {
+            multifd_zstd_update(&z->link_ns_per_byte,
+                                (double)p->last_write_ns /
+                                p->last_write_bytes);
+        }
+
+        start_ns = get_clock();
+
+        mode = multifd_zstd_choose_mode(z, pages);
+        if (mode == MULTIFD_ZSTD_RAW) {
+            multifd_zstd_send_raw(p);
+            goto done;
+        }
+        if (multifd_zstd_set_mode(p, z, mode, errp) < 0) {
+            return -1;
+        }
+    }
+
     for (i = 0; i < pages->normal_num; i++) {
         ZSTD_EndDirective flush = ZSTD_e_continue;
 
@@ -141,6 +333,23 @@ static int multifd_zstd_send_prepare(MultiFDSendParams *p, Error **errp)
     p->iovs_num++;
     p->next_packet_size = z->out.pos;
 
+done:
+    if (z->adaptive) {
+        uint64_t in_bytes = (uint64_t)pages->normal_num *
+                            multifd_ram_page_size();
+
+        if (mode != MULTIFD_ZSTD_RAW) {
+            multifd_zstd_update(&z->stats[mode].ns_per_byte,
+                                (double)(get_clock() - start_ns) /
+                                in_bytes);
+            multifd_zstd_update(&z->stats[mode].ratio,
+                                (double)p->next_packet_size / in_bytes);
+        }
+        z->packets++;
+        trace_multifd_zstd_send(p->id, multifd_zstd_mode_str[mode],
+                                in_bytes, p->next_packet_size);
+    }
+
 out:
     p->flags |= MULTIFD_FLAG_ZSTD;
     multifd_send_fill_packet(p);
@@ -178,6 +387,11 @@ static int multifd_zstd_recv_setup(MultiFDRecvParams *p, Error **errp)
         error_setg(errp, "multifd %u: out of memory for zbuff", p->id);
         return -1;
     }
+
+    if (migrate_multifd_zstd_adaptive()) {
+        /* For packets sent as is */
+        p->iov = g_new0(struct iovec, multifd_ram_page_count());
+    }
     return 0;
 }
 
@@ -191,6 +405,29 @@ static void multifd_zstd_recv_cleanup(MultiFDRecvParams *p)
     z->zbuff = NULL;
     g_free(p->compress_data);
     p->compress_data = NULL;
+
+    g_free(p->iov);
+    p->iov = NULL;
+}
+
+static int multifd_zstd_recv_raw(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t i;
+
+    if (p->next_packet_size != p->normal_num * page_size) {
+        error_setg(errp, "multifd %u: packet size received %u size expected "
+                   "%u", p->id, p->next_packet_size,
+                   p->normal_num * page_size);
+        return -1;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        p->iov[i].iov_base = p->host + p->normal[i];
+        p->iov[i].iov_len = page_size;
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+    }
+    return qio_channel_readv_all(p->c, p->iov, p->normal_num, errp);
 }
 
 static int multifd_zstd_recv(MultiFDRecvParams *p, Error **errp)
@@ -217,6 +454,15 @@ static int multifd_zstd_recv(MultiFDRecvParams *p, Error **errp)
         return 0;
     }
 
+    if (p->flags & MULTIFD_FLAG_UNCOMPRESSED) {
+        if (!migrate_multifd_zstd_adaptive()) {
+            error_setg(errp, "multifd %u: uncompressed packet received, but "
+                       "capability 'x-multifd-zstd-adaptive' is not set", p->id);
+            return -1;
+        }
+        return multifd_zstd_recv_raw(p, errp);
+    }
+
     ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
 
     if (ret != 0) {
@@ -237,14 +483,16 @@ static int multifd_zstd_recv(MultiFDRecvParams *p, Error **errp)
          * Welcome to decompressStream semantics
          *
          * We need to loop while:
-         * - return is > 0
-         * - there is input available
+         * - return is > 0, or there is input available: a return of 0
+         *   only means that a frame ended, and the sender ends frames
+         *   when it changes the compression level
          * - we haven't put out a full page
          */
         do {
             ret = ZSTD_decompressStream(z->zds, &z->out, &z->in);
-        } while (ret > 0 && (z->in.size > z->in.pos)
-                         && (z->out.pos < page_size));
+        } while (!ZSTD_isError(ret) &&
+                 (ret > 0 || z->in.size > z->in.pos) &&
+                 (z->out.pos < page_size));
         if (ret > 0 && (z->out.pos < page_size)) {
             error_setg(errp, "multifd %u: decompressStream buffer too small",
                        p->id);
@@ -14,6 +14,7 @@
 #include "qemu/cutils.h"
 #include "qemu/iov.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "exec/target_page.h"
 #include "system/system.h"
 #include "system/ramblock.h"
@@ -690,6 +691,7 @@ static void *multifd_send_thread(void *opaque)
         if (qatomic_load_acquire(&p->pending_job)) {
             bool is_device_state = multifd_payload_device_state(p->data);
             size_t total_size;
+            int64_t write_start_ns;
             int write_flags_masked = 0;
 
             p->flags = 0;
@@ -714,6 +716,7 @@ static void *multifd_send_thread(void *opaque)
              * being sent.
              */
             total_size = iov_size(p->iov, p->iovs_num);
+            write_start_ns = get_clock();
 
             if (migrate_mapped_ram()) {
                 assert(!is_device_state);
@@ -732,6 +735,10 @@ static void *multifd_send_thread(void *opaque)
             }
 
             stat64_add(&mig_stats.multifd_bytes, total_size);
+            if (!is_device_state) {
+                p->last_write_bytes = total_size;
+                p->last_write_ns = get_clock() - write_start_ns;
+            }
 
             p->next_packet_size = 0;
             multifd_send_data_clear(p->data);
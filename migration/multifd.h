@@ -73,6 +73,13 @@ MultiFDRecvData *multifd_get_recv_data(void);
  */
 #define MULTIFD_FLAG_DEVICE_STATE (32 << 1)
 
+/*
+ * If set, the pages of this packet are sent as is, even though a
+ * compression method is in use.  Only used, and only accepted by the
+ * destination, with the x-multifd-zstd-adaptive capability.
+ */
+#define MULTIFD_FLAG_UNCOMPRESSED (64 << 1)
+
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
 
@@ -228,6 +235,9 @@ typedef struct {
     uint32_t next_packet_size;
     /* packets sent through this channel */
     uint64_t packets_sent;
+    /* size of the last RAM packet written, and how long the write took */
+    uint64_t last_write_bytes;
+    int64_t last_write_ns;
     /* buffers to send */
     struct iovec *iov;
     /* number of iovs used */
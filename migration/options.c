@@ -71,6 +71,13 @@
  */
 #define DEFAULT_MIGRATE_MAX_POSTCOPY_BANDWIDTH 0
 
+/*
+ * Pages requested ahead of a postcopy fault once a pattern is detected,
+ * 0 means no prefetching.
+ */
+#define DEFAULT_MIGRATE_POSTCOPY_PREFETCH_DEPTH 8
+#define MAX_MIGRATE_POSTCOPY_PREFETCH_DEPTH 64
+
 /*
  * Parameters for self_announce_delay giving a stream of RARP/ARP
  * packets after migration.
@@ -103,6 +110,8 @@ const Property migration_properties[] = {
                      preempt_pre_7_2, false),
     DEFINE_PROP_BOOL("multifd-clean-tls-termination", MigrationState,
                      multifd_clean_tls_termination, true),
+    DEFINE_PROP_BOOL("x-postcopy-place-small-pages", MigrationState,
+                     postcopy_place_small_pages, false),
 
     /* Migration parameters */
     DEFINE_PROP_UINT8("x-throttle-trigger-threshold", MigrationState,
@@ -177,6 +186,9 @@ const Property migration_properties[] = {
     DEFINE_PROP_ZERO_PAGE_DETECTION("zero-page-detection", MigrationState,
                        parameters.zero_page_detection,
                        ZERO_PAGE_DETECTION_MULTIFD),
+    DEFINE_PROP_UINT8("postcopy-prefetch-depth", MigrationState,
+                      parameters.postcopy_prefetch_depth,
+                      DEFAULT_MIGRATE_POSTCOPY_PREFETCH_DEPTH),
 
     /* Migration capabilities */
     DEFINE_PROP_MIG_CAP("x-xbzrle", MIGRATION_CAPABILITY_XBZRLE),
@@ -201,6 +213,14 @@ const Property migration_properties[] = {
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
     DEFINE_PROP_MIG_CAP("mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("mapped-ram-lazy-load",
+                        MIGRATION_CAPABILITY_MAPPED_RAM_LAZY_LOAD),
+    DEFINE_PROP_MIG_CAP("x-colo-incremental-vmstate",
+                        MIGRATION_CAPABILITY_X_COLO_INCREMENTAL_VMSTATE),
+    DEFINE_PROP_MIG_CAP("x-convergence-control",
+                        MIGRATION_CAPABILITY_X_CONVERGENCE_CONTROL),
+    DEFINE_PROP_MIG_CAP("x-multifd-zstd-adaptive",
+                        MIGRATION_CAPABILITY_X_MULTIFD_ZSTD_ADAPTIVE),
 };
 const size_t migration_properties_count = ARRAY_SIZE(migration_properties);
 
@@ -232,6 +252,20 @@ bool migrate_colo(void)
     return s->capabilities[MIGRATION_CAPABILITY_X_COLO];
 }
 
+bool migrate_colo_incremental_vmstate(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_COLO_INCREMENTAL_VMSTATE];
+}
+
+bool migrate_convergence_control(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_CONVERGENCE_CONTROL];
+}
+
 bool migrate_dirty_bitmaps(void)
 {
     MigrationState *s = migrate_get_current();
@@ -260,6 +294,13 @@ bool migrate_mapped_ram(void)
     return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
 }
 
+bool migrate_mapped_ram_lazy_load(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM_LAZY_LOAD];
+}
+
 bool migrate_ignore_shared(void)
 {
     MigrationState *s = migrate_get_current();
@@ -281,6 +322,13 @@ bool migrate_multifd(void)
     return s->capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+bool migrate_multifd_zstd_adaptive(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_MULTIFD_ZSTD_ADAPTIVE];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s = migrate_get_current();
@@ -367,6 +415,13 @@ bool migrate_multifd_flush_after_each_section(void)
     return s->multifd_flush_after_each_section;
 }
 
+bool migrate_postcopy_place_small_pages(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->postcopy_place_small_pages;
+}
+
 bool migrate_postcopy(void)
 {
     return migrate_postcopy_ram() || migrate_dirty_bitmaps();
@@ -546,12 +601,11 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
 
 #ifdef CONFIG_LINUX
     if (new_caps[MIGRATION_CAPABILITY_ZERO_COPY_SEND] &&
-        (!new_caps[MIGRATION_CAPABILITY_MULTIFD] ||
-         new_caps[MIGRATION_CAPABILITY_XBZRLE] ||
+        (new_caps[MIGRATION_CAPABILITY_XBZRLE] ||
          migrate_multifd_compression() ||
          migrate_tls())) {
         error_setg(errp,
-                   "Zero copy only available for non-compressed non-TLS multifd migration");
+                   "Zero copy only available for non-compressed non-TLS migration");
         return false;
     }
 #else
@@ -624,6 +678,27 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM_LAZY_LOAD] &&
+        !new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        error_setg(errp, "Capability 'mapped-ram-lazy-load' requires "
+                   "capability 'mapped-ram'");
+        return false;
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_X_MULTIFD_ZSTD_ADAPTIVE] &&
+        !new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
+        error_setg(errp, "Capability 'x-multifd-zstd-adaptive' requires "
+                   "capability 'multifd'");
+        return false;
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_X_COLO_INCREMENTAL_VMSTATE] &&
+        !new_caps[MIGRATION_CAPABILITY_X_COLO]) {
+        error_setg(errp, "Capability 'x-colo-incremental-vmstate' requires "
+                   "capability 'x-colo'");
+        return false;
+    }
+
     /*
      * On destination side, check the cases that capability is being set
      * after incoming thread has started.
@@ -740,6 +815,13 @@ bool migrate_direct_io(void)
         s->capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+uint8_t migrate_postcopy_prefetch_depth(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.postcopy_prefetch_depth;
+}
+
 uint64_t migrate_downtime_limit(void)
 {
     MigrationState *s = migrate_get_current();
@@ -957,6 +1039,8 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->zero_page_detection = s->parameters.zero_page_detection;
     params->has_direct_io = true;
     params->direct_io = s->parameters.direct_io;
+    params->has_postcopy_prefetch_depth = true;
+    params->postcopy_prefetch_depth = s->parameters.postcopy_prefetch_depth;
 
     return params;
 }
@@ -991,6 +1075,7 @@ void migrate_params_init(MigrationParameters *params)
     params->has_mode = true;
     params->has_zero_page_detection = true;
     params->has_direct_io = true;
+    params->has_postcopy_prefetch_depth = true;
 }
 
 /*
@@ -1144,7 +1229,7 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         ((params->has_multifd_compression && params->multifd_compression) ||
          (params->tls_creds && *params->tls_creds))) {
         error_setg(errp,
-                   "Zero copy only available for non-compressed non-TLS multifd migration");
+                   "Zero copy only available for non-compressed non-TLS migration");
         return false;
     }
 #endif
@@ -1177,6 +1262,15 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->has_postcopy_prefetch_depth &&
+        params->postcopy_prefetch_depth > MAX_MIGRATE_POSTCOPY_PREFETCH_DEPTH) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "postcopy_prefetch_depth",
+                   "a value between 0 and "
+                   stringify(MAX_MIGRATE_POSTCOPY_PREFETCH_DEPTH));
+        return false;
+    }
+
     return true;
 }
 
@@ -1295,6 +1389,10 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_direct_io) {
         dest->direct_io = params->direct_io;
     }
+
+    if (params->has_postcopy_prefetch_depth) {
+        dest->postcopy_prefetch_depth = params->postcopy_prefetch_depth;
+    }
 }
 
 static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
@@ -1427,6 +1525,11 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_direct_io) {
         s->parameters.direct_io = params->direct_io;
     }
+
+    if (params->has_postcopy_prefetch_depth) {
+        s->parameters.postcopy_prefetch_depth =
+            params->postcopy_prefetch_depth;
+    }
 }
 
 void qmp_migrate_set_parameters(MigrateSetParameters *params, Error **errp)
@@ -18,6 +18,9 @@
 
 #include "qemu/osdep.h"
 #include "qemu/madvise.h"
+#include "qemu/host-utils.h"
+#include "qemu/stats64.h"
+#include "qemu/units.h"
 #include "exec/target_page.h"
 #include "migration.h"
 #include "qemu-file.h"
@@ -110,6 +113,8 @@ void postcopy_thread_create(MigrationIncomingState *mis,
 #include <sys/eventfd.h>
 #include <linux/userfaultfd.h>
 
+#define POSTCOPY_LATENCY_BUCKETS 33
+
 typedef struct PostcopyBlocktimeContext {
     /* time when page fault initiated per vCPU */
     uint32_t *page_fault_vcpu_time;
@@ -124,6 +129,21 @@ typedef struct PostcopyBlocktimeContext {
     int smp_cpus_down;
     uint64_t start_time;
 
+    /* time when page fault initiated per vCPU, in us since start_time */
+    uint32_t *vcpu_fault_start_us;
+    /*
+     * number of resolved page faults and their total latency, per vCPU;
+     * updated from both the fault and the preempt threads
+     */
+    Stat64 *vcpu_faults;
+    Stat64 *vcpu_latency_us;
+    Stat64 total_faults;
+    Stat64 total_latency_us;
+    /* pages requested by the prefetcher ahead of faults */
+    Stat64 prefetched_pages;
+    /* fault latencies, bucket i counts latencies in [2^(i-1), 2^i) us */
+    uint32_t latency_hist[POSTCOPY_LATENCY_BUCKETS];
+
     /*
      * Handler for exit event, necessary for
      * releasing whole blocktime_ctx
@@ -136,6 +156,9 @@ static void destroy_blocktime_context(struct PostcopyBlocktimeContext *ctx)
     g_free(ctx->page_fault_vcpu_time);
     g_free(ctx->vcpu_addr);
     g_free(ctx->vcpu_blocktime);
+    g_free(ctx->vcpu_fault_start_us);
+    g_free(ctx->vcpu_faults);
+    g_free(ctx->vcpu_latency_us);
     g_free(ctx);
 }
 
@@ -154,6 +177,9 @@ static struct PostcopyBlocktimeContext *blocktime_context_new(void)
     ctx->page_fault_vcpu_time = g_new0(uint32_t, smp_cpus);
     ctx->vcpu_addr = g_new0(uintptr_t, smp_cpus);
     ctx->vcpu_blocktime = g_new0(uint32_t, smp_cpus);
+    ctx->vcpu_fault_start_us = g_new0(uint32_t, smp_cpus);
+    ctx->vcpu_faults = g_new0(Stat64, smp_cpus);
+    ctx->vcpu_latency_us = g_new0(Stat64, smp_cpus);
 
     ctx->exit_notifier.notify = migration_exit_cb;
     ctx->start_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
@@ -174,6 +200,50 @@ static uint32List *get_vcpu_blocktime_list(PostcopyBlocktimeContext *ctx)
     return list;
 }
 
+static uint64List *get_vcpu_latency_list(PostcopyBlocktimeContext *ctx)
+{
+    MachineState *ms = MACHINE(qdev_get_machine());
+    uint64List *list = NULL;
+    int i;
+
+    for (i = ms->smp.cpus - 1; i >= 0; i--) {
+        uint64_t faults = stat64_get(&ctx->vcpu_faults[i]);
+        uint64_t latency = stat64_get(&ctx->vcpu_latency_us[i]);
+
+        QAPI_LIST_PREPEND(list, faults ? latency / faults : 0);
+    }
+
+    return list;
+}
+
+/*
+ * Return the @pct-th percentile of the fault latencies seen so far, in
+ * microseconds.  The result is the upper bound of the histogram bucket it
+ * falls into, so it is accurate to a factor of two.
+ */
+static uint64_t get_latency_percentile(PostcopyBlocktimeContext *ctx,
+                                       unsigned int pct)
+{
+    uint64_t total = 0, rank, seen = 0;
+    int i;
+
+    for (i = 0; i < POSTCOPY_LATENCY_BUCKETS; i++) {
+        total += qatomic_read(&ctx->latency_hist[i]);
+    }
+    if (!total) {
+        return 0;
+    }
+
+    rank = DIV_ROUND_UP(total * pct, 100);
+    for (i = 0; i < POSTCOPY_LATENCY_BUCKETS; i++) {
+        seen += qatomic_read(&ctx->latency_hist[i]);
+        if (seen >= rank) {
+            break;
+        }
+    }
+    return i ? (1ULL << i) - 1 : 0;
+}
+
 /*
  * This function just populates MigrationInfo from postcopy's
  * blocktime context. It will not populate MigrationInfo,
@@ -185,6 +255,7 @@ void fill_destination_postcopy_migration_info(MigrationInfo *info)
 {
     MigrationIncomingState *mis = migration_incoming_get_current();
     PostcopyBlocktimeContext *bc = mis->blocktime_ctx;
+    uint64_t faults;
 
     if (!bc) {
         return;
@@ -194,6 +265,20 @@ void fill_destination_postcopy_migration_info(MigrationInfo *info)
     info->postcopy_blocktime = bc->total_blocktime;
     info->has_postcopy_vcpu_blocktime = true;
     info->postcopy_vcpu_blocktime = get_vcpu_blocktime_list(bc);
+    info->has_postcopy_latency = true;
+    faults = stat64_get(&bc->total_faults);
+    info->postcopy_latency = faults ?
+        stat64_get(&bc->total_latency_us) / faults : 0;
+    info->has_postcopy_vcpu_latency = true;
+    info->postcopy_vcpu_latency = get_vcpu_latency_list(bc);
+    info->has_postcopy_latency_p50 = true;
+    info->postcopy_latency_p50 = get_latency_percentile(bc, 50);
+    info->has_postcopy_latency_p90 = true;
+    info->postcopy_latency_p90 = get_latency_percentile(bc, 90);
+    info->has_postcopy_latency_p99 = true;
+    info->postcopy_latency_p99 = get_latency_percentile(bc, 99);
+    info->has_postcopy_prefetched_pages = true;
+    info->postcopy_prefetched_pages = stat64_get(&bc->prefetched_pages);
 }
 
 static uint32_t get_postcopy_total_blocktime(void)
@@ -564,6 +649,255 @@ int postcopy_ram_incoming_init(MigrationIncomingState *mis)
     return 0;
 }
 
+/*
+ * Page placement thread
+ *
+ * The thread receiving the precopy channel would otherwise also issue the
+ * UFFDIO_COPY for every page it receives, so reading the next page from
+ * the socket waits for the previous page to be placed.  Hand complete host
+ * pages over to a placement thread instead, through a small queue of page
+ * buffers that are swapped with the receiver's temporary page.
+ *
+ * Only huge pages are handed over, because they are assembled in the
+ * temporary page anyway.  Small pages are placed right from the QEMUFile
+ * buffer; as that buffer is reused by the next read, handing them over
+ * would cost a copy per page, unless x-postcopy-place-small-pages is set.
+ *
+ * Pages arriving on the preempt channel are still placed by the preempt
+ * thread itself, so an urgent page never queues behind background pages.
+ */
+#define POSTCOPY_PLACE_QUEUE            8
+/* With larger host pages the extra buffers would cost too much memory */
+#define POSTCOPY_PLACE_MAX_PAGE_SIZE    (2 * MiB)
+
+typedef struct PostcopyPlaceReq {
+    /* Host page sized buffer with the contents, unless @all_zero */
+    void *buf;
+    void *host_addr;
+    RAMBlock *rb;
+    bool all_zero;
+} PostcopyPlaceReq;
+
+struct PostcopyPlacer {
+    MigrationIncomingState *mis;
+    QemuThread thread;
+    QemuMutex lock;
+    /* Signalled whenever a request is queued or completed */
+    QemuCond cond;
+    PostcopyPlaceReq reqs[POSTCOPY_PLACE_QUEUE];
+    unsigned int head;
+    unsigned int count;
+    /* Buffers neither held by the receiver nor by a queued request */
+    void *free_bufs[POSTCOPY_PLACE_QUEUE];
+    unsigned int nr_free;
+    /* First error placing a page, returned by postcopy_placer_flush() */
+    int error;
+    bool quit;
+};
+
+static int postcopy_place_req(MigrationIncomingState *mis,
+                              PostcopyPlaceReq *req)
+{
+    if (req->all_zero) {
+        return postcopy_place_page_zero(mis, req->host_addr, req->rb);
+    }
+    return postcopy_place_page(mis, req->host_addr, req->buf, req->rb);
+}
+
+static void *postcopy_placer_thread(void *opaque)
+{
+    PostcopyPlacer *p = opaque;
+    PostcopyPlaceReq batch[POSTCOPY_PLACE_QUEUE];
+    unsigned int i, n;
+    int ret;
+
+    rcu_register_thread();
+
+    qemu_mutex_lock(&p->lock);
+    while (true) {
+        while (!p->count && !p->quit) {
+            qemu_cond_wait(&p->cond, &p->lock);
+        }
+        if (!p->count) {
+            break;
+        }
+
+        /* Place everything that is queued without holding the lock */
+        n = p->count;
+        for (i = 0; i < n; i++) {
+            batch[i] = p->reqs[(p->head + i) % POSTCOPY_PLACE_QUEUE];
+        }
+        qemu_mutex_unlock(&p->lock);
+
+        ret = 0;
+        WITH_RCU_READ_LOCK_GUARD() {
+            for (i = 0; i < n && !ret; i++) {
+                ret = postcopy_place_req(p->mis, &batch[i]);
+            }
+        }
+        trace_postcopy_placer_batch(n, ret);
+
+        /*
+         * After an error the rest of the batch is dropped; those pages stay
+         * clear in the receive bitmap, so they are sent again on recovery.
+         */
+        qemu_mutex_lock(&p->lock);
+        for (i = 0; i < n; i++) {
+            p->free_bufs[p->nr_free++] = batch[i].buf;
+        }
+        p->head = (p->head + n) % POSTCOPY_PLACE_QUEUE;
+        p->count -= n;
+        if (ret && !p->error) {
+            p->error = ret;
+        }
+        qemu_cond_broadcast(&p->cond);
+    }
+    qemu_mutex_unlock(&p->lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void postcopy_placer_cleanup(MigrationIncomingState *mis)
+{
+    PostcopyPlacer *p = mis->postcopy_placer;
+    unsigned int i;
+
+    if (!p) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&p->lock) {
+        p->quit = true;
+        qemu_cond_broadcast(&p->cond);
+    }
+    qemu_thread_join(&p->thread);
+
+    /* The thread only quits once the queue is empty */
+    assert(p->nr_free == POSTCOPY_PLACE_QUEUE);
+    for (i = 0; i < p->nr_free; i++) {
+        munmap(p->free_bufs[i], mis->largest_page_size);
+    }
+    qemu_cond_destroy(&p->cond);
+    qemu_mutex_destroy(&p->lock);
+    g_free(p);
+    mis->postcopy_placer = NULL;
+}
+
+static int postcopy_placer_setup(MigrationIncomingState *mis)
+{
+    PostcopyPlacer *p;
+    void *buf;
+    int i, err;
+
+    if (mis->largest_page_size > POSTCOPY_PLACE_MAX_PAGE_SIZE ||
+        (mis->largest_page_size == qemu_target_page_size() &&
+         !migrate_postcopy_place_small_pages())) {
+        return 0;
+    }
+
+    p = g_new0(PostcopyPlacer, 1);
+    p->mis = mis;
+    for (i = 0; i < POSTCOPY_PLACE_QUEUE; i++) {
+        buf = mmap(NULL, mis->largest_page_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED) {
+            err = errno;
+            error_report("%s: Failed to map placement buffer: %s",
+                         __func__, strerror(err));
+            while (p->nr_free) {
+                munmap(p->free_bufs[--p->nr_free], mis->largest_page_size);
+            }
+            g_free(p);
+            return -err;
+        }
+        p->free_bufs[p->nr_free++] = buf;
+    }
+
+    qemu_mutex_init(&p->lock);
+    qemu_cond_init(&p->cond);
+    qemu_thread_create(&p->thread, MIGRATION_THREAD_DST_PLACE,
+                       postcopy_placer_thread, p, QEMU_THREAD_JOINABLE);
+    mis->postcopy_placer = p;
+    return 0;
+}
+
+/*
+ * Place the host page received into @tmp_page on @channel, and reset
+ * @tmp_page for the next page.  @from is where the contents are, which is
+ * either the buffer of @tmp_page or the QEMUFile buffer.
+ * returns 0 on success
+ */
+int postcopy_place_tmp_page(MigrationIncomingState *mis, int channel,
+                            PostcopyTmpPage *tmp_page, RAMBlock *rb,
+                            void *from)
+{
+    PostcopyPlacer *p = mis->postcopy_placer;
+    PostcopyPlaceReq *req;
+    int ret = 0;
+
+    if (!p || channel != RAM_CHANNEL_PRECOPY ||
+        (qemu_ram_pagesize(rb) == qemu_target_page_size() &&
+         !migrate_postcopy_place_small_pages())) {
+        if (tmp_page->all_zero) {
+            ret = postcopy_place_page_zero(mis, tmp_page->host_addr, rb);
+        } else {
+            ret = postcopy_place_page(mis, tmp_page->host_addr, from, rb);
+        }
+        postcopy_temp_page_reset(tmp_page);
+        return ret;
+    }
+
+    /* Small pages are in the QEMUFile buffer, reused by the next read */
+    if (!tmp_page->all_zero && from != tmp_page->tmp_huge_page) {
+        memcpy(tmp_page->tmp_huge_page, from, qemu_ram_pagesize(rb));
+    }
+
+    qemu_mutex_lock(&p->lock);
+    while (!p->nr_free && !p->error) {
+        qemu_cond_wait(&p->cond, &p->lock);
+    }
+    if (p->error) {
+        ret = p->error;
+    } else {
+        req = &p->reqs[(p->head + p->count) % POSTCOPY_PLACE_QUEUE];
+        req->buf = tmp_page->tmp_huge_page;
+        req->host_addr = tmp_page->host_addr;
+        req->rb = rb;
+        req->all_zero = tmp_page->all_zero;
+        p->count++;
+        tmp_page->tmp_huge_page = p->free_bufs[--p->nr_free];
+        qemu_cond_broadcast(&p->cond);
+    }
+    qemu_mutex_unlock(&p->lock);
+
+    postcopy_temp_page_reset(tmp_page);
+    return ret;
+}
+
+/*
+ * Wait until all pages queued by postcopy_place_tmp_page() on @channel
+ * are placed.  Returns the first error hit while placing them, if any.
+ */
+int postcopy_placer_flush(MigrationIncomingState *mis, int channel)
+{
+    PostcopyPlacer *p = mis->postcopy_placer;
+    int ret;
+
+    if (!p || channel != RAM_CHANNEL_PRECOPY) {
+        return 0;
+    }
+
+    QEMU_LOCK_GUARD(&p->lock);
+    while (p->count) {
+        qemu_cond_wait(&p->cond, &p->lock);
+    }
+    /* Start over cleanly if the channel is recovered */
+    ret = p->error;
+    p->error = 0;
+    return ret;
+}
+
 static void postcopy_temp_pages_cleanup(MigrationIncomingState *mis)
 {
     int i;
@@ -661,6 +995,7 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
         }
     }
 
+    postcopy_placer_cleanup(mis);
     postcopy_temp_pages_cleanup(mis);
 
     trace_postcopy_ram_incoming_cleanup_blocktime(
@@ -818,27 +1153,36 @@ static uint32_t get_low_time_offset(PostcopyBlocktimeContext *dc)
     return start_time_offset < 1 ? 1 : start_time_offset & UINT32_MAX;
 }
 
+/*
+ * Like get_low_time_offset(), but in microseconds.  This wraps around
+ * after about 71 minutes, which is fine for measuring page fault latency.
+ */
+static uint32_t get_low_time_offset_us(PostcopyBlocktimeContext *dc)
+{
+    int64_t start_time_offset = qemu_clock_get_us(QEMU_CLOCK_REALTIME) -
+                                    dc->start_time * 1000;
+    uint32_t offset = start_time_offset & UINT32_MAX;
+
+    return offset ? offset : 1;
+}
+
 /*
  * This function is being called when pagefault occurs. It
  * tracks down vCPU blocking time.
  *
  * @addr: faulted host virtual address
- * @ptid: faulted process thread id
+ * @cpu: index of the faulting vCPU, or -1 if unknown
  * @rb: ramblock appropriate to addr
  */
-static void mark_postcopy_blocktime_begin(uintptr_t addr, uint32_t ptid,
+static void mark_postcopy_blocktime_begin(uintptr_t addr, int cpu,
                                           RAMBlock *rb)
 {
-    int cpu, already_received;
+    int already_received;
     MigrationIncomingState *mis = migration_incoming_get_current();
     PostcopyBlocktimeContext *dc = mis->blocktime_ctx;
     uint32_t low_time_offset;
 
-    if (!dc || ptid == 0) {
-        return;
-    }
-    cpu = get_mem_fault_cpu_index(ptid);
-    if (cpu < 0) {
+    if (!dc || cpu < 0) {
         return;
     }
 
@@ -849,6 +1193,7 @@ static void mark_postcopy_blocktime_begin(uintptr_t addr, uint32_t ptid,
 
     qatomic_xchg(&dc->last_begin, low_time_offset);
     qatomic_xchg(&dc->page_fault_vcpu_time[cpu], low_time_offset);
+    qatomic_xchg(&dc->vcpu_fault_start_us[cpu], get_low_time_offset_us(dc));
     qatomic_xchg(&dc->vcpu_addr[cpu], addr);
 
     /*
@@ -860,6 +1205,7 @@ static void mark_postcopy_blocktime_begin(uintptr_t addr, uint32_t ptid,
     if (already_received) {
         qatomic_xchg(&dc->vcpu_addr[cpu], 0);
         qatomic_xchg(&dc->page_fault_vcpu_time[cpu], 0);
+        qatomic_xchg(&dc->vcpu_fault_start_us[cpu], 0);
         qatomic_dec(&dc->smp_cpus_down);
     }
     trace_mark_postcopy_blocktime_begin(addr, dc, dc->page_fault_vcpu_time[cpu],
@@ -901,19 +1247,21 @@ static void mark_postcopy_blocktime_end(uintptr_t addr)
     unsigned int smp_cpus = ms->smp.cpus;
     int i, affected_cpu = 0;
     bool vcpu_total_blocktime = false;
-    uint32_t read_vcpu_time, low_time_offset;
+    uint32_t read_vcpu_time, low_time_offset, low_time_offset_us;
 
     if (!dc) {
         return;
     }
 
     low_time_offset = get_low_time_offset(dc);
+    low_time_offset_us = get_low_time_offset_us(dc);
     /* lookup cpu, to clear it,
      * that algorithm looks straightforward, but it's not
      * optimal, more optimal algorithm is keeping tree or hash
      * where key is address value is a list of  */
     for (i = 0; i < smp_cpus; i++) {
         uint32_t vcpu_blocktime = 0;
+        uint32_t fault_latency;
 
         read_vcpu_time = qatomic_fetch_add(&dc->page_fault_vcpu_time[i], 0);
         if (qatomic_fetch_add(&dc->vcpu_addr[i], 0) != addr ||
@@ -923,6 +1271,16 @@ static void mark_postcopy_blocktime_end(uintptr_t addr)
         qatomic_xchg(&dc->vcpu_addr[i], 0);
         vcpu_blocktime = low_time_offset - read_vcpu_time;
         affected_cpu += 1;
+
+        /* fault-to-resolution latency, uint32_t arithmetic handles wrap */
+        fault_latency = low_time_offset_us -
+                        qatomic_xchg(&dc->vcpu_fault_start_us[i], 0);
+        stat64_add(&dc->vcpu_latency_us[i], fault_latency);
+        stat64_add(&dc->vcpu_faults[i], 1);
+        stat64_add(&dc->total_latency_us, fault_latency);
+        stat64_add(&dc->total_faults, 1);
+        qatomic_inc(&dc->latency_hist[32 - clz32(fault_latency)]);
+
         /* we need to know is that mark_postcopy_end was due to
          * faulted page, another possible case it's prefetched
          * page and in that case we shouldn't be here */
@@ -950,12 +1308,204 @@ static void postcopy_pause_fault_thread(MigrationIncomingState *mis)
     trace_postcopy_pause_fault_thread_continued();
 }
 
+/*
+ * Page prefetching
+ *
+ * Every request the fault thread sends is a full network round trip during
+ * which the vCPU is stalled.  Guests tend to touch memory in patterns: a
+ * vCPU walking an array faults on pages at a constant stride, and a fault
+ * in a region that was faulted recently is usually followed by more faults
+ * around it.  The fault thread tracks both patterns per vCPU and asks the
+ * source for the pages it expects to be touched next, so that they are
+ * already in flight (or placed) by the time the vCPU gets there.
+ *
+ * Prefetch requests go through migrate_send_rp_req_pages() like real
+ * faults.  It records every page it asks for in the requestedmap of the
+ * RAMBlock, so a later fault on a prefetched page that is still in flight
+ * is not requested again, and neither is a page that a fault asked for
+ * already.
+ */
+
+/* Largest stride between consecutive faults that is considered a pattern */
+#define POSTCOPY_PREFETCH_MAX_STRIDE    (64 * MiB)
+/* Granularity and number of recently faulted regions that are remembered */
+#define POSTCOPY_PREFETCH_REGION        (2 * MiB)
+#define POSTCOPY_PREFETCH_HISTORY       16
+/* Do not prefetch while this many page requests are outstanding */
+#define POSTCOPY_PREFETCH_MAX_INFLIGHT  256
+
+typedef struct PostcopyPrefetchVcpu {
+    RAMBlock *rb;
+    ram_addr_t last_offset;
+    int64_t stride;
+    /* number of consecutive faults that followed @stride */
+    unsigned int hits;
+    /* furthest page along @stride that has been requested already */
+    int64_t issued;
+} PostcopyPrefetchVcpu;
+
+typedef struct PostcopyPrefetchState {
+    /* one entry per vCPU, plus one for faults from unknown threads */
+    PostcopyPrefetchVcpu *vcpu;
+    int nr_vcpus;
+    struct {
+        RAMBlock *rb;
+        ram_addr_t region;
+    } history[POSTCOPY_PREFETCH_HISTORY];
+    unsigned int history_next;
+} PostcopyPrefetchState;
+
+static PostcopyPrefetchState *postcopy_prefetch_new(void)
+{
+    MachineState *ms = MACHINE(qdev_get_machine());
+    PostcopyPrefetchState *ps = g_new0(PostcopyPrefetchState, 1);
+
+    ps->nr_vcpus = ms->smp.cpus;
+    ps->vcpu = g_new0(PostcopyPrefetchVcpu, ps->nr_vcpus + 1);
+    return ps;
+}
+
+static void postcopy_prefetch_free(PostcopyPrefetchState *ps)
+{
+    g_free(ps->vcpu);
+    g_free(ps);
+}
+
+/*
+ * Ask the source for the page at @offset in @rb unless it is already
+ * there.  Returns false if no more pages should be prefetched for this
+ * fault, either because @offset is out of the RAMBlock or because too many
+ * requests are in flight already.
+ */
+static bool postcopy_prefetch_page(MigrationIncomingState *mis, RAMBlock *rb,
+                                   int64_t offset, int *count)
+{
+    uint64_t haddr;
+
+    if (offset < 0 || offset >= qemu_ram_get_used_length(rb)) {
+        return false;
+    }
+    if (qatomic_read(&mis->page_requested_count) >=
+        POSTCOPY_PREFETCH_MAX_INFLIGHT) {
+        return false;
+    }
+    /*
+     * Only the fault thread requests pages, so a clear bit in the
+     * requestedmap cannot go stale before migrate_send_rp_req_pages().
+     */
+    if (ramblock_recv_bitmap_test_byte_offset(rb, offset) ||
+        ramblock_req_bitmap_test_byte_offset(rb, offset) ||
+        ramblock_page_is_discarded(rb, offset)) {
+        return true;
+    }
+
+    haddr = (uintptr_t)qemu_ram_get_host_addr(rb) + offset;
+    if (migrate_send_rp_req_pages(mis, rb, offset, haddr)) {
+        /* The real fault will find out about the broken return path */
+        return false;
+    }
+    (*count)++;
+    return true;
+}
+
+/*
+ * Returns true if @offset is in a region of @rb that was faulted recently,
+ * and records the region otherwise.
+ */
+static bool postcopy_prefetch_region_hit(PostcopyPrefetchState *ps,
+                                         RAMBlock *rb, ram_addr_t offset)
+{
+    ram_addr_t region = ROUND_DOWN(offset, POSTCOPY_PREFETCH_REGION);
+    int i;
+
+    for (i = 0; i < POSTCOPY_PREFETCH_HISTORY; i++) {
+        if (ps->history[i].rb == rb && ps->history[i].region == region) {
+            return true;
+        }
+    }
+
+    i = ps->history_next++ % POSTCOPY_PREFETCH_HISTORY;
+    ps->history[i].rb = rb;
+    ps->history[i].region = region;
+    return false;
+}
+
+/*
+ * Called by the fault thread after it requested the page at @offset in
+ * @rb on behalf of vCPU @cpu (-1 if unknown).
+ */
+static void postcopy_prefetch(MigrationIncomingState *mis,
+                              PostcopyPrefetchState *ps, int cpu,
+                              RAMBlock *rb, ram_addr_t offset)
+{
+    PostcopyPrefetchVcpu *v = &ps->vcpu[cpu >= 0 ? cpu : ps->nr_vcpus];
+    PostcopyBlocktimeContext *dc = mis->blocktime_ctx;
+    unsigned int depth = migrate_postcopy_prefetch_depth();
+    size_t pagesize = qemu_ram_pagesize(rb);
+    int64_t delta, target;
+    int count = 0;
+    unsigned int k;
+
+    if (v->rb == rb) {
+        delta = (int64_t)offset - (int64_t)v->last_offset;
+        if (delta && delta == v->stride) {
+            v->hits++;
+        } else {
+            v->stride = delta;
+            v->hits = 0;
+            v->issued = offset;
+        }
+    } else {
+        v->rb = rb;
+        v->stride = 0;
+        v->hits = 0;
+        v->issued = offset;
+    }
+    v->last_offset = offset;
+
+    if (v->hits && v->stride >= -POSTCOPY_PREFETCH_MAX_STRIDE &&
+        v->stride <= POSTCOPY_PREFETCH_MAX_STRIDE) {
+        /* Continue from the last page requested along the stride */
+        for (k = 1; k <= depth; k++) {
+            target = offset + k * v->stride;
+            if (v->stride > 0 ? target <= v->issued : target >= v->issued) {
+                continue;
+            }
+            if (!postcopy_prefetch_page(mis, rb, target, &count)) {
+                break;
+            }
+            v->issued = target;
+        }
+        trace_postcopy_prefetch(qemu_ram_get_idstr(rb), offset, count,
+                                "stride");
+    } else if (postcopy_prefetch_region_hit(ps, rb, offset) &&
+               pagesize < POSTCOPY_PREFETCH_REGION) {
+        /* Fill in the pages that follow in the same region */
+        ram_addr_t end = ROUND_UP(offset + 1, POSTCOPY_PREFETCH_REGION);
+
+        for (k = 1; k <= depth; k++) {
+            target = offset + k * pagesize;
+            if (target >= end ||
+                !postcopy_prefetch_page(mis, rb, target, &count)) {
+                break;
+            }
+        }
+        trace_postcopy_prefetch(qemu_ram_get_idstr(rb), offset, count,
+                                "region");
+    }
+
+    if (dc && count) {
+        stat64_add(&dc->prefetched_pages, count);
+    }
+}
+
 /*
  * Handle faults detected by the USERFAULT markings
  */
 static void *postcopy_ram_fault_thread(void *opaque)
 {
     MigrationIncomingState *mis = opaque;
+    PostcopyPrefetchState *prefetch = postcopy_prefetch_new();
     struct uffd_msg msg;
     int ret;
     size_t index;
@@ -988,6 +1538,7 @@ static void *postcopy_ram_fault_thread(void *opaque)
     while (true) {
         ram_addr_t rb_offset;
         int poll_result;
+        int cpu;
 
         /*
          * We're mainly waiting for the kernel to give us a faulting HVA,
@@ -1068,9 +1619,10 @@ static void *postcopy_ram_fault_thread(void *opaque)
                                                 qemu_ram_get_idstr(rb),
                                                 rb_offset,
                                                 msg.arg.pagefault.feat.ptid);
+            cpu = msg.arg.pagefault.feat.ptid ?
+                  get_mem_fault_cpu_index(msg.arg.pagefault.feat.ptid) : -1;
             mark_postcopy_blocktime_begin(
-                    (uintptr_t)(msg.arg.pagefault.address),
-                                msg.arg.pagefault.feat.ptid, rb);
+                    (uintptr_t)(msg.arg.pagefault.address), cpu, rb);
 
 retry:
             /*
@@ -1084,6 +1636,10 @@ retry:
                 postcopy_pause_fault_thread(mis);
                 goto retry;
             }
+
+            if (migrate_postcopy_prefetch_depth()) {
+                postcopy_prefetch(mis, prefetch, cpu, rb, rb_offset);
+            }
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -1144,6 +1700,7 @@ retry:
     }
     rcu_unregister_thread();
     trace_postcopy_ram_fault_thread_exit();
+    postcopy_prefetch_free(prefetch);
     g_free(pfd);
     return NULL;
 }
@@ -1246,6 +1803,11 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
         return -1;
     }
 
+    if (postcopy_placer_setup(mis)) {
+        /* Error dumped in the sub-function */
+        return -1;
+    }
+
     if (migrate_postcopy_preempt()) {
         /*
          * This thread needs to be created after the temp pages because
@@ -1424,6 +1986,18 @@ int postcopy_place_page_zero(MigrationIncomingState *mis, void *host,
     g_assert_not_reached();
 }
 
+int postcopy_place_tmp_page(MigrationIncomingState *mis, int channel,
+                            PostcopyTmpPage *tmp_page, RAMBlock *rb,
+                            void *from)
+{
+    g_assert_not_reached();
+}
+
+int postcopy_placer_flush(MigrationIncomingState *mis, int channel)
+{
+    g_assert_not_reached();
+}
+
 int postcopy_wake_shared(struct PostCopyFD *pcfd,
                          uint64_t client_addr,
                          RAMBlock *rb)
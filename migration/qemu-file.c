@@ -37,6 +37,13 @@
 #define IO_BUF_SIZE 32768
 #define MAX_IOV_SIZE MIN_CONST(IOV_MAX, 64)
 
+/*
+ * With zero copy, the kernel keeps referencing the buffer after a write
+ * returned, so the QEMUFile rotates through this many buffers and only
+ * waits for the completions when it wraps around.
+ */
+#define ZERO_COPY_BUFS 64
+
 typedef struct FdEntry {
     QTAILQ_ENTRY(FdEntry) entry;
     int fd;
@@ -48,11 +55,19 @@ struct QEMUFile {
 
     int buf_index;
     int buf_size; /* 0 when writing */
-    uint8_t buf[IO_BUF_SIZE];
+    /* Either buf_storage, or one of zero_copy_bufs */
+    uint8_t *buf;
+    uint8_t buf_storage[IO_BUF_SIZE];
+
+    /* ZERO_COPY_BUFS buffers of IO_BUF_SIZE if zero copy is enabled */
+    uint8_t *zero_copy_bufs;
+    unsigned int zero_copy_buf;
 
     DECLARE_BITMAP(may_free, MAX_IOV_SIZE);
     struct iovec iov[MAX_IOV_SIZE];
     unsigned int iovcnt;
+    /* bytes written to ioc, see qemu_file_bytes_written() */
+    uint64_t bytes_flushed;
 
     int last_error;
     Error *last_error_obj;
@@ -116,6 +131,7 @@ static QEMUFile *qemu_file_new_impl(QIOChannel *ioc, bool is_writable)
 
     object_ref(ioc);
     f->ioc = ioc;
+    f->buf = f->buf_storage;
     f->is_writable = is_writable;
     f->can_pass_fd = qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_FD_PASS);
     QTAILQ_INIT(&f->fds);
@@ -268,6 +284,64 @@ static void qemu_iovec_release_ram(QEMUFile *f)
     memset(f->may_free, 0, sizeof(f->may_free));
 }
 
+/*
+ * Send everything that is written to @f with zero copy, including the
+ * buffers queued with qemu_put_buffer_async().  Those must not be freed
+ * until qemu_file_flush_zero_copy() or qemu_fclose() returns; changing
+ * them earlier can change the data that is sent.
+ */
+void qemu_file_set_zero_copy(QEMUFile *f)
+{
+    assert(qemu_file_is_writable(f));
+    assert(qio_channel_has_feature(f->ioc,
+                                   QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY));
+    assert(!f->zero_copy_bufs && !f->buf_index && !f->iovcnt);
+
+    f->zero_copy_bufs = g_malloc(ZERO_COPY_BUFS * IO_BUF_SIZE);
+    f->zero_copy_buf = 0;
+    f->buf = f->zero_copy_bufs;
+}
+
+/*
+ * Wait until the kernel is done with all data written with zero copy.
+ * This is done even when @f has an error already.  Returns a negative
+ * error value if that cannot be established.
+ */
+int qemu_file_flush_zero_copy(QEMUFile *f)
+{
+    Error *local_error = NULL;
+    int ret;
+
+    if (!f->zero_copy_bufs) {
+        return 0;
+    }
+
+    ret = qio_channel_flush(f->ioc, &local_error);
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_error);
+        return -EIO;
+    }
+    if (ret == 1) {
+        /* The kernel fell back to copying */
+        stat64_add(&mig_stats.dirty_sync_missed_zero_copy, 1);
+    }
+    return 0;
+}
+
+/*
+ * The data in f->buf was just written with zero copy, so switch to the
+ * next buffer.  Before coming back to the first one, wait for the kernel
+ * to release all of them.
+ */
+static void qemu_file_next_zero_copy_buf(QEMUFile *f)
+{
+    f->zero_copy_buf = (f->zero_copy_buf + 1) % ZERO_COPY_BUFS;
+    if (!f->zero_copy_buf) {
+        qemu_file_flush_zero_copy(f);
+    }
+    f->buf = f->zero_copy_bufs + f->zero_copy_buf * IO_BUF_SIZE;
+}
+
 bool qemu_file_is_seekable(QEMUFile *f)
 {
     return qio_channel_has_feature(f->ioc, QIO_CHANNEL_FEATURE_SEEKABLE);
@@ -290,16 +364,23 @@ int qemu_fflush(QEMUFile *f)
     }
     if (f->iovcnt > 0) {
         Error *local_error = NULL;
-        if (qio_channel_writev_all(f->ioc,
-                                   f->iov, f->iovcnt,
-                                   &local_error) < 0) {
+        int flags = f->zero_copy_bufs ? QIO_CHANNEL_WRITE_FLAG_ZERO_COPY : 0;
+
+        if (qio_channel_writev_full_all(f->ioc,
+                                        f->iov, f->iovcnt, NULL, 0, flags,
+                                        &local_error) < 0) {
             qemu_file_set_error_obj(f, -EIO, local_error);
         } else {
             uint64_t size = iov_size(f->iov, f->iovcnt);
             stat64_add(&mig_stats.qemu_file_transferred, size);
+            f->bytes_flushed += size;
         }
 
         qemu_iovec_release_ram(f);
+
+        if (f->zero_copy_bufs && f->buf_index) {
+            qemu_file_next_zero_copy_buf(f);
+        }
     }
 
     f->buf_index = 0;
@@ -433,7 +514,20 @@ int qemu_fclose(QEMUFile *f)
 {
     FdEntry *fde, *next;
     int ret = qemu_fflush(f);
-    int ret2 = qio_channel_close(f->ioc, NULL);
+    int ret2;
+
+    /*
+     * The kernel must be done with the buffers before they are freed, also
+     * when the last flush failed.  If it may still be using them, leak them.
+     */
+    ret2 = qemu_file_flush_zero_copy(f);
+    if (ret2 < 0) {
+        f->zero_copy_bufs = NULL;
+    }
+    if (ret >= 0) {
+        ret = ret2;
+    }
+    ret2 = qio_channel_close(f->ioc, NULL);
     if (ret >= 0) {
         ret = ret2;
     }
@@ -444,6 +538,7 @@ int qemu_fclose(QEMUFile *f)
     }
     g_clear_pointer(&f->ioc, object_unref);
     error_free(f->last_error_obj);
+    g_free(f->zero_copy_bufs);
     g_free(f);
     trace_qemu_file_fclose();
     return ret;
@@ -791,6 +886,20 @@ int coroutine_mixed_fn qemu_get_byte(QEMUFile *f)
     return result;
 }
 
+uint64_t qemu_file_bytes_written(QEMUFile *f)
+{
+    uint64_t ret = f->bytes_flushed;
+    int i;
+
+    g_assert(qemu_file_is_writable(f));
+
+    for (i = 0; i < f->iovcnt; i++) {
+        ret += f->iov[i].iov_len;
+    }
+
+    return ret;
+}
+
 uint64_t qemu_file_transferred(QEMUFile *f)
 {
     uint64_t ret = stat64_get(&mig_stats.qemu_file_transferred);
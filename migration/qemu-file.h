@@ -45,6 +45,16 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC(QEMUFile, qemu_fclose)
  */
 uint64_t qemu_file_transferred(QEMUFile *f);
 
+/*
+ * qemu_file_bytes_written:
+ *
+ * Like qemu_file_transferred(), but only counts what was written to @f,
+ * so it can tell where data starts in the output of @f.
+ *
+ * Returns: the bytes written to @f, flushed or still queued
+ */
+uint64_t qemu_file_bytes_written(QEMUFile *f);
+
 /*
  * put_buffer without copying the buffer.
  * The buffer should be available till it is sent asynchronously.
@@ -71,6 +81,8 @@ void qemu_file_set_error(QEMUFile *f, int ret);
 int qemu_file_shutdown(QEMUFile *f);
 QEMUFile *qemu_file_get_return_path(QEMUFile *f);
 int qemu_fflush(QEMUFile *f);
+void qemu_file_set_zero_copy(QEMUFile *f);
+int qemu_file_flush_zero_copy(QEMUFile *f);
 void qemu_file_set_blocking(QEMUFile *f, bool block);
 int qemu_file_get_to_fd(QEMUFile *f, int fd, size_t size);
 void qemu_set_offset(QEMUFile *f, off_t off, int whence);
@@ -33,6 +33,7 @@
 #include "qemu/madvise.h"
 #include "qemu/main-loop.h"
 #include "xbzrle.h"
+#include "host-bitmap.h"
 #include "ram.h"
 #include "migration.h"
 #include "migration-stats.h"
@@ -55,12 +56,16 @@
 #include "system/cpu-throttle.h"
 #include "savevm.h"
 #include "qemu/iov.h"
+#include "io/channel-file.h"
 #include "multifd.h"
 #include "system/runstate.h"
 #include "rdma.h"
 #include "options.h"
+#include "convergence.h"
 #include "system/dirtylimit.h"
 #include "system/kvm.h"
+#include "system/qtest.h"
+#include "system/hostmem.h"
 
 #include "hw/boards.h" /* for machine_dump_guest_core() */
 
@@ -89,6 +94,13 @@
  */
 #define MAPPED_RAM_LOAD_BUF_SIZE 0x100000
 
+/*
+ * With mapped-ram-lazy-load, every run of pages present in the migration
+ * file becomes a separate mapping.  Fall back to reading the pages if a
+ * RAMBlock would need more mappings than this.
+ */
+#define MAPPED_RAM_LAZY_LOAD_MAX_MAPPINGS 1024
+
 XBZRLECacheStats xbzrle_counters;
 
 /*
@@ -257,6 +269,8 @@ static void ramblock_recv_map_init(void)
     RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
         assert(!rb->receivedmap);
         rb->receivedmap = bitmap_new(rb->max_length >> qemu_target_page_bits());
+        rb->requestedmap = bitmap_new(rb->max_length >>
+                                      qemu_target_page_bits());
     }
 }
 
@@ -288,6 +302,30 @@ void ramblock_recv_bitmap_set_offset(RAMBlock *rb, uint64_t byte_offset)
 {
     set_bit_atomic(byte_offset >> TARGET_PAGE_BITS, rb->receivedmap);
 }
+
+bool ramblock_req_bitmap_test_byte_offset(RAMBlock *rb, uint64_t byte_offset)
+{
+    uint64_t offset = ROUND_DOWN(byte_offset, qemu_ram_pagesize(rb));
+
+    return test_bit(offset >> TARGET_PAGE_BITS, rb->requestedmap);
+}
+
+/*
+ * Marks the host page containing @byte_offset as requested from the
+ * source, and returns whether it was requested already.  The caller must
+ * hold page_request_mutex.
+ */
+bool ramblock_req_bitmap_test_and_set(RAMBlock *rb, uint64_t byte_offset)
+{
+    uint64_t offset = ROUND_DOWN(byte_offset, qemu_ram_pagesize(rb));
+    unsigned long nr = offset >> TARGET_PAGE_BITS;
+
+    if (test_bit(nr, rb->requestedmap)) {
+        return true;
+    }
+    set_bit(nr, rb->requestedmap);
+    return false;
+}
 #define  RAMBLOCK_RECV_BITMAP_ENDING  (0x0123456789abcdefULL)
 
 /*
@@ -709,6 +747,33 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
     return 1;
 }
 
+/**
+ * ramblock_find_next_dirty: find the next dirty page of a ramblock
+ *
+ * Returns the index of the first dirty page of @rb between @start and
+ * @size, or @size if there is none.  For ramblocks backed by huge pages,
+ * see host_bitmap_find_next_dirty().
+ *
+ * The caller must hold ram_state.bitmap_mutex, unless nothing else can
+ * access the bitmaps.
+ *
+ * @rb: RAMBlock where to search for dirty pages
+ * @size: page where the search stops
+ * @start: page where we start the search
+ */
+static unsigned long ramblock_find_next_dirty(RAMBlock *rb,
+                                              unsigned long size,
+                                              unsigned long start)
+{
+    if (!rb->host_bmap) {
+        return find_next_bit(rb->bmap, size, start);
+    }
+
+    return host_bitmap_find_next_dirty(rb->bmap, rb->host_bmap,
+                                       ctz64(rb->page_size) - TARGET_PAGE_BITS,
+                                       size, start);
+}
+
 /**
  * pss_find_next_dirty: find the next dirty page of current ramblock
  *
@@ -724,7 +789,6 @@ static void pss_find_next_dirty(PageSearchStatus *pss)
 {
     RAMBlock *rb = pss->block;
     unsigned long size = rb->used_length >> TARGET_PAGE_BITS;
-    unsigned long *bitmap = rb->bmap;
 
     if (migrate_ram_is_ignored(rb)) {
         /* Points directly to the end, so we know no dirty page */
@@ -741,7 +805,7 @@ static void pss_find_next_dirty(PageSearchStatus *pss)
         size = MIN(size, pss->host_page_end);
     }
 
-    pss->page = find_next_bit(bitmap, size, pss->page);
+    pss->page = ramblock_find_next_dirty(rb, size, pss->page);
 }
 
 static void migration_clear_memory_region_dirty_bitmap(RAMBlock *rb,
@@ -932,14 +996,49 @@ bool ramblock_page_is_discarded(RAMBlock *rb, ram_addr_t start)
     return false;
 }
 
+/*
+ * Sync the dirty bitmap of a ramblock backed by huge pages one host page
+ * at a time, and mark the host pages that have new dirty pages in
+ * @rb->host_bmap.  The dirty log itself stays at target page granularity,
+ * so sending a host page only sends its dirty target pages.
+ *
+ * Called with RCU critical section
+ */
+static uint64_t ramblock_sync_host_pages(RAMBlock *rb)
+{
+    uint64_t new_dirty_pages = 0;
+    unsigned long hp = 0;
+    ram_addr_t start;
+
+    for (start = 0; start < rb->used_length; start += rb->page_size) {
+        uint64_t n = cpu_physical_memory_sync_dirty_bitmap(
+                        rb, start, MIN(rb->page_size, rb->used_length - start));
+
+        if (n) {
+            set_bit(hp, rb->host_bmap);
+            new_dirty_pages += n;
+        }
+        hp++;
+    }
+
+    return new_dirty_pages;
+}
+
 /* Called with RCU critical section */
 static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
 {
-    uint64_t new_dirty_pages =
-        cpu_physical_memory_sync_dirty_bitmap(rb, 0, rb->used_length);
+    uint64_t new_dirty_pages;
+
+    if (rb->host_bmap) {
+        new_dirty_pages = ramblock_sync_host_pages(rb);
+    } else {
+        new_dirty_pages =
+            cpu_physical_memory_sync_dirty_bitmap(rb, 0, rb->used_length);
+    }
 
     rs->migration_dirty_pages += new_dirty_pages;
     rs->num_dirty_pages_period += new_dirty_pages;
+    rb->dirty_pages_period += new_dirty_pages;
 }
 
 /**
@@ -1041,6 +1140,22 @@ static void migration_trigger_throttle(RAMState *rs)
     uint64_t bytes_dirty_period = rs->num_dirty_pages_period * TARGET_PAGE_SIZE;
     uint64_t bytes_dirty_threshold = bytes_xfer_period * threshold / 100;
 
+    if (migrate_convergence_control()) {
+        switch (migration_convergence_decide()) {
+        case MIGRATION_CONVERGENCE_ACTION_THROTTLE:
+            trace_migration_throttle();
+            mig_throttle_guest_down(bytes_dirty_period,
+                                    bytes_dirty_threshold);
+            break;
+        case MIGRATION_CONVERGENCE_ACTION_DIRTY_LIMIT:
+            migration_dirty_limit_guest();
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+
     /*
      * The following detection logic can be refined later. For now:
      * Check to see if the ratio between dirtied bytes and the approx.
@@ -1091,6 +1206,8 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     /* more than 1 second = 1000 millisecons */
     if (end_time > rs->time_last_bitmap_sync + 1000) {
+        migration_convergence_update_dirty(end_time -
+                                           rs->time_last_bitmap_sync);
         migration_trigger_throttle(rs);
 
         migration_update_rates(rs, end_time);
@@ -2382,6 +2499,8 @@ static void ram_bitmaps_destroy(void)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->host_bmap);
+        block->host_bmap = NULL;
         g_free(block->file_bmap);
         block->file_bmap = NULL;
     }
@@ -2559,7 +2678,7 @@ static void postcopy_chunk_hostpages_pass(MigrationState *ms, RAMBlock *block)
     }
 
     /* Find a dirty page */
-    run_start = find_next_bit(bitmap, pages, 0);
+    run_start = ramblock_find_next_dirty(block, pages, 0);
 
     while (run_start < pages) {
 
@@ -2595,7 +2714,7 @@ static void postcopy_chunk_hostpages_pass(MigrationState *ms, RAMBlock *block)
         }
 
         /* Find the next dirty page for the next iteration */
-        run_start = find_next_bit(bitmap, pages, run_start);
+        run_start = ramblock_find_next_dirty(block, pages, run_start);
     }
 }
 
@@ -2660,6 +2779,8 @@ int ram_discard_range(const char *rbname, uint64_t start, size_t length)
     if (rb->receivedmap) {
         bitmap_clear(rb->receivedmap, start >> qemu_target_page_bits(),
                      length >> qemu_target_page_bits());
+        bitmap_clear(rb->requestedmap, start >> qemu_target_page_bits(),
+                     length >> qemu_target_page_bits());
     }
 
     return ram_block_discard_range(rb, start, length);
@@ -2777,6 +2898,15 @@ static void ram_list_init_bitmaps(void)
              */
             block->bmap = bitmap_new(pages);
             bitmap_set(block->bmap, 0, pages);
+            if (block->page_size > TARGET_PAGE_SIZE) {
+                unsigned long hps = DIV_ROUND_UP(block->max_length,
+                                                 block->page_size);
+
+                block->host_bmap = bitmap_new(hps);
+                bitmap_set(block->host_bmap, 0, hps);
+            }
+            block->dirty_pages_period = 0;
+            block->dirty_rate = 0;
             if (migrate_mapped_ram()) {
                 block->file_bmap = bitmap_new(pages);
             }
@@ -3691,6 +3821,8 @@ static int ram_load_cleanup(void *opaque)
     RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
         g_free(rb->receivedmap);
         rb->receivedmap = NULL;
+        g_free(rb->requestedmap);
+        rb->requestedmap = NULL;
     }
 
     return 0;
@@ -3725,7 +3857,7 @@ int ram_postcopy_incoming_init(MigrationIncomingState *mis)
  */
 int ram_load_postcopy(QEMUFile *f, int channel)
 {
-    int flags = 0, ret = 0;
+    int flags = 0, ret = 0, flush_ret;
     bool place_needed = false;
     bool matches_target_page_size = false;
     MigrationIncomingState *mis = migration_incoming_get_current();
@@ -3863,18 +3995,16 @@ int ram_load_postcopy(QEMUFile *f, int channel)
         }
 
         if (!ret && place_needed) {
-            if (tmp_page->all_zero) {
-                ret = postcopy_place_page_zero(mis, tmp_page->host_addr, block);
-            } else {
-                ret = postcopy_place_page(mis, tmp_page->host_addr,
-                                          place_source, block);
-            }
+            ret = postcopy_place_tmp_page(mis, channel, tmp_page, block,
+                                          place_source);
             place_needed = false;
-            postcopy_temp_page_reset(tmp_page);
         }
     }
 
-    return ret;
+    /* Pages handed over to a placement thread must be in place on return */
+    flush_ret = postcopy_placer_flush(mis, channel);
+
+    return ret ? ret : flush_ret;
 }
 
 static bool postcopy_is_running(void)
@@ -4005,6 +4135,215 @@ err:
     return false;
 }
 
+/*
+ * Map the pages of @block that are present in the migration file over
+ * guest memory, instead of reading them.  The mappings are private, so
+ * pages are read from the file (or the page cache) on first access and
+ * copied on first write.  Pages that are not present in the file are left
+ * alone, exactly like read_ramblock_mapped_ram() does.
+ *
+ * Returns false on error.  On success, *mapped tells whether the block
+ * was mapped, or whether its pages need to be read as usual.
+ */
+#ifndef _WIN32
+/*
+ * RAMBlocks that are mapped from a migration file depend on it until they
+ * are freed: writing the file changes guest memory, and truncating it
+ * makes guest accesses raise SIGBUS.  A shared lock on the file keeps
+ * outgoing file migrations, which take an exclusive lock, from writing to
+ * it.  This must be an open file description lock, as a process loses its
+ * POSIX locks when it closes any descriptor for the file.
+ *
+ * The memory must not be discarded either: MADV_DONTNEED on a private file
+ * mapping brings back the contents of the file instead of zeroes.
+ *
+ * The lock is taken and discards are disabled when the first RAMBlock is
+ * mapped, and released when the last one is freed.
+ */
+static struct {
+    RAMBlockNotifier notifier;
+    bool notifier_added;
+    int fd;                 /* holds the lock, -1 if nothing is mapped */
+    GHashTable *blocks;     /* host addresses of the mapped RAMBlocks */
+} mapped_ram_lazy_load = {
+    .fd = -1,
+};
+
+static void mapped_ram_lazy_load_block_removed(RAMBlockNotifier *n,
+                                               void *host, size_t size,
+                                               size_t max_size)
+{
+    if (!g_hash_table_remove(mapped_ram_lazy_load.blocks, host) ||
+        g_hash_table_size(mapped_ram_lazy_load.blocks)) {
+        return;
+    }
+
+    ram_block_discard_disable(false);
+    close(mapped_ram_lazy_load.fd);
+    mapped_ram_lazy_load.fd = -1;
+}
+
+static bool mapped_ram_lazy_load_same_file(int fd1, int fd2)
+{
+    struct stat st1, st2;
+
+    return !fstat(fd1, &st1) && !fstat(fd2, &st2) &&
+           st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+}
+
+/*
+ * Lock the migration file @fd before mapping @block from it.  Returns
+ * false if @block cannot be mapped, and must be read instead.
+ */
+static bool mapped_ram_lazy_load_lock(RAMBlock *block, int fd)
+{
+    int lock_fd;
+
+    if (mapped_ram_lazy_load.fd >= 0) {
+        /* One migration file at a time */
+        if (!mapped_ram_lazy_load_same_file(mapped_ram_lazy_load.fd, fd)) {
+            return false;
+        }
+        g_hash_table_add(mapped_ram_lazy_load.blocks, block->host);
+        return true;
+    }
+
+    if (!qemu_has_ofd_lock()) {
+        return false;
+    }
+    lock_fd = qemu_dup(fd);
+    if (lock_fd < 0) {
+        return false;
+    }
+    if (qemu_lock_fd(lock_fd, 0, 0, false) < 0) {
+        close(lock_fd);
+        return false;
+    }
+
+    /* Fails if something relies on discards, like virtio-mem */
+    if (ram_block_discard_disable(true)) {
+        close(lock_fd);
+        return false;
+    }
+
+    if (!mapped_ram_lazy_load.notifier_added) {
+        mapped_ram_lazy_load.blocks = g_hash_table_new(NULL, NULL);
+        mapped_ram_lazy_load.notifier.ram_block_removed =
+            mapped_ram_lazy_load_block_removed;
+        ram_block_notifier_add(&mapped_ram_lazy_load.notifier);
+        mapped_ram_lazy_load.notifier_added = true;
+    }
+    mapped_ram_lazy_load.fd = lock_fd;
+    g_hash_table_add(mapped_ram_lazy_load.blocks, block->host);
+    return true;
+}
+
+/* Apply the advice that ram_block_add() and the memory backend gave */
+static void mapped_ram_madvise(RAMBlock *block, void *host, size_t size)
+{
+    HostMemoryBackend *backend = (HostMemoryBackend *)
+        object_dynamic_cast(block->mr->owner, TYPE_MEMORY_BACKEND);
+
+    if (!machine_dump_guest_core(current_machine) ||
+        (backend && !backend->dump)) {
+        qemu_madvise(host, size, QEMU_MADV_DONTDUMP);
+    }
+    if (machine_mem_merge(current_machine) && (!backend || backend->merge)) {
+        qemu_madvise(host, size, QEMU_MADV_MERGEABLE);
+    }
+    qemu_madvise(host, size, QEMU_MADV_HUGEPAGE);
+    if (!qtest_enabled()) {
+        qemu_madvise(host, size, QEMU_MADV_DONTFORK);
+    }
+}
+#endif
+
+static bool mapped_ram_map_ramblock(QEMUFile *f, RAMBlock *block,
+                                    long num_pages, unsigned long *bitmap,
+                                    bool *mapped, Error **errp)
+{
+#ifndef _WIN32
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    HostMemoryBackend *backend;
+    unsigned long set_bit_idx, clear_bit_idx;
+    unsigned int nr_mappings = 0;
+    ram_addr_t offset, size;
+    void *host;
+    int fd;
+
+    *mapped = false;
+
+    /*
+     * Mapping replaces the memory under the RAMBlock, which must not be
+     * shared with anybody else: not with another process through a file
+     * descriptor, and not with devices that pinned it for DMA (those also
+     * disable RAM discards).  A NUMA policy would not carry over to the
+     * new mapping either.
+     */
+    backend = (HostMemoryBackend *)object_dynamic_cast(block->mr->owner,
+                                                       TYPE_MEMORY_BACKEND);
+    if (!object_dynamic_cast(OBJECT(ioc), TYPE_QIO_CHANNEL_FILE) ||
+        block->fd >= 0 || qemu_ram_is_shared(block) ||
+        (backend && backend->policy != HOST_MEM_POLICY_DEFAULT) ||
+        (mapped_ram_lazy_load.fd < 0 && ram_block_discard_is_disabled()) ||
+        qemu_ram_pagesize(block) != qemu_real_host_page_size() ||
+        TARGET_PAGE_SIZE != qemu_real_host_page_size() ||
+        !QEMU_IS_ALIGNED(block->pages_offset, qemu_real_host_page_size())) {
+        trace_ram_mapped_ram_lazy_load_skip(block->idstr);
+        return true;
+    }
+    fd = QIO_CHANNEL_FILE(ioc)->fd;
+
+    for (set_bit_idx = find_first_bit(bitmap, num_pages);
+         set_bit_idx < num_pages;
+         set_bit_idx = find_next_bit(bitmap, num_pages, clear_bit_idx + 1)) {
+        clear_bit_idx = find_next_zero_bit(bitmap, num_pages, set_bit_idx + 1);
+        if (++nr_mappings > MAPPED_RAM_LAZY_LOAD_MAX_MAPPINGS) {
+            trace_ram_mapped_ram_lazy_load_skip(block->idstr);
+            return true;
+        }
+    }
+
+    if (!mapped_ram_lazy_load_lock(block, fd)) {
+        trace_ram_mapped_ram_lazy_load_skip(block->idstr);
+        return true;
+    }
+
+    for (set_bit_idx = find_first_bit(bitmap, num_pages);
+         set_bit_idx < num_pages;
+         set_bit_idx = find_next_bit(bitmap, num_pages, clear_bit_idx + 1)) {
+        clear_bit_idx = find_next_zero_bit(bitmap, num_pages, set_bit_idx + 1);
+
+        offset = set_bit_idx << TARGET_PAGE_BITS;
+        size = (clear_bit_idx - set_bit_idx) << TARGET_PAGE_BITS;
+        if (offset + size > block->used_length) {
+            error_setg(errp, "page outside of ramblock %s range",
+                       block->idstr);
+            return false;
+        }
+
+        host = mmap(block->host + offset, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_FIXED, fd, block->pages_offset + offset);
+        if (host == MAP_FAILED) {
+            /* The old memory may be gone already, so this is fatal */
+            error_setg_errno(errp, errno,
+                             "(%s) failed to map file offset %" PRIx64,
+                             block->idstr, block->pages_offset + offset);
+            return false;
+        }
+
+        mapped_ram_madvise(block, host, size);
+    }
+
+    trace_ram_mapped_ram_lazy_load(block->idstr, nr_mappings);
+    *mapped = true;
+    return true;
+#else
+    *mapped = false;
+    return true;
+#endif
+}
+
 static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
                                       ram_addr_t length, Error **errp)
 {
@@ -4012,6 +4351,7 @@ static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
     MappedRamHeader header;
     size_t bitmap_size;
     long num_pages;
+    bool mapped = false;
 
     if (!mapped_ram_read_header(f, &header, errp)) {
         return;
@@ -4042,7 +4382,15 @@ static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
         return;
     }
 
-    if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
+    if (migrate_mapped_ram_lazy_load()) {
+        if (!mapped_ram_map_ramblock(f, block, num_pages, bitmap, &mapped,
+                                     errp)) {
+            return;
+        }
+    }
+
+    if (!mapped &&
+        !read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
         return;
     }
 
@@ -4467,6 +4815,10 @@ bool ram_dirty_bitmap_reload(MigrationState *s, RAMBlock *block, Error **errp)
      * dirty bitmap for this ramblock.
      */
     bitmap_complement(block->bmap, block->bmap, nbits);
+    if (block->host_bmap) {
+        bitmap_fill(block->host_bmap,
+                    DIV_ROUND_UP(block->max_length, block->page_size));
+    }
 
     /* Clear dirty bits of discarded ranges that we don't want to migrate. */
     ramblock_dirty_bitmap_clear_discarded_pages(block);
@@ -1834,9 +1834,15 @@ void qemu_savevm_live_state(QEMUFile *f)
     qemu_put_byte(f, QEMU_VM_EOF);
 }
 
-int qemu_save_device_state(QEMUFile *f)
+/*
+ * If @section_ends is not NULL, the number of bytes written to @f since
+ * the start of the call is appended to it at the end of each section, so
+ * that callers can tell the sections apart in the output.
+ */
+int qemu_save_device_state(QEMUFile *f, GArray *section_ends)
 {
     MigrationState *ms = migrate_get_current();
+    uint64_t start = qemu_file_bytes_written(f);
     Error *local_err = NULL;
     SaveStateEntry *se;
 
@@ -1858,6 +1864,11 @@ int qemu_save_device_state(QEMUFile *f)
             error_report_err(local_err);
             return ret;
         }
+        if (section_ends) {
+            uint64_t end = qemu_file_bytes_written(f) - start;
+
+            g_array_append_val(section_ends, end);
+        }
     }
 
     qemu_put_byte(f, QEMU_VM_EOF);
@@ -3385,7 +3396,7 @@ void qmp_xen_save_devices_state(const char *filename, bool has_live, bool live,
     qio_channel_set_name(QIO_CHANNEL(ioc), "migration-xen-save-state");
     f = qemu_file_new_output(QIO_CHANNEL(ioc));
     object_unref(OBJECT(ioc));
-    ret = qemu_save_device_state(f);
+    ret = qemu_save_device_state(f, NULL);
     if (ret < 0 || qemu_fclose(f) < 0) {
         error_setg(errp, "saving Xen device state failed");
     } else {
@@ -18,7 +18,9 @@
 #include "qobject/json-writer.h"
 #include "qemu-file.h"
 #include "qemu/bitops.h"
+#include "qemu/bswap.h"
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
 #include "trace.h"
 
 static int vmstate_subsection_save(QEMUFile *f, const VMStateDescription *vmsd,
@@ -131,6 +133,318 @@ static void vmstate_handle_alloc(void *ptr, const VMStateField *field,
     }
 }
 
+/*
+ * Most fields are integers, or fixed size arrays of them, that exist
+ * whenever the description is saved or loaded at its own version.  The
+ * first time a description is used, each of its fields is compiled into
+ * an operation.  Such plain fields are then saved and loaded with bulk
+ * copies and byte swaps instead of a VMStateInfo call per element, while
+ * all other fields still go through the interpreter.
+ */
+typedef enum {
+    VMSTATE_OP_FIELD,           /* Interpreted */
+    VMSTATE_OP_BYTES,           /* Copied as is */
+    VMSTATE_OP_BOOL,
+    VMSTATE_OP_BE,              /* Big endian integers */
+} VMStateOpKind;
+
+typedef struct VMStateOp {
+    VMStateOpKind kind;
+    uint32_t n_elems;
+    uint32_t size;
+} VMStateOp;
+
+typedef struct VMStatePlan {
+    /* What the plan was compiled from, to catch reuse of @vmsd */
+    const VMStateField *fields;
+    int version_id;
+    int nr_ops;
+    VMStateOp ops[];
+} VMStatePlan;
+
+static QemuMutex vmstate_plans_lock;
+static GHashTable *vmstate_plans;
+
+static void __attribute__((__constructor__)) vmstate_plans_init(void)
+{
+    qemu_mutex_init(&vmstate_plans_lock);
+    vmstate_plans = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+}
+
+static VMStateOpKind vmstate_compile_field(const VMStateDescription *vmsd,
+                                           const VMStateField *field)
+{
+    const VMStateInfo *info = field->info;
+
+    if (field->field_exists || field->version_id > vmsd->version_id) {
+        return VMSTATE_OP_FIELD;
+    }
+
+    switch (field->flags & ~VMS_MUST_EXIST) {
+    case VMS_SINGLE:
+    case VMS_ARRAY:
+        break;
+    case VMS_BUFFER:
+        return info == &vmstate_info_buffer ? VMSTATE_OP_BYTES :
+                                              VMSTATE_OP_FIELD;
+    default:
+        return VMSTATE_OP_FIELD;
+    }
+
+    switch (field->size) {
+    case 1:
+        if (info == &vmstate_info_uint8 || info == &vmstate_info_int8) {
+            return VMSTATE_OP_BYTES;
+        }
+        if (info == &vmstate_info_bool) {
+            return VMSTATE_OP_BOOL;
+        }
+        break;
+    case 2:
+        if (info == &vmstate_info_uint16 || info == &vmstate_info_int16) {
+            return VMSTATE_OP_BE;
+        }
+        break;
+    case 4:
+        if (info == &vmstate_info_uint32 || info == &vmstate_info_int32) {
+            return VMSTATE_OP_BE;
+        }
+        break;
+    case 8:
+        if (info == &vmstate_info_uint64 || info == &vmstate_info_int64) {
+            return VMSTATE_OP_BE;
+        }
+        break;
+    }
+    return VMSTATE_OP_FIELD;
+}
+
+static VMStatePlan *vmstate_compile(const VMStateDescription *vmsd)
+{
+    const VMStateField *field;
+    VMStatePlan *plan;
+    int i, nr_fields = 0;
+
+    for (field = vmsd->fields; field->name; field++) {
+        nr_fields++;
+    }
+    assert(field->flags == VMS_END);
+
+    plan = g_malloc(sizeof(*plan) + nr_fields * sizeof(plan->ops[0]));
+    plan->fields = vmsd->fields;
+    plan->version_id = vmsd->version_id;
+    plan->nr_ops = nr_fields;
+
+    for (i = 0; i < nr_fields; i++) {
+        field = &vmsd->fields[i];
+        plan->ops[i] = (VMStateOp) {
+            .kind = vmstate_compile_field(vmsd, field),
+            .n_elems = field->flags & VMS_ARRAY ? field->num : 1,
+            .size = field->size,
+        };
+    }
+
+    trace_vmstate_compile(vmsd->name, nr_fields);
+    return plan;
+}
+
+static const VMStatePlan *vmstate_get_plan(const VMStateDescription *vmsd)
+{
+    VMStatePlan *plan;
+
+    QEMU_LOCK_GUARD(&vmstate_plans_lock);
+
+    plan = g_hash_table_lookup(vmstate_plans, vmsd);
+    if (!plan || plan->fields != vmsd->fields ||
+        plan->version_id != vmsd->version_id) {
+        plan = vmstate_compile(vmsd);
+        g_hash_table_insert(vmstate_plans, (gpointer)vmsd, plan);
+    }
+    return plan;
+}
+
+static void vmstate_put_be_array(QEMUFile *f, const void *pv, size_t size,
+                                 size_t n_elems)
+{
+    uint8_t buf[256];
+
+    while (n_elems) {
+        size_t i, n = MIN(n_elems, sizeof(buf) / size);
+
+        for (i = 0; i < n; i++, pv += size) {
+            switch (size) {
+            case 2:
+                stw_be_p(buf + i * 2, lduw_he_p(pv));
+                break;
+            case 4:
+                stl_be_p(buf + i * 4, ldl_he_p(pv));
+                break;
+            default:
+                stq_be_p(buf + i * 8, ldq_he_p(pv));
+                break;
+            }
+        }
+        qemu_put_buffer(f, buf, n * size);
+        n_elems -= n;
+    }
+}
+
+static void vmstate_get_be_array(QEMUFile *f, void *pv, size_t size,
+                                 size_t n_elems)
+{
+    uint8_t buf[256];
+
+    while (n_elems) {
+        size_t i, n = MIN(n_elems, sizeof(buf) / size);
+
+        if (qemu_get_buffer(f, buf, n * size) != n * size) {
+            return;
+        }
+        for (i = 0; i < n; i++, pv += size) {
+            switch (size) {
+            case 2:
+                stw_he_p(pv, lduw_be_p(buf + i * 2));
+                break;
+            case 4:
+                stl_he_p(pv, ldl_be_p(buf + i * 4));
+                break;
+            default:
+                stq_he_p(pv, ldq_be_p(buf + i * 8));
+                break;
+            }
+        }
+        n_elems -= n;
+    }
+}
+
+static void vmstate_get_bool_array(QEMUFile *f, bool *v, size_t n_elems)
+{
+    uint8_t buf[256];
+
+    while (n_elems) {
+        size_t i, n = MIN(n_elems, sizeof(buf));
+
+        if (qemu_get_buffer(f, buf, n) != n) {
+            return;
+        }
+        for (i = 0; i < n; i++) {
+            *v++ = buf[i];
+        }
+        n_elems -= n;
+    }
+}
+
+static int vmstate_load_field(QEMUFile *f, const VMStateDescription *vmsd,
+                              const VMStateField *field, void *opaque,
+                              int version_id)
+{
+    bool exists = vmstate_field_exists(vmsd, field, opaque, version_id);
+    int ret;
+
+    trace_vmstate_load_state_field(vmsd->name, field->name, exists);
+    if (exists) {
+        void *first_elem = opaque + field->offset;
+        int i, n_elems = vmstate_n_elems(opaque, field);
+        int size = vmstate_size(opaque, field);
+
+        vmstate_handle_alloc(first_elem, field, opaque);
+        if (field->flags & VMS_POINTER) {
+            first_elem = *(void **)first_elem;
+            assert(first_elem || !n_elems || !size);
+        }
+        for (i = 0; i < n_elems; i++) {
+            void *curr_elem = first_elem + size * i;
+            const VMStateField *inner_field;
+
+            if (field->flags & VMS_ARRAY_OF_POINTER) {
+                curr_elem = *(void **)curr_elem;
+            }
+
+            if (!curr_elem && size) {
+                /*
+                 * If null pointer found (which should only happen in
+                 * an array of pointers), use null placeholder and do
+                 * not follow.
+                 */
+                inner_field = vmsd_create_fake_nullptr_field(field);
+            } else {
+                inner_field = field;
+            }
+
+            if (inner_field->flags & VMS_STRUCT) {
+                ret = vmstate_load_state(f, inner_field->vmsd, curr_elem,
+                                         inner_field->vmsd->version_id);
+            } else if (inner_field->flags & VMS_VSTRUCT) {
+                ret = vmstate_load_state(f, inner_field->vmsd, curr_elem,
+                                         inner_field->struct_version_id);
+            } else {
+                ret = inner_field->info->get(f, curr_elem, size,
+                                             inner_field);
+            }
+
+            /* If we used a fake temp field.. free it now */
+            if (inner_field != field) {
+                g_clear_pointer((gpointer *)&inner_field, g_free);
+            }
+
+            if (ret >= 0) {
+                ret = qemu_file_get_error(f);
+            }
+            if (ret < 0) {
+                qemu_file_set_error(f, ret);
+                error_report("Failed to load %s:%s", vmsd->name,
+                             field->name);
+                trace_vmstate_load_field_error(field->name, ret);
+                return ret;
+            }
+        }
+    } else if (field->flags & VMS_MUST_EXIST) {
+        error_report("Input validation failed: %s/%s",
+                     vmsd->name, field->name);
+        return -1;
+    }
+    return 0;
+}
+
+static int vmstate_load_plan(QEMUFile *f, const VMStateDescription *vmsd,
+                             const VMStatePlan *plan, void *opaque)
+{
+    int i, ret;
+
+    for (i = 0; i < plan->nr_ops; i++) {
+        const VMStateOp *op = &plan->ops[i];
+        const VMStateField *field = &vmsd->fields[i];
+        void *pv = opaque + field->offset;
+
+        switch (op->kind) {
+        case VMSTATE_OP_FIELD:
+            ret = vmstate_load_field(f, vmsd, field, opaque,
+                                     vmsd->version_id);
+            if (ret < 0) {
+                return ret;
+            }
+            continue;
+        case VMSTATE_OP_BYTES:
+            qemu_get_buffer(f, pv, op->n_elems * op->size);
+            break;
+        case VMSTATE_OP_BOOL:
+            vmstate_get_bool_array(f, pv, op->n_elems);
+            break;
+        case VMSTATE_OP_BE:
+            vmstate_get_be_array(f, pv, op->size, op->n_elems);
+            break;
+        }
+
+        ret = qemu_file_get_error(f);
+        if (ret < 0) {
+            error_report("Failed to load %s:%s", vmsd->name, field->name);
+            trace_vmstate_load_field_error(field->name, ret);
+            return ret;
+        }
+    }
+    return 0;
+}
+
 int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, int version_id)
 {
@@ -158,69 +472,20 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
             return ret;
         }
     }
-    while (field->name) {
-        bool exists = vmstate_field_exists(vmsd, field, opaque, version_id);
-        trace_vmstate_load_state_field(vmsd->name, field->name, exists);
-        if (exists) {
-            void *first_elem = opaque + field->offset;
-            int i, n_elems = vmstate_n_elems(opaque, field);
-            int size = vmstate_size(opaque, field);
-
-            vmstate_handle_alloc(first_elem, field, opaque);
-            if (field->flags & VMS_POINTER) {
-                first_elem = *(void **)first_elem;
-                assert(first_elem || !n_elems || !size);
-            }
-            for (i = 0; i < n_elems; i++) {
-                void *curr_elem = first_elem + size * i;
-                const VMStateField *inner_field;
+    if (version_id == vmsd->version_id) {
+        const VMStatePlan *plan = vmstate_get_plan(vmsd);
 
-                if (field->flags & VMS_ARRAY_OF_POINTER) {
-                    curr_elem = *(void **)curr_elem;
-                }
-
-                if (!curr_elem && size) {
-                    /*
-                     * If null pointer found (which should only happen in
-                     * an array of pointers), use null placeholder and do
-                     * not follow.
-                     */
-                    inner_field = vmsd_create_fake_nullptr_field(field);
-                } else {
-                    inner_field = field;
-                }
-
-                if (inner_field->flags & VMS_STRUCT) {
-                    ret = vmstate_load_state(f, inner_field->vmsd, curr_elem,
-                                             inner_field->vmsd->version_id);
-                } else if (inner_field->flags & VMS_VSTRUCT) {
-                    ret = vmstate_load_state(f, inner_field->vmsd, curr_elem,
-                                             inner_field->struct_version_id);
-                } else {
-                    ret = inner_field->info->get(f, curr_elem, size,
-                                                 inner_field);
-                }
-
-                /* If we used a fake temp field.. free it now */
-                if (inner_field != field) {
-                    g_clear_pointer((gpointer *)&inner_field, g_free);
-                }
-
-                if (ret >= 0) {
-                    ret = qemu_file_get_error(f);
-                }
-                if (ret < 0) {
-                    qemu_file_set_error(f, ret);
-                    error_report("Failed to load %s:%s", vmsd->name,
-                                 field->name);
-                    trace_vmstate_load_field_error(field->name, ret);
-                    return ret;
-                }
-            }
-        } else if (field->flags & VMS_MUST_EXIST) {
-            error_report("Input validation failed: %s/%s",
-                         vmsd->name, field->name);
-            return -1;
+        ret = vmstate_load_plan(f, vmsd, plan, opaque);
+        if (ret < 0) {
+            return ret;
+        }
+        /* The plan covers all fields */
+        field += plan->nr_ops;
+    }
+    while (field->name) {
+        ret = vmstate_load_field(f, vmsd, field, opaque, version_id);
+        if (ret < 0) {
+            return ret;
         }
         field++;
     }
@@ -395,6 +660,160 @@ int vmstate_save_state_with_err(QEMUFile *f, const VMStateDescription *vmsd,
     return vmstate_save_state_v(f, vmsd, opaque, vmdesc_id, vmsd->version_id, errp);
 }
 
+static int vmstate_save_field(QEMUFile *f, const VMStateDescription *vmsd,
+                              const VMStateField *field, void *opaque,
+                              JSONWriter *vmdesc, int version_id,
+                              Error **errp)
+{
+    int ret;
+
+    if (vmstate_field_exists(vmsd, field, opaque, version_id)) {
+        void *first_elem = opaque + field->offset;
+        int i, n_elems = vmstate_n_elems(opaque, field);
+        int size = vmstate_size(opaque, field);
+        uint64_t old_offset, written_bytes;
+        JSONWriter *vmdesc_loop = vmdesc;
+        bool is_prev_null = false;
+
+        trace_vmstate_save_state_loop(vmsd->name, field->name, n_elems);
+        if (field->flags & VMS_POINTER) {
+            first_elem = *(void **)first_elem;
+            assert(first_elem || !n_elems || !size);
+        }
+
+        for (i = 0; i < n_elems; i++) {
+            void *curr_elem = first_elem + size * i;
+            const VMStateField *inner_field;
+            bool is_null;
+            int max_elems = n_elems - i;
+
+            old_offset = qemu_file_transferred(f);
+            if (field->flags & VMS_ARRAY_OF_POINTER) {
+                assert(curr_elem);
+                curr_elem = *(void **)curr_elem;
+            }
+
+            if (!curr_elem && size) {
+                /*
+                 * If null pointer found (which should only happen in
+                 * an array of pointers), use null placeholder and do
+                 * not follow.
+                 */
+                inner_field = vmsd_create_fake_nullptr_field(field);
+                is_null = true;
+            } else {
+                inner_field = field;
+                is_null = false;
+            }
+
+            /*
+             * This logic only matters when dumping VM Desc.
+             *
+             * Due to the fake nullptr handling above, if there's mixed
+             * null/non-null data, it doesn't make sense to emit a
+             * compressed array representation spanning the entire array
+             * because the field types will be different (e.g. struct
+             * vs. nullptr). Search ahead for the next null/non-null element
+             * and start a new compressed array if found.
+             */
+            if (vmdesc && (field->flags & VMS_ARRAY_OF_POINTER) &&
+                is_null != is_prev_null) {
+
+                is_prev_null = is_null;
+                vmdesc_loop = vmdesc;
+
+                for (int j = i + 1; j < n_elems; j++) {
+                    void *elem = *(void **)(first_elem + size * j);
+                    bool elem_is_null = !elem && size;
+
+                    if (is_null != elem_is_null) {
+                        max_elems = j - i;
+                        break;
+                    }
+                }
+            }
+
+            vmsd_desc_field_start(vmsd, vmdesc_loop, inner_field,
+                                  i, max_elems);
+
+            if (inner_field->flags & VMS_STRUCT) {
+                ret = vmstate_save_state(f, inner_field->vmsd,
+                                         curr_elem, vmdesc_loop);
+            } else if (inner_field->flags & VMS_VSTRUCT) {
+                ret = vmstate_save_state_v(f, inner_field->vmsd,
+                                           curr_elem, vmdesc_loop,
+                                           inner_field->struct_version_id,
+                                           errp);
+            } else {
+                ret = inner_field->info->put(f, curr_elem, size,
+                                             inner_field, vmdesc_loop);
+            }
+
+            written_bytes = qemu_file_transferred(f) - old_offset;
+            vmsd_desc_field_end(vmsd, vmdesc_loop, inner_field,
+                                written_bytes);
+
+            /* If we used a fake temp field.. free it now */
+            if (is_null) {
+                g_clear_pointer((gpointer *)&inner_field, g_free);
+            }
+
+            if (ret) {
+                error_setg(errp, "Save of field %s/%s failed",
+                            vmsd->name, field->name);
+                return ret;
+            }
+
+            /* Compressed arrays only care about the first element */
+            if (vmdesc_loop && vmsd_can_compress(field)) {
+                vmdesc_loop = NULL;
+            }
+        }
+    } else {
+        if (field->flags & VMS_MUST_EXIST) {
+            error_report("Output state validation failed: %s/%s",
+                    vmsd->name, field->name);
+            assert(!(field->flags & VMS_MUST_EXIST));
+        }
+    }
+    return 0;
+}
+
+static int vmstate_save_plan(QEMUFile *f, const VMStateDescription *vmsd,
+                             const VMStatePlan *plan, void *opaque,
+                             JSONWriter *vmdesc, Error **errp)
+{
+    int i, ret;
+
+    for (i = 0; i < plan->nr_ops; i++) {
+        const VMStateOp *op = &plan->ops[i];
+        const VMStateField *field = &vmsd->fields[i];
+        void *pv = opaque + field->offset;
+
+        if (op->kind == VMSTATE_OP_FIELD) {
+            ret = vmstate_save_field(f, vmsd, field, opaque, vmdesc,
+                                     vmsd->version_id, errp);
+            if (ret) {
+                return ret;
+            }
+            continue;
+        }
+        if (!op->n_elems) {
+            continue;
+        }
+
+        /* Same description as the interpreter: a compressed array */
+        vmsd_desc_field_start(vmsd, vmdesc, field, 0, op->n_elems);
+        if (op->kind == VMSTATE_OP_BE) {
+            vmstate_put_be_array(f, pv, op->size, op->n_elems);
+        } else {
+            qemu_put_buffer(f, pv, op->n_elems * op->size);
+        }
+        vmsd_desc_field_end(vmsd, vmdesc, field, op->size);
+    }
+    return 0;
+}
+
 int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
                          void *opaque, JSONWriter *vmdesc, int version_id, Error **errp)
 {
@@ -418,121 +837,24 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
         json_writer_start_array(vmdesc, "fields");
     }
 
-    while (field->name) {
-        if (vmstate_field_exists(vmsd, field, opaque, version_id)) {
-            void *first_elem = opaque + field->offset;
-            int i, n_elems = vmstate_n_elems(opaque, field);
-            int size = vmstate_size(opaque, field);
-            uint64_t old_offset, written_bytes;
-            JSONWriter *vmdesc_loop = vmdesc;
-            bool is_prev_null = false;
-
-            trace_vmstate_save_state_loop(vmsd->name, field->name, n_elems);
-            if (field->flags & VMS_POINTER) {
-                first_elem = *(void **)first_elem;
-                assert(first_elem || !n_elems || !size);
-            }
-
-            for (i = 0; i < n_elems; i++) {
-                void *curr_elem = first_elem + size * i;
-                const VMStateField *inner_field;
-                bool is_null;
-                int max_elems = n_elems - i;
-
-                old_offset = qemu_file_transferred(f);
-                if (field->flags & VMS_ARRAY_OF_POINTER) {
-                    assert(curr_elem);
-                    curr_elem = *(void **)curr_elem;
-                }
-
-                if (!curr_elem && size) {
-                    /*
-                     * If null pointer found (which should only happen in
-                     * an array of pointers), use null placeholder and do
-                     * not follow.
-                     */
-                    inner_field = vmsd_create_fake_nullptr_field(field);
-                    is_null = true;
-                } else {
-                    inner_field = field;
-                    is_null = false;
-                }
-
-                /*
-                 * This logic only matters when dumping VM Desc.
-                 *
-                 * Due to the fake nullptr handling above, if there's mixed
-                 * null/non-null data, it doesn't make sense to emit a
-                 * compressed array representation spanning the entire array
-                 * because the field types will be different (e.g. struct
-                 * vs. nullptr). Search ahead for the next null/non-null element
-                 * and start a new compressed array if found.
-                 */
-                if (vmdesc && (field->flags & VMS_ARRAY_OF_POINTER) &&
-                    is_null != is_prev_null) {
-
-                    is_prev_null = is_null;
-                    vmdesc_loop = vmdesc;
-
-                    for (int j = i + 1; j < n_elems; j++) {
-                        void *elem = *(void **)(first_elem + size * j);
-                        bool elem_is_null = !elem && size;
-
-                        if (is_null != elem_is_null) {
-                            max_elems = j - i;
-                            break;
-                        }
-                    }
-                }
-
-                vmsd_desc_field_start(vmsd, vmdesc_loop, inner_field,
-                                      i, max_elems);
-
-                if (inner_field->flags & VMS_STRUCT) {
-                    ret = vmstate_save_state(f, inner_field->vmsd,
-                                             curr_elem, vmdesc_loop);
-                } else if (inner_field->flags & VMS_VSTRUCT) {
-                    ret = vmstate_save_state_v(f, inner_field->vmsd,
-                                               curr_elem, vmdesc_loop,
-                                               inner_field->struct_version_id,
-                                               errp);
-                } else {
-                    ret = inner_field->info->put(f, curr_elem, size,
-                                                 inner_field, vmdesc_loop);
-                }
-
-                written_bytes = qemu_file_transferred(f) - old_offset;
-                vmsd_desc_field_end(vmsd, vmdesc_loop, inner_field,
-                                    written_bytes);
+    if (version_id == vmsd->version_id) {
+        const VMStatePlan *plan = vmstate_get_plan(vmsd);
 
-                /* If we used a fake temp field.. free it now */
-                if (is_null) {
-                    g_clear_pointer((gpointer *)&inner_field, g_free);
-                }
-
-                if (ret) {
-                    error_setg(errp, "Save of field %s/%s failed",
-                                vmsd->name, field->name);
-                    if (vmsd->post_save) {
-                        vmsd->post_save(opaque);
-                    }
-                    return ret;
-                }
-
-                /* Compressed arrays only care about the first element */
-                if (vmdesc_loop && vmsd_can_compress(field)) {
-                    vmdesc_loop = NULL;
-                }
-            }
-        } else {
-            if (field->flags & VMS_MUST_EXIST) {
-                error_report("Output state validation failed: %s/%s",
-                        vmsd->name, field->name);
-                assert(!(field->flags & VMS_MUST_EXIST));
-            }
-        }
+        ret = vmstate_save_plan(f, vmsd, plan, opaque, vmdesc, errp);
+        /* The plan covers all fields */
+        field += plan->nr_ops;
+    }
+    while (!ret && field->name) {
+        ret = vmstate_save_field(f, vmsd, field, opaque, vmdesc, version_id,
+                                 errp);
         field++;
     }
+    if (ret) {
+        if (vmsd->post_save) {
+            vmsd->post_save(opaque);
+        }
+        return ret;
+    }
     assert(field->flags == VMS_END);
 
     if (vmdesc) {
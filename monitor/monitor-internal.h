@@ -29,6 +29,7 @@
 #include "monitor/monitor.h"
 #include "qapi/qapi-types-control.h"
 #include "qapi/qmp-registry.h"
+#include "qobject/cbor-parser.h"
 #include "qobject/json-parser.h"
 #include "qemu/readline.h"
 #include "system/iothread.h"
@@ -134,7 +135,28 @@ struct MonitorHMP {
 typedef struct {
     Monitor common;
     JSONMessageParser parser;
+    CborMessageParser cbor_parser;
     bool pretty;
+    /*
+     * Input is decoded as CBOR rather than JSON.  Set before the response
+     * to qmp_capabilities goes out when capability "cbor" is accepted, so
+     * that input that a client sends as soon as it has the response is
+     * decoded as CBOR even when it is read in @mon_iothread.
+     * Written with common.mon_lock held, read atomically.
+     */
+    bool cbor_input;
+    /*
+     * A CBOR data item was read since @cbor_input was set.  Until then,
+     * JSON whitespace that followed qmp_capabilities is skipped.
+     * Only accessed where input is read.
+     */
+    bool cbor_input_started;
+    /*
+     * Responses and events are encoded as CBOR rather than JSON.  Set
+     * right after the response to qmp_capabilities.
+     * Written with common.mon_lock held, read atomically.
+     */
+    bool cbor;
     /*
      * When a client connects, we're in capabilities negotiation mode.
      * @commands is &qmp_cap_negotiation_commands then.  When command
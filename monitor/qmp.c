@@ -28,6 +28,7 @@
 #include "monitor-internal.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-control.h"
+#include "qobject/qcbor.h"
 #include "qobject/qdict.h"
 #include "qobject/qjson.h"
 #include "qobject/qlist.h"
@@ -81,6 +82,21 @@ static void monitor_qmp_caps_reset(MonitorQMP *mon)
     memset(mon->capab_offered, 0, sizeof(mon->capab_offered));
     memset(mon->capab, 0, sizeof(mon->capab));
     mon->capab_offered[QMP_CAPABILITY_OOB] = mon->common.use_io_thread;
+    mon->capab_offered[QMP_CAPABILITY_CBOR] = true;
+}
+
+/* Whether input is decoded as CBOR, see MonitorQMP */
+static bool qmp_cbor_enabled(MonitorQMP *mon)
+{
+    return qatomic_read(&mon->cbor_input);
+}
+
+static void monitor_qmp_set_cbor(MonitorQMP *mon, bool cbor)
+{
+    QEMU_LOCK_GUARD(&mon->common.mon_lock);
+    qatomic_set(&mon->cbor_input, cbor);
+    qatomic_set(&mon->cbor, cbor);
+    mon->cbor_input_started = false;
 }
 
 static void qmp_request_free(QMPRequest *req)
@@ -129,21 +145,48 @@ static void monitor_qmp_cleanup_queue_and_resume(MonitorQMP *mon)
 
 }
 
-void qmp_send_response(MonitorQMP *mon, const QDict *rsp)
+/* Caller must hold mon->common.mon_lock */
+static void qmp_send_cbor_locked(MonitorQMP *mon, const GString *cbor)
+{
+    trace_monitor_qmp_respond_cbor(mon, cbor->len);
+
+    /* Binary data, so no monitor_puts() */
+    g_string_append_len(mon->common.outbuf, cbor->str, cbor->len);
+    monitor_flush_locked(&mon->common);
+}
+
+/*
+ * Caller must hold mon->common.mon_lock, so that the encoding cannot
+ * change under our feet.
+ */
+static void qmp_send_response_locked(MonitorQMP *mon, const QDict *rsp)
 {
     const QObject *data = QOBJECT(rsp);
     GString *json;
 
+    if (mon->cbor) {
+        g_autoptr(GString) cbor = qobject_to_cbor(data);
+
+        qmp_send_cbor_locked(mon, cbor);
+        return;
+    }
+
     json = qobject_to_json_pretty(data, mon->pretty);
     assert(json != NULL);
     trace_monitor_qmp_respond(mon, json->str);
 
     g_string_append_c(json, '\n');
-    monitor_puts(&mon->common, json->str);
+    monitor_puts_locked(&mon->common, json->str);
 
     g_string_free(json, true);
 }
 
+void qmp_send_response(MonitorQMP *mon, const QDict *rsp)
+{
+    QEMU_LOCK_GUARD(&mon->common.mon_lock);
+    qmp_send_response_locked(mon, rsp);
+}
+
 /*
  * Emit QMP response @rsp to @mon.
  * Null @rsp can only happen for commands with QCO_NO_SUCCESS_RESP.
@@ -162,12 +205,44 @@ static void monitor_qmp_respond(MonitorQMP *mon, QDict *rsp)
  */
 static void monitor_qmp_dispatch(MonitorQMP *mon, QObject *req)
 {
+    bool negotiating = mon->commands == &qmp_cap_negotiation_commands;
     QDict *rsp;
     QDict *error;
 
+    if (qmp_cbor_enabled(mon)) {
+        g_autoptr(GString) cbor = NULL;
+
+        cbor = qmp_dispatch_cbor(mon->commands, req, qmp_oob_enabled(mon),
+                                 &mon->common);
+        if (cbor) {
+            QEMU_LOCK_GUARD(&mon->common.mon_lock);
+            /* Unless the client that sent @req is gone */
+            if (mon->cbor) {
+                qmp_send_cbor_locked(mon, cbor);
+            }
+        }
+        return;
+    }
+
     rsp = qmp_dispatch(mon->commands, req, qmp_oob_enabled(mon),
                        &mon->common);
 
+    if (negotiating && mon->commands == &qmp_commands &&
+        mon->capab[QMP_CAPABILITY_CBOR]) {
+        /*
+         * The response to qmp_capabilities is the last JSON message.
+         * Switch the input before the client can see the response, and
+         * the output with the lock held, so that no event gets between.
+         */
+        WITH_QEMU_LOCK_GUARD(&mon->common.mon_lock) {
+            qatomic_set(&mon->cbor_input, true);
+            qmp_send_response_locked(mon, rsp);
+            qatomic_set(&mon->cbor, true);
+        }
+        qobject_unref(rsp);
+        return;
+    }
+
     if (mon->commands == &qmp_cap_negotiation_commands) {
         error = qdict_get_qdict(rsp, "error");
         if (error
@@ -430,7 +505,24 @@ static void monitor_qmp_read(void *opaque, const uint8_t *buf, int size)
 {
     MonitorQMP *mon = opaque;
 
-    json_message_parser_feed(&mon->parser, (const char *) buf, size);
+    if (qmp_cbor_enabled(mon)) {
+        /*
+         * A client may end qmp_capabilities with a newline, like any
+         * other JSON command.  No CBOR request starts with these bytes.
+         */
+        while (!mon->cbor_input_started && size &&
+               (*buf == ' ' || *buf == '\t' || *buf == '\n' || *buf == '\r')) {
+            buf++;
+            size--;
+        }
+        if (!size) {
+            return;
+        }
+        mon->cbor_input_started = true;
+        cbor_message_parser_feed(&mon->cbor_parser, buf, size);
+    } else {
+        json_message_parser_feed(&mon->parser, (const char *) buf, size);
+    }
 }
 
 static QDict *qmp_greeting(MonitorQMP *mon)
@@ -464,6 +556,7 @@ static void monitor_qmp_event(void *opaque, QEMUChrEvent event)
     case CHR_EVENT_OPENED:
         mon->commands = &qmp_cap_negotiation_commands;
         monitor_qmp_caps_reset(mon);
+        monitor_qmp_set_cbor(mon, false);
         data = qmp_greeting(mon);
         qmp_send_response(mon, data);
         qobject_unref(data);
@@ -479,6 +572,9 @@ static void monitor_qmp_event(void *opaque, QEMUChrEvent event)
         json_message_parser_destroy(&mon->parser);
         json_message_parser_init(&mon->parser, handle_qmp_command,
                                  mon, NULL);
+        monitor_qmp_set_cbor(mon, false);
+        cbor_message_parser_destroy(&mon->cbor_parser);
+        cbor_message_parser_init(&mon->cbor_parser, handle_qmp_command, mon);
         monitor_fdsets_cleanup();
         break;
     case CHR_EVENT_BREAK:
@@ -492,6 +588,7 @@ static void monitor_qmp_event(void *opaque, QEMUChrEvent event)
 void monitor_data_destroy_qmp(MonitorQMP *mon)
 {
     json_message_parser_destroy(&mon->parser);
+    cbor_message_parser_destroy(&mon->cbor_parser);
     qemu_mutex_destroy(&mon->qmp_queue_lock);
     monitor_qmp_cleanup_req_queue_locked(mon);
     g_queue_free(mon->qmp_requests);
@@ -531,6 +628,7 @@ void monitor_init_qmp(Chardev *chr, bool pretty, Error **errp)
     mon->qmp_requests = g_queue_new();
 
     json_message_parser_init(&mon->parser, handle_qmp_command, mon, NULL);
+    cbor_message_parser_init(&mon->cbor_parser, handle_qmp_command, mon);
     if (mon->common.use_io_thread) {
         /*
          * Make sure the old iowatch is gone.  It's possible when
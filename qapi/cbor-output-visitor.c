@@ -0,0 +1,152 @@
+/*
+ * CBOR Output Visitor
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/cbor-output-visitor.h"
+#include "qapi/compat-policy.h"
+#include "qapi/visitor-impl.h"
+#include "qobject/cbor-writer.h"
+#include "qobject/qcbor.h"
+
+struct CborOutputVisitor {
+    Visitor visitor;
+    CborWriter *writer;
+};
+
+static CborOutputVisitor *to_cov(Visitor *v)
+{
+    return container_of(v, CborOutputVisitor, visitor);
+}
+
+static bool cbor_output_start_struct(Visitor *v, const char *name,
+                                     void **obj, size_t unused, Error **errp)
+{
+    cbor_writer_start_object(to_cov(v)->writer, name);
+    return true;
+}
+
+static void cbor_output_end_struct(Visitor *v, void **obj)
+{
+    cbor_writer_end_object(to_cov(v)->writer);
+}
+
+static bool cbor_output_start_list(Visitor *v, const char *name,
+                                   GenericList **listp, size_t size,
+                                   Error **errp)
+{
+    cbor_writer_start_array(to_cov(v)->writer, name);
+    return true;
+}
+
+static GenericList *cbor_output_next_list(Visitor *v, GenericList *tail,
+                                          size_t size)
+{
+    return tail->next;
+}
+
+static void cbor_output_end_list(Visitor *v, void **obj)
+{
+    cbor_writer_end_array(to_cov(v)->writer);
+}
+
+static bool cbor_output_type_int64(Visitor *v, const char *name,
+                                   int64_t *obj, Error **errp)
+{
+    cbor_writer_int64(to_cov(v)->writer, name, *obj);
+    return true;
+}
+
+static bool cbor_output_type_uint64(Visitor *v, const char *name,
+                                    uint64_t *obj, Error **errp)
+{
+    cbor_writer_uint64(to_cov(v)->writer, name, *obj);
+    return true;
+}
+
+static bool cbor_output_type_bool(Visitor *v, const char *name, bool *obj,
+                                  Error **errp)
+{
+    cbor_writer_bool(to_cov(v)->writer, name, *obj);
+    return true;
+}
+
+static bool cbor_output_type_str(Visitor *v, const char *name, char **obj,
+                                 Error **errp)
+{
+    cbor_writer_str(to_cov(v)->writer, name, *obj ?: "");
+    return true;
+}
+
+static bool cbor_output_type_number(Visitor *v, const char *name,
+                                    double *obj, Error **errp)
+{
+    cbor_writer_double(to_cov(v)->writer, name, *obj);
+    return true;
+}
+
+static bool cbor_output_type_any(Visitor *v, const char *name,
+                                 QObject **obj, Error **errp)
+{
+    cbor_writer_qobject(to_cov(v)->writer, name, *obj);
+    return true;
+}
+
+static bool cbor_output_type_null(Visitor *v, const char *name,
+                                  QNull **obj, Error **errp)
+{
+    cbor_writer_null(to_cov(v)->writer, name);
+    return true;
+}
+
+static bool cbor_output_policy_skip(Visitor *v, const char *name,
+                                    uint64_t features)
+{
+    CompatPolicy *pol = &v->compat_policy;
+
+    return ((features & 1u << QAPI_DEPRECATED)
+            && pol->deprecated_output == COMPAT_POLICY_OUTPUT_HIDE)
+        || ((features & 1u << QAPI_UNSTABLE)
+            && pol->unstable_output == COMPAT_POLICY_OUTPUT_HIDE);
+}
+
+/* Everything has been written to the CborWriter already */
+static void cbor_output_complete(Visitor *v, void *opaque)
+{
+}
+
+static void cbor_output_free(Visitor *v)
+{
+    g_free(to_cov(v));
+}
+
+Visitor *cbor_output_visitor_new(CborWriter *writer)
+{
+    CborOutputVisitor *v;
+
+    v = g_malloc0(sizeof(*v));
+
+    v->visitor.type = VISITOR_OUTPUT;
+    v->visitor.start_struct = cbor_output_start_struct;
+    v->visitor.end_struct = cbor_output_end_struct;
+    v->visitor.start_list = cbor_output_start_list;
+    v->visitor.next_list = cbor_output_next_list;
+    v->visitor.end_list = cbor_output_end_list;
+    v->visitor.type_int64 = cbor_output_type_int64;
+    v->visitor.type_uint64 = cbor_output_type_uint64;
+    v->visitor.type_bool = cbor_output_type_bool;
+    v->visitor.type_str = cbor_output_type_str;
+    v->visitor.type_number = cbor_output_type_number;
+    v->visitor.type_any = cbor_output_type_any;
+    v->visitor.type_null = cbor_output_type_null;
+    v->visitor.policy_skip = cbor_output_policy_skip;
+    v->visitor.complete = cbor_output_complete;
+    v->visitor.free = cbor_output_free;
+    v->writer = writer;
+
+    return &v->visitor;
+}
@@ -14,6 +14,7 @@
 #include "qemu/osdep.h"
 
 #include "block/aio.h"
+#include "qapi/cbor-output-visitor.h"
 #include "qapi/compat-policy.h"
 #include "qapi/error.h"
 #include "qapi/qmp-registry.h"
@@ -21,8 +22,11 @@
 #include "qobject/qjson.h"
 #include "qapi/qobject-input-visitor.h"
 #include "qapi/qobject-output-visitor.h"
+#include "qobject/cbor-writer.h"
 #include "qobject/qbool.h"
+#include "qobject/qcbor.h"
 #include "qemu/coroutine.h"
+#include "qemu/coroutine-tls.h"
 #include "qemu/main-loop.h"
 
 Visitor *qobject_input_visitor_new_qmp(QObject *obj)
@@ -41,6 +45,36 @@ Visitor *qobject_output_visitor_new_qmp(QObject **result)
     return v;
 }
 
+/*
+ * Where the return value of the command that runs in @co goes, when
+ * qmp_dispatch_cbor() dispatched it.  Other coroutines of the thread
+ * can run marshallers while @co is yielded, hence the check of @co.
+ */
+typedef struct QmpReturnWriter {
+    Coroutine *co;
+    CborWriter *writer;
+} QmpReturnWriter;
+
+QEMU_DEFINE_STATIC_CO_TLS(QmpReturnWriter, qmp_return_writer)
+
+Visitor *qmp_output_visitor_new(QObject **result)
+{
+    QmpReturnWriter *rw = get_ptr_qmp_return_writer();
+    Visitor *v;
+
+    if (rw->writer && rw->co == qemu_coroutine_self()) {
+        v = cbor_output_visitor_new(rw->writer);
+        *result = NULL;
+        /* Only the return value of the command itself goes there */
+        *rw = (QmpReturnWriter) {};
+    } else {
+        v = qobject_output_visitor_new(result);
+    }
+
+    visit_set_policy(v, &compat_policy);
+    return v;
+}
+
 static QDict *qmp_dispatch_check_obj(QDict *dict, bool allow_oob,
                                      Error **errp)
 {
@@ -110,9 +144,35 @@ bool qmp_is_oob(const QDict *dict)
         && !qdict_haskey(dict, "execute");
 }
 
+static void coroutine_mixed_fn qmp_call_command(const QmpCommand *cmd,
+                                                Monitor *cur_mon,
+                                                CborWriter *ret_writer,
+                                                QDict *args, QObject **ret,
+                                                Error **errp)
+{
+    QmpReturnWriter *rw;
+
+    monitor_set_cur(qemu_coroutine_self(), cur_mon);
+    rw = get_ptr_qmp_return_writer();
+    *rw = (QmpReturnWriter) {
+        .co = qemu_coroutine_self(),
+        .writer = ret_writer,
+    };
+
+    cmd->fn(args, ret, errp);
+
+    /* @cmd may have yielded, look it up again */
+    rw = get_ptr_qmp_return_writer();
+    if (rw->co == qemu_coroutine_self()) {
+        *rw = (QmpReturnWriter) {};
+    }
+    monitor_set_cur(qemu_coroutine_self(), NULL);
+}
+
 typedef struct QmpDispatchBH {
     const QmpCommand *cmd;
     Monitor *cur_mon;
+    CborWriter *ret_writer;
     QDict *args;
     QObject **ret;
     Error **errp;
@@ -124,18 +184,23 @@ static void do_qmp_dispatch_bh(void *opaque)
     QmpDispatchBH *data = opaque;
 
     assert(monitor_cur() == NULL);
-    monitor_set_cur(qemu_coroutine_self(), data->cur_mon);
-    data->cmd->fn(data->args, data->ret, data->errp);
-    monitor_set_cur(qemu_coroutine_self(), NULL);
+    qmp_call_command(data->cmd, data->cur_mon, data->ret_writer, data->args,
+                     data->ret, data->errp);
     aio_co_wake(data->co);
 }
 
 /*
  * Runs outside of coroutine context for OOB commands, but in coroutine
  * context for everything else.
+ *
+ * If @ret_writer is non-null, the return value of the command may be
+ * encoded there instead of being put in the response.
  */
-QDict *coroutine_mixed_fn qmp_dispatch(const QmpCommandList *cmds, QObject *request,
-                                       bool allow_oob, Monitor *cur_mon)
+static QDict *coroutine_mixed_fn do_qmp_dispatch(const QmpCommandList *cmds,
+                                                 QObject *request,
+                                                 bool allow_oob,
+                                                 Monitor *cur_mon,
+                                                 CborWriter *ret_writer)
 {
     Error *err = NULL;
     bool oob;
@@ -216,9 +281,7 @@ QDict *coroutine_mixed_fn qmp_dispatch(const QmpCommandList *cmds, QObject *requ
             qemu_coroutine_yield();
         }
 
-        monitor_set_cur(qemu_coroutine_self(), cur_mon);
-        cmd->fn(args, &ret, &err);
-        monitor_set_cur(qemu_coroutine_self(), NULL);
+        qmp_call_command(cmd, cur_mon, ret_writer, args, &ret, &err);
 
         if (qemu_in_coroutine()) {
             /*
@@ -248,6 +311,7 @@ QDict *coroutine_mixed_fn qmp_dispatch(const QmpCommandList *cmds, QObject *requ
 
         QmpDispatchBH data = {
             .cur_mon    = cur_mon,
+            .ret_writer = ret_writer,
             .cmd        = cmd,
             .args       = args,
             .ret        = &ret,
@@ -268,7 +332,7 @@ QDict *coroutine_mixed_fn qmp_dispatch(const QmpCommandList *cmds, QObject *requ
     if (cmd->options & QCO_NO_SUCCESS_RESP) {
         g_assert(!ret);
         return NULL;
-    } else if (!ret) {
+    } else if (!ret && !(ret_writer && cbor_writer_get(ret_writer)->len)) {
         /*
          * When the command's schema has no 'returns', cmd->fn()
          * leaves @ret null.  The QMP spec calls for an empty object
@@ -278,7 +342,9 @@ QDict *coroutine_mixed_fn qmp_dispatch(const QmpCommandList *cmds, QObject *requ
     }
 
     rsp = qdict_new();
-    qdict_put_obj(rsp, "return", ret);
+    if (ret) {
+        qdict_put_obj(rsp, "return", ret);
+    }
 
 out:
     if (err) {
@@ -294,3 +360,50 @@ out:
 
     return rsp;
 }
+
+QDict *coroutine_mixed_fn qmp_dispatch(const QmpCommandList *cmds, QObject *request,
+                                       bool allow_oob, Monitor *cur_mon)
+{
+    return do_qmp_dispatch(cmds, request, allow_oob, cur_mon, NULL);
+}
+
+/*
+ * Like qmp_dispatch(), but return the response encoded as CBOR.  The
+ * generated marshallers encode the return value of the command straight
+ * from its C type, without building a QObject for it first.
+ */
+GString *coroutine_mixed_fn qmp_dispatch_cbor(const QmpCommandList *cmds,
+                                              QObject *request,
+                                              bool allow_oob,
+                                              Monitor *cur_mon)
+{
+    g_autoptr(CborWriter) ret_writer = cbor_writer_new();
+    const GString *ret;
+    CborWriter *writer;
+    const QDictEntry *ent;
+    QDict *rsp;
+
+    rsp = do_qmp_dispatch(cmds, request, allow_oob, cur_mon, ret_writer);
+    if (!rsp) {
+        return NULL;
+    }
+
+    ret = cbor_writer_get(ret_writer);
+    if (!ret->len || qdict_haskey(rsp, "error")) {
+        GString *cbor = qobject_to_cbor(QOBJECT(rsp));
+
+        qobject_unref(rsp);
+        return cbor;
+    }
+
+    writer = cbor_writer_new();
+    cbor_writer_start_object(writer, NULL);
+    cbor_writer_raw(writer, "return", ret);
+    for (ent = qdict_first(rsp); ent; ent = qdict_next(rsp, ent)) {
+        cbor_writer_qobject(writer, qdict_entry_key(ent),
+                            qdict_entry_value(ent));
+    }
+    cbor_writer_end_object(writer);
+    qobject_unref(rsp);
+    return cbor_writer_get_and_free(writer);
+}
@@ -0,0 +1,581 @@
+/*
+ * CBOR Parser
+ *
+ * Decodes the subset of CBOR (RFC 8949) that maps to QObjects: integers,
+ * text strings, arrays, maps with text string keys, booleans, null and
+ * floating-point numbers.  Tags are ignored.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include "qapi/error.h"
+#include "qobject/cbor-parser.h"
+#include "qobject/qbool.h"
+#include "qobject/qcbor.h"
+#include "qobject/qdict.h"
+#include "qobject/qlist.h"
+#include "qobject/qnull.h"
+#include "qobject/qnum.h"
+#include "qobject/qstring.h"
+
+/* Same limits as for JSON */
+#define MAX_MESSAGE_SIZE (64ULL << 20)
+#define MAX_NESTING (1 << 10)
+
+typedef struct CborDecoder {
+    const uint8_t *start, *p, *end;
+    /* Input length that is needed to make progress, when incomplete */
+    size_t needed;
+    int depth;
+} CborDecoder;
+
+/*
+ * The parse functions return 1 on success, 0 if the input ends before
+ * the item does, and -1 on error.
+ */
+
+static int parse_error(Error **errp, const char *message)
+{
+    error_setg(errp, "CBOR parse error, %s", message);
+    return -1;
+}
+
+static bool need(CborDecoder *dec, uint64_t n)
+{
+    size_t offset = dec->p - dec->start;
+
+    if (dec->end - dec->p < n) {
+        dec->needed = n > SIZE_MAX - offset ? SIZE_MAX : offset + n;
+        return false;
+    }
+    return true;
+}
+
+static int parse_head(CborDecoder *dec, uint8_t *major, uint8_t *info,
+                      uint64_t *val, Error **errp)
+{
+    int n, i;
+
+    if (!need(dec, 1)) {
+        return 0;
+    }
+    *major = *dec->p >> 5;
+    *info = *dec->p & 0x1f;
+
+    if (*info < 24) {
+        n = 0;
+        *val = *info;
+    } else if (*info <= 27) {
+        n = 1 << (*info - 24);
+    } else if (*info == CBOR_INDEFINITE) {
+        n = 0;
+        *val = 0;
+    } else {
+        return parse_error(errp, "reserved additional information");
+    }
+
+    if (!need(dec, 1 + n)) {
+        return 0;
+    }
+    dec->p++;
+    if (n) {
+        *val = 0;
+        for (i = 0; i < n; i++) {
+            *val = *val << 8 | *dec->p++;
+        }
+    }
+    return 1;
+}
+
+static int parse_text(CborDecoder *dec, uint8_t info, uint64_t len,
+                      GString *str, Error **errp)
+{
+    uint8_t major;
+    int ret;
+
+    if (info != CBOR_INDEFINITE) {
+        if (!need(dec, len)) {
+            return 0;
+        }
+        g_string_append_len(str, (const char *)dec->p, len);
+        dec->p += len;
+        return 1;
+    }
+
+    /* Indefinite length: a sequence of definite length chunks */
+    for (;;) {
+        ret = parse_head(dec, &major, &info, &len, errp);
+        if (ret <= 0) {
+            return ret;
+        }
+        if (major == CBOR_MAJOR_SIMPLE && info == CBOR_INDEFINITE) {
+            return 1;
+        }
+        if (major != CBOR_MAJOR_TEXT || info == CBOR_INDEFINITE) {
+            return parse_error(errp, "invalid text string chunk");
+        }
+        ret = parse_text(dec, info, len, str, errp);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+}
+
+static int parse_string(CborDecoder *dec, uint8_t info, uint64_t len,
+                        QString **obj, Error **errp)
+{
+    g_autoptr(GString) str = g_string_new(NULL);
+    int ret;
+
+    ret = parse_text(dec, info, len, str, errp);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    /* This also rejects NUL characters, which QString cannot hold */
+    if (!g_utf8_validate(str->str, str->len, NULL)) {
+        return parse_error(errp, "invalid UTF-8 in text string");
+    }
+    *obj = qstring_from_gstring(g_steal_pointer(&str));
+    return 1;
+}
+
+/* Whether the next item is the "break" that ends an indefinite length item */
+static int parse_break(CborDecoder *dec)
+{
+    if (!need(dec, 1)) {
+        return 0;
+    }
+    if (*dec->p == CBOR_BREAK) {
+        dec->p++;
+        return 1;
+    }
+    return -1;
+}
+
+static int parse_value(CborDecoder *dec, QObject **obj, Error **errp);
+
+static int parse_array(CborDecoder *dec, uint8_t info, uint64_t len,
+                       QObject **obj, Error **errp)
+{
+    g_autoptr(QList) list = qlist_new();
+    QObject *elem;
+    uint64_t i;
+    int ret;
+
+    for (i = 0; info == CBOR_INDEFINITE || i < len; i++) {
+        if (info == CBOR_INDEFINITE) {
+            ret = parse_break(dec);
+            if (ret >= 0) {
+                if (ret == 0) {
+                    return 0;
+                }
+                break;
+            }
+        }
+        ret = parse_value(dec, &elem, errp);
+        if (ret <= 0) {
+            return ret;
+        }
+        qlist_append_obj(list, elem);
+    }
+
+    *obj = QOBJECT(g_steal_pointer(&list));
+    return 1;
+}
+
+static int parse_map(CborDecoder *dec, uint8_t info, uint64_t len,
+                     QObject **obj, Error **errp)
+{
+    g_autoptr(QDict) dict = qdict_new();
+    QString *key;
+    QObject *value;
+    uint8_t key_major, key_info;
+    uint64_t key_len, i;
+    int ret;
+
+    for (i = 0; info == CBOR_INDEFINITE || i < len; i++) {
+        if (info == CBOR_INDEFINITE) {
+            ret = parse_break(dec);
+            if (ret >= 0) {
+                if (ret == 0) {
+                    return 0;
+                }
+                break;
+            }
+        }
+
+        ret = parse_head(dec, &key_major, &key_info, &key_len, errp);
+        if (ret <= 0) {
+            return ret;
+        }
+        if (key_major != CBOR_MAJOR_TEXT) {
+            return parse_error(errp, "key is not a text string");
+        }
+        ret = parse_string(dec, key_info, key_len, &key, errp);
+        if (ret <= 0) {
+            return ret;
+        }
+
+        ret = parse_value(dec, &value, errp);
+        if (ret <= 0) {
+            qobject_unref(key);
+            return ret;
+        }
+        if (qdict_haskey(dict, qstring_get_str(key))) {
+            qobject_unref(key);
+            qobject_unref(value);
+            return parse_error(errp, "duplicate key");
+        }
+        qdict_put_obj(dict, qstring_get_str(key), value);
+        qobject_unref(key);
+    }
+
+    *obj = QOBJECT(g_steal_pointer(&dict));
+    return 1;
+}
+
+static double half_to_double(uint16_t half)
+{
+    int exp = (half >> 10) & 0x1f;
+    int mant = half & 0x3ff;
+    double val;
+
+    if (exp == 0) {
+        val = ldexp(mant, -24);
+    } else if (exp != 31) {
+        val = ldexp(mant + 1024, exp - 25);
+    } else {
+        val = mant ? NAN : INFINITY;
+    }
+    return half & 0x8000 ? -val : val;
+}
+
+static int parse_simple(uint8_t info, uint64_t val, QObject **obj,
+                        Error **errp)
+{
+    uint32_t bits32;
+    float f;
+    double d;
+
+    switch (info) {
+    case CBOR_FALSE & 0x1f:
+    case CBOR_TRUE & 0x1f:
+        *obj = QOBJECT(qbool_from_bool(info == (CBOR_TRUE & 0x1f)));
+        return 1;
+    case CBOR_NULL & 0x1f:
+        *obj = QOBJECT(qnull());
+        return 1;
+    case 25:
+        d = half_to_double(val);
+        break;
+    case 26:
+        bits32 = val;
+        memcpy(&f, &bits32, sizeof(f));
+        d = f;
+        break;
+    case CBOR_FLOAT64 & 0x1f:
+        memcpy(&d, &val, sizeof(d));
+        break;
+    case CBOR_INDEFINITE:
+        return parse_error(errp, "unexpected break");
+    default:
+        return parse_error(errp, "unsupported simple value");
+    }
+
+    /* Like the JSON parser, which has no syntax for them */
+    if (!isfinite(d)) {
+        return parse_error(errp, "infinite or NaN floating-point number");
+    }
+    *obj = QOBJECT(qnum_from_double(d));
+    return 1;
+}
+
+static int parse_value(CborDecoder *dec, QObject **obj, Error **errp)
+{
+    uint8_t major, info;
+    uint64_t val;
+    int ret;
+
+    /* Tags only give a meaning to the item that follows them */
+    do {
+        ret = parse_head(dec, &major, &info, &val, errp);
+        if (ret <= 0) {
+            return ret;
+        }
+    } while (major == CBOR_MAJOR_TAG);
+
+    if (info == CBOR_INDEFINITE &&
+        (major == CBOR_MAJOR_UINT || major == CBOR_MAJOR_NEGINT)) {
+        return parse_error(errp, "invalid integer");
+    }
+
+    switch (major) {
+    case CBOR_MAJOR_UINT:
+        if (val <= INT64_MAX) {
+            *obj = QOBJECT(qnum_from_int(val));
+        } else {
+            *obj = QOBJECT(qnum_from_uint(val));
+        }
+        return 1;
+    case CBOR_MAJOR_NEGINT:
+        if (val > INT64_MAX) {
+            return parse_error(errp, "integer out of range");
+        }
+        *obj = QOBJECT(qnum_from_int(-1 - (int64_t)val));
+        return 1;
+    case CBOR_MAJOR_BYTES:
+        return parse_error(errp, "byte strings are not supported");
+    case CBOR_MAJOR_TEXT: {
+        QString *str;
+
+        ret = parse_string(dec, info, val, &str, errp);
+        if (ret > 0) {
+            *obj = QOBJECT(str);
+        }
+        return ret;
+    }
+    case CBOR_MAJOR_ARRAY:
+    case CBOR_MAJOR_MAP:
+        if (++dec->depth > MAX_NESTING) {
+            return parse_error(errp, "nesting depth limit exceeded");
+        }
+        if (major == CBOR_MAJOR_ARRAY) {
+            ret = parse_array(dec, info, val, obj, errp);
+        } else {
+            ret = parse_map(dec, info, val, obj, errp);
+        }
+        dec->depth--;
+        return ret;
+    default:
+        return parse_simple(info, val, obj, errp);
+    }
+}
+
+/*
+ * Decode the single CBOR item in @buf, which is @len bytes long.
+ */
+QObject *qobject_from_cbor(const void *buf, size_t len, Error **errp)
+{
+    CborDecoder dec = {
+        .start = buf,
+        .p = buf,
+        .end = (const uint8_t *)buf + len,
+    };
+    QObject *obj;
+    int ret;
+
+    ret = parse_value(&dec, &obj, errp);
+    if (ret < 0) {
+        return NULL;
+    }
+    if (ret == 0) {
+        parse_error(errp, "unexpected end of input");
+        return NULL;
+    }
+    if (dec.p != dec.end) {
+        qobject_unref(obj);
+        parse_error(errp, "expecting at most one CBOR item");
+        return NULL;
+    }
+    return obj;
+}
+
+/* Items to come in an open item of indefinite length */
+#define SCAN_INDEFINITE UINT64_MAX
+
+/* An item is complete, which completes the items that contain it, maybe */
+static bool cbor_scan_item_done(CborMessageParser *parser)
+{
+    while (parser->open->len) {
+        uint64_t *left = &g_array_index(parser->open, uint64_t,
+                                        parser->open->len - 1);
+
+        if (*left == SCAN_INDEFINITE || --*left) {
+            return false;
+        }
+        g_array_set_size(parser->open, parser->open->len - 1);
+    }
+    return true;
+}
+
+static void cbor_scan_open(CborMessageParser *parser, uint64_t items)
+{
+    g_array_append_val(parser->open, items);
+}
+
+/*
+ * Find where the item that starts at the beginning of the buffer ends,
+ * without decoding it, so that it is decoded only once, when it is all
+ * there.  Picks up where the last call left off.
+ *
+ * Return 1 when the item ends at @scanned, 0 if more input is needed,
+ * and -1 on error.
+ */
+static int cbor_scan(CborMessageParser *parser, Error **errp)
+{
+    const uint8_t *data = parser->buf->data;
+    size_t len = parser->buf->len;
+    uint8_t major, info;
+    uint64_t val;
+    int n, i;
+
+    for (;;) {
+        if (parser->skip) {
+            n = MIN(parser->skip, len - parser->scanned);
+            parser->scanned += n;
+            parser->skip -= n;
+            if (parser->skip) {
+                return 0;
+            }
+            if (cbor_scan_item_done(parser)) {
+                return 1;
+            }
+        }
+
+        if (parser->scanned == len) {
+            return 0;
+        }
+        major = data[parser->scanned] >> 5;
+        info = data[parser->scanned] & 0x1f;
+        if (info < 24 || info == CBOR_INDEFINITE) {
+            n = 0;
+        } else if (info <= 27) {
+            n = 1 << (info - 24);
+        } else {
+            return parse_error(errp, "reserved additional information");
+        }
+        if (len - parser->scanned < 1 + n) {
+            return 0;
+        }
+        val = info < 24 ? info : 0;
+        for (i = 0; i < n; i++) {
+            val = val << 8 | data[parser->scanned + 1 + i];
+        }
+        parser->scanned += 1 + n;
+
+        switch (major) {
+        case CBOR_MAJOR_UINT:
+        case CBOR_MAJOR_NEGINT:
+            if (info == CBOR_INDEFINITE) {
+                return parse_error(errp, "invalid integer");
+            }
+            break;
+        case CBOR_MAJOR_BYTES:
+            return parse_error(errp, "byte strings are not supported");
+        case CBOR_MAJOR_TEXT:
+            if (info == CBOR_INDEFINITE) {
+                /* Its chunks are items of their own */
+                cbor_scan_open(parser, SCAN_INDEFINITE);
+                continue;
+            }
+            if (val > MAX_MESSAGE_SIZE) {
+                return parse_error(errp, "CBOR message size limit exceeded");
+            }
+            if (val) {
+                parser->skip = val;
+                continue;
+            }
+            break;
+        case CBOR_MAJOR_ARRAY:
+        case CBOR_MAJOR_MAP:
+            if (parser->open->len >= MAX_NESTING) {
+                return parse_error(errp, "nesting depth limit exceeded");
+            }
+            if (info == CBOR_INDEFINITE) {
+                cbor_scan_open(parser, SCAN_INDEFINITE);
+                continue;
+            }
+            /* Each item takes at least a byte */
+            if (val > MAX_MESSAGE_SIZE) {
+                return parse_error(errp, "CBOR message size limit exceeded");
+            }
+            if (val) {
+                cbor_scan_open(parser, major == CBOR_MAJOR_MAP ? 2 * val : val);
+                continue;
+            }
+            break;
+        case CBOR_MAJOR_TAG:
+            /* Not an item, the item that follows is */
+            continue;
+        default:
+            if (info == CBOR_INDEFINITE) {
+                if (!parser->open->len ||
+                    g_array_index(parser->open, uint64_t,
+                                  parser->open->len - 1) != SCAN_INDEFINITE) {
+                    return parse_error(errp, "unexpected break");
+                }
+                g_array_set_size(parser->open, parser->open->len - 1);
+            }
+            break;
+        }
+
+        if (cbor_scan_item_done(parser)) {
+            return 1;
+        }
+    }
+}
+
+static void cbor_scan_reset(CborMessageParser *parser)
+{
+    parser->scanned = 0;
+    parser->skip = 0;
+    g_array_set_size(parser->open, 0);
+}
+
+void cbor_message_parser_init(CborMessageParser *parser,
+                              void (*emit)(void *opaque, QObject *obj,
+                                           Error *err),
+                              void *opaque)
+{
+    parser->emit = emit;
+    parser->opaque = opaque;
+    parser->buf = g_byte_array_new();
+    parser->open = g_array_new(false, false, sizeof(uint64_t));
+    cbor_scan_reset(parser);
+}
+
+void cbor_message_parser_feed(CborMessageParser *parser,
+                              const void *buffer, size_t size)
+{
+    g_byte_array_append(parser->buf, buffer, size);
+
+    while (parser->scanned < parser->buf->len) {
+        QObject *obj = NULL;
+        Error *err = NULL;
+        size_t len;
+        int ret;
+
+        ret = cbor_scan(parser, &err);
+        if (ret == 0) {
+            if (parser->buf->len + parser->skip <= MAX_MESSAGE_SIZE) {
+                return;
+            }
+            /* Security consideration, as for JSON */
+            error_setg(&err, "CBOR message size limit exceeded");
+            ret = -1;
+        }
+
+        if (ret > 0) {
+            len = parser->scanned;
+            obj = qobject_from_cbor(parser->buf->data, len, &err);
+            g_byte_array_remove_range(parser->buf, 0, len);
+        } else {
+            g_byte_array_set_size(parser->buf, 0);
+        }
+        cbor_scan_reset(parser);
+        parser->emit(parser->opaque, obj, err);
+    }
+}
+
+void cbor_message_parser_destroy(CborMessageParser *parser)
+{
+    g_byte_array_unref(parser->buf);
+    parser->buf = NULL;
+    g_array_unref(parser->open);
+    parser->open = NULL;
+}
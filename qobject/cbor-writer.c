@@ -0,0 +1,211 @@
+/*
+ * CBOR Writer
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "qobject/cbor-writer.h"
+#include "qobject/qcbor.h"
+
+struct CborWriter {
+    GString *contents;
+    GByteArray *container_is_array;
+};
+
+CborWriter *cbor_writer_new(void)
+{
+    CborWriter *writer = g_new(CborWriter, 1);
+
+    writer->contents = g_string_new(NULL);
+    writer->container_is_array = g_byte_array_new();
+    return writer;
+}
+
+const GString *cbor_writer_get(CborWriter *writer)
+{
+    g_assert(!writer->container_is_array->len);
+    return writer->contents;
+}
+
+GString *cbor_writer_get_and_free(CborWriter *writer)
+{
+    GString *contents = writer->contents;
+
+    writer->contents = NULL;
+    g_byte_array_free(writer->container_is_array, true);
+    g_free(writer);
+    return contents;
+}
+
+void cbor_writer_free(CborWriter *writer)
+{
+    if (writer) {
+        g_string_free(cbor_writer_get_and_free(writer), true);
+    }
+}
+
+static void enter_container(CborWriter *writer, bool is_array)
+{
+    unsigned depth = writer->container_is_array->len;
+
+    g_byte_array_set_size(writer->container_is_array, depth + 1);
+    writer->container_is_array->data[depth] = is_array;
+}
+
+static void leave_container(CborWriter *writer, bool is_array)
+{
+    unsigned depth = writer->container_is_array->len;
+
+    assert(depth);
+    assert(writer->container_is_array->data[depth - 1] == is_array);
+    g_byte_array_set_size(writer->container_is_array, depth - 1);
+    g_string_append_c(writer->contents, CBOR_BREAK);
+}
+
+static bool in_object(CborWriter *writer)
+{
+    unsigned depth = writer->container_is_array->len;
+
+    return depth && !writer->container_is_array->data[depth - 1];
+}
+
+/* Initial byte and argument of an item, in the shortest form */
+static void head(CborWriter *writer, uint8_t major, uint64_t val)
+{
+    uint8_t buf[9];
+    int n, i;
+
+    if (val < 24) {
+        g_string_append_c(writer->contents, major << 5 | val);
+        return;
+    }
+
+    if (val <= UINT8_MAX) {
+        buf[0] = major << 5 | 24;
+        n = 1;
+    } else if (val <= UINT16_MAX) {
+        buf[0] = major << 5 | 25;
+        n = 2;
+    } else if (val <= UINT32_MAX) {
+        buf[0] = major << 5 | 26;
+        n = 4;
+    } else {
+        buf[0] = major << 5 | 27;
+        n = 8;
+    }
+    for (i = n; i > 0; i--) {
+        buf[i] = val;
+        val >>= 8;
+    }
+    g_string_append_len(writer->contents, (char *)buf, n + 1);
+}
+
+static void text(CborWriter *writer, const char *str)
+{
+    size_t len = strlen(str);
+    g_autofree char *valid = NULL;
+
+    /* Text strings must be valid UTF-8, like JSON's */
+    if (!g_utf8_validate(str, len, NULL)) {
+        valid = g_utf8_make_valid(str, len);
+        str = valid;
+        len = strlen(valid);
+    }
+
+    head(writer, CBOR_MAJOR_TEXT, len);
+    g_string_append_len(writer->contents, str, len);
+}
+
+static void maybe_name(CborWriter *writer, const char *name)
+{
+    if (in_object(writer)) {
+        text(writer, name);
+    }
+}
+
+void cbor_writer_start_object(CborWriter *writer, const char *name)
+{
+    maybe_name(writer, name);
+    g_string_append_c(writer->contents, CBOR_MAJOR_MAP << 5 | CBOR_INDEFINITE);
+    enter_container(writer, false);
+}
+
+void cbor_writer_end_object(CborWriter *writer)
+{
+    leave_container(writer, false);
+}
+
+void cbor_writer_start_array(CborWriter *writer, const char *name)
+{
+    maybe_name(writer, name);
+    g_string_append_c(writer->contents,
+                      CBOR_MAJOR_ARRAY << 5 | CBOR_INDEFINITE);
+    enter_container(writer, true);
+}
+
+void cbor_writer_end_array(CborWriter *writer)
+{
+    leave_container(writer, true);
+}
+
+void cbor_writer_bool(CborWriter *writer, const char *name, bool val)
+{
+    maybe_name(writer, name);
+    g_string_append_c(writer->contents, val ? CBOR_TRUE : CBOR_FALSE);
+}
+
+void cbor_writer_null(CborWriter *writer, const char *name)
+{
+    maybe_name(writer, name);
+    g_string_append_c(writer->contents, CBOR_NULL);
+}
+
+void cbor_writer_int64(CborWriter *writer, const char *name, int64_t val)
+{
+    maybe_name(writer, name);
+    if (val < 0) {
+        head(writer, CBOR_MAJOR_NEGINT, ~(uint64_t)val);
+    } else {
+        head(writer, CBOR_MAJOR_UINT, val);
+    }
+}
+
+void cbor_writer_uint64(CborWriter *writer, const char *name, uint64_t val)
+{
+    maybe_name(writer, name);
+    head(writer, CBOR_MAJOR_UINT, val);
+}
+
+void cbor_writer_double(CborWriter *writer, const char *name, double val)
+{
+    uint64_t bits;
+    uint8_t buf[9];
+    int i;
+
+    maybe_name(writer, name);
+
+    /* Always double precision; unlike JSON, Inf and NaN are fine */
+    memcpy(&bits, &val, sizeof(bits));
+    buf[0] = CBOR_FLOAT64;
+    for (i = 8; i > 0; i--) {
+        buf[i] = bits;
+        bits >>= 8;
+    }
+    g_string_append_len(writer->contents, (char *)buf, sizeof(buf));
+}
+
+void cbor_writer_str(CborWriter *writer, const char *name, const char *str)
+{
+    maybe_name(writer, name);
+    text(writer, str);
+}
+
+void cbor_writer_raw(CborWriter *writer, const char *name,
+                     const GString *item)
+{
+    maybe_name(writer, name);
+    g_string_append_len(writer->contents, item->str, item->len);
+}
@@ -12,6 +12,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/host-utils.h"
 #include "json-parser-int.h"
 
 #define MAX_TOKEN_SIZE (64ULL << 20)
@@ -342,12 +343,97 @@ static void json_lexer_feed_char(JSONLexer *lexer, char ch, bool flush)
     }
 }
 
-void json_lexer_feed(JSONLexer *lexer, const char *buffer, size_t size)
+/*
+ * Bytes that a string delimited by @quote consumes without leaving
+ * state IN_DQ_STRING or IN_SQ_STRING: see json_lexer[].
+ */
+static inline bool json_string_char(uint8_t ch, char quote)
+{
+    return ch >= 0x20 && ch < 0xFE && ch != '\\' && ch != quote;
+}
+
+typedef uint8_t JSONScanVec __attribute__((vector_size(16)));
+typedef int8_t JSONScanMask __attribute__((vector_size(16)));
+
+/*
+ * Return the length of the run of bytes at the start of @buf that the
+ * body of a string delimited by @quote consumes, looking at 16 bytes at
+ * a time.
+ */
+static size_t json_scan_string(const char *buf, size_t size, char quote)
 {
     size_t i;
 
-    for (i = 0; i < size; i++) {
-        json_lexer_feed_char(lexer, buffer[i], false);
+    for (i = 0; i + sizeof(JSONScanVec) <= size; i += sizeof(JSONScanVec)) {
+        JSONScanVec v;
+        JSONScanMask m;
+        uint64_t w[2];
+        int j;
+
+        memcpy(&v, buf + i, sizeof(v));
+        m = (v < 0x20) | (v >= 0xFE) | (v == '\\') | (v == (uint8_t)quote);
+        memcpy(w, &m, sizeof(w));
+        for (j = 0; j < 2; j++) {
+            if (w[j]) {
+                return i + j * 8 + (HOST_BIG_ENDIAN ? clz64(w[j])
+                                                    : ctz64(w[j])) / 8;
+            }
+        }
+    }
+
+    while (i < size && json_string_char(buf[i], quote)) {
+        i++;
+    }
+    return i;
+}
+
+void json_lexer_feed(JSONLexer *lexer, const char *buffer, size_t size)
+{
+    size_t i = 0, n;
+
+    while (i < size) {
+        /*
+         * Fast paths for the bulk of most input, strings and whitespace
+         * between tokens.  The state machine handles everything else.
+         * They only pay off when the caller feeds more than a byte at a
+         * time, which the QMP monitor does not.
+         */
+        switch (lexer->state) {
+        case IN_DQ_STRING:
+        case IN_SQ_STRING:
+            /* Leave enforcing MAX_TOKEN_SIZE to json_lexer_feed_char() */
+            n = json_scan_string(buffer + i,
+                                 MIN(size - i,
+                                     MAX_TOKEN_SIZE - lexer->token->len),
+                                 lexer->state == IN_DQ_STRING ? '"' : '\'');
+            if (n) {
+                g_string_append_len(lexer->token, buffer + i, n);
+                lexer->x += n;
+                i += n;
+                continue;
+            }
+            break;
+        case IN_START:
+        case IN_START_INTERP:
+            n = i;
+            while (i < size && (buffer[i] == ' ' || buffer[i] == '\t' ||
+                                buffer[i] == '\r' || buffer[i] == '\n')) {
+                lexer->x++;
+                if (buffer[i] == '\n') {
+                    lexer->x = 0;
+                    lexer->y++;
+                }
+                i++;
+            }
+            if (i != n) {
+                continue;
+            }
+            break;
+        default:
+            break;
+        }
+
+        json_lexer_feed_char(lexer, buffer[i++], false);
     }
 }
 
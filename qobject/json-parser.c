@@ -28,13 +28,14 @@ struct JSONToken {
     JSONTokenType type;
     int x;
     int y;
+    unsigned size;              /* of the token including padding */
     char str[];
 };
 
 typedef struct JSONParserContext {
     Error *err;
-    JSONToken *current;
-    GQueue *buf;
+    uint8_t *next;              /* next token in the token buffer */
+    uint8_t *end;
     va_list *ap;
 } JSONParserContext;
 
@@ -92,6 +93,16 @@ static int cvt4hex(const char *s)
     return cp;
 }
 
+/*
+ * ASCII characters that parse_string() copies as they are, rather than
+ * decoding them as an escape sequence, an interpolation or UTF-8
+ */
+static inline bool json_plain_char(char ch, char quote)
+{
+    return ch >= 0x20 && ch < 0x7F && ch != '\\' && ch != '%' &&
+        ch != quote;
+}
+
 /**
  * parse_string(): Parse a JSON string
  *
@@ -143,6 +154,16 @@ static QString *parse_string(JSONParserContext *ctxt, JSONToken *token)
 
     while (*ptr != quote) {
         assert(*ptr);
+
+        /* Most characters stand for themselves */
+        for (beg = ptr; json_plain_char(*ptr, quote); ptr++) {
+            /* nothing */
+        }
+        if (ptr != beg) {
+            g_string_append_len(str, beg, ptr - beg);
+            continue;
+        }
+
         switch (*ptr) {
         case '\\':
             beg = ptr++;
@@ -235,20 +256,23 @@ out:
     return NULL;
 }
 
-/* Note: the token object returned by parser_context_peek_token or
- * parser_context_pop_token is deleted as soon as parser_context_pop_token
- * is called again.
- */
-static JSONToken *parser_context_pop_token(JSONParserContext *ctxt)
+/* Note: tokens stay valid until json_parser_parse() returns */
+static JSONToken *parser_context_peek_token(JSONParserContext *ctxt)
 {
-    g_free(ctxt->current);
-    ctxt->current = g_queue_pop_head(ctxt->buf);
-    return ctxt->current;
+    if (ctxt->next == ctxt->end) {
+        return NULL;
+    }
+    return (JSONToken *)ctxt->next;
 }
 
-static JSONToken *parser_context_peek_token(JSONParserContext *ctxt)
+static JSONToken *parser_context_pop_token(JSONParserContext *ctxt)
 {
-    return g_queue_peek_head(ctxt->buf);
+    JSONToken *token = parser_context_peek_token(ctxt);
+
+    if (token) {
+        ctxt->next += token->size;
+    }
+    return token;
 }
 
 /**
@@ -559,32 +583,41 @@ static QObject *parse_value(JSONParserContext *ctxt)
     }
 }
 
-JSONToken *json_token(JSONTokenType type, int x, int y, GString *tokstr)
+/*
+ * Append a token to @tokens.  Tokens are stored one after the other
+ * rather than allocated one by one.
+ */
+void json_token_append(GByteArray *tokens, JSONTokenType type, int x, int y,
+                       GString *tokstr)
 {
-    JSONToken *token = g_malloc(sizeof(JSONToken) + tokstr->len + 1);
+    size_t offset = tokens->len;
+    size_t size = ROUND_UP(sizeof(JSONToken) + tokstr->len + 1,
+                           __alignof__(JSONToken));
+    JSONToken *token;
 
+    g_byte_array_set_size(tokens, offset + size);
+    token = (JSONToken *)(tokens->data + offset);
     token->type = type;
     memcpy(token->str, tokstr->str, tokstr->len);
     token->str[tokstr->len] = 0;
     token->x = x;
     token->y = y;
-    return token;
+    token->size = size;
 }
 
-QObject *json_parser_parse(GQueue *tokens, va_list *ap, Error **errp)
+QObject *json_parser_parse(GByteArray *tokens, va_list *ap, Error **errp)
 {
-    JSONParserContext ctxt = { .buf = tokens, .ap = ap };
+    JSONParserContext ctxt = {
+        .next = tokens->data,
+        .end = tokens->data + tokens->len,
+        .ap = ap,
+    };
     QObject *result;
 
     result = parse_value(&ctxt);
-    assert(ctxt.err || g_queue_is_empty(ctxt.buf));
+    assert(ctxt.err || ctxt.next == ctxt.end);
 
     error_propagate(errp, ctxt.err);
 
-    while (!g_queue_is_empty(ctxt.buf)) {
-        parser_context_pop_token(&ctxt);
-    }
-    g_free(ctxt.current);
-
     return result;
 }
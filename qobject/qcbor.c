@@ -0,0 +1,95 @@
+/*
+ * QObject CBOR integration
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "qobject/cbor-writer.h"
+#include "qobject/qbool.h"
+#include "qobject/qcbor.h"
+#include "qobject/qdict.h"
+#include "qobject/qlist.h"
+#include "qobject/qnum.h"
+#include "qobject/qstring.h"
+
+void cbor_writer_qobject(CborWriter *writer, const char *name,
+                         const QObject *obj)
+{
+    switch (qobject_type(obj)) {
+    case QTYPE_QNULL:
+        cbor_writer_null(writer, name);
+        break;
+    case QTYPE_QNUM: {
+        QNum *val = qobject_to(QNum, obj);
+
+        switch (val->kind) {
+        case QNUM_I64:
+            cbor_writer_int64(writer, name, val->u.i64);
+            break;
+        case QNUM_U64:
+            cbor_writer_uint64(writer, name, val->u.u64);
+            break;
+        case QNUM_DOUBLE:
+            cbor_writer_double(writer, name, val->u.dbl);
+            break;
+        default:
+            abort();
+        }
+        break;
+    }
+    case QTYPE_QSTRING: {
+        QString *val = qobject_to(QString, obj);
+
+        cbor_writer_str(writer, name, qstring_get_str(val));
+        break;
+    }
+    case QTYPE_QDICT: {
+        QDict *val = qobject_to(QDict, obj);
+        const QDictEntry *entry;
+
+        cbor_writer_start_object(writer, name);
+
+        for (entry = qdict_first(val);
+             entry;
+             entry = qdict_next(val, entry)) {
+            cbor_writer_qobject(writer, qdict_entry_key(entry),
+                                qdict_entry_value(entry));
+        }
+
+        cbor_writer_end_object(writer);
+        break;
+    }
+    case QTYPE_QLIST: {
+        QList *val = qobject_to(QList, obj);
+        QListEntry *entry;
+
+        cbor_writer_start_array(writer, name);
+
+        QLIST_FOREACH_ENTRY(val, entry) {
+            cbor_writer_qobject(writer, NULL, qlist_entry_obj(entry));
+        }
+
+        cbor_writer_end_array(writer);
+        break;
+    }
+    case QTYPE_QBOOL: {
+        QBool *val = qobject_to(QBool, obj);
+
+        cbor_writer_bool(writer, name, qbool_get_bool(val));
+        break;
+    }
+    default:
+        abort();
+    }
+}
+
+GString *qobject_to_cbor(const QObject *obj)
+{
+    CborWriter *writer = cbor_writer_new();
+
+    cbor_writer_qobject(writer, NULL, obj);
+    return cbor_writer_get_and_free(writer);
+}
@@ -147,7 +147,7 @@ def gen_marshal_output(ret_type: QAPISchemaType) -> str:
 {
     Visitor *v;
 
-    v = qobject_output_visitor_new_qmp(ret_out);
+    v = qmp_output_visitor_new(ret_out);
     if (visit_type_%(c_name)s(v, "unused", &ret_in, errp)) {
         visit_complete(v, ret_out);
     }
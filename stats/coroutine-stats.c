@@ -0,0 +1,70 @@
+/*
+ * Coroutine pool statistics for query-stats
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/coroutine.h"
+#include "system/stats.h"
+
+static void coroutine_stats_cb(StatsResultList **result, StatsTarget target,
+                               strList *names, strList *targets, Error **errp)
+{
+    StatsList *stats_list = NULL;
+    CoroutinePoolStats pool;
+
+    if (target != STATS_TARGET_VM) {
+        return;
+    }
+
+    qemu_coroutine_get_pool_stats(&pool);
+
+    if (apply_str_list_filter("pool-size", names)) {
+        stats_list = add_stats_scalar(stats_list, "pool-size", pool.size);
+    }
+    if (apply_str_list_filter("pool-discards", names)) {
+        stats_list = add_stats_scalar(stats_list, "pool-discards",
+                                      pool.discards);
+    }
+    if (apply_str_list_filter("pool-refills", names)) {
+        stats_list = add_stats_scalar(stats_list, "pool-refills",
+                                      pool.refills);
+    }
+    if (apply_str_list_filter("pool-misses", names)) {
+        stats_list = add_stats_scalar(stats_list, "pool-misses", pool.misses);
+    }
+    if (apply_str_list_filter("pool-hits", names)) {
+        stats_list = add_stats_scalar(stats_list, "pool-hits", pool.hits);
+    }
+
+    if (stats_list) {
+        add_stats_entry(result, STATS_PROVIDER_COROUTINE, NULL, stats_list);
+    }
+}
+
+static void coroutine_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *stats_list = NULL;
+
+    stats_list = add_stats_schema_value(stats_list, "pool-size",
+                                        STATS_TYPE_INSTANT);
+    stats_list = add_stats_schema_value(stats_list, "pool-discards",
+                                        STATS_TYPE_CUMULATIVE);
+    stats_list = add_stats_schema_value(stats_list, "pool-refills",
+                                        STATS_TYPE_CUMULATIVE);
+    stats_list = add_stats_schema_value(stats_list, "pool-misses",
+                                        STATS_TYPE_CUMULATIVE);
+    stats_list = add_stats_schema_value(stats_list, "pool-hits",
+                                        STATS_TYPE_CUMULATIVE);
+
+    add_stats_schema(result, STATS_PROVIDER_COROUTINE, STATS_TARGET_VM,
+                     stats_list);
+}
+
+void coroutine_stats_init(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_COROUTINE, coroutine_stats_cb,
+                        coroutine_schemas_cb);
+}
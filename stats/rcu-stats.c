@@ -0,0 +1,65 @@
+/*
+ * RCU statistics for query-stats
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/rcu.h"
+#include "system/stats.h"
+
+static void rcu_stats_cb(StatsResultList **result, StatsTarget target,
+                         strList *names, strList *targets, Error **errp)
+{
+    StatsList *stats_list = NULL;
+    RCUStats rcu;
+
+    if (target != STATS_TARGET_VM) {
+        return;
+    }
+
+    rcu_get_stats(&rcu);
+
+    if (apply_str_list_filter("callback-latency", names)) {
+        stats_list = add_stats_histogram(stats_list, "callback-latency",
+                                         rcu.callback_latency,
+                                         RCU_LATENCY_BUCKETS);
+    }
+    if (apply_str_list_filter("pending-callbacks", names)) {
+        stats_list = add_stats_scalar(stats_list, "pending-callbacks",
+                                      rcu.pending);
+    }
+    if (apply_str_list_filter("callbacks", names)) {
+        stats_list = add_stats_scalar(stats_list, "callbacks",
+                                      rcu.callbacks);
+    }
+    if (apply_str_list_filter("grace-periods", names)) {
+        stats_list = add_stats_scalar(stats_list, "grace-periods",
+                                      rcu.grace_periods);
+    }
+
+    if (stats_list) {
+        add_stats_entry(result, STATS_PROVIDER_RCU, NULL, stats_list);
+    }
+}
+
+static void rcu_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *stats_list = NULL;
+
+    stats_list = add_stats_schema_latency(stats_list, "callback-latency");
+    stats_list = add_stats_schema_value(stats_list, "pending-callbacks",
+                                        STATS_TYPE_INSTANT);
+    stats_list = add_stats_schema_value(stats_list, "callbacks",
+                                        STATS_TYPE_CUMULATIVE);
+    stats_list = add_stats_schema_value(stats_list, "grace-periods",
+                                        STATS_TYPE_CUMULATIVE);
+
+    add_stats_schema(result, STATS_PROVIDER_RCU, STATS_TARGET_VM, stats_list);
+}
+
+void rcu_stats_init(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_RCU, rcu_stats_cb, rcu_schemas_cb);
+}
@@ -66,6 +66,15 @@ static bool invoke_stats_cb(StatsCallbacks *entry,
         break;
     case STATS_TARGET_CRYPTODEV:
         break;
+    case STATS_TARGET_BLOCK_NODE:
+        if (filter->u.block_node.has_nodes) {
+            if (!filter->u.block_node.nodes) {
+                /* No targets allowed?  Return no statistics.  */
+                return true;
+            }
+            targets = filter->u.block_node.nodes;
+        }
+        break;
     default:
         abort();
     }
@@ -148,6 +157,70 @@ void add_stats_schema(StatsSchemaList **schema_results,
     QAPI_LIST_PREPEND(*schema_results, entry);
 }
 
+StatsList *add_stats_scalar(StatsList *list, const char *name,
+                            uint64_t value)
+{
+    Stats *stats = g_new0(Stats, 1);
+
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QNUM;
+    stats->value->u.scalar = value;
+    QAPI_LIST_PREPEND(list, stats);
+    return list;
+}
+
+StatsSchemaValueList *add_stats_schema_value(StatsSchemaValueList *list,
+                                             const char *name,
+                                             StatsType type)
+{
+    StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+    value->name = g_strdup(name);
+    value->type = type;
+    QAPI_LIST_PREPEND(list, value);
+    return list;
+}
+
+StatsList *add_stats_histogram(StatsList *list, const char *name,
+                               const uint64_t *buckets, int nb_buckets)
+{
+    uint64List *values = NULL;
+    Stats *stats;
+    int i;
+
+    /* Only the non-empty prefix of the histogram */
+    while (nb_buckets > 0 && !buckets[nb_buckets - 1]) {
+        nb_buckets--;
+    }
+    if (!nb_buckets) {
+        return list;
+    }
+    for (i = nb_buckets - 1; i >= 0; i--) {
+        QAPI_LIST_PREPEND(values, buckets[i]);
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QLIST;
+    stats->value->u.list = values;
+    QAPI_LIST_PREPEND(list, stats);
+    return list;
+}
+
+StatsSchemaValueList *add_stats_schema_latency(StatsSchemaValueList *list,
+                                               const char *name)
+{
+    list = add_stats_schema_value(list, name, STATS_TYPE_LOG2_HISTOGRAM);
+    list->value->has_unit = true;
+    list->value->unit = STATS_UNIT_SECONDS;
+    list->value->has_base = true;
+    list->value->base = 10;
+    list->value->exponent = -9;
+    return list;
+}
+
 bool apply_str_list_filter(const char *string, strList *list)
 {
     strList *str_list = NULL;
@@ -0,0 +1,75 @@
+/*
+ * Thread pool statistics for query-stats
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.
+ */
+
+#include "qemu/osdep.h"
+#include "block/thread-pool.h"
+#include "system/stats.h"
+
+/* Stats names, with "queue-latency" and "requests" appended */
+static const char *const thread_pool_class_prefix[THREAD_POOL_CLASS__MAX] = {
+    [THREAD_POOL_CLASS_DEFAULT] = "",
+    [THREAD_POOL_CLASS_SLOW] = "slow-",
+};
+
+static void thread_pool_stats_cb(StatsResultList **result, StatsTarget target,
+                                 strList *names, strList *targets,
+                                 Error **errp)
+{
+    StatsList *stats_list = NULL;
+    ThreadPoolClass cls;
+
+    if (target != STATS_TARGET_VM) {
+        return;
+    }
+
+    for (cls = THREAD_POOL_CLASS__MAX; cls-- > 0; ) {
+        const char *prefix = thread_pool_class_prefix[cls];
+        g_autofree char *latency = g_strconcat(prefix, "queue-latency", NULL);
+        g_autofree char *requests = g_strconcat(prefix, "requests", NULL);
+        ThreadPoolStats tp;
+
+        thread_pool_get_stats(cls, &tp);
+
+        if (apply_str_list_filter(latency, names)) {
+            stats_list = add_stats_histogram(stats_list, latency,
+                                             tp.queue_latency,
+                                             THREAD_POOL_LATENCY_BUCKETS);
+        }
+        if (apply_str_list_filter(requests, names)) {
+            stats_list = add_stats_scalar(stats_list, requests, tp.requests);
+        }
+    }
+
+    if (stats_list) {
+        add_stats_entry(result, STATS_PROVIDER_THREAD_POOL, NULL, stats_list);
+    }
+}
+
+static void thread_pool_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *stats_list = NULL;
+    ThreadPoolClass cls;
+
+    for (cls = THREAD_POOL_CLASS__MAX; cls-- > 0; ) {
+        const char *prefix = thread_pool_class_prefix[cls];
+        g_autofree char *latency = g_strconcat(prefix, "queue-latency", NULL);
+        g_autofree char *requests = g_strconcat(prefix, "requests", NULL);
+
+        stats_list = add_stats_schema_latency(stats_list, latency);
+        stats_list = add_stats_schema_value(stats_list, requests,
+                                            STATS_TYPE_CUMULATIVE);
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_THREAD_POOL, STATS_TARGET_VM,
+                     stats_list);
+}
+
+void thread_pool_stats_init(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_THREAD_POOL, thread_pool_stats_cb,
+                        thread_pool_schemas_cb);
+}
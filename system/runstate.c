@@ -51,12 +51,14 @@
 #include "qemu/thread.h"
 #include "qom/object.h"
 #include "qom/object_interfaces.h"
+#include "system/blockdev.h"
 #include "system/cpus.h"
 #include "system/qtest.h"
 #include "system/replay.h"
 #include "system/reset.h"
 #include "system/runstate.h"
 #include "system/runstate-action.h"
+#include "system/stats.h"
 #include "system/system.h"
 #include "system/tpm.h"
 #include "trace.h"
@@ -974,6 +976,10 @@ void qemu_init_subsystems(void)
     os_setup_early_signal_handling();
 
     bdrv_init_with_whitelist();
+    blockdev_stats_init();
+    rcu_stats_init();
+    coroutine_stats_init();
+    thread_pool_stats_init();
     socket_init();
 }
 
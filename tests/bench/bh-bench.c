@@ -0,0 +1,134 @@
+/*
+ * Cross-thread bottom half benchmark
+ *
+ * Measures how many oneshot BHs per second other threads can hand to an
+ * AioContext, like thread pool completions or virtqueue kicks from vCPU
+ * threads do.  Each BH is a kick of the event loop, which can either wake
+ * up from a blocking poll or, with polling enabled, find the BH without
+ * being woken up.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "block/aio.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+
+#define MAX_PRODUCERS   8
+#define DURATION_MS     1000
+
+/* BHs that a producer can have in flight */
+#define WINDOW          256
+
+typedef struct Producer {
+    QemuThread thread;
+    uint64_t sent;
+    uint64_t done;      /* atomic */
+} Producer;
+
+static AioContext *ctx;
+static Producer producers[MAX_PRODUCERS];
+static bool stopping;
+static bool consumer_stopping;
+
+static void bh_cb(void *opaque)
+{
+    Producer *p = opaque;
+
+    qatomic_set(&p->done, p->done + 1);
+}
+
+static void *consumer_thread(void *opaque)
+{
+    qemu_set_current_aio_context(ctx);
+    while (!qatomic_read(&consumer_stopping)) {
+        aio_poll(ctx, true);
+    }
+    return NULL;
+}
+
+static void *producer_thread(void *opaque)
+{
+    Producer *p = opaque;
+
+    while (!qatomic_read(&stopping)) {
+        if (p->sent - qatomic_read(&p->done) >= WINDOW) {
+            cpu_relax();
+            continue;
+        }
+        aio_bh_schedule_oneshot(ctx, bh_cb, p);
+        p->sent++;
+    }
+
+    /* Let the consumer run what is still in flight */
+    while (qatomic_read(&p->done) != p->sent) {
+        cpu_relax();
+    }
+    return NULL;
+}
+
+static void run(int nr_producers, int64_t poll_max_ns)
+{
+    QemuThread consumer;
+    uint64_t done = 0;
+    int64_t start, elapsed;
+    int i;
+
+    ctx = aio_context_new(&error_abort);
+    aio_context_set_poll_params(ctx, poll_max_ns, 0, 0, &error_abort);
+    qatomic_set(&stopping, false);
+    qatomic_set(&consumer_stopping, false);
+
+    qemu_thread_create(&consumer, "consumer", consumer_thread, NULL,
+                       QEMU_THREAD_JOINABLE);
+
+    start = get_clock();
+    for (i = 0; i < nr_producers; i++) {
+        producers[i] = (Producer) {};
+        qemu_thread_create(&producers[i].thread, "producer", producer_thread,
+                           &producers[i], QEMU_THREAD_JOINABLE);
+    }
+
+    g_usleep(DURATION_MS * 1000);
+    qatomic_set(&stopping, true);
+
+    for (i = 0; i < nr_producers; i++) {
+        qemu_thread_join(&producers[i].thread);
+        done += producers[i].done;
+    }
+    elapsed = get_clock() - start;
+
+    /* The consumer may be blocked in aio_poll() */
+    qatomic_set(&consumer_stopping, true);
+    aio_notify(ctx);
+    qemu_thread_join(&consumer);
+    aio_context_unref(ctx);
+
+    g_test_message("%d producer(s), %s: %.2f M kicks/s", nr_producers,
+                   poll_max_ns ? "polling" : "blocking",
+                   (double) done * 1000 / elapsed);
+}
+
+static void test_kicks(gconstpointer opaque)
+{
+    int64_t poll_max_ns = (uintptr_t) opaque;
+    int nr_producers;
+
+    for (nr_producers = 1; nr_producers <= MAX_PRODUCERS; nr_producers *= 2) {
+        run(nr_producers, poll_max_ns);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_data_func("/bh/kicks/blocking", (void *)(uintptr_t) 0,
+                         test_kicks);
+    g_test_add_data_func("/bh/kicks/polling", (void *)(uintptr_t) 32768,
+                         test_kicks);
+    return g_test_run();
+}
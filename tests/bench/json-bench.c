@@ -0,0 +1,156 @@
+/*
+ * JSON parser benchmark
+ *
+ * Measures how fast typical QMP input goes through the streaming JSON
+ * parser and through qobject_from_json(): a blockdev-add with a nested
+ * node graph, a migrate-set-parameters with many members, and a large
+ * message that is mostly arrays.
+ *
+ * The QMP monitor feeds the streaming parser one byte at a time, because
+ * monitor_can_read() never asks for more; qemu-ga feeds it whatever a read
+ * returns, up to 4 KiB.  Only larger chunks let the lexer scan strings
+ * more than a byte at a time.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qobject/json-parser.h"
+#include "qobject/qjson.h"
+#include "qobject/qobject.h"
+#include "qemu/timer.h"
+
+#define DURATION_MS     1000
+
+static const char blockdev_add[] =
+    "{ \"execute\": \"blockdev-add\", \"arguments\": {"
+    " \"node-name\": \"disk0\", \"driver\": \"qcow2\","
+    " \"discard\": \"unmap\", \"detect-zeroes\": \"unmap\","
+    " \"cache\": { \"direct\": true, \"no-flush\": false },"
+    " \"backing\": { \"driver\": \"qcow2\", \"node-name\": \"base0\","
+    "   \"file\": { \"driver\": \"file\", \"node-name\": \"base0-file\","
+    "     \"filename\": \"/var/lib/libvirt/images/base-image.qcow2\","
+    "     \"aio\": \"io_uring\", \"locking\": \"auto\" } },"
+    " \"file\": { \"driver\": \"throttle\", \"throttle-group\": \"tg0\","
+    "   \"file\": { \"driver\": \"file\", \"node-name\": \"disk0-file\","
+    "     \"filename\": \"/var/lib/libvirt/images/overlay-image.qcow2\","
+    "     \"aio\": \"io_uring\", \"locking\": \"auto\" } } },"
+    " \"id\": \"libvirt-42\" }";
+
+static const char migrate_set_parameters[] =
+    "{ \"execute\": \"migrate-set-parameters\", \"arguments\": {"
+    " \"compress-level\": 1, \"compress-threads\": 8,"
+    " \"decompress-threads\": 2, \"throttle-trigger-threshold\": 50,"
+    " \"cpu-throttle-initial\": 20, \"cpu-throttle-increment\": 10,"
+    " \"cpu-throttle-tailslow\": false, \"tls-creds\": \"\","
+    " \"tls-hostname\": \"\", \"max-bandwidth\": 9223372036853727232,"
+    " \"avail-switchover-bandwidth\": 0, \"downtime-limit\": 300,"
+    " \"x-checkpoint-delay\": 20000, \"multifd-channels\": 4,"
+    " \"xbzrle-cache-size\": 67108864, \"max-postcopy-bandwidth\": 0,"
+    " \"max-cpu-throttle\": 99, \"announce-initial\": 50,"
+    " \"announce-max\": 550, \"announce-rounds\": 5,"
+    " \"announce-step\": 100, \"multifd-compression\": \"none\","
+    " \"multifd-zlib-level\": 1, \"multifd-zstd-level\": 1,"
+    " \"mode\": \"normal\", \"zero-page-detection\": \"multifd\" },"
+    " \"id\": \"libvirt-43\" }";
+
+static GString *array_heavy;
+
+static void build_array_heavy(void)
+{
+    int i;
+
+    array_heavy = g_string_new("{ \"execute\": \"x-bench\", "
+                               "\"arguments\": { \"dirty\": [");
+    for (i = 0; i < 4096; i++) {
+        g_string_append_printf(array_heavy, "%s{ \"addr\": %d, "
+                               "\"pages\": [%d, %d, %d, %d], "
+                               "\"name\": \"ram-block-%d\" }",
+                               i ? ", " : "", i * 4096,
+                               i, i + 1, i + 2, i + 3, i);
+    }
+    g_string_append(array_heavy, "] }, \"id\": \"bench\" }");
+}
+
+static void emit(void *opaque, QObject *json, Error *err)
+{
+    uint64_t *msgs = opaque;
+
+    g_assert(json && !err);
+    qobject_unref(json);
+    (*msgs)++;
+}
+
+static void report(const char *what, const char *name, size_t len,
+                   uint64_t msgs, int64_t elapsed)
+{
+    g_test_message("%-24s %-12s %8.1f MB/s %10.0f msgs/s", name, what,
+                   (double) msgs * len * 1000 / elapsed,
+                   (double) msgs * NANOSECONDS_PER_SECOND / elapsed);
+}
+
+/* Input arrives in chunks of up to @chunk_size bytes */
+static void run_streamer(const char *what, const char *name, const char *msg,
+                         size_t len, size_t chunk_size)
+{
+    JSONMessageParser parser;
+    uint64_t msgs = 0;
+    int64_t start, elapsed;
+    size_t off, chunk;
+
+    json_message_parser_init(&parser, emit, &msgs, NULL);
+    start = get_clock();
+    do {
+        for (off = 0; off < len; off += chunk) {
+            chunk = MIN(len - off, chunk_size);
+            json_message_parser_feed(&parser, msg + off, chunk);
+        }
+        elapsed = get_clock() - start;
+    } while (elapsed < DURATION_MS * SCALE_MS);
+    json_message_parser_destroy(&parser);
+
+    report(what, name, len, msgs, elapsed);
+}
+
+static void run_from_json(const char *name, const char *msg, size_t len)
+{
+    uint64_t msgs = 0;
+    int64_t start, elapsed;
+
+    start = get_clock();
+    do {
+        qobject_unref(qobject_from_json(msg, &error_abort));
+        msgs++;
+        elapsed = get_clock() - start;
+    } while (elapsed < DURATION_MS * SCALE_MS);
+
+    report("from_json", name, len, msgs, elapsed);
+}
+
+static void run(const char *name, const char *msg)
+{
+    size_t len = strlen(msg);
+
+    run_streamer("qmp-monitor", name, msg, len, 1);
+    run_streamer("qemu-ga", name, msg, len, 4096);
+    run_from_json(name, msg, len);
+}
+
+static void test_parse(void)
+{
+    run("blockdev-add", blockdev_add);
+    run("migrate-set-parameters", migrate_set_parameters);
+    run("array-heavy", array_heavy->str);
+}
+
+int main(int argc, char **argv)
+{
+    build_array_heavy();
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/json/parse", test_parse);
+    return g_test_run();
+}
@@ -0,0 +1,138 @@
+/*
+ * QEMUFile write benchmark
+ *
+ * Measures the CPU time that the writing thread spends per GiB of RAM
+ * pages sent through a QEMUFile over a TCP connection, for the different
+ * ways a page can be queued: copied into the QEMUFile buffer, queued by
+ * reference, and queued by reference with zero copy.
+ *
+ * Over loopback the kernel copies zero-copy data anyway, so the zero-copy
+ * numbers there only show the overhead of the completion handling.  Run
+ * the receiver on another host for real numbers.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-visit-sockets.h"
+#include "io/channel-socket.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "../migration/qemu-file.h"
+
+#define PAGE_SIZE       4096
+#define RAM_SIZE        (64 * MiB)
+#define TRANSFER_SIZE   (2 * GiB)
+
+typedef enum {
+    BENCH_COPY,
+    BENCH_ASYNC,
+    BENCH_ZERO_COPY,
+} BenchMode;
+
+static uint8_t *ram;
+
+static void *drain_thread(void *opaque)
+{
+    QIOChannel *ioc = opaque;
+    static char buf[256 * KiB];
+
+    while (qio_channel_read(ioc, buf, sizeof(buf), NULL) > 0) {
+        /* discard */
+    }
+    return NULL;
+}
+
+static int64_t thread_cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec;
+}
+
+static void test_write(const void *opaque)
+{
+    BenchMode mode = (uintptr_t) opaque;
+    g_autoptr(QIOChannelSocket) lioc = qio_channel_socket_new();
+    g_autoptr(QIOChannelSocket) cioc = qio_channel_socket_new();
+    g_autoptr(QIOChannelSocket) sioc = NULL;
+    g_autoptr(SocketAddress) laddr = NULL;
+    SocketAddress addr = {
+        .type = SOCKET_ADDRESS_TYPE_INET,
+        .u.inet = {
+            .host = (char *)"127.0.0.1",
+            .port = (char *)"0",
+        },
+    };
+    QemuThread thread;
+    QEMUFile *f;
+    uint64_t offset;
+    int64_t start_cpu, start_wall, cpu, wall;
+
+    qio_channel_socket_listen_sync(lioc, &addr, 1, &error_abort);
+    laddr = qio_channel_socket_get_local_address(lioc, &error_abort);
+    qio_channel_socket_connect_sync(cioc, laddr, &error_abort);
+    sioc = qio_channel_socket_accept(lioc, &error_abort);
+
+    if (mode == BENCH_ZERO_COPY &&
+        !qio_channel_has_feature(QIO_CHANNEL(cioc),
+                                 QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+        g_test_skip("MSG_ZEROCOPY not supported");
+        return;
+    }
+
+    qemu_thread_create(&thread, "drain", drain_thread, sioc,
+                       QEMU_THREAD_JOINABLE);
+
+    f = qemu_file_new_output(QIO_CHANNEL(cioc));
+    if (mode == BENCH_ZERO_COPY) {
+        qemu_file_set_zero_copy(f);
+    }
+
+    start_cpu = thread_cpu_ns();
+    start_wall = get_clock();
+    for (offset = 0; offset < TRANSFER_SIZE; offset += PAGE_SIZE) {
+        uint8_t *page = ram + offset % RAM_SIZE;
+
+        /* Like the page header of the RAM section */
+        qemu_put_be64(f, offset);
+        if (mode == BENCH_COPY) {
+            qemu_put_buffer(f, page, PAGE_SIZE);
+        } else {
+            qemu_put_buffer_async(f, page, PAGE_SIZE, false);
+        }
+    }
+    g_assert_cmpint(qemu_fflush(f), ==, 0);
+    g_assert_cmpint(qemu_file_flush_zero_copy(f), ==, 0);
+    cpu = thread_cpu_ns() - start_cpu;
+    wall = get_clock() - start_wall;
+
+    qemu_fclose(f);
+    qemu_thread_join(&thread);
+
+    g_test_message("%.1f ms CPU per GiB, %.0f MiB/s",
+                   (double) cpu / SCALE_MS / (TRANSFER_SIZE / GiB),
+                   (double) TRANSFER_SIZE / MiB * NANOSECONDS_PER_SECOND /
+                   wall);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    ram = qemu_memalign(PAGE_SIZE, RAM_SIZE);
+    memset(ram, 0x5a, RAM_SIZE);
+
+    g_test_add_data_func("/qemu-file/write/copy",
+                         (void *)(uintptr_t) BENCH_COPY, test_write);
+    g_test_add_data_func("/qemu-file/write/async",
+                         (void *)(uintptr_t) BENCH_ASYNC, test_write);
+    g_test_add_data_func("/qemu-file/write/zero-copy",
+                         (void *)(uintptr_t) BENCH_ZERO_COPY, test_write);
+    return g_test_run();
+}
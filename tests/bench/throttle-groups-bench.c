@@ -0,0 +1,135 @@
+/*
+ * Throttle group scalability benchmark
+ *
+ * Several members of the same throttle group submit requests from
+ * different threads, each with its own AioContext, like disks that share
+ * a group but run in different iothreads.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "block/aio.h"
+#include "block/block.h"
+#include "block/throttle-groups.h"
+#include "qemu/coroutine.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "qemu/thread.h"
+
+#define MAX_THREADS     8
+#define REQUEST_SIZE    4096
+#define DURATION_SEC    1
+
+typedef struct BenchThread {
+    QemuThread thread;
+    AioContext *ctx;
+    ThrottleGroupMember tgm;
+    uint64_t ops;
+    bool done;
+} BenchThread;
+
+static BenchThread threads[MAX_THREADS];
+static bool stop;
+
+static void coroutine_fn bench_co(void *opaque)
+{
+    BenchThread *t = opaque;
+
+    while (!qatomic_read(&stop)) {
+        throttle_group_co_io_limits_intercept(&t->tgm, REQUEST_SIZE,
+                                              THROTTLE_WRITE);
+        t->ops++;
+    }
+    t->done = true;
+}
+
+static void *bench_thread(void *opaque)
+{
+    BenchThread *t = opaque;
+
+    qemu_set_current_aio_context(t->ctx);
+    aio_co_enter(t->ctx, qemu_coroutine_create(bench_co, t));
+
+    /* Also wait for restarts scheduled by throttle timers */
+    while (!t->done || qatomic_read(&t->tgm.restart_pending)) {
+        aio_poll(t->ctx, true);
+    }
+    return NULL;
+}
+
+static void run(int nr_threads, uint64_t iops)
+{
+    ThrottleConfig cfg;
+    uint64_t total = 0, min = UINT64_MAX, max = 0;
+    int i;
+
+    for (i = 0; i < nr_threads; i++) {
+        threads[i] = (BenchThread) {
+            .ctx = aio_context_new(&error_abort),
+        };
+        throttle_group_register_tgm(&threads[i].tgm, "bench", threads[i].ctx);
+    }
+
+    throttle_config_init(&cfg);
+    cfg.buckets[THROTTLE_OPS_TOTAL].avg = iops;
+    throttle_group_config(&threads[0].tgm, &cfg);
+
+    qatomic_set(&stop, false);
+    for (i = 0; i < nr_threads; i++) {
+        qemu_thread_create(&threads[i].thread, "bench", bench_thread,
+                           &threads[i], QEMU_THREAD_JOINABLE);
+    }
+
+    g_usleep(DURATION_SEC * G_USEC_PER_SEC);
+    qatomic_set(&stop, true);
+
+    for (i = 0; i < nr_threads; i++) {
+        BenchThread *t = &threads[i];
+
+        /* Wake up threads that are waiting for a throttle timer */
+        aio_notify(t->ctx);
+        qemu_thread_join(&t->thread);
+
+        total += t->ops;
+        min = MIN(min, t->ops);
+        max = MAX(max, t->ops);
+
+        throttle_group_unregister_tgm(&t->tgm);
+        aio_context_unref(t->ctx);
+    }
+
+    g_test_message("%d threads, limit %10" PRIu64 " IOPS: %10.0f IOPS, "
+                   "per thread min %" PRIu64 " max %" PRIu64,
+                   nr_threads, iops, (double) total / DURATION_SEC, min, max);
+}
+
+static void test_scaling(const void *opaque)
+{
+    uint64_t iops = (uintptr_t) opaque;
+    int nr_threads;
+
+    for (nr_threads = 1; nr_threads <= MAX_THREADS; nr_threads *= 2) {
+        run(nr_threads, iops);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    qemu_init_main_loop(&error_fatal);
+    bdrv_init();
+    module_call_init(MODULE_INIT_QOM);
+
+    g_test_init(&argc, &argv, NULL);
+
+    /* Limit far above what the threads can do: measures the overhead */
+    g_test_add_data_func("/throttle-groups/scaling/unlimited",
+                         (void *)(uintptr_t) 100000000, test_scaling);
+    /* Binding limit: the total should match it and be shared fairly */
+    g_test_add_data_func("/throttle-groups/scaling/limited",
+                         (void *)(uintptr_t) 200000, test_scaling);
+    return g_test_run();
+}
@@ -0,0 +1,93 @@
+/*
+ * QEMU timer list benchmark
+ *
+ * Measures the cost of rearming timers and of computing the deadline of
+ * a timer list that holds many pending timers, like the per-request
+ * timers of a busy device or of the block layer.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+
+#define MAX_TIMERS      16384
+#define NR_OPS          (4 * 1024 * 1024)
+
+static QEMUTimer timers[MAX_TIMERS];
+
+static void timer_cb(void *opaque)
+{
+}
+
+static void notify_cb(void *opaque, QEMUClockType type)
+{
+}
+
+static void run(int nr_timers)
+{
+    QEMUTimerListGroup tlg;
+    QEMUTimerList *tl;
+    int64_t now = get_clock();
+    int64_t start, mod_ns, deadline_ns;
+    int64_t deadline = 0;
+    GRand *rand = g_rand_new_with_seed(nr_timers);
+    int i;
+
+    timerlistgroup_init(&tlg, notify_cb, NULL);
+    tl = tlg.tl[QEMU_CLOCK_REALTIME];
+    for (i = 0; i < nr_timers; i++) {
+        timer_init_full(&timers[i], &tlg, QEMU_CLOCK_REALTIME, SCALE_NS, 0,
+                        timer_cb, NULL);
+        timer_mod_ns(&timers[i], now + NANOSECONDS_PER_SECOND * 3600 +
+                     g_rand_int_range(rand, 0, NANOSECONDS_PER_SECOND));
+    }
+
+    /* Far in the future, so that no timer ever expires */
+    start = get_clock();
+    for (i = 0; i < NR_OPS; i++) {
+        timer_mod_ns(&timers[i % nr_timers],
+                     now + NANOSECONDS_PER_SECOND * 3600 +
+                     g_rand_int_range(rand, 0, NANOSECONDS_PER_SECOND));
+    }
+    mod_ns = get_clock() - start;
+
+    start = get_clock();
+    for (i = 0; i < NR_OPS; i++) {
+        deadline |= timerlist_deadline_ns(tl);
+    }
+    deadline_ns = get_clock() - start;
+    g_assert_cmpint(deadline, >, 0);
+
+    for (i = 0; i < nr_timers; i++) {
+        timer_del(&timers[i]);
+    }
+    g_assert(!timerlist_has_timers(tl));
+    timerlistgroup_deinit(&tlg);
+    g_rand_free(rand);
+
+    g_test_message("%5d timers: timer_mod %6.1f ns, "
+                   "timerlist_deadline_ns %6.1f ns",
+                   nr_timers, (double) mod_ns / NR_OPS,
+                   (double) deadline_ns / NR_OPS);
+}
+
+static void test_timers(void)
+{
+    int nr_timers;
+
+    for (nr_timers = 16; nr_timers <= MAX_TIMERS; nr_timers *= 4) {
+        run(nr_timers);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    init_clocks(NULL);
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/timer/mod-deadline", test_timers);
+    return g_test_run();
+}
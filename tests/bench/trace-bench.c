@@ -0,0 +1,114 @@
+/*
+ * Simple trace backend benchmark
+ *
+ * Measures how many events per second each thread can record with the
+ * "simple" backend, like block and virtio tracepoints do in the I/O
+ * path, and how many of them the writeout thread has to drop.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "trace/control.h"
+#include "trace/simple.h"
+
+#define MAX_THREADS     8
+#define DURATION_MS     1000
+
+typedef struct Tracer {
+    QemuThread thread;
+    uint64_t recorded;
+    uint64_t dropped;
+} Tracer;
+
+static Tracer tracers[MAX_THREADS];
+static bool stopping;
+
+/* Like a tracepoint with a pointer, an offset, a length and a name */
+static void *tracer_thread(void *opaque)
+{
+    Tracer *t = opaque;
+    static const char name[] = "drive0";
+    uint64_t i = 0;
+
+    while (!qatomic_read(&stopping)) {
+        TraceBufferRecord rec;
+
+        if (trace_record_start(&rec, 0, 8 * 3 + 4 + strlen(name))) {
+            t->dropped++;
+            continue;
+        }
+        trace_record_write_u64(&rec, (uintptr_t)t);
+        trace_record_write_u64(&rec, i * 4096);
+        trace_record_write_u64(&rec, 4096);
+        trace_record_write_str(&rec, name, strlen(name));
+        trace_record_finish(&rec);
+        t->recorded++;
+        i++;
+    }
+    return NULL;
+}
+
+static void run(int nr_threads)
+{
+    uint64_t recorded = 0, dropped = 0;
+    int64_t start, elapsed;
+    int i;
+
+    qatomic_set(&stopping, false);
+    start = get_clock();
+    for (i = 0; i < nr_threads; i++) {
+        tracers[i] = (Tracer) {};
+        qemu_thread_create(&tracers[i].thread, "tracer", tracer_thread,
+                           &tracers[i], QEMU_THREAD_JOINABLE);
+    }
+
+    g_usleep(DURATION_MS * 1000);
+    qatomic_set(&stopping, true);
+
+    for (i = 0; i < nr_threads; i++) {
+        qemu_thread_join(&tracers[i].thread);
+        recorded += tracers[i].recorded;
+        dropped += tracers[i].dropped;
+    }
+    elapsed = get_clock() - start;
+    st_flush_trace_buffer();
+
+    g_test_message("%d thread(s): %.2f M events/s recorded per thread, "
+                   "%.1f%% dropped", nr_threads,
+                   (double) recorded * 1000 / elapsed / nr_threads,
+                   (double) dropped * 100 / MAX(recorded + dropped, 1));
+}
+
+static void test_events(void)
+{
+    g_autofree char *path = NULL;
+    int nr_threads;
+    int fd;
+
+    fd = g_file_open_tmp("trace-bench-XXXXXX", &path, NULL);
+    g_assert(fd >= 0);
+    close(fd);
+
+    st_set_trace_file(path);
+    st_set_trace_file_enabled(true);
+    for (nr_threads = 1; nr_threads <= MAX_THREADS; nr_threads *= 2) {
+        run(nr_threads);
+    }
+    st_set_trace_file_enabled(false);
+    unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    if (!trace_init_backends()) {
+        return 1;
+    }
+    g_test_add_func("/trace/simple/events", test_events);
+    return g_test_run();
+}
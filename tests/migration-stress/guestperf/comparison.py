@@ -171,4 +171,23 @@ def __init__(self, name, scenarios):
         Scenario("compr-multifd-compression-uadk",
                  multifd=True, multifd_channels=2, multifd_compression="uadk"),
     ]),
+
+    # Looking at effect of adaptive multifd zstd compression
+    # with varying bandwidth limits
+    Comparison("compr-multifd-zstd-adaptive", scenarios = [
+        Scenario("compr-multifd-zstd-bw-100",
+                 multifd=True, multifd_channels=2, multifd_compression="zstd",
+                 bandwidth=100),
+        Scenario("compr-multifd-zstd-adaptive-bw-100",
+                 multifd=True, multifd_channels=2, multifd_compression="zstd",
+                 multifd_zstd_adaptive=True, bandwidth=100),
+        Scenario("compr-multifd-zstd-bw-1000",
+                 multifd=True, multifd_channels=2, multifd_compression="zstd",
+                 bandwidth=1000),
+        Scenario("compr-multifd-zstd-adaptive-bw-1000",
+                 multifd=True, multifd_channels=2, multifd_compression="zstd",
+                 multifd_zstd_adaptive=True, bandwidth=1000),
+        Scenario("compr-multifd-none-bw-1000",
+                 multifd=True, multifd_channels=2, bandwidth=1000),
+    ]),
 ]
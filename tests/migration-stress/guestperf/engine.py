@@ -220,6 +220,18 @@ def _migrate(self, hardware, scenario, src,
                 resp = dst.cmd("migrate-set-parameters",
                     multifd_compression=scenario._multifd_compression)
 
+            if scenario._multifd_zstd_adaptive:
+                resp = src.cmd("migrate-set-capabilities",
+                               capabilities = [
+                                   { "capability": "x-multifd-zstd-adaptive",
+                                     "state": True }
+                               ])
+                resp = dst.cmd("migrate-set-capabilities",
+                               capabilities = [
+                                   { "capability": "x-multifd-zstd-adaptive",
+                                     "state": True }
+                               ])
+
         if scenario._dirty_limit:
             if not hardware._dirty_ring_size:
                 raise Exception("dirty ring size must be configured when "
@@ -31,6 +31,7 @@ def __init__(self, name,
                  compression_mt=False, compression_mt_threads=1,
                  compression_xbzrle=False, compression_xbzrle_cache=10,
                  multifd=False, multifd_channels=2, multifd_compression="",
+                 multifd_zstd_adaptive=False,
                  dirty_limit=False, x_vcpu_dirty_limit_period=500,
                  vcpu_dirty_limit=1):
 
@@ -62,6 +63,7 @@ def __init__(self, name,
         self._multifd = multifd
         self._multifd_channels = multifd_channels
         self._multifd_compression = multifd_compression
+        self._multifd_zstd_adaptive = multifd_zstd_adaptive
 
         self._dirty_limit = dirty_limit
         self._x_vcpu_dirty_limit_period = x_vcpu_dirty_limit_period
@@ -87,6 +89,7 @@ def serialize(self):
             "multifd": self._multifd,
             "multifd_channels": self._multifd_channels,
             "multifd_compression": self._multifd_compression,
+            "multifd_zstd_adaptive": self._multifd_zstd_adaptive,
             "dirty_limit": self._dirty_limit,
             "x_vcpu_dirty_limit_period": self._x_vcpu_dirty_limit_period,
             "vcpu_dirty_limit": self._vcpu_dirty_limit,
@@ -112,4 +115,5 @@ def deserialize(cls, data):
             data["compression_xbzrle_cache"],
             data["multifd"],
             data["multifd_channels"],
-            data["multifd_compression"])
+            data["multifd_compression"],
+            multifd_zstd_adaptive=data.get("multifd_zstd_adaptive", False))
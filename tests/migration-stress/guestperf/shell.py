@@ -133,6 +133,9 @@ def __init__(self):
                             default=2, type=int)
         parser.add_argument("--multifd-compression", dest="multifd_compression",
                             default="")
+        parser.add_argument("--multifd-zstd-adaptive",
+                            dest="multifd_zstd_adaptive", default=False,
+                            action="store_true")
 
         parser.add_argument("--dirty-limit", dest="dirty_limit", default=False,
                             action="store_true")
@@ -170,6 +173,7 @@ def get_scenario(self, args):
                         multifd=args.multifd,
                         multifd_channels=args.multifd_channels,
                         multifd_compression=args.multifd_compression,
+                        multifd_zstd_adaptive=args.multifd_zstd_adaptive,
 
                         dirty_limit=args.dirty_limit,
                         x_vcpu_dirty_limit_period=\
@@ -56,6 +56,19 @@ static void test_multifd_postcopy_tcp_zstd(void)
 
     test_precopy_common(&args);
 }
+
+static void test_multifd_tcp_zstd_adaptive(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start = {
+            .caps[MIGRATION_CAPABILITY_MULTIFD] = true,
+            .caps[MIGRATION_CAPABILITY_X_MULTIFD_ZSTD_ADAPTIVE] = true,
+        },
+        .start_hook = migrate_hook_start_precopy_tcp_multifd_zstd,
+    };
+    test_precopy_common(&args);
+}
 #endif /* CONFIG_ZSTD */
 
 #ifdef CONFIG_QATZIP
@@ -198,6 +211,8 @@ void migration_test_add_compression(MigrationTestEnv *env)
 #ifdef CONFIG_ZSTD
     migration_test_add("/migration/multifd/tcp/plain/zstd",
                        test_multifd_tcp_zstd);
+    migration_test_add("/migration/multifd/tcp/plain/zstd/adaptive",
+                       test_multifd_tcp_zstd_adaptive);
     if (env->has_uffd) {
         migration_test_add("/migration/multifd+postcopy/tcp/plain/zstd",
                            test_multifd_postcopy_tcp_zstd);
@@ -137,6 +137,41 @@ static void test_precopy_file_mapped_ram(void)
     test_file_common(&args, true);
 }
 
+/*
+ * The destination runs with its RAM mapped from the migration file, so
+ * migrating to that file again must fail rather than change guest memory.
+ */
+static void migrate_hook_end_mapped_ram_lazy_load(QTestState *from,
+                                                  QTestState *to,
+                                                  void *opaque)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+
+    /* Only RAM with 4k pages, like the target's, is mapped */
+    if (qemu_real_host_page_size() != 4096) {
+        return;
+    }
+    migrate_qmp_fail(to, uri, NULL, "{}");
+}
+
+static void test_precopy_file_mapped_ram_lazy_load(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start = {
+            .caps[MIGRATION_CAPABILITY_MAPPED_RAM] = true,
+            .caps[MIGRATION_CAPABILITY_MAPPED_RAM_LAZY_LOAD] = true,
+        },
+        .end_hook = migrate_hook_end_mapped_ram_lazy_load,
+    };
+
+    test_file_common(&args, true);
+}
+
 static void test_multifd_file_mapped_ram_live(void)
 {
     g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
@@ -326,6 +361,8 @@ void migration_test_add_file(MigrationTestEnv *env)
                        test_precopy_file_mapped_ram);
     migration_test_add("/migration/precopy/file/mapped-ram/live",
                        test_precopy_file_mapped_ram_live);
+    migration_test_add("/migration/precopy/file/mapped-ram/lazy-load",
+                       test_precopy_file_mapped_ram_lazy_load);
 
     migration_test_add("/migration/multifd/file/mapped-ram",
                        test_multifd_file_mapped_ram);
@@ -32,6 +32,10 @@ typedef struct MigrationTestEnv {
     char *tmpfs;
 } MigrationTestEnv;
 
+/* Guest memory range that the test guest keeps dirtying */
+extern unsigned start_address;
+extern unsigned end_address;
+
 MigrationTestEnv *migration_get_env(void);
 int migration_env_clean(MigrationTestEnv *env);
 
@@ -12,7 +12,9 @@
 
 #include "qemu/osdep.h"
 #include "libqtest.h"
+#include "migration/bootfile.h"
 #include "migration/framework.h"
+#include "migration/migration-qmp.h"
 #include "migration/migration-util.h"
 #include "qobject/qlist.h"
 #include "qemu/module.h"
@@ -47,6 +49,63 @@ static void test_postcopy_preempt(void)
     test_postcopy_common(&args);
 }
 
+static void *migrate_hook_start_postcopy_prefetch(QTestState *from,
+                                                  QTestState *to)
+{
+    migrate_set_parameter_int(to, "postcopy-prefetch-depth", 16);
+    return NULL;
+}
+
+/*
+ * The guest walks its memory at a constant stride, so most pages it faults
+ * on after the switchover have been prefetched already.  Each of them must
+ * still be requested from the source at most once.
+ */
+static void migrate_hook_end_postcopy_prefetch(QTestState *from,
+                                               QTestState *to, void *opaque)
+{
+    int64_t requests = read_ram_property_int(from, "postcopy-requests");
+    /* Allow for the few pages of code and stack outside the test range */
+    int64_t pages = (end_address - start_address) / TEST_MEM_PAGE_SIZE + 64;
+
+    g_assert_cmpint(requests, >, 0);
+    g_assert_cmpint(requests, <=, pages);
+}
+
+static void test_postcopy_prefetch(void)
+{
+    MigrateCommon args = {
+        .start_hook = migrate_hook_start_postcopy_prefetch,
+        .end_hook = migrate_hook_end_postcopy_prefetch,
+    };
+
+    test_postcopy_common(&args);
+}
+
+/*
+ * The destination places background pages from its placement thread, which
+ * otherwise only takes huge pages.
+ */
+#define POSTCOPY_PLACER_OPTS "-global migration.x-postcopy-place-small-pages=on"
+
+static void test_postcopy_placer(void)
+{
+    MigrateCommon args = {
+        .start.opts_target = POSTCOPY_PLACER_OPTS,
+    };
+
+    test_postcopy_common(&args);
+}
+
+static void test_postcopy_placer_recovery(void)
+{
+    MigrateCommon args = {
+        .start.opts_target = POSTCOPY_PLACER_OPTS,
+    };
+
+    test_postcopy_recovery_common(&args);
+}
+
 static void test_postcopy_recovery(void)
 {
     MigrateCommon args = { };
@@ -137,6 +196,12 @@ void migration_test_add_postcopy(MigrationTestEnv *env)
             "/migration/postcopy/recovery/double-failures/reconnect",
             test_postcopy_recovery_fail_reconnect);
 
+        migration_test_add("/migration/postcopy/prefetch",
+                           test_postcopy_prefetch);
+        migration_test_add("/migration/postcopy/placer",
+                           test_postcopy_placer);
+        migration_test_add("/migration/postcopy/recovery/placer",
+                           test_postcopy_placer_recovery);
         migration_test_add("/migration/multifd+postcopy/plain",
                            test_multifd_postcopy);
         migration_test_add("/migration/multifd+postcopy/preempt/plain",
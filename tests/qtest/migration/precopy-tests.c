@@ -233,6 +233,21 @@ static void test_precopy_tcp_switchover_ack(void)
     test_precopy_common(&args);
 }
 
+#ifdef CONFIG_LINUX
+/* Without multifd, zero copy send applies to the main channel */
+static void test_precopy_tcp_zero_copy(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "tcp:127.0.0.1:0",
+        .start = {
+            .caps[MIGRATION_CAPABILITY_ZERO_COPY_SEND] = true,
+        },
+    };
+
+    test_precopy_common(&args);
+}
+#endif
+
 #ifndef _WIN32
 static void *migrate_hook_start_fd(QTestState *from,
                                    QTestState *to)
@@ -461,6 +476,50 @@ static void test_auto_converge(void)
     migrate_end(from, to, true);
 }
 
+/*
+ * Like test_auto_converge(), this test needs a whole pass at 3MB/s
+ * before the controller can measure anything, so it is slow.
+ */
+static void test_convergence_control(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateStart args = {};
+    QTestState *from, *to;
+    QDict *rsp_return;
+
+    if (migrate_start(&from, &to, uri, &args)) {
+        return;
+    }
+
+    migrate_set_capability(from, "x-convergence-control", true);
+    migrate_set_capability(from, "auto-converge", true);
+    migrate_ensure_non_converge(from);
+
+    wait_for_serial("src_serial");
+
+    migrate_qmp(from, to, uri, NULL, "{}");
+
+    /* The controller throttles since migration does not converge */
+    while (!read_migrate_property_int(from, "cpu-throttle-percentage")) {
+        usleep(1000 * 100);
+        g_assert_false(get_src()->stop_seen);
+    }
+
+    rsp_return = migrate_query_not_failed(from);
+    g_assert_cmpstr(qdict_get_str(rsp_return, "convergence-action"), ==,
+                    "throttle");
+    qobject_unref(rsp_return);
+
+    migrate_ensure_converge(from);
+
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+    wait_for_migration_complete(from);
+
+    migrate_end(from, to, true);
+}
+
 static void *
 migrate_hook_start_precopy_tcp_multifd(QTestState *from,
                                        QTestState *to)
@@ -1278,6 +1337,10 @@ void migration_test_add_precopy(MigrationTestEnv *env)
 
     migration_test_add("/migration/precopy/tcp/plain/switchover-ack",
                        test_precopy_tcp_switchover_ack);
+#ifdef CONFIG_LINUX
+    migration_test_add("/migration/precopy/tcp/plain/zero-copy",
+                       test_precopy_tcp_zero_copy);
+#endif
 
 #ifndef _WIN32
     migration_test_add("/migration/precopy/fd/tcp",
@@ -1292,6 +1355,8 @@ void migration_test_add_precopy(MigrationTestEnv *env)
     if (g_test_slow()) {
         migration_test_add("/migration/auto_converge",
                            test_auto_converge);
+        migration_test_add("/migration/convergence_control",
+                           test_convergence_control);
         if (g_str_equal(env->arch, "x86_64") &&
             env->has_kvm && env->has_dirty_ring) {
             migration_test_add("/dirty_limit",
@@ -18,6 +18,10 @@
 #include "qobject/qlist.h"
 #include "qapi/qobject-input-visitor.h"
 #include "qobject/qstring.h"
+#include "qobject/qjson.h"
+#include "qobject/qcbor.h"
+#include "qobject/cbor-parser.h"
+#include "qemu/sockets.h"
 
 const char common_args[] = "-nodefaults -machine none";
 
@@ -281,6 +285,104 @@ static void test_qmp_oob(void)
     qtest_quit(qts);
 }
 
+/* CBOR tests */
+
+static QDict *recv_json_line(int fd)
+{
+    g_autoptr(GString) line = g_string_new(NULL);
+    char ch;
+
+    do {
+        g_assert_cmpint(read(fd, &ch, 1), ==, 1);
+        g_string_append_c(line, ch);
+    } while (ch != '\n');
+
+    return qobject_to(QDict, qobject_from_json(line->str, &error_abort));
+}
+
+static void recv_cbor_emit(void *opaque, QObject *obj, Error *err)
+{
+    QObject **resp = opaque;
+
+    g_assert(!err);
+    g_assert(!*resp);
+    *resp = obj;
+}
+
+static QDict *recv_cbor(int fd)
+{
+    CborMessageParser parser;
+    QObject *resp = NULL;
+    uint8_t byte;
+
+    cbor_message_parser_init(&parser, recv_cbor_emit, &resp);
+    while (!resp) {
+        g_assert_cmpint(read(fd, &byte, 1), ==, 1);
+        cbor_message_parser_feed(&parser, &byte, 1);
+    }
+    cbor_message_parser_destroy(&parser);
+
+    return qobject_to(QDict, resp);
+}
+
+static void test_qmp_cbor(void)
+{
+    g_autofree char *tmpdir = g_dir_make_tmp("qmp-test-XXXXXX", NULL);
+    g_autofree char *path = g_strdup_printf("%s/cbor.sock", tmpdir);
+    g_autoptr(GString) msg = NULL;
+    g_autoptr(GString) cbor = NULL;
+    QTestState *qts;
+    QDict *resp, *req;
+    QList *capabilities;
+    const QListEntry *entry;
+    bool offered = false;
+    int fd;
+
+    /* A second QMP monitor, read in the monitor I/O thread */
+    qts = qtest_initf("%s -chardev socket,id=cbor,path=%s,server=on,wait=off"
+                      " -mon chardev=cbor,mode=control", common_args, path);
+    fd = unix_connect(path, &error_abort);
+
+    resp = recv_json_line(fd);
+    capabilities = qdict_get_qlist(qdict_get_qdict(resp, "QMP"),
+                                   "capabilities");
+    QLIST_FOREACH_ENTRY(capabilities, entry) {
+        QString *qstr = qobject_to(QString, entry->value);
+
+        offered |= !strcmp(qstring_get_str(qstr), "cbor");
+    }
+    g_assert(offered);
+    qobject_unref(resp);
+
+    /*
+     * Send a CBOR command right behind qmp_capabilities and its newline,
+     * in the same write, without waiting for the response.
+     */
+    req = qdict_from_jsonf_nofail("{ 'execute': 'query-name',"
+                                  " 'id': 'cbor-1' }");
+    cbor = qobject_to_cbor(QOBJECT(req));
+    qobject_unref(req);
+    msg = g_string_new("{ \"execute\": \"qmp_capabilities\","
+                       " \"arguments\": { \"enable\": [ \"cbor\" ] } }\r\n");
+    g_string_append_len(msg, cbor->str, cbor->len);
+    g_assert_cmpint(qemu_write_full(fd, msg->str, msg->len), ==, msg->len);
+
+    /* The response to qmp_capabilities is the last JSON message */
+    resp = recv_json_line(fd);
+    g_assert(qdict_haskey(resp, "return"));
+    qobject_unref(resp);
+
+    resp = recv_cbor(fd);
+    g_assert_cmpstr(qdict_get_try_str(resp, "id"), ==, "cbor-1");
+    g_assert(qdict_get_qdict(resp, "return"));
+    qobject_unref(resp);
+
+    close(fd);
+    qtest_quit(qts);
+    unlink(path);
+    rmdir(tmpdir);
+}
+
 #endif /* _WIN32 */
 
 /* Preconfig tests */
@@ -345,6 +447,7 @@ int main(int argc, char *argv[])
 #ifndef _WIN32
     /* This case calls mkfifo() which does not exist on win32 */
     qtest_add_func("qmp/oob", test_qmp_oob);
+    qtest_add_func("qmp/cbor", test_qmp_cbor);
 #endif
     qtest_add_func("qmp/preconfig", test_qmp_preconfig);
     qtest_add_func("qmp/missing-any-arg", test_qmp_missing_any_arg);
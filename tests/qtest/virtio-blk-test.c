@@ -785,6 +785,13 @@ static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
     return arg;
 }
 
+/* Requests from a virtqueue are shared by the threads of the pool */
+static void *virtio_blk_test_setup_iothread_pool(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line, " -object iothread-pool,id=pool0,size=2");
+    return virtio_blk_test_setup(cmd_line, arg);
+}
+
 static void register_virtio_blk_test(void)
 {
     QOSGraphTestOptions opts = {
@@ -802,6 +809,12 @@ static void register_virtio_blk_test(void)
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+
+    opts.before = virtio_blk_test_setup_iothread_pool;
+    opts.edge = (QOSGraphEdgeOptions) {
+        .extra_device_opts = "iothread=pool0/thread1",
+    };
+    qos_add_test("iothread-pool", "virtio-blk-pci", basic, &opts);
 }
 
 libqos_init(register_virtio_blk_test);
@@ -359,6 +359,16 @@ static void *virtio_scsi_setup_iothread(GString *cmd_line, void *arg)
     return arg;
 }
 
+/* The threads of a pool are iothreads too */
+static void *virtio_scsi_setup_iothread_pool(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line,
+                    " -object iothread-pool,id=pool0,size=2"
+                    " -blockdev driver=null-co,read-zeroes=on,node-name=null0"
+                    " -device scsi-hd,drive=null0");
+    return arg;
+}
+
 static void register_virtio_scsi_test(void)
 {
     QOSGraphTestOptions opts = { };
@@ -383,6 +393,13 @@ static void register_virtio_scsi_test(void)
     };
     qos_add_test("iothread-attach-node", "virtio-scsi-pci",
                  test_iothread_attach_node, &opts);
+
+    opts.before = virtio_scsi_setup_iothread_pool;
+    opts.edge = (QOSGraphEdgeOptions) {
+        .extra_device_opts = "iothread=pool0/thread1",
+    };
+    qos_add_test("iothread-pool-attach-node", "virtio-scsi-pci",
+                 test_iothread_attach_node, &opts);
 }
 
 libqos_init(register_virtio_scsi_test);
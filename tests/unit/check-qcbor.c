@@ -0,0 +1,298 @@
+/*
+ * QObject CBOR encoding and decoding tests
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+
+#include "qapi/error.h"
+#include "qobject/cbor-parser.h"
+#include "qobject/qbool.h"
+#include "qobject/qcbor.h"
+#include "qobject/qdict.h"
+#include "qobject/qjson.h"
+#include "qobject/qlist.h"
+#include "qobject/qnull.h"
+#include "qobject/qnum.h"
+#include "qobject/qstring.h"
+
+#define BYTES(...) ((const uint8_t[]) { __VA_ARGS__ }), \
+    sizeof((const uint8_t[]) { __VA_ARGS__ })
+
+/* Check that @obj encodes to @expected, and decodes back */
+static void check_encoding(QObject *obj, const uint8_t *expected, size_t len)
+{
+    GString *cbor = qobject_to_cbor(obj);
+    QObject *decoded;
+
+    g_assert_cmpmem(cbor->str, cbor->len, expected, len);
+    decoded = qobject_from_cbor(cbor->str, cbor->len, &error_abort);
+    g_assert(qobject_is_equal(obj, decoded));
+
+    qobject_unref(decoded);
+    g_string_free(cbor, true);
+    qobject_unref(obj);
+}
+
+static QObject *decode(const uint8_t *buf, size_t len)
+{
+    return qobject_from_cbor(buf, len, &error_abort);
+}
+
+static void decode_error(const uint8_t *buf, size_t len)
+{
+    Error *err = NULL;
+
+    g_assert_null(qobject_from_cbor(buf, len, &err));
+    error_free_or_abort(&err);
+}
+
+static void int_number(void)
+{
+    check_encoding(QOBJECT(qnum_from_int(0)), BYTES(0x00));
+    check_encoding(QOBJECT(qnum_from_int(23)), BYTES(0x17));
+    check_encoding(QOBJECT(qnum_from_int(24)), BYTES(0x18, 0x18));
+    check_encoding(QOBJECT(qnum_from_int(1000)), BYTES(0x19, 0x03, 0xe8));
+    check_encoding(QOBJECT(qnum_from_int(1000000)),
+                   BYTES(0x1a, 0x00, 0x0f, 0x42, 0x40));
+    check_encoding(QOBJECT(qnum_from_int(-1)), BYTES(0x20));
+    check_encoding(QOBJECT(qnum_from_int(-1000)), BYTES(0x39, 0x03, 0xe7));
+    check_encoding(QOBJECT(qnum_from_int(INT64_MIN)),
+                   BYTES(0x3b, 0x7f, 0xff, 0xff, 0xff,
+                         0xff, 0xff, 0xff, 0xff));
+    check_encoding(QOBJECT(qnum_from_uint(UINT64_MAX)),
+                   BYTES(0x1b, 0xff, 0xff, 0xff, 0xff,
+                         0xff, 0xff, 0xff, 0xff));
+
+    /* Too small for int64_t */
+    decode_error(BYTES(0x3b, 0x80, 0x00, 0x00, 0x00,
+                       0x00, 0x00, 0x00, 0x00));
+}
+
+static void float_number(void)
+{
+    QObject *obj;
+
+    check_encoding(QOBJECT(qnum_from_double(1.5)),
+                   BYTES(0xfb, 0x3f, 0xf8, 0x00, 0x00,
+                         0x00, 0x00, 0x00, 0x00));
+
+    /* Half and single precision */
+    obj = decode(BYTES(0xf9, 0xc4, 0x00));
+    g_assert_cmpfloat(qnum_get_double(qobject_to(QNum, obj)), ==, -4.0);
+    qobject_unref(obj);
+    obj = decode(BYTES(0xf9, 0x00, 0x01));
+    g_assert_cmpfloat(qnum_get_double(qobject_to(QNum, obj)), ==,
+                      0x1p-24);
+    qobject_unref(obj);
+    obj = decode(BYTES(0xfa, 0x47, 0xc3, 0x50, 0x00));
+    g_assert_cmpfloat(qnum_get_double(qobject_to(QNum, obj)), ==, 100000.0);
+    qobject_unref(obj);
+}
+
+static void simple_values(void)
+{
+    check_encoding(QOBJECT(qbool_from_bool(false)), BYTES(0xf4));
+    check_encoding(QOBJECT(qbool_from_bool(true)), BYTES(0xf5));
+    check_encoding(QOBJECT(qnull()), BYTES(0xf6));
+
+    /* undefined */
+    decode_error(BYTES(0xf7));
+}
+
+static void text_string(void)
+{
+    QObject *obj;
+
+    check_encoding(QOBJECT(qstring_from_str("")), BYTES(0x60));
+    check_encoding(QOBJECT(qstring_from_str("\xc3\xbc")),
+                   BYTES(0x62, 0xc3, 0xbc));
+
+    /* Indefinite length */
+    obj = decode(BYTES(0x7f, 0x62, 'a', 'b', 0x61, 'c', 0xff));
+    g_assert_cmpstr(qstring_get_str(qobject_to(QString, obj)), ==, "abc");
+    qobject_unref(obj);
+
+    /* Invalid UTF-8, embedded NUL, byte string */
+    decode_error(BYTES(0x61, 0xff));
+    decode_error(BYTES(0x62, 'a', 0x00));
+    decode_error(BYTES(0x41, 'a'));
+    decode_error(BYTES(0x7f, 0x41, 'a', 0xff));
+}
+
+static void containers(void)
+{
+    QDict *dict = qdict_new();
+    QList *list = qlist_new();
+    QObject *obj;
+
+    qlist_append_bool(list, true);
+    qlist_append_null(list);
+    qdict_put(dict, "a", list);
+    check_encoding(QOBJECT(dict),
+                   BYTES(0xbf, 0x61, 'a', 0x9f, 0xf5, 0xf6, 0xff, 0xff));
+
+    /* Definite length, and tags are ignored */
+    obj = decode(BYTES(0xa1, 0x61, 'a', 0x82, 0x01, 0xc1, 0x02));
+    dict = qobject_to(QDict, obj);
+    list = qdict_get_qlist(dict, "a");
+    g_assert_cmpint(qlist_size(list), ==, 2);
+    g_assert_cmpint(qnum_get_int(qobject_to(QNum, qlist_peek(list))), ==, 1);
+    qobject_unref(obj);
+
+    /* Key not a text string, duplicate key, stray break */
+    decode_error(BYTES(0xa1, 0x01, 0x02));
+    decode_error(BYTES(0xa2, 0x61, 'a', 0x01, 0x61, 'a', 0x02));
+    decode_error(BYTES(0x82, 0x01, 0xff));
+}
+
+static void roundtrip(void)
+{
+    QObject *obj = qobject_from_json(
+        "{ 'execute': 'query-foo', 'id': [ 1, -2, 3.25, 'x' ],"
+        " 'arguments': { 'a': { 'b': null, 'c': true }, 'd': [ ],"
+        " 'e': 18446744073709551615, 'f': '\\u00e9t\\u00e9' } }",
+        &error_abort);
+    GString *cbor = qobject_to_cbor(obj);
+    QObject *decoded = qobject_from_cbor(cbor->str, cbor->len,
+                                         &error_abort);
+
+    g_assert(qobject_is_equal(obj, decoded));
+    qobject_unref(decoded);
+    g_string_free(cbor, true);
+    qobject_unref(obj);
+}
+
+static void errors(void)
+{
+    uint8_t deep[1026];
+
+    decode_error((const uint8_t *)"", 0);
+    decode_error(BYTES(0x9f, 0x01));
+    decode_error(BYTES(0x19, 0x01));
+    decode_error(BYTES(0x01, 0x02));
+    decode_error(BYTES(0x1c));
+
+    /* Infinity and NaN in half, single and double precision */
+    decode_error(BYTES(0xf9, 0x7c, 0x00));
+    decode_error(BYTES(0xf9, 0xfc, 0x00));
+    decode_error(BYTES(0xf9, 0x7e, 0x00));
+    decode_error(BYTES(0xfa, 0x7f, 0x80, 0x00, 0x00));
+    decode_error(BYTES(0xfa, 0x7f, 0xc0, 0x00, 0x00));
+    decode_error(BYTES(0xfb, 0xff, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00));
+    decode_error(BYTES(0xfb, 0x7f, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00));
+
+    memset(deep, 0x81, sizeof(deep) - 1);
+    deep[sizeof(deep) - 1] = 0x00;
+    decode_error(deep, sizeof(deep));
+}
+
+typedef struct StreamResult {
+    GQueue objs;
+    int errors;
+} StreamResult;
+
+static void stream_emit(void *opaque, QObject *obj, Error *err)
+{
+    StreamResult *res = opaque;
+
+    if (err) {
+        g_assert_null(obj);
+        error_free(err);
+        res->errors++;
+    } else {
+        g_queue_push_tail(&res->objs, obj);
+    }
+}
+
+static void stream(void)
+{
+    const uint8_t input[] = {
+        0xbf, 0x67, 'e', 'x', 'e', 'c', 'u', 't', 'e', 0x64, 'q', 'u', 'i',
+        't', 0xff,
+        0x19, 0x01, 0x00,
+    };
+    /* { "a": [ 1(1), "xy" "z" ] }, [] */
+    const uint8_t nested[] = {
+        0xa1, 0x61, 'a', 0x82, 0xc1, 0x01, 0x7f, 0x62, 'x', 'y', 0x61, 'z',
+        0xff,
+        0x80,
+    };
+    CborMessageParser parser;
+    StreamResult res = { G_QUEUE_INIT };
+    QObject *obj;
+    QList *list;
+    int i;
+
+    cbor_message_parser_init(&parser, stream_emit, &res);
+
+    /* Byte by byte */
+    for (i = 0; i < sizeof(input); i++) {
+        cbor_message_parser_feed(&parser, &input[i], 1);
+    }
+    g_assert_cmpint(res.objs.length, ==, 2);
+    obj = g_queue_pop_head(&res.objs);
+    g_assert_cmpstr(qdict_get_str(qobject_to(QDict, obj), "execute"), ==,
+                    "quit");
+    qobject_unref(obj);
+    obj = g_queue_pop_head(&res.objs);
+    g_assert_cmpint(qnum_get_int(qobject_to(QNum, obj)), ==, 256);
+    qobject_unref(obj);
+
+    /* All at once */
+    cbor_message_parser_feed(&parser, input, sizeof(input));
+    g_assert_cmpint(res.objs.length, ==, 2);
+    while ((obj = g_queue_pop_head(&res.objs))) {
+        qobject_unref(obj);
+    }
+
+    /* Items are tracked across feeds, whatever their length and nesting */
+    for (i = 0; i < sizeof(nested); i++) {
+        cbor_message_parser_feed(&parser, &nested[i], 1);
+        g_assert_cmpint(res.objs.length, ==, i == sizeof(nested) - 2);
+    }
+    obj = g_queue_pop_head(&res.objs);
+    list = qobject_to(QList, qdict_get(qobject_to(QDict, obj), "a"));
+    g_assert_cmpint(qlist_size(list), ==, 2);
+    g_assert_cmpint(qnum_get_int(qobject_to(QNum, qlist_peek(list))), ==, 1);
+    qobject_unref(obj);
+    cbor_message_parser_feed(&parser, &nested[sizeof(nested) - 1], 1);
+    obj = g_queue_pop_head(&res.objs);
+    g_assert_cmpint(qlist_size(qobject_to(QList, obj)), ==, 0);
+    qobject_unref(obj);
+
+    /* An error drops what has been received so far */
+    cbor_message_parser_feed(&parser, BYTES(0x9f, 0x01, 0x41, 'a', 0x02));
+    g_assert_cmpint(res.errors, ==, 1);
+    g_assert(g_queue_is_empty(&res.objs));
+    cbor_message_parser_feed(&parser, BYTES(0x03));
+    g_assert_cmpint(res.objs.length, ==, 1);
+    qobject_unref(g_queue_pop_head(&res.objs));
+
+    /* Too large */
+    cbor_message_parser_feed(&parser, BYTES(0x7b, 0x01, 0x00, 0x00, 0x00,
+                                            0x00, 0x00, 0x00, 0x00));
+    g_assert_cmpint(res.errors, ==, 2);
+
+    g_assert(g_queue_is_empty(&res.objs));
+    cbor_message_parser_destroy(&parser);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/cbor/number/int", int_number);
+    g_test_add_func("/cbor/number/float", float_number);
+    g_test_add_func("/cbor/simple", simple_values);
+    g_test_add_func("/cbor/string", text_string);
+    g_test_add_func("/cbor/containers", containers);
+    g_test_add_func("/cbor/roundtrip", roundtrip);
+    g_test_add_func("/cbor/errors", errors);
+    g_test_add_func("/cbor/stream", stream);
+
+    return g_test_run();
+}
@@ -27,9 +27,13 @@ static void ptimer_test_expire_qemu_timers(int64_t expire_time,
                                            QEMUClockType type)
 {
     QEMUTimerList *timer_list = main_loop_tlg.tl[type];
-    QEMUTimer *t = timer_list->active_timers.next;
+    /* The callbacks can modify the list */
+    g_autoptr(GList) timers = g_list_copy(timer_list->active_timers);
+    GList *l;
+
+    for (l = timers; l; l = l->next) {
+        QEMUTimer *t = l->data;
 
-    while (t != NULL) {
         if (t->expire_time == expire_time) {
             timer_del(t);
 
@@ -37,8 +41,6 @@ static void ptimer_test_expire_qemu_timers(int64_t expire_time,
                 t->cb(t->opaque);
             }
         }
-
-        t = t->next;
     }
 }
 
@@ -368,6 +368,115 @@ static void test_wait_event_notifier_noflush(void)
     event_notifier_cleanup(&data.e);
 }
 
+#define ORDER_TIMERS 64
+
+typedef struct {
+    QEMUTimer timer;
+    int64_t expire;
+    uint64_t seq;
+    bool armed;
+} OrderTimer;
+
+static OrderTimer order_timers[ORDER_TIMERS];
+static int order_fired[ORDER_TIMERS];
+static int nr_order_fired;
+
+static void order_timer_cb(void *opaque)
+{
+    OrderTimer *t = opaque;
+
+    order_fired[nr_order_fired++] = t - order_timers;
+}
+
+static void order_timer_mod(OrderTimer *t, int64_t expire, uint64_t *seq)
+{
+    timer_mod_ns(&t->timer, expire);
+    t->expire = expire;
+    t->seq = (*seq)++;
+    t->armed = true;
+}
+
+static void test_timer_order(void)
+{
+    QEMUTimerList *tl = ctx->tlg.tl[QEMU_CLOCK_REALTIME];
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    uint64_t seq = 0;
+    int expected[ORDER_TIMERS];
+    int nr_expected = 0;
+    int i, j;
+
+    for (i = 0; i < ORDER_TIMERS; i++) {
+        aio_timer_init(ctx, &order_timers[i].timer, QEMU_CLOCK_REALTIME,
+                       SCALE_NS, order_timer_cb, &order_timers[i]);
+        order_timers[i].armed = false;
+    }
+
+    /* Already expired, with many timers sharing the same expire time */
+    for (i = 0; i < ORDER_TIMERS; i++) {
+        order_timer_mod(&order_timers[i], (i * 7) % 16, &seq);
+    }
+    /* Rearming moves a timer after the others with the same expire time */
+    for (i = 0; i < ORDER_TIMERS; i += 3) {
+        order_timer_mod(&order_timers[i], order_timers[i].expire, &seq);
+    }
+    for (i = 0; i < ORDER_TIMERS; i += 5) {
+        timer_del(&order_timers[i].timer);
+        order_timers[i].armed = false;
+    }
+    g_assert_cmpint(timerlist_deadline_ns(tl), ==, 0);
+
+    /* Expected order: by expire time, then by the time they were armed */
+    for (i = 0; i < ORDER_TIMERS; i++) {
+        OrderTimer *t = &order_timers[i];
+
+        if (!t->armed) {
+            continue;
+        }
+        for (j = nr_expected; j > 0; j--) {
+            OrderTimer *prev = &order_timers[expected[j - 1]];
+
+            if (prev->expire < t->expire ||
+                (prev->expire == t->expire && prev->seq < t->seq)) {
+                break;
+            }
+            expected[j] = expected[j - 1];
+        }
+        expected[j] = i;
+        nr_expected++;
+    }
+
+    nr_order_fired = 0;
+    g_assert(timerlist_run_timers(tl));
+    g_assert_cmpint(nr_order_fired, ==, nr_expected);
+    for (i = 0; i < nr_expected; i++) {
+        g_assert_cmpint(order_fired[i], ==, expected[i]);
+    }
+    g_assert(!timerlist_has_timers(tl));
+    g_assert_cmpint(timerlist_deadline_ns(tl), ==, -1);
+
+    /* The deadline follows the soonest timer as timers go away */
+    timer_mod_ns(&order_timers[0].timer, now + 10 * NANOSECONDS_PER_SECOND);
+    timer_mod_ns(&order_timers[1].timer, now + 20 * NANOSECONDS_PER_SECOND);
+    timer_mod_ns(&order_timers[2].timer, now + 30 * NANOSECONDS_PER_SECOND);
+    g_assert_cmpint(timerlist_deadline_ns(tl), <=,
+                    10 * NANOSECONDS_PER_SECOND);
+    timer_del(&order_timers[0].timer);
+    g_assert_cmpint(timerlist_deadline_ns(tl), >,
+                    10 * NANOSECONDS_PER_SECOND);
+    g_assert_cmpint(timerlist_deadline_ns(tl), <=,
+                    20 * NANOSECONDS_PER_SECOND);
+    timer_mod_ns(&order_timers[2].timer, now);
+    g_assert_cmpint(timerlist_deadline_ns(tl), ==, 0);
+
+    for (i = 0; i < ORDER_TIMERS; i++) {
+        timer_del(&order_timers[i].timer);
+    }
+    g_assert(!timerlist_has_timers(tl));
+
+    /* Clear the notifications of the timer_mod calls */
+    do {} while (aio_poll(ctx, false));
+}
+
 static void test_timer_schedule(void)
 {
     TimerTestData data = { .n = 0, .ctx = ctx, .ns = SCALE_MS * 750LL,
@@ -847,6 +956,7 @@ int main(int argc, char **argv)
     g_test_add_func("/aio/event/wait/no-flush-cb",  test_wait_event_notifier_noflush);
     g_test_add_func("/aio/event/flush",             test_flush_event_notifier);
     g_test_add_func("/aio/timer/schedule",          test_timer_schedule);
+    g_test_add_func("/aio/timer/order",             test_timer_order);
 
     g_test_add_func("/aio/coroutine/queue-chaining", test_queue_chaining);
     g_test_add_func("/aio/coroutine/worker-thread-co-enter", test_worker_thread_co_enter);
@@ -0,0 +1,187 @@
+/*
+ * Block-status cache tests
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "block/block_int.h"
+#include "system/block-backend.h"
+
+#define EXTENT_SIZE (64 * 1024)
+#define CLUSTER_SIZE EXTENT_SIZE
+
+static int coroutine_fn
+bdrv_test_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                     QEMUIOVector *qiov, BdrvRequestFlags flags)
+{
+    return 0;
+}
+
+static int64_t coroutine_fn bdrv_test_co_getlength(BlockDriverState *bs)
+{
+    return 16 * CLUSTER_SIZE;
+}
+
+static int coroutine_fn
+bdrv_test_co_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
+{
+    bdi->cluster_size = CLUSTER_SIZE;
+    return 0;
+}
+
+static BlockDriver bdrv_test = {
+    .format_name = "test",
+    .block_status_cacheable = true,
+    .bdrv_co_pwritev = bdrv_test_co_pwritev,
+    .bdrv_co_getlength = bdrv_test_co_getlength,
+    .bdrv_co_get_info = bdrv_test_co_get_info,
+};
+
+static BlockDriverState *test_node(void)
+{
+    return bdrv_new_open_driver(&bdrv_test, "test-node", BDRV_O_RDWR,
+                                &error_abort);
+}
+
+static void fill(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                 int status)
+{
+    bdrv_bsc_fill(bs, bdrv_bsc_generation(bs), offset, bytes, status,
+                  offset, bs);
+}
+
+static void test_lookup(void)
+{
+    BlockDriverState *bs = test_node();
+    BlockDriverState *file = NULL;
+    int64_t pnum = 0, map = 0;
+    int ret;
+
+    g_assert_cmpint(bdrv_bsc_lookup(bs, 0, &pnum, &map, &file), ==, -ENOENT);
+
+    fill(bs, 0, EXTENT_SIZE, BDRV_BLOCK_DATA | BDRV_BLOCK_OFFSET_VALID);
+    fill(bs, EXTENT_SIZE, EXTENT_SIZE, BDRV_BLOCK_ZERO);
+
+    ret = bdrv_bsc_lookup(bs, 4096, &pnum, &map, &file);
+    g_assert_cmpint(ret, ==, BDRV_BLOCK_DATA | BDRV_BLOCK_OFFSET_VALID);
+    g_assert_cmpint(pnum, ==, EXTENT_SIZE - 4096);
+    g_assert_cmpint(map, ==, 4096);
+    g_assert(file == bs);
+
+    ret = bdrv_bsc_lookup(bs, EXTENT_SIZE, &pnum, &map, &file);
+    g_assert_cmpint(ret, ==, BDRV_BLOCK_ZERO);
+    g_assert_cmpint(pnum, ==, EXTENT_SIZE);
+
+    g_assert_cmpint(bdrv_bsc_lookup(bs, 2 * EXTENT_SIZE, &pnum, &map, &file),
+                    ==, -ENOENT);
+
+    bdrv_unref(bs);
+}
+
+static void test_invalidate(void)
+{
+    BlockDriverState *bs = test_node();
+    BlockDriverState *file;
+    int64_t pnum, map;
+
+    fill(bs, 0, EXTENT_SIZE, BDRV_BLOCK_DATA);
+    fill(bs, EXTENT_SIZE, EXTENT_SIZE, BDRV_BLOCK_ZERO);
+    fill(bs, 2 * EXTENT_SIZE, EXTENT_SIZE, 0);
+
+    /* Touches the end of the first and the start of the second extent */
+    bdrv_bsc_invalidate_range(bs, EXTENT_SIZE - 512, 1024);
+    g_assert_cmpint(bdrv_bsc_lookup(bs, 0, &pnum, &map, &file), ==, -ENOENT);
+    g_assert_cmpint(bdrv_bsc_lookup(bs, EXTENT_SIZE, &pnum, &map, &file),
+                    ==, -ENOENT);
+    g_assert_cmpint(bdrv_bsc_lookup(bs, 2 * EXTENT_SIZE, &pnum, &map, &file),
+                    ==, 0);
+
+    bdrv_bsc_invalidate(bs);
+    g_assert_cmpint(bdrv_bsc_lookup(bs, 2 * EXTENT_SIZE, &pnum, &map, &file),
+                    ==, -ENOENT);
+
+    bdrv_unref(bs);
+}
+
+static void test_overlapping_fill(void)
+{
+    BlockDriverState *bs = test_node();
+    BlockDriverState *file;
+    int64_t pnum, map;
+
+    fill(bs, 0, EXTENT_SIZE, BDRV_BLOCK_DATA);
+    fill(bs, EXTENT_SIZE / 2, EXTENT_SIZE, BDRV_BLOCK_ZERO);
+
+    g_assert_cmpint(bdrv_bsc_lookup(bs, 0, &pnum, &map, &file), ==, -ENOENT);
+    g_assert_cmpint(bdrv_bsc_lookup(bs, EXTENT_SIZE / 2, &pnum, &map, &file),
+                    ==, BDRV_BLOCK_ZERO);
+    g_assert_cmpint(pnum, ==, EXTENT_SIZE);
+
+    bdrv_unref(bs);
+}
+
+/* A write to part of a cluster changes the status of all of it */
+static void test_partial_cluster_write(void)
+{
+    BlockDriverState *bs = test_node();
+    BlockBackend *blk = blk_new(qemu_get_aio_context(),
+                                BLK_PERM_ALL, BLK_PERM_ALL);
+    BlockDriverState *file;
+    int64_t pnum, map;
+    uint8_t buf[512] = {};
+
+    blk_insert_bs(blk, bs, &error_abort);
+
+    fill(bs, 0, CLUSTER_SIZE, 0);
+    fill(bs, CLUSTER_SIZE, CLUSTER_SIZE, 0);
+
+    g_assert_cmpint(blk_pwrite(blk, 4096, sizeof(buf), buf, 0), ==, 0);
+
+    /* Untouched by the write, but in the same cluster */
+    g_assert_cmpint(bdrv_bsc_lookup(bs, CLUSTER_SIZE / 2, &pnum, &map, &file),
+                    ==, -ENOENT);
+    g_assert_cmpint(bdrv_bsc_lookup(bs, CLUSTER_SIZE, &pnum, &map, &file),
+                    ==, 0);
+
+    blk_unref(blk);
+    bdrv_unref(bs);
+}
+
+static void test_stale_generation(void)
+{
+    BlockDriverState *bs = test_node();
+    BlockDriverState *file;
+    int64_t pnum, map;
+    uint64_t generation = bdrv_bsc_generation(bs);
+
+    /* A write completing while the driver is being queried */
+    bdrv_bsc_invalidate_range(bs, 0, 512);
+
+    bdrv_bsc_fill(bs, generation, 0, EXTENT_SIZE, 0, 0, NULL);
+    g_assert_cmpint(bdrv_bsc_lookup(bs, 0, &pnum, &map, &file), ==, -ENOENT);
+
+    bdrv_unref(bs);
+}
+
+int main(int argc, char **argv)
+{
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/block-status-cache/lookup", test_lookup);
+    g_test_add_func("/block-status-cache/invalidate", test_invalidate);
+    g_test_add_func("/block-status-cache/overlapping-fill",
+                    test_overlapping_fill);
+    g_test_add_func("/block-status-cache/stale-generation",
+                    test_stale_generation);
+    g_test_add_func("/block-status-cache/partial-cluster-write",
+                    test_partial_cluster_write);
+
+    return g_test_run();
+}
@@ -0,0 +1,212 @@
+/*
+ * COLO incremental device state unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/module.h"
+#include "io/channel-buffer.h"
+#include "migration/vmstate.h"
+#include "../migration/colo-delta.h"
+#include "../migration/qemu-file.h"
+#include "../migration/savevm.h"
+
+#define NR_SECTIONS     4
+#define SECTION_SIZE    (16 * 1024)
+
+typedef struct TestSection {
+    uint8_t data[SECTION_SIZE];
+} TestSection;
+
+static const VMStateDescription vmstate_test_section = {
+    .name = "test-section",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_BUFFER(data, TestSection),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+typedef struct {
+    TestSection sections[NR_SECTIONS];
+    ColoVmstateDelta primary;
+    ColoVmstateDelta secondary;
+    /*
+     * Device state as saved on the primary and loaded on the secondary.
+     * Like the migration stream between the two, @save stays open across
+     * checkpoints, as closing a QEMUFile frees the channel buffer.
+     */
+    QIOChannelBuffer *save;
+    QEMUFile *fsave;
+    QIOChannelBuffer *load;
+    QIOChannelBuffer *wire;
+    QEMUFile *out;
+    QEMUFile *in;
+} DeltaFixture;
+
+static void delta_fixture_setup(DeltaFixture *t, const void *data)
+{
+    int i, j;
+
+    for (i = 0; i < NR_SECTIONS; i++) {
+        for (j = 0; j < SECTION_SIZE; j++) {
+            t->sections[i].data[j] = i * 7 + j;
+        }
+    }
+    colo_delta_init(&t->primary);
+    colo_delta_init(&t->secondary);
+    t->save = qio_channel_buffer_new(SECTION_SIZE);
+    t->fsave = qemu_file_new_output(QIO_CHANNEL(t->save));
+    t->load = qio_channel_buffer_new(SECTION_SIZE);
+    t->wire = qio_channel_buffer_new(SECTION_SIZE);
+    t->out = qemu_file_new_output(QIO_CHANNEL(t->wire));
+    t->in = qemu_file_new_input(QIO_CHANNEL(t->wire));
+}
+
+static void delta_fixture_teardown(DeltaFixture *t, const void *data)
+{
+    colo_delta_cleanup(&t->primary);
+    colo_delta_cleanup(&t->secondary);
+    qemu_fclose(t->fsave);
+    qemu_fclose(t->out);
+    qemu_fclose(t->in);
+    object_unref(OBJECT(t->save));
+    object_unref(OBJECT(t->load));
+    object_unref(OBJECT(t->wire));
+}
+
+/*
+ * Save the sections like a COLO checkpoint does with
+ * qemu_save_device_state(): into the reset channel buffer, recording where
+ * each section ends from the bytes written.
+ */
+static void delta_save(DeltaFixture *t)
+{
+    uint64_t start, end;
+    int i;
+
+    qio_channel_io_seek(QIO_CHANNEL(t->save), 0, 0, NULL);
+    t->save->usage = 0;
+
+    start = qemu_file_bytes_written(t->fsave);
+    for (i = 0; i < NR_SECTIONS; i++) {
+        g_assert_cmpint(vmstate_save_state(t->fsave, &vmstate_test_section,
+                                           &t->sections[i], NULL), ==, 0);
+        end = qemu_file_bytes_written(t->fsave) - start;
+        g_array_append_val(t->primary.next_ends, end);
+    }
+    qemu_put_byte(t->fsave, QEMU_VM_EOF);
+    g_assert_cmpint(qemu_fflush(t->fsave), ==, 0);
+}
+
+/*
+ * Run a checkpoint and check that the secondary gets the device state that
+ * the primary saved.  Returns the number of bytes that went over the wire.
+ */
+static uint64_t delta_checkpoint(DeltaFixture *t)
+{
+    g_autofree uint8_t *state = NULL;
+    uint64_t size, sent;
+
+    delta_save(t);
+    size = t->save->usage;
+    state = g_memdup2(t->save->data, size);
+
+    qio_channel_io_seek(QIO_CHANNEL(t->wire), 0, 0, NULL);
+    t->wire->usage = 0;
+    colo_delta_put(&t->primary, t->out, t->save, &error_abort);
+    sent = t->wire->usage;
+
+    qio_channel_io_seek(QIO_CHANNEL(t->wire), 0, 0, NULL);
+    colo_delta_get(&t->secondary, t->in, t->load, size, &error_abort);
+    g_assert_cmpmem(t->load->data, t->load->usage, state, size);
+
+    return sent;
+}
+
+/* Each section ends where its data ends in the channel buffer */
+static void test_section_ends(DeltaFixture *t, const void *data)
+{
+    GArray *ends = t->primary.next_ends;
+    int i;
+
+    delta_save(t);
+
+    g_assert_cmpuint(ends->len, ==, NR_SECTIONS);
+    for (i = 0; i < NR_SECTIONS; i++) {
+        uint64_t start = i ? g_array_index(ends, uint64_t, i - 1) : 0;
+
+        g_assert_cmpuint(g_array_index(ends, uint64_t, i), >=,
+                         start + SECTION_SIZE);
+    }
+    g_assert_cmpuint(g_array_index(ends, uint64_t, NR_SECTIONS - 1), ==,
+                     t->save->usage - 1);
+}
+
+static void test_round_trip(DeltaFixture *t, const void *data)
+{
+    uint64_t sent;
+
+    /* Nothing to compare against, everything is sent */
+    sent = delta_checkpoint(t);
+    g_assert_cmpuint(sent, >, NR_SECTIONS * SECTION_SIZE);
+
+    /* Nothing changed */
+    sent = delta_checkpoint(t);
+    g_assert_cmpuint(sent, <, 64);
+
+    /* A few bytes in two sections */
+    t->sections[1].data[100] ^= 0xff;
+    t->sections[3].data[5000] ^= 0xff;
+    t->sections[3].data[5001] ^= 0xff;
+    sent = delta_checkpoint(t);
+    g_assert_cmpuint(sent, <, 4 * 1024);
+
+    /* A whole section */
+    memset(t->sections[2].data, 0x5a, SECTION_SIZE);
+    sent = delta_checkpoint(t);
+    g_assert_cmpuint(sent, >, SECTION_SIZE);
+    g_assert_cmpuint(sent, <, 2 * SECTION_SIZE);
+}
+
+/*
+ * A checkpoint that fails after its sections were saved must not leave
+ * them behind, and the next checkpoint must not depend on a previous state
+ * that the secondary may not have.
+ */
+static void test_reset(DeltaFixture *t, const void *data)
+{
+    uint64_t sent;
+
+    delta_checkpoint(t);
+
+    /* The device state was saved, but never sent */
+    delta_save(t);
+    colo_delta_reset(&t->primary);
+    g_assert_cmpuint(t->primary.next_ends->len, ==, 0);
+
+    /* The secondary lost its state too, the next one must be complete */
+    colo_delta_reset(&t->secondary);
+    t->sections[0].data[0] ^= 0xff;
+    sent = delta_checkpoint(t);
+    g_assert_cmpuint(sent, >, NR_SECTIONS * SECTION_SIZE);
+    g_assert_cmpuint(t->primary.ends->len, ==, NR_SECTIONS + 1);
+}
+
+int main(int argc, char **argv)
+{
+    module_call_init(MODULE_INIT_QOM);
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_add("/colo-delta/section-ends", DeltaFixture, NULL,
+               delta_fixture_setup, test_section_ends, delta_fixture_teardown);
+    g_test_add("/colo-delta/round-trip", DeltaFixture, NULL,
+               delta_fixture_setup, test_round_trip, delta_fixture_teardown);
+    g_test_add("/colo-delta/reset", DeltaFixture, NULL,
+               delta_fixture_setup, test_reset, delta_fixture_teardown);
+    return g_test_run();
+}
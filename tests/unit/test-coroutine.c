@@ -449,6 +449,84 @@ static void test_lifecycle(void)
     g_assert(done); /* expect done to be true (second time) */
 }
 
+/*
+ * Check that coroutines with a small stack can use a good part of it, and
+ * that they are not handed out when a default one is requested
+ */
+
+static void coroutine_fn use_stack_and_exit(void *opaque)
+{
+    volatile char buf[32 * 1024];
+    bool *done = opaque;
+
+    memset((char *)buf, 0x5a, sizeof(buf));
+    qemu_coroutine_yield();
+    *done = buf[0] == 0x5a && buf[sizeof(buf) - 1] == 0x5a;
+}
+
+static void test_small_stack(void)
+{
+    Coroutine *small, *coroutine;
+    bool done = false;
+
+    small = qemu_coroutine_create_small(use_stack_and_exit, &done);
+    qemu_coroutine_enter(small);
+    g_assert(!done);
+    qemu_coroutine_enter(small);
+    g_assert(done);
+
+    /* @small has terminated and, with pooling, is back in its pool */
+    done = false;
+    coroutine = qemu_coroutine_create(set_and_exit, &done);
+    if (IS_ENABLED(CONFIG_COROUTINE_POOL)) {
+        g_assert(coroutine != small);
+    }
+    qemu_coroutine_enter(coroutine);
+    g_assert(done);
+}
+
+/*
+ * Check that pool statistics account for reused and new coroutines
+ */
+
+static void create_and_enter_many(void)
+{
+    /* More than the local pool of a thread holds */
+    Coroutine *coroutines[300];
+    bool done;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(coroutines); i++) {
+        coroutines[i] = qemu_coroutine_create(set_and_exit, &done);
+    }
+    for (i = 0; i < ARRAY_SIZE(coroutines); i++) {
+        qemu_coroutine_enter(coroutines[i]);
+    }
+}
+
+static void test_pool_stats(void)
+{
+    CoroutinePoolStats before, after;
+
+    if (!IS_ENABLED(CONFIG_COROUTINE_POOL)) {
+        g_test_skip("coroutine pool is disabled");
+        return;
+    }
+
+    qemu_coroutine_get_pool_stats(&before);
+    create_and_enter_many();
+    qemu_coroutine_get_pool_stats(&after);
+    g_assert_cmpuint(after.misses, >, before.misses);
+    g_assert_cmpuint(after.hits + after.misses, <=,
+                     before.hits + before.misses + 300);
+
+    /* Now the pools have what the first round left */
+    before = after;
+    create_and_enter_many();
+    qemu_coroutine_get_pool_stats(&after);
+    g_assert_cmpuint(after.hits, >, before.hits);
+}
+
 
 #define RECORD_SIZE 10 /* Leave some room for expansion */
 struct coroutine_position {
@@ -650,6 +728,8 @@ int main(int argc, char **argv)
     }
 
     g_test_add_func("/basic/lifecycle", test_lifecycle);
+    g_test_add_func("/basic/small-stack", test_small_stack);
+    g_test_add_func("/basic/pool-stats", test_pool_stats);
     g_test_add_func("/basic/yield", test_yield);
     g_test_add_func("/basic/nesting", test_nesting);
     g_test_add_func("/basic/self", test_self);
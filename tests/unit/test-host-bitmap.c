@@ -0,0 +1,111 @@
+/*
+ * Huge page dirty bitmap search unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "../migration/host-bitmap.h"
+
+/* 2 MiB host pages made of 4 KiB target pages */
+#define SHIFT       9
+#define HP_PAGES    (1UL << SHIFT)
+#define NR_HPS      4
+#define NR_PAGES    (NR_HPS * HP_PAGES)
+
+/*
+ * Runs of dirty pages that cover whole host pages, as left behind by
+ * postcopy_chunk_hostpages_pass(), are found at their start, and the
+ * clean host pages around them get unmarked.
+ */
+static void test_aligned_runs(void)
+{
+    g_autofree unsigned long *bmap = bitmap_new(NR_PAGES);
+    g_autofree unsigned long *host_bmap = bitmap_new(NR_HPS);
+
+    /* Like ram_list_init_bitmaps(), every host page may be dirty */
+    bitmap_set(host_bmap, 0, NR_HPS);
+    bitmap_set(bmap, HP_PAGES, HP_PAGES);
+    bitmap_set(bmap, 3 * HP_PAGES, HP_PAGES);
+
+    g_assert_cmpuint(host_bitmap_find_next_dirty(bmap, host_bmap, SHIFT,
+                                                 NR_PAGES, 0),
+                     ==, HP_PAGES);
+    g_assert_false(test_bit(0, host_bmap));
+    g_assert_cmpuint(find_next_zero_bit(bmap, NR_PAGES, HP_PAGES), ==,
+                     2 * HP_PAGES);
+
+    g_assert_cmpuint(host_bitmap_find_next_dirty(bmap, host_bmap, SHIFT,
+                                                 NR_PAGES, 2 * HP_PAGES),
+                     ==, 3 * HP_PAGES);
+    g_assert_false(test_bit(2, host_bmap));
+    g_assert_cmpuint(find_next_zero_bit(bmap, NR_PAGES, 3 * HP_PAGES), ==,
+                     NR_PAGES);
+
+    g_assert_true(test_bit(1, host_bmap));
+    g_assert_true(test_bit(3, host_bmap));
+
+    /* Every page of a dirty host page is found in turn */
+    g_assert_cmpuint(host_bitmap_find_next_dirty(bmap, host_bmap, SHIFT,
+                                                 NR_PAGES, HP_PAGES + 1),
+                     ==, HP_PAGES + 1);
+    g_assert_cmpuint(host_bitmap_find_next_dirty(bmap, host_bmap, SHIFT,
+                                                 NR_PAGES, 2 * HP_PAGES - 1),
+                     ==, 2 * HP_PAGES - 1);
+}
+
+/*
+ * A host page stays marked after its last dirty page is sent, and is only
+ * unmarked once a search covers all of it.
+ */
+static void test_clear_last_page(void)
+{
+    g_autofree unsigned long *bmap = bitmap_new(NR_PAGES);
+    g_autofree unsigned long *host_bmap = bitmap_new(NR_HPS);
+    unsigned long last = 2 * HP_PAGES - 1;
+
+    bitmap_set(host_bmap, 0, NR_HPS);
+    set_bit(last, bmap);
+
+    g_assert_cmpuint(host_bitmap_find_next_dirty(bmap, host_bmap, SHIFT,
+                                                 NR_PAGES, 0),
+                     ==, last);
+    clear_bit(last, bmap);
+    g_assert_cmpuint(host_bitmap_find_next_dirty(bmap, host_bmap, SHIFT,
+                                                 NR_PAGES, last + 1),
+                     ==, NR_PAGES);
+    g_assert_true(test_bit(1, host_bmap));
+
+    /* Searching part of the host page does not unmark it */
+    g_assert_cmpuint(host_bitmap_find_next_dirty(bmap, host_bmap, SHIFT,
+                                                 NR_PAGES, HP_PAGES + 1),
+                     ==, NR_PAGES);
+    g_assert_true(test_bit(1, host_bmap));
+    g_assert_cmpuint(host_bitmap_find_next_dirty(bmap, host_bmap, SHIFT,
+                                                 HP_PAGES + 1, 0),
+                     ==, HP_PAGES + 1);
+    g_assert_true(test_bit(1, host_bmap));
+
+    /* Neither does a page that is dirtied again before the next search */
+    set_bit(last, bmap);
+    g_assert_cmpuint(host_bitmap_find_next_dirty(bmap, host_bmap, SHIFT,
+                                                 NR_PAGES, 0),
+                     ==, last);
+    g_assert_true(test_bit(1, host_bmap));
+    clear_bit(last, bmap);
+
+    g_assert_cmpuint(host_bitmap_find_next_dirty(bmap, host_bmap, SHIFT,
+                                                 NR_PAGES, 0),
+                     ==, NR_PAGES);
+    g_assert_true(bitmap_empty(host_bmap, NR_HPS));
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/host-bitmap/aligned-runs", test_aligned_runs);
+    g_test_add_func("/host-bitmap/clear-last-page", test_clear_last_page);
+    return g_test_run();
+}
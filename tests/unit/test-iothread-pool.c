@@ -0,0 +1,222 @@
+/*
+ * iothread-pool unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/aio-wait.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
+#include "qemu/coroutine.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "qom/object.h"
+#include "system/iothread-pool.h"
+
+#define POOL_SIZE   4
+#define NR_WORK     256
+
+static IOThreadPool *pool;
+
+typedef struct {
+    QemuEvent done;
+    QemuEvent others_done;
+    unsigned remaining;
+    unsigned ran_on[POOL_SIZE];
+    bool outside_pool;
+} WorkFixture;
+
+static int pool_thread_index(void)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    int i;
+
+    for (i = 0; i < POOL_SIZE; i++) {
+        if (iothread_get_aio_context(iothread_pool_get_iothread(pool, i)) ==
+            ctx) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void work_done(WorkFixture *data)
+{
+    int i = pool_thread_index();
+
+    if (i < 0) {
+        qatomic_set(&data->outside_pool, true);
+    } else {
+        qatomic_inc(&data->ran_on[i]);
+    }
+
+    switch (qatomic_fetch_dec(&data->remaining)) {
+    case 2:
+        qemu_event_set(&data->others_done);
+        break;
+    case 1:
+        qemu_event_set(&data->done);
+        break;
+    }
+}
+
+static void work_cb(void *opaque)
+{
+    work_done(opaque);
+}
+
+static void work_fixture_setup(WorkFixture *data, const void *unused)
+{
+    data->remaining = NR_WORK;
+    qemu_event_init(&data->done, false);
+    qemu_event_init(&data->others_done, false);
+}
+
+static void nop_bh(void *opaque)
+{
+}
+
+static void work_fixture_teardown(WorkFixture *data, const void *unused)
+{
+    int i;
+
+    /*
+     * The last work item may still be in qemu_event_set() when the test
+     * sees it done; wait until every thread has returned from its work.
+     */
+    for (i = 0; i < POOL_SIZE; i++) {
+        IOThread *iothread = iothread_pool_get_iothread(pool, i);
+
+        aio_wait_bh_oneshot(iothread_get_aio_context(iothread), nop_bh, NULL);
+    }
+    qemu_event_destroy(&data->done);
+    qemu_event_destroy(&data->others_done);
+}
+
+static unsigned work_threads_used(WorkFixture *data)
+{
+    unsigned n = 0;
+    int i;
+
+    for (i = 0; i < POOL_SIZE; i++) {
+        n += !!data->ran_on[i];
+    }
+    return n;
+}
+
+/* Work from outside the pool runs in the threads of the pool */
+static void test_schedule_outside(WorkFixture *data, const void *unused)
+{
+    int i;
+
+    for (i = 0; i < NR_WORK; i++) {
+        iothread_pool_schedule(pool, work_cb, data);
+    }
+    qemu_event_wait(&data->done);
+
+    g_assert_false(data->outside_pool);
+}
+
+static void coroutine_fn work_co(void *opaque)
+{
+    work_done(opaque);
+}
+
+/* Coroutines start in a thread of the pool and stay there */
+static void test_co_enter(WorkFixture *data, const void *unused)
+{
+    int i;
+
+    for (i = 0; i < NR_WORK; i++) {
+        iothread_pool_co_enter(pool, qemu_coroutine_create(work_co, data));
+    }
+    qemu_event_wait(&data->done);
+
+    g_assert_false(data->outside_pool);
+}
+
+/* Keeps its thread busy until all other work has run */
+static void blocking_cb(void *opaque)
+{
+    WorkFixture *data = opaque;
+
+    qemu_event_wait(&data->others_done);
+    work_done(data);
+}
+
+/*
+ * Work from a thread of the pool is queued in that thread.  Its first item
+ * blocks whichever thread runs it, so the other items only complete if the
+ * idle threads are kicked and steal them.
+ */
+static void schedule_inside_bh(void *opaque)
+{
+    WorkFixture *data = opaque;
+    int i;
+
+    g_assert_cmpint(pool_thread_index(), ==, 0);
+
+    iothread_pool_schedule(pool, blocking_cb, data);
+    for (i = 1; i < NR_WORK; i++) {
+        iothread_pool_schedule(pool, work_cb, data);
+    }
+}
+
+static void test_steal(WorkFixture *data, const void *unused)
+{
+    AioContext *ctx = iothread_get_aio_context(
+        iothread_pool_get_iothread(pool, 0));
+
+    aio_bh_schedule_oneshot(ctx, schedule_inside_bh, data);
+    qemu_event_wait(&data->done);
+
+    g_assert_false(data->outside_pool);
+    g_assert_cmpint(work_threads_used(data), >, 1);
+}
+
+/* The threads of the pool are listed by query-iothreads */
+static void test_query(void)
+{
+    IOThreadInfoList *head = qmp_query_iothreads(&error_abort);
+    IOThreadInfoList *info;
+    int i = 0;
+
+    for (info = head; info; info = info->next) {
+        g_autofree char *id = g_strdup_printf("pool0/thread%d", i);
+
+        g_assert_cmpstr(info->value->id, ==, id);
+        i++;
+    }
+    g_assert_cmpint(i, ==, POOL_SIZE);
+    qapi_free_IOThreadInfoList(head);
+}
+
+int main(int argc, char **argv)
+{
+    g_autofree char *size = g_strdup_printf("%d", POOL_SIZE);
+    int ret;
+
+    qemu_init_main_loop(&error_abort);
+    module_call_init(MODULE_INIT_QOM);
+
+    pool = IOTHREAD_POOL(object_new_with_props(TYPE_IOTHREAD_POOL,
+                                               object_get_objects_root(),
+                                               "pool0", &error_abort,
+                                               "size", size, NULL));
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_add("/iothread-pool/schedule-outside", WorkFixture, NULL,
+               work_fixture_setup, test_schedule_outside,
+               work_fixture_teardown);
+    g_test_add("/iothread-pool/co-enter", WorkFixture, NULL,
+               work_fixture_setup, test_co_enter, work_fixture_teardown);
+    g_test_add("/iothread-pool/steal", WorkFixture, NULL,
+               work_fixture_setup, test_steal, work_fixture_teardown);
+    g_test_add_func("/iothread-pool/query", test_query);
+    ret = g_test_run();
+
+    object_unparent(OBJECT(pool));
+    return ret;
+}
@@ -1,5 +1,6 @@
 #include "qemu/osdep.h"
 #include "qapi/compat-policy.h"
+#include "qobject/qcbor.h"
 #include "qobject/qdict.h"
 #include "qobject/qjson.h"
 #include "qobject/qnum.h"
@@ -341,6 +342,56 @@ static void test_dispatch_cmd_ret_deprecated(void)
     #undef cmd
 }
 
+/*
+ * Check that qmp_dispatch_cbor() responds like qmp_dispatch(), though
+ * it encodes return values without building a QObject
+ */
+static void check_dispatch_cbor(const char *json)
+{
+    QObject *req = qobject_from_json(json, &error_abort);
+    QDict *resp;
+    GString *cbor;
+    QObject *cbor_resp;
+
+    resp = qmp_dispatch(&qmp_commands, req, false, NULL);
+    cbor = qmp_dispatch_cbor(&qmp_commands, req, false, NULL);
+    g_assert(resp && cbor);
+    cbor_resp = qobject_from_cbor(cbor->str, cbor->len, &error_abort);
+    g_assert(qobject_is_equal(QOBJECT(resp), cbor_resp));
+
+    qobject_unref(cbor_resp);
+    g_string_free(cbor, true);
+    qobject_unref(resp);
+    qobject_unref(req);
+}
+
+static void test_dispatch_cmd_cbor(void)
+{
+    QDict *req = qdict_new();
+
+    check_dispatch_cbor("{ 'execute': 'user-def-cmd', 'id': 1 }");
+    check_dispatch_cbor(
+        "{ 'execute': 'user-def-cmd2', 'id': 'two', 'arguments': {"
+        " 'ud1a': { 'integer': 42, 'string': 'hello' },"
+        " 'ud1b': { 'integer': -422, 'string': 'hello2' } } }");
+    check_dispatch_cbor(
+        "{ 'execute': 'guest-get-time', 'arguments': { 'a': 66 } }");
+    check_dispatch_cbor(
+        "{ 'execute': 'guest-sync', 'arguments': { 'arg': [ 1.5, null ] } }");
+    check_dispatch_cbor("{ 'execute': 'user-def-cmd2', 'id': [ 3 ] }");
+
+    memset(&compat_policy, 0, sizeof(compat_policy));
+    compat_policy.has_deprecated_output = true;
+    compat_policy.deprecated_output = COMPAT_POLICY_OUTPUT_HIDE;
+    check_dispatch_cbor("{ 'execute': 'test-features0' }");
+    memset(&compat_policy, 0, sizeof(compat_policy));
+
+    qdict_put_str(req, "execute", "cmd-success-response");
+    g_assert_null(qmp_dispatch_cbor(&qmp_commands, QOBJECT(req), false,
+                                    NULL));
+    qobject_unref(req);
+}
+
 /* test generated dealloc functions for generated types */
 static void test_dealloc_types(void)
 {
@@ -421,6 +472,7 @@ int main(int argc, char **argv)
                     test_dispatch_cmd_arg_deprecated);
     g_test_add_func("/qmp/dispatch_cmd_ret_deprecated",
                     test_dispatch_cmd_ret_deprecated);
+    g_test_add_func("/qmp/dispatch_cmd_cbor", test_dispatch_cmd_cbor);
     g_test_add_func("/qmp/dealloc_types", test_dealloc_types);
     g_test_add_func("/qmp/dealloc_partial", test_dealloc_partial);
 
@@ -134,6 +134,48 @@ static void test_submit_many(void)
     }
 }
 
+static QemuEvent slow_event;
+
+static int slow_cb(void *opaque)
+{
+    qemu_event_wait(&slow_event);
+    return 0;
+}
+
+static void test_submit_slow(void)
+{
+    WorkerTestData slow[THREAD_POOL_MAX_THREADS_DEFAULT];
+    WorkerTestData data = { .n = 0, .ret = -EINPROGRESS };
+    int i;
+
+    qemu_event_init(&slow_event, false);
+
+    /* Enough slow requests to take up all threads if they could */
+    for (i = 0; i < ARRAY_SIZE(slow); i++) {
+        slow[i].ret = -EINPROGRESS;
+        thread_pool_submit_aio_class(THREAD_POOL_CLASS_SLOW, slow_cb,
+                                     &slow[i], done_cb, &slow[i]);
+    }
+    active = ARRAY_SIZE(slow) + 1;
+
+    /* A quick request still gets a thread */
+    thread_pool_submit_aio(worker_cb, &data, done_cb, &data);
+    while (data.ret == -EINPROGRESS) {
+        aio_poll(ctx, true);
+    }
+    g_assert_cmpint(data.n, ==, 1);
+    g_assert_cmpint(data.ret, ==, 0);
+
+    qemu_event_set(&slow_event);
+    while (active > 0) {
+        aio_poll(ctx, true);
+    }
+    for (i = 0; i < ARRAY_SIZE(slow); i++) {
+        g_assert_cmpint(slow[i].ret, ==, 0);
+    }
+    qemu_event_destroy(&slow_event);
+}
+
 static void do_test_cancel(bool sync)
 {
     WorkerTestData data[100];
@@ -240,6 +282,7 @@ int main(int argc, char **argv)
     g_test_add_func("/thread-pool/submit-aio", test_submit_aio);
     g_test_add_func("/thread-pool/submit-co", test_submit_co);
     g_test_add_func("/thread-pool/submit-many", test_submit_many);
+    g_test_add_func("/thread-pool/submit-slow", test_submit_slow);
     g_test_add_func("/thread-pool/cancel", test_cancel);
     g_test_add_func("/thread-pool/cancel-async", test_cancel_async);
 
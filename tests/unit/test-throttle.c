@@ -734,6 +734,48 @@ static void test_accounting(void)
                                 (64.0 / 13)));
 }
 
+static void test_lease(void)
+{
+    uint64_t bytes, ops;
+
+    throttle_config_init(&cfg);
+    cfg.buckets[THROTTLE_OPS_TOTAL].avg = 1000;
+    cfg.buckets[THROTTLE_BPS_WRITE].avg = 10485760;
+    throttle_init(&ts);
+    throttle_config(&ts, QEMU_CLOCK_VIRTUAL, &cfg);
+
+    /* empty buckets: the lease is limited to 10 ms worth of I/O */
+    bytes = ops = UINT64_MAX;
+    throttle_compute_lease(&ts, THROTTLE_WRITE, &bytes, &ops);
+    g_assert_cmpuint(ops, ==, 10);
+    g_assert_cmpuint(bytes, ==, 104857);
+
+    /* no bucket limits read bytes, so the caller's bound is kept */
+    bytes = 4096;
+    ops = UINT64_MAX;
+    throttle_compute_lease(&ts, THROTTLE_READ, &bytes, &ops);
+    g_assert_cmpuint(bytes, ==, 4096);
+    g_assert_cmpuint(ops, ==, 10);
+
+    /* leases are accounted like I/O and shrink the next lease */
+    throttle_account_lease(&ts, THROTTLE_WRITE, 100000, 95);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_TOTAL].level, 95));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_WRITE].level, 100000));
+
+    bytes = ops = UINT64_MAX;
+    throttle_compute_lease(&ts, THROTTLE_WRITE, &bytes, &ops);
+    g_assert_cmpuint(ops, ==, 0);
+
+    /* unused leases can be given back, but never below zero */
+    throttle_return_lease(&ts, THROTTLE_WRITE, 100000, 95);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_TOTAL].level, 0));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_WRITE].level, 0));
+
+    throttle_return_lease(&ts, THROTTLE_WRITE, 100000, 95);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_TOTAL].level, 0));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_WRITE].level, 0));
+}
+
 static void test_groups(void)
 {
     ThrottleConfig cfg1, cfg2;
@@ -829,6 +871,7 @@ int main(int argc, char **argv)
                     test_iops_size_is_missing_limit);
     g_test_add_func("/throttle/config_functions",   test_config_functions);
     g_test_add_func("/throttle/accounting",         test_accounting);
+    g_test_add_func("/throttle/lease",              test_lease);
     g_test_add_func("/throttle/groups",             test_groups);
     return g_test_run();
 }
@@ -28,6 +28,7 @@
 #include "migration/qemu-file-types.h"
 #include "../migration/qemu-file.h"
 #include "../migration/savevm.h"
+#include "qemu/bswap.h"
 #include "qemu/module.h"
 #include "io/channel-file.h"
 
@@ -330,6 +331,71 @@ static void test_simple_array(void)
                          sizeof(wire_simple_arr)));
 }
 
+/* Arrays larger than what the compiled fields convert at once */
+
+typedef struct TestLargeArray {
+    uint32_t u32[100];
+    int64_t i64[40];
+    uint8_t u8[300];
+    bool b[3];
+} TestLargeArray;
+
+static const VMStateDescription vmstate_large_arr = {
+    .name = "large/array",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(u32, TestLargeArray, 100),
+        VMSTATE_INT64_ARRAY(i64, TestLargeArray, 40),
+        VMSTATE_UINT8_ARRAY(u8, TestLargeArray, 300),
+        VMSTATE_BOOL_ARRAY(b, TestLargeArray, 3),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void test_large_array(void)
+{
+    g_autofree TestLargeArray *obj = g_new0(TestLargeArray, 1);
+    g_autofree TestLargeArray *loaded = g_new0(TestLargeArray, 1);
+    size_t size = 100 * 4 + 40 * 8 + 300 + 3;
+    g_autofree uint8_t *wire = g_malloc(size + 1);
+    uint8_t *p = wire;
+    QEMUFile *f;
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        obj->u32[i] = 0x01020304 * i;
+        stl_be_p(p, obj->u32[i]);
+        p += 4;
+    }
+    for (i = 0; i < 40; i++) {
+        obj->i64[i] = -0x0102030405060708LL * i;
+        stq_be_p(p, obj->i64[i]);
+        p += 8;
+    }
+    for (i = 0; i < 300; i++) {
+        obj->u8[i] = i;
+        *p++ = i;
+    }
+    obj->b[1] = true;
+    *p++ = 0;
+    *p++ = 1;
+    *p++ = 0;
+    *p = QEMU_VM_EOF;
+
+    save_vmstate(&vmstate_large_arr, obj);
+    compare_vmstate(wire, size + 1);
+
+    /* Any non-zero byte loads as true */
+    wire[size - 2] = 2;
+    save_buffer(wire, size + 1);
+    f = open_test_file(false);
+    SUCCESS(vmstate_load_state(f, &vmstate_large_arr, loaded, 1));
+    g_assert(!qemu_file_get_error(f));
+    qemu_fclose(f);
+    g_assert(!memcmp(obj, loaded, sizeof(*obj)));
+}
+
 typedef struct TestStruct {
     uint32_t a, b, c, e;
     uint64_t d, f;
@@ -1492,6 +1558,7 @@ int main(int argc, char **argv)
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/vmstate/simple/primitive", test_simple_primitive);
     g_test_add_func("/vmstate/simple/array", test_simple_array);
+    g_test_add_func("/vmstate/large/array", test_large_array);
     g_test_add_func("/vmstate/versioned/load/v1", test_load_v1);
     g_test_add_func("/vmstate/versioned/load/v2", test_load_v2);
     g_test_add_func("/vmstate/field_exists/load/noskip", test_load_noskip);
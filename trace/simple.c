@@ -12,6 +12,10 @@
 #ifndef _WIN32
 #include <pthread.h>
 #endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "qemu/atomic.h"
 #include "qemu/timer.h"
 #include "trace/control.h"
 #include "trace/simple.h"
@@ -30,8 +34,8 @@
 /** Records were dropped event ID */
 #define DROPPED_EVENT_ID (~(uint64_t)0 - 1)
 
-/** Trace record is valid */
-#define TRACE_RECORD_VALID ((uint64_t)1 << 63)
+/** Rest of the ring buffer is unused, never written to the trace file */
+#define PADDING_EVENT_ID (~(uint64_t)0 - 2)
 
 /*
  * Trace records are written out by a dedicated thread.  The thread waits for
@@ -44,26 +48,66 @@ static GCond trace_empty_cond;
 static bool trace_available;
 static bool trace_writeout_enabled;
 
+/* The writeout thread found all rings empty and waits without a timeout */
+static bool trace_writeout_idle;
+
 enum {
-    TRACE_BUF_LEN = 4096 * 64,
-    TRACE_BUF_FLUSH_THRESHOLD = TRACE_BUF_LEN / 4,
+    TRACE_RING_LEN = 4096 * 16,
+    TRACE_RING_FLUSH_THRESHOLD = TRACE_RING_LEN / 4,
+    TRACE_BATCH_LEN = 4096 * 64,
+    /* Write out records of threads that trace rarely, too */
+    TRACE_WRITEOUT_INTERVAL_US = 100 * 1000,
 };
 
-uint8_t trace_buf[TRACE_BUF_LEN];
-static volatile gint trace_idx;
-static unsigned int writeout_idx;
-static volatile gint dropped_events;
+/*
+ * Each thread that traces has a ring buffer of its own, so recording an
+ * event never touches memory that other threads write.  The thread is
+ * the only producer and the writeout thread the only consumer: @head and
+ * @tail only grow, and records between them are ready to be written out.
+ *
+ * Ring buffers are never freed.  When a thread exits, its ring buffer
+ * goes to the next thread that starts tracing.  Tracepoints that run in
+ * a thread after its ring buffer was released only borrow a ring buffer
+ * for the duration of one record.
+ */
+typedef struct TraceRing {
+    struct TraceRing *next;
+    bool owned;                 /* atomic */
+    bool busy;                  /* the owner is writing a record */
+    unsigned int dropped;       /* atomic */
+    unsigned int head;          /* written by the owner */
+    unsigned int tail;          /* written by the writeout thread */
+    unsigned int flush_head;    /* head to write out up to, writeout thread */
+    struct TraceRecord *oldest; /* next record to write out, writeout thread */
+    uint8_t buf[TRACE_RING_LEN] QEMU_ALIGNED(8);
+} TraceRing;
+
+static TraceRing *trace_rings;
+static __thread TraceRing *trace_ring;
+static __thread bool trace_thread_exiting;
+
+/*
+ * Rings that have records to write out, in a binary min-heap on the
+ * timestamp of their oldest record.  Only used by the writeout thread.
+ */
+static TraceRing **trace_heap;
+static unsigned int trace_heap_max;
+
 static uint32_t trace_pid;
 static FILE *trace_fp;
 static char *trace_file_name;
 
+/* Records on their way to trace_fp, see trace_write_records() */
+static uint8_t trace_batch[TRACE_BATCH_LEN];
+static size_t trace_batch_len;
+
 #define TRACE_RECORD_TYPE_MAPPING 0
 #define TRACE_RECORD_TYPE_EVENT   1
 
 /* * Trace buffer entry */
-typedef struct {
+typedef struct TraceRecord {
     uint64_t event; /* event ID value */
-    uint64_t timestamp_ns;
+    uint64_t timestamp_ns; /* trace_clock() until written out */
     uint32_t length;   /*    in bytes */
     uint32_t pid;
     uint64_t arguments[];
@@ -75,54 +119,130 @@ typedef struct {
     uint64_t header_version;  /* HEADER_VERSION  */
 } TraceLogHeader;
 
+/*
+ * Where the host has a time stamp counter that ticks at a constant rate,
+ * records are stamped with it, which is much cheaper than get_clock().
+ * The writeout thread converts ticks to get_clock() nanoseconds, with a
+ * rate that it measures over the whole life of the trace.
+ */
+static bool trace_use_host_ticks;
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size);
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size);
+static struct {
+    int64_t base_ticks;
+    int64_t base_ns;
+    double ns_per_tick;
+} trace_clock_cal;
 
-static void clear_buffer_range(unsigned int idx, size_t len)
+static inline int64_t trace_clock(void)
 {
-    uint32_t num = 0;
-    while (num < len) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = 0;
-        num++;
+    return trace_use_host_ticks ? cpu_get_host_ticks() : get_clock();
+}
+
+static bool trace_host_ticks_usable(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+
+    /* Invariant TSC */
+    return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+           (edx & (1 << 8));
+#else
+    return false;
+#endif
+}
+
+static void trace_clock_calibrate(void)
+{
+    int64_t ticks = cpu_get_host_ticks();
+    int64_t ns = get_clock();
+
+    if (ticks > trace_clock_cal.base_ticks && ns > trace_clock_cal.base_ns) {
+        trace_clock_cal.ns_per_tick = (double)(ns - trace_clock_cal.base_ns) /
+                                      (ticks - trace_clock_cal.base_ticks);
     }
 }
-/**
- * Read a trace record from the trace buffer
- *
- * @idx         Trace buffer index
- * @record      Trace record to fill
- *
- * Returns false if the record is not valid.
- */
-static bool get_trace_record(unsigned int idx, TraceRecord **recordptr)
+
+static void trace_clock_init(void)
 {
-    uint64_t event_flag = 0;
-    TraceRecord record;
-    /* read the event flag to see if its a valid record */
-    read_from_buffer(idx, &record, sizeof(event_flag));
+    if (!trace_host_ticks_usable()) {
+        return;
+    }
 
-    if (!(record.event & TRACE_RECORD_VALID)) {
-        return false;
+    trace_clock_cal.base_ticks = cpu_get_host_ticks();
+    trace_clock_cal.base_ns = get_clock();
+
+    /* A first estimate, refined every time records are written out */
+    while (get_clock() - trace_clock_cal.base_ns < SCALE_MS) {
+        cpu_relax();
     }
+    trace_clock_calibrate();
+    trace_use_host_ticks = true;
+}
+
+static uint64_t trace_clock_to_ns(uint64_t t)
+{
+    if (!trace_use_host_ticks) {
+        return t;
+    }
+    return trace_clock_cal.base_ns +
+           (int64_t)(((int64_t)t - trace_clock_cal.base_ticks) *
+                     trace_clock_cal.ns_per_tick);
+}
 
-    smp_rmb(); /* read memory barrier before accessing record */
-    /* read the record header to know record length */
-    read_from_buffer(idx, &record, sizeof(TraceRecord));
-    *recordptr = malloc(record.length); /* don't use g_malloc, can deadlock when traced */
-    /* make a copy of record to avoid being overwritten */
-    read_from_buffer(idx, *recordptr, record.length);
-    smp_rmb(); /* memory barrier before clearing valid flag */
-    (*recordptr)->event &= ~TRACE_RECORD_VALID;
-    /* clear the trace buffer range for consumed record otherwise any byte
-     * with its MSB set may be considered as a valid event id when the writer
-     * thread crosses this range of buffer again.
+/* Called by glib when a thread that has a ring buffer exits */
+static void trace_ring_release(gpointer opaque)
+{
+    TraceRing *ring = opaque;
+
+    /*
+     * Tracepoints later in the teardown of the thread must not write to
+     * @ring anymore, another thread can claim it as soon as it is released.
+     * Glib may not run another round of thread-specific data destructors,
+     * so they give back the ring they use after each record.
      */
-    clear_buffer_range(idx, record.length);
-    return true;
+    trace_ring = NULL;
+    trace_thread_exiting = true;
+    qatomic_store_release(&ring->owned, false);
+}
+
+static GPrivate trace_ring_key = G_PRIVATE_INIT(trace_ring_release);
+
+static TraceRing *trace_ring_claim(void)
+{
+    TraceRing *ring;
+
+    for (ring = qatomic_load_acquire(&trace_rings); ring; ring = ring->next) {
+        if (!qatomic_read(&ring->owned) &&
+            !qatomic_cmpxchg(&ring->owned, false, true)) {
+            break;
+        }
+    }
+
+    if (!ring) {
+        /* don't use g_malloc, can deadlock when traced */
+        ring = calloc(1, sizeof(*ring));
+        if (!ring) {
+            return NULL;
+        }
+        ring->owned = true;
+        do {
+            ring->next = qatomic_read(&trace_rings);
+        } while (qatomic_cmpxchg(&trace_rings, ring->next, ring) != ring->next);
+    }
+
+    if (!trace_thread_exiting) {
+        g_private_set(&trace_ring_key, ring);
+        trace_ring = ring;
+    }
+    return ring;
+}
+
+/* Give back a ring that was only claimed for one record */
+static void trace_ring_put(TraceRing *ring)
+{
+    if (ring != trace_ring) {
+        qatomic_store_release(&ring->owned, false);
+    }
 }
 
 /**
@@ -143,141 +263,324 @@ static void flush_trace_file(bool wait)
     g_mutex_unlock(&trace_lock);
 }
 
+/*
+ * Return whether some ring has records that are not written out yet.
+ * If not, mark the writeout thread idle, so that the next record kicks it.
+ */
+static bool trace_records_pending(void)
+{
+    TraceRing *ring;
+
+    qatomic_set(&trace_writeout_idle, true);
+    smp_mb();
+
+    for (ring = qatomic_load_acquire(&trace_rings); ring; ring = ring->next) {
+        if (qatomic_read(&ring->head) != ring->tail ||
+            qatomic_read(&ring->dropped)) {
+            qatomic_set(&trace_writeout_idle, false);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Records of threads that trace rarely are written out after at most
+ * TRACE_WRITEOUT_INTERVAL_US.  While there are none, wait without a
+ * timeout instead of waking up periodically.
+ */
 static void wait_for_trace_records_available(void)
 {
+    gint64 deadline = 0;
+
     g_mutex_lock(&trace_lock);
     while (!(trace_available && trace_writeout_enabled)) {
         g_cond_signal(&trace_empty_cond);
-        g_cond_wait(&trace_available_cond, &trace_lock);
+        if (trace_writeout_enabled && !deadline && trace_records_pending()) {
+            deadline = g_get_monotonic_time() + TRACE_WRITEOUT_INTERVAL_US;
+        }
+        if (!trace_writeout_enabled || !deadline) {
+            g_cond_wait(&trace_available_cond, &trace_lock);
+        } else if (!g_cond_wait_until(&trace_available_cond, &trace_lock,
+                                      deadline)) {
+            break;
+        }
     }
+    qatomic_set(&trace_writeout_idle, false);
     trace_available = false;
     g_mutex_unlock(&trace_lock);
 }
 
-static gpointer writeout_thread(gpointer opaque)
+static void trace_write_batch(void)
 {
-    TraceRecord *recordptr;
-    union {
-        TraceRecord rec;
-        uint8_t bytes[sizeof(TraceRecord) + sizeof(uint64_t)];
-    } dropped;
-    unsigned int idx = 0;
-    int dropped_count;
     size_t unused __attribute__ ((unused));
+
+    unused = fwrite(trace_batch, trace_batch_len, 1, trace_fp);
+    trace_batch_len = 0;
+}
+
+static void trace_batch_add(const void *data, size_t len)
+{
+    if (trace_batch_len + len > sizeof(trace_batch)) {
+        trace_write_batch();
+    }
+    memcpy(trace_batch + trace_batch_len, data, len);
+    trace_batch_len += len;
+}
+
+static void trace_batch_add_record(const TraceRecord *record)
+{
     uint64_t type = TRACE_RECORD_TYPE_EVENT;
+    TraceRecord header = *record;
 
-    for (;;) {
-        wait_for_trace_records_available();
+    header.timestamp_ns = trace_clock_to_ns(record->timestamp_ns);
+    trace_batch_add(&type, sizeof(type));
+    trace_batch_add(&header, sizeof(header));
+    trace_batch_add(record->arguments, record->length - sizeof(header));
+}
+
+/*
+ * Point @ring->oldest to the oldest record of @ring that is not written
+ * out yet, or NULL if there is none before @flush_head.
+ */
+static TraceRecord *trace_ring_peek(TraceRing *ring)
+{
+    TraceRecord *record;
+    unsigned int off;
+
+    ring->oldest = NULL;
+    while (ring->tail != ring->flush_head) {
+        off = ring->tail % TRACE_RING_LEN;
+        record = (TraceRecord *)(ring->buf + off);
+        if (record->event != PADDING_EVENT_ID) {
+            ring->oldest = record;
+            break;
+        }
+        qatomic_store_release(&ring->tail, ring->tail + TRACE_RING_LEN - off);
+    }
+    return ring->oldest;
+}
+
+static bool trace_ring_before(TraceRing *a, TraceRing *b)
+{
+    return a->oldest->timestamp_ns < b->oldest->timestamp_ns;
+}
+
+static void trace_heap_down(unsigned int n, unsigned int i)
+{
+    TraceRing *ring = trace_heap[i];
+
+    while (2 * i + 1 < n) {
+        unsigned int child = 2 * i + 1;
+
+        if (child + 1 < n &&
+            trace_ring_before(trace_heap[child + 1], trace_heap[child])) {
+            child++;
+        }
+        if (!trace_ring_before(trace_heap[child], ring)) {
+            break;
+        }
+        trace_heap[i] = trace_heap[child];
+        i = child;
+    }
+    trace_heap[i] = ring;
+}
+
+/*
+ * Write out the records that all threads have finished so far, merged
+ * in timestamp order.  Records that are finished while this runs may be
+ * older than the last ones written out.
+ */
+static void trace_write_records(void)
+{
+    TraceRing *rings = qatomic_load_acquire(&trace_rings);
+    TraceRing *ring;
+    TraceRecord *record;
+    uint64_t dropped = 0;
+    unsigned int n = 0, i;
+
+    if (trace_use_host_ticks) {
+        trace_clock_calibrate();
+    }
+
+    for (ring = rings; ring; ring = ring->next) {
+        n++;
+    }
+    if (n > trace_heap_max) {
+        /* don't use g_renew, can deadlock when traced */
+        TraceRing **heap = realloc(trace_heap, n * sizeof(*heap));
+
+        if (!heap) {
+            return;
+        }
+        trace_heap = heap;
+        trace_heap_max = n;
+    }
+
+    for (ring = rings; ring; ring = ring->next) {
+        dropped += qatomic_xchg(&ring->dropped, 0);
+        ring->flush_head = qatomic_load_acquire(&ring->head);
+    }
+
+    if (dropped) {
+        uint64_t type = TRACE_RECORD_TYPE_EVENT;
+        union {
+            TraceRecord rec;
+            uint8_t bytes[sizeof(TraceRecord) + sizeof(uint64_t)];
+        } rec;
+
+        rec.rec.event = DROPPED_EVENT_ID;
+        rec.rec.timestamp_ns = get_clock();
+        rec.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
+        rec.rec.pid = trace_pid;
+        rec.rec.arguments[0] = dropped;
+        trace_batch_add(&type, sizeof(type));
+        trace_batch_add(&rec.rec, rec.rec.length);
+    }
+
+    n = 0;
+    for (ring = rings; ring; ring = ring->next) {
+        if (trace_ring_peek(ring)) {
+            trace_heap[n++] = ring;
+        }
+    }
+    for (i = n / 2; i-- > 0;) {
+        trace_heap_down(n, i);
+    }
 
-        if (g_atomic_int_get(&dropped_events)) {
-            dropped.rec.event = DROPPED_EVENT_ID;
-            dropped.rec.timestamp_ns = get_clock();
-            dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
-            dropped.rec.pid = trace_pid;
-            do {
-                dropped_count = g_atomic_int_get(&dropped_events);
-            } while (!g_atomic_int_compare_and_exchange(&dropped_events,
-                                                        dropped_count, 0));
-            dropped.rec.arguments[0] = dropped_count;
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+    while (n) {
+        ring = trace_heap[0];
+        record = ring->oldest;
+        trace_batch_add_record(record);
+        qatomic_store_release(&ring->tail,
+                              ring->tail + ROUND_UP(record->length, 8));
+
+        if (!trace_ring_peek(ring)) {
+            trace_heap[0] = trace_heap[--n];
+        }
+        if (n) {
+            trace_heap_down(n, 0);
         }
+    }
 
-        while (get_trace_record(idx, &recordptr)) {
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(recordptr, recordptr->length, 1, trace_fp);
-            writeout_idx += recordptr->length;
-            free(recordptr); /* don't use g_free, can deadlock when traced */
-            idx = writeout_idx % TRACE_BUF_LEN;
+    trace_write_batch();
+    fflush(trace_fp);
+
+    /* Threads that filled up their ring buffer meanwhile kicked only once */
+    for (ring = rings; ring; ring = ring->next) {
+        if (qatomic_read(&ring->head) - ring->tail >
+            TRACE_RING_FLUSH_THRESHOLD) {
+            flush_trace_file(false);
+            break;
         }
+    }
+}
 
-        fflush(trace_fp);
+static gpointer writeout_thread(gpointer opaque)
+{
+    for (;;) {
+        wait_for_trace_records_available();
+        trace_write_records();
     }
     return NULL;
 }
 
 void trace_record_write_u64(TraceBufferRecord *rec, uint64_t val)
 {
-    rec->rec_off = write_to_buffer(rec->rec_off, &val, sizeof(uint64_t));
+    memcpy(rec->ptr, &val, sizeof(val));
+    rec->ptr += sizeof(val);
 }
 
 void trace_record_write_str(TraceBufferRecord *rec, const char *s, uint32_t slen)
 {
     /* Write string length first */
-    rec->rec_off = write_to_buffer(rec->rec_off, &slen, sizeof(slen));
+    memcpy(rec->ptr, &slen, sizeof(slen));
+    rec->ptr += sizeof(slen);
     /* Write actual string now */
-    rec->rec_off = write_to_buffer(rec->rec_off, (void*)s, slen);
+    memcpy(rec->ptr, s, slen);
+    rec->ptr += slen;
 }
 
 int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
 {
-    unsigned int idx, rec_off, old_idx, new_idx;
+    TraceRing *ring = trace_ring ?: trace_ring_claim();
     uint32_t rec_len = sizeof(TraceRecord) + datasize;
-    uint64_t event_u64 = event;
-    uint64_t timestamp_ns = get_clock();
-
-    do {
-        old_idx = g_atomic_int_get(&trace_idx);
-        smp_rmb();
-        new_idx = old_idx + rec_len;
-
-        if (new_idx - writeout_idx > TRACE_BUF_LEN) {
-            /* Trace Buffer Full, Event dropped ! */
-            g_atomic_int_inc(&dropped_events);
-            return -ENOSPC;
-        }
-    } while (!g_atomic_int_compare_and_exchange(&trace_idx, old_idx, new_idx));
+    unsigned int size = ROUND_UP(rec_len, 8);
+    unsigned int head, off, pad;
+    TraceRecord *record;
 
-    idx = old_idx % TRACE_BUF_LEN;
+    /* A signal handler may trace while this thread is writing a record */
+    if (!ring || ring->busy) {
+        goto dropped;
+    }
+    ring->busy = true;
+    barrier();
+
+    head = ring->head;
+    off = head % TRACE_RING_LEN;
+    pad = off + size > TRACE_RING_LEN ? TRACE_RING_LEN - off : 0;
+    if (size > TRACE_RING_LEN ||
+        head + pad + size - qatomic_load_acquire(&ring->tail) >
+        TRACE_RING_LEN) {
+        /* Trace Buffer Full, Event dropped ! */
+        ring->busy = false;
+        goto dropped;
+    }
 
-    rec_off = idx;
-    rec_off = write_to_buffer(rec_off, &event_u64, sizeof(event_u64));
-    rec_off = write_to_buffer(rec_off, &timestamp_ns, sizeof(timestamp_ns));
-    rec_off = write_to_buffer(rec_off, &rec_len, sizeof(rec_len));
-    rec_off = write_to_buffer(rec_off, &trace_pid, sizeof(trace_pid));
+    if (pad) {
+        /* Records do not wrap around the end of the ring buffer */
+        record = (TraceRecord *)(ring->buf + off);
+        record->event = PADDING_EVENT_ID;
+        head += pad;
+        off = 0;
+    }
 
-    rec->tbuf_idx = idx;
-    rec->rec_off  = (idx + sizeof(TraceRecord)) % TRACE_BUF_LEN;
-    return 0;
-}
+    record = (TraceRecord *)(ring->buf + off);
+    record->event = event;
+    record->timestamp_ns = trace_clock();
+    record->length = rec_len;
+    record->pid = trace_pid;
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
-{
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        data_ptr[x++] = trace_buf[idx++];
-    }
-}
+    rec->ring = ring;
+    rec->ptr = (uint8_t *)record->arguments;
+    rec->next_head = head + size;
+    return 0;
 
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
-{
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = data_ptr[x++];
+dropped:
+    if (ring) {
+        qatomic_inc(&ring->dropped);
+        trace_ring_put(ring);
     }
-    return idx; /* most callers wants to know where to write next */
+    return -ENOSPC;
 }
 
 void trace_record_finish(TraceBufferRecord *rec)
 {
-    TraceRecord record;
-    read_from_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-    smp_wmb(); /* write barrier before marking as valid */
-    record.event |= TRACE_RECORD_VALID;
-    write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-
-    if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
-        > TRACE_BUF_FLUSH_THRESHOLD) {
+    TraceRing *ring = rec->ring;
+    unsigned int used = rec->next_head - qatomic_read(&ring->tail);
+    unsigned int prev_used = ring->head - qatomic_read(&ring->tail);
+
+    qatomic_store_release(&ring->head, rec->next_head);
+    barrier();
+    ring->busy = false;
+
+    /* Kick only once per ring buffer that fills up */
+    if (used > TRACE_RING_FLUSH_THRESHOLD &&
+        prev_used <= TRACE_RING_FLUSH_THRESHOLD) {
         flush_trace_file(false);
+    } else if (!prev_used) {
+        /* Pairs with smp_mb() in trace_records_pending() */
+        smp_mb();
+        if (qatomic_read(&trace_writeout_idle) &&
+            qatomic_xchg(&trace_writeout_idle, false)) {
+            /* Let the writeout thread start its timeout */
+            g_mutex_lock(&trace_lock);
+            g_cond_signal(&trace_available_cond);
+            g_mutex_unlock(&trace_lock);
+        }
     }
+
+    trace_ring_put(ring);
 }
 
 static int st_write_event_mapping(TraceEventIter *iter)
@@ -412,6 +715,7 @@ bool st_init(void)
     GThread *thread;
 
     trace_pid = getpid();
+    trace_clock_init();
 
     thread = trace_thread_create(writeout_thread);
     if (!thread) {
@@ -19,8 +19,9 @@ void st_init_group(size_t group);
 void st_flush_trace_buffer(void);
 
 typedef struct {
-    unsigned int tbuf_idx;
-    unsigned int rec_off;
+    struct TraceRing *ring;
+    uint8_t *ptr;               /* where the next argument goes */
+    unsigned int next_head;
 } TraceBufferRecord;
 
 /* Note for hackers: Make sure MAX_TRACE_LEN < sizeof(uint32_t) */
@@ -385,6 +385,11 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
         timeout = blocking && !have_select_revents
             ? qemu_timeout_ns_to_ms(aio_compute_timeout(ctx)) : 0;
+
+        /* Don't block if aio_notify() was called, it may not kick us again */
+        if (blocking && qatomic_read(&ctx->notified)) {
+            timeout = 0;
+        }
         ret = WaitForMultipleObjects(count, events, FALSE, timeout);
         if (blocking) {
             assert(first);
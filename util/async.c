@@ -316,7 +316,8 @@ aio_ctx_prepare(GSource *source, gint    *timeout)
     /* We assume there is no timeout already supplied */
     *timeout = qemu_timeout_ns_to_ms(aio_compute_timeout(ctx));
 
-    if (aio_prepare(ctx)) {
+    /* Don't block if aio_notify() was called, it may not kick us again */
+    if (aio_prepare(ctx) || qatomic_read(&ctx->notified)) {
         *timeout = 0;
     }
 
@@ -490,15 +491,22 @@ void aio_notify(AioContext *ctx)
     /*
      * Write e.g. ctx->bh_list before writing ctx->notified.  Pairs with
      * smp_mb() in aio_notify_accept().
+     *
+     * If ctx->notified was already set, whoever set it either kicks the
+     * event loop or lets it see ctx->notified before it blocks; the event
+     * loop has not yet cleared the flag, so it will also see our writes.
+     * This way many producers cost a single event_notifier_set() until
+     * the event loop wakes up.
      */
-    smp_wmb();
-    qatomic_set(&ctx->notified, true);
+    if (qatomic_xchg(&ctx->notified, true)) {
+        return;
+    }
 
     /*
      * Write ctx->notified (and also ctx->bh_list) before reading ctx->notify_me.
      * Pairs with smp_mb() in aio_ctx_prepare or aio_poll.
      */
-    smp_mb();
+    smp_mb__after_rmw();
     if (qatomic_read(&ctx->notify_me)) {
         event_notifier_set(&ctx->notifier);
     }
@@ -55,16 +55,16 @@ static void coroutine_trampoline(void *co_)
     }
 }
 
-Coroutine *qemu_coroutine_new(void)
+Coroutine *qemu_coroutine_new(size_t stack_size)
 {
     CoroutineEmscripten *co;
 
     co = g_malloc0(sizeof(*co));
 
-    co->stack_size = COROUTINE_STACK_SIZE;
+    co->stack_size = stack_size;
     co->stack = qemu_alloc_stack(&co->stack_size);
 
-    co->asyncify_stack_size = COROUTINE_STACK_SIZE;
+    co->asyncify_stack_size = stack_size;
     co->asyncify_stack = g_malloc0(co->asyncify_stack_size);
     emscripten_fiber_init(&co->fiber, coroutine_trampoline, &co->base,
                           co->stack, co->stack_size, co->asyncify_stack,
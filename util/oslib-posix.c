@@ -60,6 +60,11 @@
 
 #include "qemu/memalign.h"
 #include "qemu/mmap-alloc.h"
+#include "qemu/bitmap.h"
+
+#ifdef CONFIG_LINUX
+#include <linux/mempolicy.h>
+#endif
 
 #define MAX_MEM_PREALLOC_THREAD_COUNT 16
 
@@ -741,6 +746,28 @@ void *qemu_alloc_stack(size_t *sz)
         abort();
     }
 
+#ifdef CONFIG_LINUX
+    /*
+     * Stacks are used by the thread that allocates them, or by threads on
+     * the same node in the case of pooled coroutines.  Keep the pages there
+     * even if they are first touched elsewhere.  This is only a preference,
+     * so errors are ignored, and the system calls are made directly so
+     * that libqemuutil does not need libnuma.
+     */
+    {
+        unsigned int cpu, node;
+
+        if (!syscall(__NR_getcpu, &cpu, &node, NULL)) {
+            /* mbind() wants one more bit, see hostmem.c */
+            g_autofree unsigned long *nodemask = bitmap_new(node + 2);
+
+            set_bit(node, nodemask);
+            syscall(__NR_mbind, ptr + pagesz, *sz - pagesz, MPOL_PREFERRED,
+                    nodemask, node + 2, 0);
+        }
+    }
+#endif
+
 #ifdef CONFIG_DEBUG_STACK_USAGE
     for (ptr2 = ptr + pagesz; ptr2 < ptr + *sz; ptr2 += sizeof(uint32_t)) {
         *(uint32_t *)ptr2 = 0xdeadbeaf;
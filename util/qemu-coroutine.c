@@ -19,10 +19,18 @@
 #include "qemu/coroutine_int.h"
 #include "qemu/coroutine-tls.h"
 #include "qemu/cutils.h"
+#include "qemu/stats64.h"
 #include "block/aio.h"
 
+#ifdef CONFIG_LINUX
+#include <sys/syscall.h>
+#endif
+
 enum {
     COROUTINE_POOL_BATCH_MAX_SIZE = 128,
+
+    /* Hosts with more NUMA nodes share global pools between nodes */
+    COROUTINE_POOL_MAX_NODES = 16,
 };
 
 /*
@@ -44,6 +52,14 @@ enum {
  * .-------------------.
  * | Batch 1 | Batch 2 | per-thread local_pool (maximum 2 batches)
  * `-------------------'
+ *
+ * Coroutines with small stacks are kept in separate pools with the same
+ * layout, one per CoroutineStack value.
+ *
+ * There is one global pool per NUMA node, each with its own lock.  Threads
+ * exchange batches with the pool of the node they run on, so that stacks,
+ * which qemu_alloc_stack() places on the node of the allocating thread,
+ * keep being used on that node.
  */
 typedef struct CoroutinePoolBatch {
     /* Batches are kept in a list */
@@ -59,14 +75,65 @@ typedef QSLIST_HEAD(, CoroutinePoolBatch) CoroutinePool;
 /* Host operating system limit on number of pooled coroutines */
 static unsigned int global_pool_hard_max_size;
 
-static QemuMutex global_pool_lock; /* protects the following variables */
-static CoroutinePool global_pool = QSLIST_HEAD_INITIALIZER(global_pool);
-static unsigned int global_pool_size;
+/* Coroutines in all global pools, atomic */
+static unsigned int global_pool_total_size;
 static unsigned int global_pool_max_size = COROUTINE_POOL_BATCH_MAX_SIZE;
 
-QEMU_DEFINE_STATIC_CO_TLS(CoroutinePool, local_pool);
+typedef struct CoroutineNodePool {
+    QemuMutex lock; /* protects pool */
+    CoroutinePool pool[COROUTINE_STACK__MAX];
+} CoroutineNodePool;
+
+static CoroutineNodePool global_pool[COROUTINE_POOL_MAX_NODES];
+
+static struct {
+    Stat64 hits;
+    Stat64 misses;
+    Stat64 refills;
+    Stat64 discards;
+} pool_stats;
+
+typedef struct CoroutineLocalPools {
+    CoroutinePool pool[COROUTINE_STACK__MAX];
+
+    /* Not yet added to pool_stats.hits */
+    unsigned int hits;
+} CoroutineLocalPools;
+
+QEMU_DEFINE_STATIC_CO_TLS(CoroutineLocalPools, local_pools);
 QEMU_DEFINE_STATIC_CO_TLS(Notifier, local_pool_cleanup_notifier);
 
+static CoroutinePool *get_local_pool(CoroutineStack stack)
+{
+    return &get_ptr_local_pools()->pool[stack];
+}
+
+static void local_pool_flush_hits(void)
+{
+    CoroutineLocalPools *local_pools = get_ptr_local_pools();
+
+    stat64_add(&pool_stats.hits, local_pools->hits);
+    local_pools->hits = 0;
+}
+
+/*
+ * The global pool of the NUMA node that the current thread runs on.  This
+ * is called once per batch, so the cost of a system call does not matter,
+ * and it keeps libnuma out of libqemuutil.  Hosts without NUMA report
+ * node 0.
+ */
+static CoroutineNodePool *get_node_pool(void)
+{
+#ifdef CONFIG_LINUX
+    unsigned int cpu, node;
+
+    if (!syscall(__NR_getcpu, &cpu, &node, NULL)) {
+        return &global_pool[node % COROUTINE_POOL_MAX_NODES];
+    }
+#endif
+    return &global_pool[0];
+}
+
 static CoroutinePoolBatch *coroutine_pool_batch_new(void)
 {
     CoroutinePoolBatch *batch = g_new(CoroutinePoolBatch, 1);
@@ -90,14 +157,19 @@ static void coroutine_pool_batch_delete(CoroutinePoolBatch *batch)
 
 static void local_pool_cleanup(Notifier *n, void *value)
 {
-    CoroutinePool *local_pool = get_ptr_local_pool();
+    CoroutineStack stack;
     CoroutinePoolBatch *batch;
     CoroutinePoolBatch *tmp;
 
-    QSLIST_FOREACH_SAFE(batch, local_pool, next, tmp) {
-        QSLIST_REMOVE_HEAD(local_pool, next);
-        coroutine_pool_batch_delete(batch);
+    for (stack = 0; stack < COROUTINE_STACK__MAX; stack++) {
+        CoroutinePool *local_pool = get_local_pool(stack);
+
+        QSLIST_FOREACH_SAFE(batch, local_pool, next, tmp) {
+            QSLIST_REMOVE_HEAD(local_pool, next);
+            coroutine_pool_batch_delete(batch);
+        }
     }
+    local_pool_flush_hits();
 }
 
 /* Ensure the atexit notifier is registered */
@@ -111,9 +183,9 @@ static void local_pool_cleanup_init_once(void)
 }
 
 /* Helper to get the next unused coroutine from the local pool */
-static Coroutine *coroutine_pool_get_local(void)
+static Coroutine *coroutine_pool_get_local(CoroutineStack stack)
 {
-    CoroutinePool *local_pool = get_ptr_local_pool();
+    CoroutinePool *local_pool = get_local_pool(stack);
     CoroutinePoolBatch *batch = QSLIST_FIRST(local_pool);
     Coroutine *co;
 
@@ -124,71 +196,84 @@ static Coroutine *coroutine_pool_get_local(void)
     co = QSLIST_FIRST(&batch->list);
     QSLIST_REMOVE_HEAD(&batch->list, pool_next);
     batch->size--;
+    get_ptr_local_pools()->hits++;
 
     if (batch->size == 0) {
         QSLIST_REMOVE_HEAD(local_pool, next);
         coroutine_pool_batch_delete(batch);
+        local_pool_flush_hits();
     }
     return co;
 }
 
-/* Get the next batch from the global pool */
-static void coroutine_pool_refill_local(void)
+/* Get the next batch from the global pool of the current node */
+static void coroutine_pool_refill_local(CoroutineStack stack)
 {
-    CoroutinePool *local_pool = get_ptr_local_pool();
+    CoroutinePool *local_pool = get_local_pool(stack);
+    CoroutineNodePool *node_pool = get_node_pool();
     CoroutinePoolBatch *batch = NULL;
 
-    WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
-        batch = QSLIST_FIRST(&global_pool);
+    if (!qatomic_read(&global_pool_total_size)) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&node_pool->lock) {
+        batch = QSLIST_FIRST(&node_pool->pool[stack]);
 
         if (batch) {
-            QSLIST_REMOVE_HEAD(&global_pool, next);
-            global_pool_size -= batch->size;
+            QSLIST_REMOVE_HEAD(&node_pool->pool[stack], next);
         }
     }
 
     if (batch) {
+        qatomic_sub(&global_pool_total_size, batch->size);
+        stat64_add(&pool_stats.refills, 1);
         QSLIST_INSERT_HEAD(local_pool, batch, next);
         local_pool_cleanup_init_once();
     }
 }
 
-/* Add a batch of coroutines to the global pool */
-static void coroutine_pool_put_global(CoroutinePoolBatch *batch)
+/* Add a batch of coroutines to the global pool of the current node */
+static void coroutine_pool_put_global(CoroutineStack stack,
+                                      CoroutinePoolBatch *batch)
 {
-    WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
-        unsigned int max = MIN(global_pool_max_size,
-                               global_pool_hard_max_size);
+    CoroutineNodePool *node_pool = get_node_pool();
+    unsigned int max = MIN(qatomic_read(&global_pool_max_size),
+                           global_pool_hard_max_size);
 
-        if (global_pool_size < max) {
-            QSLIST_INSERT_HEAD(&global_pool, batch, next);
-
-            /* Overshooting the max pool size is allowed */
-            global_pool_size += batch->size;
-            return;
+    /*
+     * The hard limit is on the number of stacks, whatever their size and
+     * node.  Overshooting the max pool size is allowed.
+     */
+    if (qatomic_fetch_add(&global_pool_total_size, batch->size) < max) {
+        WITH_QEMU_LOCK_GUARD(&node_pool->lock) {
+            QSLIST_INSERT_HEAD(&node_pool->pool[stack], batch, next);
         }
+        return;
     }
 
     /* The global pool was full, so throw away this batch */
+    qatomic_sub(&global_pool_total_size, batch->size);
+    stat64_add(&pool_stats.discards, 1);
     coroutine_pool_batch_delete(batch);
 }
 
 /* Get the next unused coroutine from the pool or return NULL */
-static Coroutine *coroutine_pool_get(void)
+static Coroutine *coroutine_pool_get(CoroutineStack stack)
 {
     Coroutine *co;
 
-    co = coroutine_pool_get_local();
+    co = coroutine_pool_get_local(stack);
     if (!co) {
-        coroutine_pool_refill_local();
-        co = coroutine_pool_get_local();
+        coroutine_pool_refill_local(stack);
+        co = coroutine_pool_get_local(stack);
     }
     return co;
 }
 
 static void coroutine_pool_put(Coroutine *co)
 {
-    CoroutinePool *local_pool = get_ptr_local_pool();
+    CoroutinePool *local_pool = get_local_pool(co->stack);
     CoroutinePoolBatch *batch = QSLIST_FIRST(local_pool);
 
     if (unlikely(!batch)) {
@@ -203,7 +288,7 @@ static void coroutine_pool_put(Coroutine *co)
         /* Is the local pool full? */
         if (next) {
             QSLIST_REMOVE_HEAD(local_pool, next);
-            coroutine_pool_put_global(batch);
+            coroutine_pool_put_global(co->stack, batch);
         }
 
         batch = coroutine_pool_batch_new();
@@ -214,16 +299,24 @@ static void coroutine_pool_put(Coroutine *co)
     batch->size++;
 }
 
-Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
+static const size_t coroutine_stack_size[COROUTINE_STACK__MAX] = {
+    [COROUTINE_STACK_DEFAULT] = COROUTINE_STACK_SIZE,
+    [COROUTINE_STACK_SMALL] = COROUTINE_SMALL_STACK_SIZE,
+};
+
+static Coroutine *coroutine_create(CoroutineStack stack,
+                                   CoroutineEntry *entry, void *opaque)
 {
     Coroutine *co = NULL;
 
     if (IS_ENABLED(CONFIG_COROUTINE_POOL)) {
-        co = coroutine_pool_get();
+        co = coroutine_pool_get(stack);
     }
 
     if (!co) {
-        co = qemu_coroutine_new();
+        co = qemu_coroutine_new(coroutine_stack_size[stack]);
+        co->stack = stack;
+        stat64_add(&pool_stats.misses, 1);
     }
 
     co->entry = entry;
@@ -232,6 +325,16 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     return co;
 }
 
+Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
+{
+    return coroutine_create(COROUTINE_STACK_DEFAULT, entry, opaque);
+}
+
+Coroutine *qemu_coroutine_create_small(CoroutineEntry *entry, void *opaque)
+{
+    return coroutine_create(COROUTINE_STACK_SMALL, entry, opaque);
+}
+
 static void coroutine_delete(Coroutine *co)
 {
     co->caller = NULL;
@@ -351,14 +454,21 @@ AioContext *qemu_coroutine_get_aio_context(Coroutine *co)
 
 void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size)
 {
-    QEMU_LOCK_GUARD(&global_pool_lock);
-    global_pool_max_size += additional_pool_size;
+    qatomic_add(&global_pool_max_size, additional_pool_size);
 }
 
 void qemu_coroutine_dec_pool_size(unsigned int removing_pool_size)
 {
-    QEMU_LOCK_GUARD(&global_pool_lock);
-    global_pool_max_size -= removing_pool_size;
+    qatomic_sub(&global_pool_max_size, removing_pool_size);
+}
+
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats)
+{
+    stats->hits = stat64_get(&pool_stats.hits);
+    stats->misses = stat64_get(&pool_stats.misses);
+    stats->refills = stat64_get(&pool_stats.refills);
+    stats->discards = stat64_get(&pool_stats.discards);
+    stats->size = qatomic_read(&global_pool_total_size);
 }
 
 static unsigned int get_global_pool_hard_max_size(void)
@@ -396,6 +506,10 @@ static unsigned int get_global_pool_hard_max_size(void)
 
 static void __attribute__((constructor)) qemu_coroutine_init(void)
 {
-    qemu_mutex_init(&global_pool_lock);
+    int i;
+
+    for (i = 0; i < COROUTINE_POOL_MAX_NODES; i++) {
+        qemu_mutex_init(&global_pool[i].lock);
+    }
     global_pool_hard_max_size = get_global_pool_hard_max_size();
 }
@@ -62,12 +62,20 @@ static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
  * used by different AioContexts / threads. Each clock also has
  * a list of the QEMUTimerLists associated with it, in order that
  * reenabling the clock can call all the notifiers.
+ *
+ * The active timers are kept in a binary min-heap, so that adding or
+ * removing a timer is O(log n) and the soonest timer is always at the
+ * top.  Timers with the same expire time run in the order they were
+ * armed, like with a sorted list.
  */
 
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
-    QEMUTimer *active_timers;
+    QEMUTimer **active_timers;
+    int nr_active_timers;
+    int max_active_timers;
+    uint64_t timer_seq;
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -94,6 +102,128 @@ static bool timer_expired_ns(QEMUTimer *timer_head, int64_t current_time)
     return timer_head && (timer_head->expire_time <= current_time);
 }
 
+/* Called with active_timers_lock held */
+static QEMUTimer *timerlist_first(QEMUTimerList *timer_list)
+{
+    return timer_list->nr_active_timers ? timer_list->active_timers[0] : NULL;
+}
+
+static bool timer_before(QEMUTimer *a, QEMUTimer *b)
+{
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
+
+static void timerlist_heap_set(QEMUTimerList *timer_list, int i,
+                               QEMUTimer *ts)
+{
+    timer_list->active_timers[i] = ts;
+    ts->heap_index = i;
+}
+
+static void timerlist_heap_up(QEMUTimerList *timer_list, int i)
+{
+    QEMUTimer *ts = timer_list->active_timers[i];
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+
+        if (!timer_before(ts, timer_list->active_timers[parent])) {
+            break;
+        }
+        timerlist_heap_set(timer_list, i, timer_list->active_timers[parent]);
+        i = parent;
+    }
+    timerlist_heap_set(timer_list, i, ts);
+}
+
+static void timerlist_heap_down(QEMUTimerList *timer_list, int i)
+{
+    QEMUTimer *ts = timer_list->active_timers[i];
+    int n = timer_list->nr_active_timers;
+
+    while (2 * i + 1 < n) {
+        int child = 2 * i + 1;
+
+        if (child + 1 < n &&
+            timer_before(timer_list->active_timers[child + 1],
+                         timer_list->active_timers[child])) {
+            child++;
+        }
+        if (!timer_before(timer_list->active_timers[child], ts)) {
+            break;
+        }
+        timerlist_heap_set(timer_list, i, timer_list->active_timers[child]);
+        i = child;
+    }
+    timerlist_heap_set(timer_list, i, ts);
+}
+
+/* Called with active_timers_lock held */
+static void timerlist_heap_insert(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    int n = timer_list->nr_active_timers;
+
+    if (n == timer_list->max_active_timers) {
+        timer_list->max_active_timers = MAX(16, n * 2);
+        timer_list->active_timers = g_renew(QEMUTimer *,
+                                            timer_list->active_timers,
+                                            timer_list->max_active_timers);
+    }
+
+    ts->seq = timer_list->timer_seq++;
+    timer_list->active_timers[n] = ts;
+    qatomic_set(&timer_list->nr_active_timers, n + 1);
+    timerlist_heap_up(timer_list, n);
+}
+
+/* Called with active_timers_lock held */
+static void timerlist_heap_remove(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    int i = ts->heap_index;
+    int n = timer_list->nr_active_timers - 1;
+    QEMUTimer *last = timer_list->active_timers[n];
+
+    assert(timer_list->active_timers[i] == ts);
+    ts->heap_index = -1;
+    qatomic_set(&timer_list->nr_active_timers, n);
+
+    if (i != n) {
+        /* Move the last timer into the hole, then restore the order */
+        timerlist_heap_set(timer_list, i, last);
+        timerlist_heap_down(timer_list, i);
+        timerlist_heap_up(timer_list, last->heap_index);
+    }
+}
+
+/*
+ * Soonest expire time, but no later than @best, of the timers below
+ * index @i of the heap whose attributes are all in @attr_mask.  Subtrees
+ * whose top expires after @best cannot do better, so they are skipped.
+ *
+ * Called with active_timers_lock held
+ */
+static int64_t timerlist_heap_soonest(QEMUTimerList *timer_list, int i,
+                                      int attr_mask, int64_t best)
+{
+    QEMUTimer *ts;
+
+    if (i >= timer_list->nr_active_timers) {
+        return best;
+    }
+
+    ts = timer_list->active_timers[i];
+    if (ts->expire_time >= best) {
+        return best;
+    }
+    if (!(ts->attributes & ~attr_mask)) {
+        return ts->expire_time;
+    }
+
+    best = timerlist_heap_soonest(timer_list, 2 * i + 1, attr_mask, best);
+    return timerlist_heap_soonest(timer_list, 2 * i + 2, attr_mask, best);
+}
+
 QEMUTimerList *timerlist_new(QEMUClockType type,
                              QEMUTimerListNotifyCB *cb,
                              void *opaque)
@@ -118,6 +248,7 @@ void timerlist_free(QEMUTimerList *timer_list)
         QLIST_REMOVE(timer_list, list);
     }
     qemu_mutex_destroy(&timer_list->active_timers_lock);
+    g_free(timer_list->active_timers);
     g_free(timer_list);
 }
 
@@ -172,7 +303,7 @@ void qemu_clock_enable(QEMUClockType type, bool enabled)
 
 bool timerlist_has_timers(QEMUTimerList *timer_list)
 {
-    return !!qatomic_read(&timer_list->active_timers);
+    return !!qatomic_read(&timer_list->nr_active_timers);
 }
 
 bool qemu_clock_has_timers(QEMUClockType type)
@@ -185,15 +316,15 @@ bool timerlist_expired(QEMUTimerList *timer_list)
 {
     int64_t expire_time = 0;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!qatomic_read(&timer_list->nr_active_timers)) {
         return false;
     }
 
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        if (!timer_list->nr_active_timers) {
             return false;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = timerlist_first(timer_list)->expire_time;
     }
 
     return expire_time <= qemu_clock_get_ns(timer_list->clock->type);
@@ -215,7 +346,7 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
     int64_t delta;
     int64_t expire_time = 0;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!qatomic_read(&timer_list->nr_active_timers)) {
         return -1;
     }
 
@@ -228,10 +359,10 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
      * the caller should notice the change and there is no race condition.
      */
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        if (!timer_list->nr_active_timers) {
             return -1;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = timerlist_first(timer_list)->expire_time;
     }
 
     delta = expire_time - qemu_clock_get_ns(timer_list->clock->type);
@@ -253,7 +384,6 @@ int64_t qemu_clock_deadline_ns_all(QEMUClockType type, int attr_mask)
     int64_t deadline = -1;
     int64_t delta;
     int64_t expire_time;
-    QEMUTimer *ts;
     QEMUTimerList *timer_list;
     QEMUClock *clock = qemu_clock_ptr(type);
 
@@ -262,21 +392,17 @@ int64_t qemu_clock_deadline_ns_all(QEMUClockType type, int attr_mask)
     }
 
     QLIST_FOREACH(timer_list, &clock->timerlists, list) {
-        if (!qatomic_read(&timer_list->active_timers)) {
+        if (!qatomic_read(&timer_list->nr_active_timers)) {
             continue;
         }
         qemu_mutex_lock(&timer_list->active_timers_lock);
-        ts = timer_list->active_timers;
         /* Skip all external timers */
-        while (ts && (ts->attributes & ~attr_mask)) {
-            ts = ts->next;
-        }
-        if (!ts) {
-            qemu_mutex_unlock(&timer_list->active_timers_lock);
+        expire_time = timerlist_heap_soonest(timer_list, 0, attr_mask,
+                                             INT64_MAX);
+        qemu_mutex_unlock(&timer_list->active_timers_lock);
+        if (expire_time == INT64_MAX) {
             continue;
         }
-        expire_time = ts->expire_time;
-        qemu_mutex_unlock(&timer_list->active_timers_lock);
 
         delta = expire_time - qemu_clock_get_ns(type);
         if (delta <= 0) {
@@ -361,6 +487,7 @@ void timer_init_full(QEMUTimer *ts,
     ts->scale = scale;
     ts->attributes = attributes;
     ts->expire_time = -1;
+    ts->heap_index = -1;
 }
 
 void timer_deinit(QEMUTimer *ts)
@@ -371,41 +498,19 @@ void timer_deinit(QEMUTimer *ts)
 
 static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
 {
-    QEMUTimer **pt, *t;
-
     ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            qatomic_set(pt, t->next);
-            break;
-        }
-        pt = &t->next;
+    if (ts->heap_index >= 0) {
+        timerlist_heap_remove(timer_list, ts);
     }
 }
 
 static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
                                 QEMUTimer *ts, int64_t expire_time)
 {
-    QEMUTimer **pt, *t;
-
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
-    for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
-            break;
-        }
-        pt = &t->next;
-    }
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    qatomic_set(pt, ts);
+    timerlist_heap_insert(timer_list, ts);
 
-    return pt == &timer_list->active_timers;
+    return timerlist_first(timer_list) == ts;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -493,7 +598,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     QEMUTimerCB *cb;
     void *opaque;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!qatomic_read(&timer_list->nr_active_timers)) {
         return false;
     }
 
@@ -532,7 +637,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
      */
     current_time = qemu_clock_get_ns(timer_list->clock->type);
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    while ((ts = timer_list->active_timers)) {
+    while ((ts = timerlist_first(timer_list))) {
         if (!timer_expired_ns(ts, current_time)) {
             /* No expired timers left.  The checkpoint can be skipped
              * if no timers fired or they were all external.
@@ -552,9 +657,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
-        ts->expire_time = -1;
+        timer_del_locked(timer_list, ts);
         cb = ts->cb;
         opaque = ts->opaque;
 
@@ -32,6 +32,9 @@
 #include "qemu/thread.h"
 #include "qemu/main-loop.h"
 #include "qemu/lockable.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
+#include "system/stats.h"
 #if defined(CONFIG_MALLOC_TRIM)
 #include <malloc.h>
 #endif
@@ -50,6 +53,16 @@ static int in_drain_call_rcu;
 static QemuMutex rcu_registry_lock;
 static QemuMutex rcu_sync_lock;
 
+/*
+ * Twice the number of grace periods completed by synchronize_rcu(), plus
+ * one while a grace period is in progress.  Written under rcu_sync_lock.
+ */
+static unsigned long rcu_sync_seq;
+
+static Stat64 rcu_stat_grace_periods;
+static Stat64 rcu_stat_callbacks;
+static Stat64 rcu_stat_latency[RCU_LATENCY_BUCKETS];
+
 /*
  * Check whether a quiescent state was crossed between the beginning of
  * update_counter_and_wait and now.
@@ -143,7 +156,26 @@ static void wait_for_readers(void)
 
 void synchronize_rcu(void)
 {
+    unsigned long seq;
+
+    /*
+     * Order the writes to RCU-protected pointers before the read of
+     * rcu_sync_seq.  A grace period that starts after this point orders
+     * them with its own smp_mb_global().
+     */
+    smp_mb();
+
+    /*
+     * Concurrent callers share grace periods: wait until one starts
+     * and completes after the snapshot, then we are done.
+     */
+    seq = (qatomic_read(&rcu_sync_seq) + 3) & ~1UL;
+
     QEMU_LOCK_GUARD(&rcu_sync_lock);
+    if ((long)(rcu_sync_seq - seq) >= 0) {
+        return;
+    }
+    qatomic_set(&rcu_sync_seq, rcu_sync_seq + 1);
 
     /* Write RCU-protected pointers before reading p_rcu_reader->ctr.
      * Pairs with smp_mb_placeholder() in rcu_read_lock().
@@ -153,29 +185,41 @@ void synchronize_rcu(void)
      */
     smp_mb_global();
 
-    QEMU_LOCK_GUARD(&rcu_registry_lock);
-    if (!QLIST_EMPTY(&registry)) {
-        if (sizeof(rcu_gp_ctr) < 8) {
-            /* For architectures with 32-bit longs, a two-subphases algorithm
-             * ensures we do not encounter overflow bugs.
-             *
-             * Switch parity: 0 -> 1, 1 -> 0.
-             */
-            qatomic_set(&rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR);
+    WITH_QEMU_LOCK_GUARD(&rcu_registry_lock) {
+        if (!QLIST_EMPTY(&registry)) {
+            if (sizeof(rcu_gp_ctr) < 8) {
+                /* For architectures with 32-bit longs, a two-subphases
+                 * algorithm ensures we do not encounter overflow bugs.
+                 *
+                 * Switch parity: 0 -> 1, 1 -> 0.
+                 */
+                qatomic_set(&rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR);
+                wait_for_readers();
+                qatomic_set(&rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR);
+            } else {
+                /* Increment current grace period.  */
+                qatomic_set(&rcu_gp_ctr, rcu_gp_ctr + RCU_GP_CTR);
+            }
+
             wait_for_readers();
-            qatomic_set(&rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR);
-        } else {
-            /* Increment current grace period.  */
-            qatomic_set(&rcu_gp_ctr, rcu_gp_ctr + RCU_GP_CTR);
         }
-
-        wait_for_readers();
     }
+
+    /* Pairs with smp_mb() at the beginning.  */
+    qatomic_store_release(&rcu_sync_seq, rcu_sync_seq + 1);
+    stat64_add(&rcu_stat_grace_periods, 1);
 }
 
 
 #define RCU_CALL_MIN_SIZE        30
 
+/*
+ * How long to wait for callbacks to pile up.  This amortizes the cost of
+ * the grace period, which is much lower with expedited barriers.
+ */
+#define RCU_CALL_WAIT_US            10000
+#define RCU_CALL_WAIT_US_EXPEDITED  1000
+
 /* Multi-producer, single-consumer queue based on urcu/static/wfqueue.h
  * from liburcu.  Note that head is only used by the consumer.
  */
@@ -184,6 +228,10 @@ static struct rcu_head *head = &dummy, **tail = &dummy.next;
 static int rcu_call_count;
 static QemuEvent rcu_call_ready_event;
 
+/* get_clock() when the oldest callback not yet in a batch was queued */
+static bool rcu_call_timed;
+static Stat64 rcu_call_oldest;
+
 static void enqueue(struct rcu_head *node)
 {
     struct rcu_head **old_tail;
@@ -261,13 +309,16 @@ static void *call_rcu_thread(void *opaque)
     for (;;) {
         int tries = 0;
         int n = qatomic_read(&rcu_call_count);
+        int64_t start, ns;
+        int bucket;
 
         /* Heuristically wait for a decent number of callbacks to pile up.
          * Fetch rcu_call_count now, we only must process elements that were
          * added before synchronize_rcu() starts.
          */
         while (n == 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5)) {
-            g_usleep(10000);
+            g_usleep(smp_mb_global_expedited() ? RCU_CALL_WAIT_US_EXPEDITED
+                                               : RCU_CALL_WAIT_US);
             if (n == 0) {
                 qemu_event_reset(&rcu_call_ready_event);
                 n = qatomic_read(&rcu_call_count);
@@ -281,7 +332,10 @@ static void *call_rcu_thread(void *opaque)
             n = qatomic_read(&rcu_call_count);
         }
 
+        start = stat64_get(&rcu_call_oldest);
+        qatomic_set(&rcu_call_timed, false);
         qatomic_sub(&rcu_call_count, n);
+        stat64_add(&rcu_stat_callbacks, n);
         synchronize_rcu();
         bql_lock();
         while (n > 0) {
@@ -301,6 +355,10 @@ static void *call_rcu_thread(void *opaque)
             node->func(node);
         }
         bql_unlock();
+
+        ns = get_clock() - start;
+        bucket = stats_log2_bucket(ns, RCU_LATENCY_BUCKETS);
+        stat64_add(&rcu_stat_latency[bucket], 1);
     }
     abort();
 }
@@ -308,11 +366,27 @@ static void *call_rcu_thread(void *opaque)
 void call_rcu1(struct rcu_head *node, void (*func)(struct rcu_head *node))
 {
     node->func = func;
+    if (!qatomic_read(&rcu_call_timed) &&
+        !qatomic_xchg(&rcu_call_timed, true)) {
+        stat64_set(&rcu_call_oldest, get_clock());
+    }
     enqueue(node);
     qatomic_inc(&rcu_call_count);
     qemu_event_set(&rcu_call_ready_event);
 }
 
+void rcu_get_stats(RCUStats *stats)
+{
+    int i;
+
+    stats->grace_periods = stat64_get(&rcu_stat_grace_periods);
+    stats->callbacks = stat64_get(&rcu_stat_callbacks);
+    stats->pending = qatomic_read(&rcu_call_count);
+    for (i = 0; i < RCU_LATENCY_BUCKETS; i++) {
+        stats->callback_latency[i] = stat64_get(&rcu_stat_latency[i]);
+    }
+}
+
 
 struct rcu_drain {
     struct rcu_head rcu;
@@ -458,6 +532,7 @@ static void rcu_init_child(void)
     }
 
     memset(&registry, 0, sizeof(registry));
+    smp_mb_global_init();
     rcu_init_complete();
 }
 #endif
@@ -19,6 +19,8 @@ membarrier(int cmd, int flags)
 {
     return syscall(__NR_membarrier, cmd, flags);
 }
+
+static bool expedited;
 #endif
 
 void smp_mb_global(void)
@@ -26,12 +28,22 @@ void smp_mb_global(void)
 #if defined CONFIG_WIN32
     FlushProcessWriteBuffers();
 #elif defined CONFIG_LINUX
-    membarrier(MEMBARRIER_CMD_SHARED, 0);
+    membarrier(expedited ? MEMBARRIER_CMD_PRIVATE_EXPEDITED
+                         : MEMBARRIER_CMD_SHARED, 0);
 #else
 #error --enable-membarrier is not supported on this operating system.
 #endif
 }
 
+bool smp_mb_global_expedited(void)
+{
+#ifdef CONFIG_LINUX
+    return expedited;
+#else
+    return true;
+#endif
+}
+
 void smp_mb_global_init(void)
 {
 #ifdef CONFIG_LINUX
@@ -46,5 +58,13 @@ void smp_mb_global_init(void)
         error_report("Please upgrade your system to a newer version of Linux");
         exit(1);
     }
+
+    /*
+     * MEMBARRIER_CMD_SHARED waits for all CPUs to go through a context
+     * switch, which takes milliseconds.  Private expedited barriers
+     * instead interrupt the CPUs that are running threads of this process.
+     */
+    expedited = (ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+        membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
 #endif
 }
@@ -19,11 +19,32 @@
 #include "qemu/queue.h"
 #include "qemu/thread.h"
 #include "qemu/coroutine.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
 #include "trace.h"
 #include "block/thread-pool.h"
+#include "system/stats.h"
 #include "qemu/main-loop.h"
 
+/*
+ * A slow request that waited this long is run before quick ones, so that
+ * quick requests cannot starve slow ones.
+ */
+#define THREAD_POOL_SLOW_DEADLINE_NS (10 * SCALE_MS)
+
+/*
+ * A request that waited this long in the queue means that the pool is
+ * too small for the load, so a worker that picks it up adds a thread.
+ */
+#define THREAD_POOL_SPAWN_LATENCY_NS (1 * SCALE_MS)
+
+static struct {
+    Stat64 requests;
+    Stat64 latency[THREAD_POOL_LATENCY_BUCKETS];
+} thread_pool_stats[THREAD_POOL_CLASS__MAX];
+
 static void do_spawn_thread(ThreadPoolAio *pool);
+static void spawn_thread(ThreadPoolAio *pool);
 
 typedef struct ThreadPoolElementAio ThreadPoolElementAio;
 
@@ -38,6 +59,8 @@ struct ThreadPoolElementAio {
     ThreadPoolAio *pool;
     ThreadPoolFunc *func;
     void *arg;
+    ThreadPoolClass cls;
+    int64_t submit_ns;
 
     /* Moving state out of THREAD_QUEUED is protected by lock.  After
      * that, only the worker thread can write to it.  Reads and writes
@@ -65,7 +88,8 @@ struct ThreadPoolAio {
     QLIST_HEAD(, ThreadPoolElementAio) head;
 
     /* The following variables are protected by lock.  */
-    QTAILQ_HEAD(, ThreadPoolElementAio) request_list;
+    QTAILQ_HEAD(, ThreadPoolElementAio) request_list[THREAD_POOL_CLASS__MAX];
+    int active_threads[THREAD_POOL_CLASS__MAX];
     int cur_threads;
     int idle_threads;
     int new_threads;     /* backlog of threads we need to create */
@@ -74,6 +98,53 @@ struct ThreadPoolAio {
     int max_threads;
 };
 
+/*
+ * Pick the next request to run, or return NULL if there is none that can
+ * run now.  Quick requests go first.  Slow ones never take up more than
+ * half of the threads, so that a quick request does not have to wait for
+ * them to finish, and they go first once they are past their deadline.
+ *
+ * Runs with lock taken.
+ */
+static ThreadPoolElementAio *thread_pool_next_request(ThreadPoolAio *pool,
+                                                      int64_t now)
+{
+    ThreadPoolElementAio *quick, *slow;
+
+    quick = QTAILQ_FIRST(&pool->request_list[THREAD_POOL_CLASS_DEFAULT]);
+    slow = QTAILQ_FIRST(&pool->request_list[THREAD_POOL_CLASS_SLOW]);
+
+    if (slow && pool->active_threads[THREAD_POOL_CLASS_SLOW] >=
+                MAX(pool->max_threads / 2, 1)) {
+        slow = NULL;
+    }
+    if (quick && slow &&
+        now - slow->submit_ns < THREAD_POOL_SLOW_DEADLINE_NS) {
+        slow = NULL;
+    }
+    return slow ?: quick;
+}
+
+static bool thread_pool_has_requests(ThreadPoolAio *pool)
+{
+    int i;
+
+    for (i = 0; i < THREAD_POOL_CLASS__MAX; i++) {
+        if (!QTAILQ_EMPTY(&pool->request_list[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void thread_pool_account(ThreadPoolClass cls, int64_t latency)
+{
+    int bucket = stats_log2_bucket(latency, THREAD_POOL_LATENCY_BUCKETS);
+
+    stat64_add(&thread_pool_stats[cls].requests, 1);
+    stat64_add(&thread_pool_stats[cls].latency[bucket], 1);
+}
+
 static void *worker_thread(void *opaque)
 {
     ThreadPoolAio *pool = opaque;
@@ -84,14 +155,16 @@ static void *worker_thread(void *opaque)
 
     while (pool->cur_threads <= pool->max_threads) {
         ThreadPoolElementAio *req;
+        int64_t now = get_clock();
         int ret;
 
-        if (QTAILQ_EMPTY(&pool->request_list)) {
+        req = thread_pool_next_request(pool, now);
+        if (!req) {
             pool->idle_threads++;
             ret = qemu_cond_timedwait(&pool->request_cond, &pool->lock, 10000);
             pool->idle_threads--;
             if (ret == 0 &&
-                QTAILQ_EMPTY(&pool->request_list) &&
+                !thread_pool_has_requests(pool) &&
                 pool->cur_threads > pool->min_threads) {
                 /* Timed out + no work to do + no need for warm threads = exit.  */
                 break;
@@ -103,11 +176,19 @@ static void *worker_thread(void *opaque)
             continue;
         }
 
-        req = QTAILQ_FIRST(&pool->request_list);
-        QTAILQ_REMOVE(&pool->request_list, req, reqs);
+        QTAILQ_REMOVE(&pool->request_list[req->cls], req, reqs);
         req->state = THREAD_ACTIVE;
+        pool->active_threads[req->cls]++;
+
+        /* Requests wait too long in the queue, add a thread */
+        if (now - req->submit_ns > THREAD_POOL_SPAWN_LATENCY_NS &&
+            thread_pool_has_requests(pool) &&
+            pool->idle_threads == 0 && pool->cur_threads < pool->max_threads) {
+            spawn_thread(pool);
+        }
         qemu_mutex_unlock(&pool->lock);
 
+        thread_pool_account(req->cls, now - req->submit_ns);
         ret = req->func(req->arg);
 
         req->ret = ret;
@@ -117,6 +198,7 @@ static void *worker_thread(void *opaque)
 
         qemu_bh_schedule(pool->completion_bh);
         qemu_mutex_lock(&pool->lock);
+        pool->active_threads[req->cls]--;
     }
 
     pool->cur_threads--;
@@ -224,7 +306,7 @@ static void thread_pool_cancel(BlockAIOCB *acb)
 
     QEMU_LOCK_GUARD(&pool->lock);
     if (elem->state == THREAD_QUEUED) {
-        QTAILQ_REMOVE(&pool->request_list, elem, reqs);
+        QTAILQ_REMOVE(&pool->request_list[elem->cls], elem, reqs);
         qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
@@ -238,8 +320,9 @@ static const AIOCBInfo thread_pool_aiocb_info = {
     .cancel_async       = thread_pool_cancel,
 };
 
-BlockAIOCB *thread_pool_submit_aio(ThreadPoolFunc *func, void *arg,
-                                   BlockCompletionFunc *cb, void *opaque)
+BlockAIOCB *thread_pool_submit_aio_class(ThreadPoolClass cls,
+                                         ThreadPoolFunc *func, void *arg,
+                                         BlockCompletionFunc *cb, void *opaque)
 {
     ThreadPoolElementAio *req;
     AioContext *ctx = qemu_get_current_aio_context();
@@ -251,6 +334,8 @@ BlockAIOCB *thread_pool_submit_aio(ThreadPoolFunc *func, void *arg,
     req = qemu_aio_get(&thread_pool_aiocb_info, NULL, cb, opaque);
     req->func = func;
     req->arg = arg;
+    req->cls = cls;
+    req->submit_ns = get_clock();
     req->state = THREAD_QUEUED;
     req->pool = pool;
 
@@ -262,12 +347,19 @@ BlockAIOCB *thread_pool_submit_aio(ThreadPoolFunc *func, void *arg,
     if (pool->idle_threads == 0 && pool->cur_threads < pool->max_threads) {
         spawn_thread(pool);
     }
-    QTAILQ_INSERT_TAIL(&pool->request_list, req, reqs);
+    QTAILQ_INSERT_TAIL(&pool->request_list[cls], req, reqs);
     qemu_mutex_unlock(&pool->lock);
     qemu_cond_signal(&pool->request_cond);
     return &req->common;
 }
 
+BlockAIOCB *thread_pool_submit_aio(ThreadPoolFunc *func, void *arg,
+                                   BlockCompletionFunc *cb, void *opaque)
+{
+    return thread_pool_submit_aio_class(THREAD_POOL_CLASS_DEFAULT, func, arg,
+                                        cb, opaque);
+}
+
 typedef struct ThreadPoolCo {
     Coroutine *co;
     int ret;
@@ -281,15 +373,32 @@ static void thread_pool_co_cb(void *opaque, int ret)
     aio_co_wake(co->co);
 }
 
-int coroutine_fn thread_pool_submit_co(ThreadPoolFunc *func, void *arg)
+int coroutine_fn thread_pool_submit_co_class(ThreadPoolClass cls,
+                                             ThreadPoolFunc *func, void *arg)
 {
     ThreadPoolCo tpc = { .co = qemu_coroutine_self(), .ret = -EINPROGRESS };
     assert(qemu_in_coroutine());
-    thread_pool_submit_aio(func, arg, thread_pool_co_cb, &tpc);
+    thread_pool_submit_aio_class(cls, func, arg, thread_pool_co_cb, &tpc);
     qemu_coroutine_yield();
     return tpc.ret;
 }
 
+int coroutine_fn thread_pool_submit_co(ThreadPoolFunc *func, void *arg)
+{
+    return thread_pool_submit_co_class(THREAD_POOL_CLASS_DEFAULT, func, arg);
+}
+
+void thread_pool_get_stats(ThreadPoolClass cls, ThreadPoolStats *stats)
+{
+    int i;
+
+    stats->requests = stat64_get(&thread_pool_stats[cls].requests);
+    for (i = 0; i < THREAD_POOL_LATENCY_BUCKETS; i++) {
+        stats->queue_latency[i] =
+            stat64_get(&thread_pool_stats[cls].latency[i]);
+    }
+}
+
 void thread_pool_update_params(ThreadPoolAio *pool, AioContext *ctx)
 {
     qemu_mutex_lock(&pool->lock);
@@ -332,7 +441,9 @@ static void thread_pool_init_one(ThreadPoolAio *pool, AioContext *ctx)
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
-    QTAILQ_INIT(&pool->request_list);
+    for (int i = 0; i < THREAD_POOL_CLASS__MAX; i++) {
+        QTAILQ_INIT(&pool->request_list[i]);
+    }
 
     thread_pool_update_params(pool, ctx);
 }
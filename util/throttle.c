@@ -87,6 +87,29 @@ static int64_t throttle_do_compute_wait(double limit, double extra)
     return wait;
 }
 
+/* Compute the sizes of the main and the burst bucket
+ *
+ * @bkt:               the leaky bucket we operate on
+ * @bucket_size:       I/O before throttling to bkt->avg
+ * @burst_bucket_size: I/O before throttling to bkt->max
+ */
+static void throttle_bucket_sizes(LeakyBucket *bkt, double *bucket_size,
+                                  double *burst_bucket_size)
+{
+    if (!bkt->max) {
+        /* If bkt->max is 0 we still want to allow short bursts of I/O
+         * from the guest, otherwise every other request will be throttled
+         * and performance will suffer considerably. */
+        *bucket_size = (double) bkt->avg / 10;
+        *burst_bucket_size = 0;
+    } else {
+        /* If we have a burst limit then we have to wait until all I/O
+         * at burst rate has finished before throttling to bkt->avg */
+        *bucket_size = bkt->max * bkt->burst_length;
+        *burst_bucket_size = (double) bkt->max / 10;
+    }
+}
+
 /* This function compute the wait time in ns that a leaky bucket should trigger
  *
  * @bkt: the leaky bucket we operate on
@@ -102,18 +125,7 @@ int64_t throttle_compute_wait(LeakyBucket *bkt)
         return 0;
     }
 
-    if (!bkt->max) {
-        /* If bkt->max is 0 we still want to allow short bursts of I/O
-         * from the guest, otherwise every other request will be throttled
-         * and performance will suffer considerably. */
-        bucket_size = (double) bkt->avg / 10;
-        burst_bucket_size = 0;
-    } else {
-        /* If we have a burst limit then we have to wait until all I/O
-         * at burst rate has finished before throttling to bkt->avg */
-        bucket_size = bkt->max * bkt->burst_length;
-        burst_bucket_size = (double) bkt->max / 10;
-    }
+    throttle_bucket_sizes(bkt, &bucket_size, &burst_bucket_size);
 
     /* If the main bucket is full then we have to wait */
     extra = bkt->level - bucket_size;
@@ -462,6 +474,41 @@ bool throttle_schedule_timer(ThrottleState *ts,
     return true;
 }
 
+static const BucketType throttle_bucket_types_size[THROTTLE_MAX][2] = {
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
+};
+static const BucketType throttle_bucket_types_units[THROTTLE_MAX][2] = {
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
+};
+
+/* Add @size and @units to the buckets for @direction. Negative values give
+ * back I/O that was accounted in advance but never performed.
+ */
+static void throttle_do_account(ThrottleState *ts, ThrottleDirection direction,
+                                double size, double units)
+{
+    unsigned i;
+
+    assert(direction < THROTTLE_MAX);
+    for (i = 0; i < ARRAY_SIZE(throttle_bucket_types_size[THROTTLE_READ]); i++) {
+        LeakyBucket *bkt;
+
+        bkt = &ts->cfg.buckets[throttle_bucket_types_size[direction][i]];
+        bkt->level = MAX(bkt->level + size, 0);
+        if (bkt->burst_length > 1) {
+            bkt->burst_level = MAX(bkt->burst_level + size, 0);
+        }
+
+        bkt = &ts->cfg.buckets[throttle_bucket_types_units[direction][i]];
+        bkt->level = MAX(bkt->level + units, 0);
+        if (bkt->burst_length > 1) {
+            bkt->burst_level = MAX(bkt->burst_level + units, 0);
+        }
+    }
+}
+
 /* do the accounting for this operation
  *
  * @direction: throttle direction
@@ -470,38 +517,89 @@ bool throttle_schedule_timer(ThrottleState *ts,
 void throttle_account(ThrottleState *ts, ThrottleDirection direction,
                       uint64_t size)
 {
-    static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
-    };
-    static const BucketType bucket_types_units[THROTTLE_MAX][2] = {
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
-    };
     double units = 1.0;
-    unsigned i;
 
-    assert(direction < THROTTLE_MAX);
     /* if cfg.op_size is defined and smaller than size we compute unit count */
     if (ts->cfg.op_size && size > ts->cfg.op_size) {
         units = (double) size / ts->cfg.op_size;
     }
 
-    for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
-        LeakyBucket *bkt;
+    throttle_do_account(ts, direction, size, units);
+}
 
-        bkt = &ts->cfg.buckets[bucket_types_size[direction][i]];
-        bkt->level += size;
-        if (bkt->burst_length > 1) {
-            bkt->burst_level += size;
-        }
+/* Shrink *@lease to what @bkt can hand out in advance */
+static void throttle_bucket_lease(LeakyBucket *bkt, uint64_t *lease)
+{
+    double bucket_size, burst_bucket_size, room;
 
-        bkt = &ts->cfg.buckets[bucket_types_units[direction][i]];
-        bkt->level += units;
-        if (bkt->burst_length > 1) {
-            bkt->burst_level += units;
-        }
+    if (!bkt->avg) {
+        return;
     }
+
+    throttle_bucket_sizes(bkt, &bucket_size, &burst_bucket_size);
+    room = bucket_size - bkt->level;
+    if (bkt->burst_length > 1) {
+        room = MIN(room, burst_bucket_size - bkt->burst_level);
+    }
+    room = MIN(room / THROTTLE_LEASE_SHARE,
+               (double) bkt->avg * THROTTLE_LEASE_NS / NANOSECONDS_PER_SECOND);
+
+    *lease = room > 0 ? MIN(*lease, (uint64_t) room) : 0;
+}
+
+/* Compute the budget that can be handed out in advance to a single user of
+ * @ts for @direction: a fraction of the room left in the buckets, and never
+ * more than THROTTLE_LEASE_NS worth of the average rate, so that the users
+ * that do not hold a lease are not starved.
+ *
+ * Buckets without a limit do not restrict the lease; if no bucket for bytes
+ * (or operations) has a limit, *@bytes (or *@units) is left unchanged, so
+ * the caller should initialize them to its upper bound.
+ *
+ * The levels are used as of the last leak, so this is meant to be called
+ * right after throttle_schedule_timer().
+ *
+ * @direction: throttle direction
+ * @bytes:     the number of bytes in the lease
+ * @units:     the number of operations in the lease
+ */
+void throttle_compute_lease(ThrottleState *ts, ThrottleDirection direction,
+                            uint64_t *bytes, uint64_t *units)
+{
+    unsigned i;
+
+    assert(direction < THROTTLE_MAX);
+    for (i = 0; i < ARRAY_SIZE(throttle_bucket_types_size[THROTTLE_READ]); i++) {
+        throttle_bucket_lease(
+            &ts->cfg.buckets[throttle_bucket_types_size[direction][i]], bytes);
+        throttle_bucket_lease(
+            &ts->cfg.buckets[throttle_bucket_types_units[direction][i]], units);
+    }
+}
+
+/* Account a lease computed by throttle_compute_lease()
+ *
+ * @direction: throttle direction
+ * @bytes:     the number of bytes in the lease
+ * @units:     the number of operations in the lease
+ */
+void throttle_account_lease(ThrottleState *ts, ThrottleDirection direction,
+                            uint64_t bytes, uint64_t units)
+{
+    throttle_do_account(ts, direction, bytes, units);
+}
+
+/* Give back the unused part of a lease, as if that I/O had never been
+ * accounted.
+ *
+ * @direction: throttle direction
+ * @bytes:     the number of unused bytes
+ * @units:     the number of unused operations
+ */
+void throttle_return_lease(ThrottleState *ts, ThrottleDirection direction,
+                           uint64_t bytes, uint64_t units)
+{
+    throttle_do_account(ts, direction, -(double) bytes, -(double) units);
 }
 
 /* return a ThrottleConfig based on the options in a ThrottleLimits